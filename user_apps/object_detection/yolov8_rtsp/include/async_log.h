@@ -0,0 +1,191 @@
+#ifndef _RKNN_DEMO_ASYNC_LOG_H_
+#define _RKNN_DEMO_ASYNC_LOG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <type_traits>
+
+// Logging for the frame loop. A call copies its arguments into a fixed size
+// record of a lock-free ring and returns; a background thread does the
+// formatting and the (possibly slow) console write. When the ring is full
+// records are dropped and counted instead of blocking the caller.
+
+typedef enum {
+  ALOG_LEVEL_ERROR = 0,
+  ALOG_LEVEL_WARN,
+  ALOG_LEVEL_INFO,
+  ALOG_LEVEL_DEBUG,
+} alog_level;
+
+#define ALOG_MAX_ARGS 6
+#define ALOG_STR_BYTES 32 // room for string arguments, copied and truncated
+#define ALOG_RING_SIZE 1024
+#define ALOG_DEFAULT_RATE 10 // records per second a call site may emit
+
+// One per call site, created by the ALOG macros
+typedef struct {
+  const char *fmt;
+  const char *file;
+  int line;
+  alog_level level;
+  uint32_t max_per_sec; // 0 disables the rate limit
+  std::atomic<uint32_t> window_sec;
+  std::atomic<uint32_t> window_count;
+  std::atomic<uint32_t> suppressed;
+} alog_site_t;
+
+typedef enum {
+  ALOG_ARG_INT = 0,
+  ALOG_ARG_UINT,
+  ALOG_ARG_DOUBLE,
+  ALOG_ARG_STR, // value is an offset into alog_record_t.str
+  ALOG_ARG_PTR,
+} alog_arg_type;
+
+typedef union {
+  int64_t i;
+  uint64_t u;
+  double d;
+  const void *p;
+} alog_arg_t;
+
+typedef struct {
+  alog_site_t *site;
+  uint32_t suppressed; // records of this site dropped by the rate limit
+  uint8_t n_args;
+  uint8_t types[ALOG_MAX_ARGS];
+  uint8_t str_len;
+  alog_arg_t args[ALOG_MAX_ARGS];
+  char str[ALOG_STR_BYTES];
+} alog_record_t;
+
+// Start the writer thread. Before this, and after deinit, records are
+// formatted synchronously.
+int async_log_init(alog_level level);
+
+// Drain what is queued and stop the writer thread
+void async_log_deinit();
+
+void async_log_set_level(alog_level level);
+
+// Records waiting for the writer thread
+uint32_t async_log_queue_depth();
+
+// Parse "error", "warn", "info" or "debug", -1 if unknown
+int async_log_parse_level(const char *name);
+
+extern std::atomic<int> async_log_level;
+
+static inline bool async_log_enabled(alog_level level) {
+  return (int)level <= async_log_level.load(std::memory_order_relaxed);
+}
+
+// Check the per-site budget, true when the record may be emitted
+bool async_log_admit(alog_site_t *site);
+
+// Queue a filled record
+void async_log_submit(alog_record_t *record);
+
+// Argument packing, picked by type at compile time
+template <typename T>
+static inline typename std::enable_if<std::is_integral<T>::value &&
+                                      std::is_signed<T>::value>::type
+alog_pack(alog_record_t *rec, T value) {
+  rec->types[rec->n_args] = ALOG_ARG_INT;
+  rec->args[rec->n_args++].i = value;
+}
+
+template <typename T>
+static inline typename std::enable_if<std::is_integral<T>::value &&
+                                      !std::is_signed<T>::value>::type
+alog_pack(alog_record_t *rec, T value) {
+  rec->types[rec->n_args] = ALOG_ARG_UINT;
+  rec->args[rec->n_args++].u = value;
+}
+
+template <typename T>
+static inline typename std::enable_if<std::is_floating_point<T>::value>::type
+alog_pack(alog_record_t *rec, T value) {
+  rec->types[rec->n_args] = ALOG_ARG_DOUBLE;
+  rec->args[rec->n_args++].d = value;
+}
+
+template <typename T>
+static inline typename std::enable_if<std::is_enum<T>::value>::type
+alog_pack(alog_record_t *rec, T value) {
+  rec->types[rec->n_args] = ALOG_ARG_INT;
+  rec->args[rec->n_args++].i = (int64_t)value;
+}
+
+static inline void alog_pack(alog_record_t *rec, const char *value) {
+  uint8_t off = rec->str_len;
+  uint8_t len = 0;
+  if (value == NULL) {
+    value = "(null)";
+  }
+  // strings share the buffer, later ones are cut short once it is full
+  while (value[len] != '\0' && off + len < ALOG_STR_BYTES - 1) {
+    rec->str[off + len] = value[len];
+    len++;
+  }
+  rec->str[off + len] = '\0';
+  rec->str_len = off + len < ALOG_STR_BYTES - 1 ? off + len + 1 : off + len;
+  rec->types[rec->n_args] = ALOG_ARG_STR;
+  rec->args[rec->n_args++].u = off;
+}
+
+static inline void alog_pack(alog_record_t *rec, char *value) {
+  alog_pack(rec, (const char *)value);
+}
+
+static inline void alog_pack(alog_record_t *rec, const void *value) {
+  rec->types[rec->n_args] = ALOG_ARG_PTR;
+  rec->args[rec->n_args++].p = value;
+}
+
+static inline void alog_pack_all(alog_record_t *rec) {}
+
+template <typename T, typename... Rest>
+static inline void alog_pack_all(alog_record_t *rec, T value, Rest... rest) {
+  alog_pack(rec, value);
+  alog_pack_all(rec, rest...);
+}
+
+template <typename... Args>
+static inline void async_log_write(alog_site_t *site, Args... args) {
+  static_assert(sizeof...(Args) <= ALOG_MAX_ARGS, "too many log arguments");
+  if (!async_log_admit(site)) {
+    return;
+  }
+  alog_record_t rec;
+  rec.site = site;
+  rec.n_args = 0;
+  rec.str_len = 0;
+  alog_pack_all(&rec, args...);
+  async_log_submit(&rec);
+}
+
+// printf-style; the dead printf keeps the compiler's format checks
+#define ALOG_RATE(level, max_per_sec, fmt, ...)                              \
+  do {                                                                       \
+    static alog_site_t _alog_site = {fmt,  __FILE__, __LINE__, level,        \
+                                     max_per_sec, {0}, {0}, {0}};            \
+    if (async_log_enabled(level)) {                                          \
+      if (0)                                                                 \
+        printf(fmt, ##__VA_ARGS__);                                          \
+      async_log_write(&_alog_site, ##__VA_ARGS__);                           \
+    }                                                                        \
+  } while (0)
+
+#define ALOGE(fmt, ...) \
+  ALOG_RATE(ALOG_LEVEL_ERROR, ALOG_DEFAULT_RATE, fmt, ##__VA_ARGS__)
+#define ALOGW(fmt, ...) \
+  ALOG_RATE(ALOG_LEVEL_WARN, ALOG_DEFAULT_RATE, fmt, ##__VA_ARGS__)
+#define ALOGI(fmt, ...) \
+  ALOG_RATE(ALOG_LEVEL_INFO, ALOG_DEFAULT_RATE, fmt, ##__VA_ARGS__)
+#define ALOGD(fmt, ...) \
+  ALOG_RATE(ALOG_LEVEL_DEBUG, ALOG_DEFAULT_RATE, fmt, ##__VA_ARGS__)
+
+#endif //_RKNN_DEMO_ASYNC_LOG_H_
@@ -0,0 +1,51 @@
+#ifndef _RKNN_DEMO_BITRATE_CTRL_H_
+#define _RKNN_DEMO_BITRATE_CTRL_H_
+
+#include <stdint.h>
+
+// Encoder bitrate steered by what the viewers can take and by what the scene
+// needs. Once per interval:
+//  - a deep RTSP client queue means the link is saturated, the bitrate is
+//    cut multiplicatively;
+//  - after a few calm intervals it climbs back additively, up to a ceiling;
+//  - the ceiling follows scene activity, a scene without objects is held at
+//    the lower part of the range.
+// The controller only does arithmetic, the caller applies the result.
+
+#define BITRATE_CTRL_INTERVAL_US 1000000
+#define BITRATE_CTRL_HIGH_PRESSURE 0.25f // queue fill that cuts the bitrate
+#define BITRATE_CTRL_LOW_PRESSURE 0.10f  // below this an interval is calm
+#define BITRATE_CTRL_DECREASE 0.7f
+#define BITRATE_CTRL_INCREASE 0.1f // of the range, per step
+#define BITRATE_CTRL_CALM_INTERVALS 3
+#define BITRATE_CTRL_IDLE_SHARE 0.5f // of the range usable by an idle scene
+#define BITRATE_CTRL_MIN_CHANGE 0.05f // smaller changes are not applied
+
+typedef struct {
+  int min_kbps;
+  int max_kbps;
+  int kbps;         // what the encoder runs at
+  float target;     // where the controller is heading
+  float activity;   // 0 idle .. 1 objects in every frame, smoothed
+  int calm;         // consecutive intervals without queue pressure
+  uint64_t interval_start_us;
+
+  // gathered over the current interval
+  int queue_peak;
+  int frames;
+  int active_frames;
+} bitrate_ctrl_t;
+
+void bitrate_ctrl_init(bitrate_ctrl_t *ctrl, int min_kbps, int max_kbps,
+                       int start_kbps);
+
+// Per encoded frame, with the number of objects detected in it
+void bitrate_ctrl_frame(bitrate_ctrl_t *ctrl, int n_objects);
+
+// Per frame, with the deepest client queue seen since the last call and the
+// queue capacity. Returns the bitrate to switch the encoder to once an
+// interval has passed and the change is worth a reconfiguration, else 0.
+int bitrate_ctrl_update(bitrate_ctrl_t *ctrl, uint64_t now_us, int queue_peak,
+                        int queue_capacity);
+
+#endif //_RKNN_DEMO_BITRATE_CTRL_H_
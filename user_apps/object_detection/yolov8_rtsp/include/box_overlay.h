@@ -0,0 +1,48 @@
+#ifndef _RKNN_DEMO_BOX_OVERLAY_H_
+#define _RKNN_DEMO_BOX_OVERLAY_H_
+
+#include <stdint.h>
+
+#include "yolov8.h"
+
+// Box outlines of a frame, collected to be drawn by RGA in one call. RGA
+// draws the lines inside the rectangle, so boxes are widened by half the
+// line thickness to look like cv::rectangle, which centers them on the box
+// edge. Rectangles are clipped to the frame and, for YUV 4:2:0 buffers,
+// aligned outwards to even pixels. The RGA call is left to the caller.
+
+#define BOX_OVERLAY_MAX OBJ_NUMB_MAX_SIZE
+#define BOX_OVERLAY_TOO_SMALL -2
+
+// Model input to frame coordinates: undo the letterbox padding and scale
+typedef struct {
+  float scale_x;
+  float scale_y;
+  int pad_x;
+  int pad_y;
+} box_overlay_map_t;
+
+typedef struct {
+  int width;
+  int height;
+  int thickness;
+  int align; // 2 on YUV 4:2:0 buffers, 1 on RGB
+  image_rect_t rects[BOX_OVERLAY_MAX]; // right and bottom exclusive
+  int n_rects;
+} box_overlay_t;
+
+void box_overlay_map_box(const box_overlay_map_t *map, image_rect_t *box);
+
+void box_overlay_init(box_overlay_t *overlay, int width, int height,
+                      int thickness, int align);
+
+void box_overlay_reset(box_overlay_t *overlay);
+
+// Add the outline of a box in frame coordinates, edges inclusive as drawn
+// by cv::rectangle. Returns its index, -1 when nothing of it is left inside
+// the frame or the overlay is full, or BOX_OVERLAY_TOO_SMALL when what is
+// left is no wider or taller than two lines; the caller draws that one
+// itself.
+int box_overlay_add(box_overlay_t *overlay, const image_rect_t *box);
+
+#endif //_RKNN_DEMO_BOX_OVERLAY_H_
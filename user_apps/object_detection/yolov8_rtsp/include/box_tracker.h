@@ -0,0 +1,39 @@
+#ifndef _RKNN_DEMO_BOX_TRACKER_H_
+#define _RKNN_DEMO_BOX_TRACKER_H_
+
+#include <stdint.h>
+
+#include "yolov8.h"
+
+#define BOX_TRACK_MAX_NUM OBJ_NUMB_MAX_SIZE
+
+// A box followed across frames. Slots are reused, so per-object state kept
+// by a consumer must be keyed by id, not only by slot index.
+typedef struct {
+  uint32_t id; // 0 marks a free slot
+  image_rect_t box;
+  int cls_id;
+  int hits;   // frames the object was matched in
+  int missed; // consecutive frames without a match
+} box_track_t;
+
+typedef struct {
+  box_track_t tracks[BOX_TRACK_MAX_NUM];
+  uint32_t next_id;
+  float iou_threshold;
+  int max_missed;
+} box_tracker_t;
+
+float box_iou(const image_rect_t *a, const image_rect_t *b);
+
+void box_tracker_init(box_tracker_t *tracker, float iou_threshold,
+                      int max_missed);
+
+// Greedily match detections to tracks of the same class by IoU. On return
+// track_slots[i] holds the track slot of od_results->results[i], or -1 if no
+// slot was free. Unmatched tracks age and are dropped after max_missed.
+int box_tracker_update(box_tracker_t *tracker,
+                       const object_detect_result_list *od_results,
+                       int *track_slots);
+
+#endif //_RKNN_DEMO_BOX_TRACKER_H_
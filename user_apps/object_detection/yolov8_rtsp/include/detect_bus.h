@@ -0,0 +1,95 @@
+#ifndef _RKNN_DEMO_DETECT_BUS_H_
+#define _RKNN_DEMO_DETECT_BUS_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "yolov8.h"
+
+// Detections of every frame published to other local processes. The results
+// live in a sealed memfd holding a small ring of records; a reader gets the
+// fd once over an abstract Unix socket, maps it read-only and from then on
+// polls the ring from its own address space, without syscalls or messages.
+//
+// Each slot is a seqlock: the publisher makes the sequence odd, writes the
+// record and makes it even again. A reader copies the record out and keeps
+// it only if the sequence was even and unchanged around the copy.
+
+#define DETECT_BUS_MAGIC 0x42544544 // "DETB"
+#define DETECT_BUS_VERSION 1        // bump on any layout change below
+#define DETECT_BUS_SLOTS 8          // power of two
+#define DETECT_BUS_NAME "yolov8_rtsp.detections"
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2,
+              "the bus needs lock-free atomics shared between processes");
+static_assert(sizeof(object_detect_result) == 24,
+              "object_detect_result changed, bump DETECT_BUS_VERSION");
+
+typedef struct {
+  uint64_t frame_id;     // counts published frames from 0
+  uint64_t timestamp_us; // CLOCK_MONOTONIC at capture
+  uint32_t width;        // frame size the boxes refer to
+  uint32_t height;
+  int32_t count;
+  uint32_t reserved;
+  object_detect_result results[OBJ_NUMB_MAX_SIZE];
+} detect_bus_record_t;
+
+typedef struct {
+  std::atomic<uint32_t> seq; // odd while the publisher writes
+  uint32_t reserved;
+  detect_bus_record_t rec;
+} detect_bus_slot_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t n_slots;
+  std::atomic<uint32_t> published; // records written so far
+  uint32_t reserved;
+  detect_bus_slot_t slots[DETECT_BUS_SLOTS];
+} detect_bus_shm_t;
+
+// Publisher side, owned by the detection loop
+typedef struct {
+  int shm_fd;
+  int listen_fd;
+  detect_bus_shm_t *shm;
+  pthread_t thread;
+  std::atomic<bool> running;
+} detect_bus_t;
+
+// Create the ring and serve its fd on the abstract socket @name
+int detect_bus_open(detect_bus_t *bus, const char *name);
+
+void detect_bus_close(detect_bus_t *bus);
+
+void detect_bus_publish(detect_bus_t *bus, uint64_t timestamp_us, int width,
+                        int height, const object_detect_result_list *results);
+
+// Reader side, for consumers in other processes
+typedef struct {
+  int shm_fd;
+  const detect_bus_shm_t *shm;
+  uint32_t next; // sequence of the next record read_next returns
+} detect_bus_reader_t;
+
+// Fetch the ring from the publisher at @name and check its layout version
+int detect_bus_reader_open(detect_bus_reader_t *reader, const char *name);
+
+void detect_bus_reader_close(detect_bus_reader_t *reader);
+
+// Copy out the newest record. Returns 0, or -1 when nothing is published yet.
+int detect_bus_read_latest(detect_bus_reader_t *reader,
+                           detect_bus_record_t *rec);
+
+// Copy out the record after the last one read. Returns 1 when a record was
+// read, 0 when the reader is caught up. Records overwritten before they were
+// read are skipped and added to *missed.
+int detect_bus_read_next(detect_bus_reader_t *reader, detect_bus_record_t *rec,
+                         uint32_t *missed);
+
+#endif //_RKNN_DEMO_DETECT_BUS_H_
@@ -0,0 +1,82 @@
+#ifndef _RKNN_DEMO_DETECT_STREAM_H_
+#define _RKNN_DEMO_DETECT_STREAM_H_
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "yolov8.h"
+
+// Detections sent to a recorder as UDP datagrams, unicast or multicast. Every
+// packet decodes on its own, so a lost datagram only loses its frames.
+//
+// Packet: 'D' 'S' version n_frames, then varints packet_seq, width, height
+// Frame:  frame_id, pts_us (absolute in the first frame of the packet, delta
+//         to the previous frame after), flags byte, object count
+// Object: zigzag(left - previous left), zigzag(top - previous top), width,
+//         height, class id, score byte (prop * 255), and with
+//         DETECT_STREAM_FLAG_IDS zigzag(object id - previous object id)
+//
+// Integers are LEB128 varints. pts_us is the PTS handed to the encoder for
+// the same frame, so detections line up with the RTSP stream.
+
+#define DETECT_STREAM_VERSION 1
+#define DETECT_STREAM_MTU 1400        // payload bytes of one datagram
+#define DETECT_STREAM_MAX_BATCH 8     // frames per packet at most
+#define DETECT_STREAM_BATCH_US 100000 // longest a frame waits for company
+
+#define DETECT_STREAM_FLAG_IDS 0x01
+#define DETECT_STREAM_FLAG_TRUNCATED 0x02 // objects did not fit a datagram
+
+typedef struct {
+  int fd;
+  struct sockaddr_in dest;
+  uint32_t packet_seq;
+
+  // packet being batched
+  uint8_t packet[DETECT_STREAM_MTU];
+  size_t len;
+  int n_frames;
+  int width;
+  int height;
+  uint32_t last_frame_id;
+  uint64_t first_pts_us;
+  uint64_t last_pts_us;
+} detect_stream_t;
+
+// dest is "ip:port", a multicast group or a unicast address
+int detect_stream_open(detect_stream_t *stream, const char *dest);
+
+// Sends what is still batched
+void detect_stream_close(detect_stream_t *stream);
+
+// Queue the detections of one frame. object_ids may be NULL. The packet goes
+// out when it is full, holds DETECT_STREAM_MAX_BATCH frames or spans
+// DETECT_STREAM_BATCH_US; at low frame rates every frame is sent right away.
+int detect_stream_send(detect_stream_t *stream, uint32_t frame_id,
+                       uint64_t pts_us, int width, int height,
+                       const object_detect_result_list *results,
+                       const uint32_t *object_ids);
+
+int detect_stream_flush(detect_stream_t *stream);
+
+// One frame as decoded by the receiver. Scores come back quantized to 1/255.
+typedef struct {
+  uint32_t frame_id;
+  uint64_t pts_us;
+  int width;
+  int height;
+  uint8_t flags;
+  int count;
+  object_detect_result results[OBJ_NUMB_MAX_SIZE];
+  uint32_t object_ids[OBJ_NUMB_MAX_SIZE]; // 0 without DETECT_STREAM_FLAG_IDS
+} detect_stream_frame_t;
+
+// Decode one datagram, appending its frames. Returns the number of frames,
+// or -1 for a malformed or foreign packet (frames is then left unchanged).
+int detect_stream_decode(const uint8_t *data, size_t len, uint32_t *packet_seq,
+                         std::vector<detect_stream_frame_t> &frames);
+
+#endif //_RKNN_DEMO_DETECT_STREAM_H_
@@ -0,0 +1,42 @@
+#ifndef _RKNN_DEMO_DETECTOR_H_
+#define _RKNN_DEMO_DETECTOR_H_
+
+#include "frame_buffer.h"
+#include "yolov8.h"
+
+// How the camera frame has to be prepared for the model input tensor
+typedef struct {
+  int width;
+  int height;
+  int channel;
+  bool letterbox; // keep aspect ratio and pad, otherwise stretch
+  unsigned char pad_value;
+} detector_preprocess_spec;
+
+// A detector backend wraps model loading and output decoding of one model
+// family, so main only deals with the common rknn_app_context_t and
+// object_detect_result_list.
+typedef struct {
+  const char *name;
+  int (*init)(const char *model_path, rknn_app_context_t *app_ctx);
+  int (*release)(rknn_app_context_t *app_ctx);
+  void (*get_preprocess_spec)(rknn_app_context_t *app_ctx,
+                              detector_preprocess_spec *spec);
+  int (*decode)(rknn_app_context_t *app_ctx, float conf_threshold,
+                float nms_threshold, object_detect_result_list *od_results);
+} detector_backend_t;
+
+// Look up a backend by name ("yolov8", "ssd"), NULL if unknown
+const detector_backend_t *get_detector_backend(const char *name);
+
+// Run the NPU on the already filled input tensor and decode the outputs
+int detector_inference(const detector_backend_t *backend,
+                       rknn_app_context_t *app_ctx,
+                       object_detect_result_list *od_results);
+
+// Run once on a zeroed input so the first camera frame does not pay for the
+// lazy initialization of the runtime. input wraps the model input tensor;
+// internal memory must be set already.
+int detector_warmup(rknn_app_context_t *app_ctx, frame_buffer_t *input);
+
+#endif //_RKNN_DEMO_DETECTOR_H_
@@ -0,0 +1,44 @@
+#ifndef _RKNN_DEMO_EVENT_RECORDER_H_
+#define _RKNN_DEMO_EVENT_RECORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nal_parser.h"
+
+// Event clips with pre-roll. Every encoded access unit is copied into an
+// in-memory frame ring holding the last few seconds; a trigger makes a
+// writer thread mux the ring from its oldest key frame on, and every frame
+// until the post-roll has passed, into an MPEG-TS file.
+//
+// The capture loop only copies into the ring under a short lock. The writer
+// muxes into a staging buffer and writes it out in large sequential chunks
+// without holding the lock, so a slow flash never stalls capture: when the
+// writer falls behind far enough for the ring to overwrite its position it
+// skips ahead to the oldest GOP still held and counts the gap. All buffers
+// are allocated at create.
+
+#define EVENT_PREROLL_US (5 * 1000000ULL)
+#define EVENT_POSTROLL_US (10 * 1000000ULL) // after the last trigger
+#define EVENT_MAX_CLIP_US (120 * 1000000ULL) // split at the next key frame
+#define EVENT_RING_BYTES (4 * 1024 * 1024)
+#define EVENT_RING_FRAMES 1024
+#define EVENT_WRITE_BYTES (512 * 1024)
+
+typedef struct _event_recorder event_recorder_t;
+
+// Clips go to dir/event_YYYYmmdd_HHMMSS.ts. NULL when the directory is not
+// writable or the buffers cannot be allocated.
+event_recorder_t *event_recorder_create(const char *dir, nal_codec codec);
+
+// Copy one Annex-B access unit into the ring
+int event_recorder_push(event_recorder_t *rec, const uint8_t *data,
+                        size_t len, uint64_t pts_us);
+
+// Start a clip, or extend the running one, for an event at pts_us
+void event_recorder_trigger(event_recorder_t *rec, uint64_t pts_us);
+
+// Finish the clip being written and stop the writer thread
+void event_recorder_destroy(event_recorder_t *rec);
+
+#endif //_RKNN_DEMO_EVENT_RECORDER_H_
@@ -0,0 +1,109 @@
+#ifndef _RKNN_DEMO_FRAME_BUFFER_H_
+#define _RKNN_DEMO_FRAME_BUFFER_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "im2d.hpp"
+#include "luckfox_mpi.h"
+#include "rknn_api.h"
+
+// An image in dma-buf memory as the CPU, RGA, the NPU and the MPI all see
+// it: fd, mapping, geometry, RGA format and the state of the CPU cache.
+// Stages hand the buffer on instead of fds and addresses. The RGA handle
+// and the RKNN tensor mem of the fd are made on first use and shared by
+// everyone holding the buffer, and a stage only flushes or invalidates the
+// cache when the last writer was on the other side of it.
+//
+// Buffers are reference counted. The last unref releases the handles and
+// gives the memory back to where it came from (an MB pool, a dma heap)
+// through the ops of its allocator.
+
+typedef struct _frame_buffer frame_buffer_t;
+
+typedef enum {
+  FRAME_BUFFER_CLEAN,
+  FRAME_BUFFER_CPU_DIRTY,    // CPU wrote, flush before a device reads
+  FRAME_BUFFER_DEVICE_DIRTY, // a device wrote, invalidate before the CPU reads
+} frame_buffer_cache_t;
+
+// What the allocator does for a buffer; any of them may be NULL
+typedef struct {
+  int (*flush)(frame_buffer_t *buf);      // write dirty CPU lines back
+  int (*invalidate)(frame_buffer_t *buf); // drop stale CPU lines
+  void (*release)(frame_buffer_t *buf);   // give the memory back
+} frame_buffer_ops_t;
+
+struct _frame_buffer {
+  int fd;
+  void *vaddr;
+  size_t size;
+  int width;
+  int height;
+  int stride; // bytes per row of the first plane
+  int format; // RGA format
+  frame_buffer_cache_t cache;
+
+  const frame_buffer_ops_t *ops;
+  void *origin; // allocator data, e.g. the MB block
+
+  int refs;
+  pthread_mutex_t lock; // guards the handles below
+  rga_buffer_handle_t rga_handle;
+  rknn_context rknn_ctx;
+  rknn_tensor_mem *rknn_mem;
+  bool owns_rknn_mem;
+};
+
+// A buffer over memory some allocator handed out, one reference held. NULL
+// when out of memory; ops->release is not called then.
+frame_buffer_t *frame_buffer_wrap(int fd, void *vaddr, size_t size, int width,
+                                  int height, int stride, int format,
+                                  const frame_buffer_ops_t *ops, void *origin);
+
+frame_buffer_t *frame_buffer_ref(frame_buffer_t *buf);
+
+// NULL is ignored
+void frame_buffer_unref(frame_buffer_t *buf);
+
+// Before a device (RGA, NPU, VENC) reads or writes the buffer
+int frame_buffer_sync_for_device(frame_buffer_t *buf);
+// Before the CPU reads or writes it
+int frame_buffer_sync_for_cpu(frame_buffer_t *buf);
+// After the write, so the next sync knows what to do
+void frame_buffer_cpu_wrote(frame_buffer_t *buf);
+void frame_buffer_device_wrote(frame_buffer_t *buf);
+
+// RGA handle of the fd, imported on first use. 0 on failure.
+rga_buffer_handle_t frame_buffer_rga_handle(frame_buffer_t *buf);
+
+// The whole image for RGA calls; the handle is 0 when the import failed
+rga_buffer_t frame_buffer_rga(frame_buffer_t *buf);
+
+// RKNN tensor mem over the fd for ctx, made on first use. A buffer is bound
+// to the first context that asks; NULL for any other one, or on failure.
+rknn_tensor_mem *frame_buffer_rknn_mem(frame_buffer_t *buf, rknn_context ctx);
+
+// Allocators, in frame_buffer_alloc.cc
+
+// Takes over the reference on blk; the last unref releases it to its pool
+frame_buffer_t *frame_buffer_from_mb(MB_BLK blk, int width, int height,
+                                     int stride, int format);
+
+// MB block of a buffer from frame_buffer_from_mb, MB_INVALID_HANDLE for any
+// other buffer
+MB_BLK frame_buffer_mb(const frame_buffer_t *buf);
+
+// New memory from a dma heap (e.g. DMA_HEAP_PATH), freed by the last unref
+frame_buffer_t *frame_buffer_alloc_dma(const char *heap, int width,
+                                       int height, int stride, int format);
+
+// A tensor mem of ctx, such as a model input. The context keeps owning the
+// memory; the buffer must be unreffed before the context is released.
+frame_buffer_t *frame_buffer_from_rknn_mem(rknn_context ctx,
+                                           rknn_tensor_mem *mem, int width,
+                                           int height, int stride,
+                                           int format);
+
+#endif //_RKNN_DEMO_FRAME_BUFFER_H_
@@ -0,0 +1,21 @@
+#ifndef _RKNN_DEMO_FRAME_CONVERT_H_
+#define _RKNN_DEMO_FRAME_CONVERT_H_
+
+#include <stdint.h>
+
+// CPU preprocessing for when RGA cannot do it, without OpenCV. Both give
+// the same result as the OpenCV calls they replace, up to rounding.
+
+// YUV 4:2:0 semi-planar with V first (NV21) to packed BGR, BT.601 limited
+// range with the fixed-point coefficients of COLOR_YUV420sp2BGR. The VU
+// plane follows height rows of Y.
+void yuv420sp_to_bgr(const uint8_t *yuv, int width, int height, int stride,
+                     uint8_t *bgr);
+
+// Bilinear scale of a packed BGR image into the rect (x, y, w, h) of dst,
+// the rest of dst filled with pad, like cv::resize with INTER_LINEAR
+void bgr_letterbox(const uint8_t *src, int src_width, int src_height,
+                   uint8_t *dst, int dst_width, int dst_height, int x, int y,
+                   int w, int h, uint8_t pad);
+
+#endif //_RKNN_DEMO_FRAME_CONVERT_H_
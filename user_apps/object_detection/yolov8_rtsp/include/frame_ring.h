@@ -0,0 +1,57 @@
+#ifndef _RKNN_DEMO_FRAME_RING_H_
+#define _RKNN_DEMO_FRAME_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Encoded frames of the last few seconds, in one buffer allocated at init.
+// Frames are stored contiguously (a frame that does not fit before the end
+// of the buffer starts over at 0) and are evicted a whole GOP at a time, so
+// the oldest frame is always a key frame and a clip cut from the ring
+// decodes from its first frame.
+//
+// Not thread safe, the recorder serializes access.
+
+typedef struct {
+  uint32_t offset;
+  uint32_t len;
+  uint64_t pts_us;
+  bool keyframe;
+} frame_ring_entry_t;
+
+typedef struct {
+  uint8_t *data;
+  uint32_t size;
+  frame_ring_entry_t *entries;
+  uint32_t max_entries;
+
+  // live frames are seq head..tail-1, entry seq % max_entries
+  uint64_t head;
+  uint64_t tail;
+  uint32_t write_offset;
+
+  uint64_t keep_us; // GOPs older than this are dropped even with room left
+  uint64_t pin;     // frames from here on are kept while there is room
+} frame_ring_t;
+
+#define FRAME_RING_NO_PIN UINT64_MAX
+
+int frame_ring_init(frame_ring_t *ring, uint32_t size, uint32_t max_entries,
+                    uint64_t keep_us);
+void frame_ring_deinit(frame_ring_t *ring);
+
+// Copy a frame in, dropping the oldest GOPs as needed. Frames before the
+// first key frame, and frames larger than the ring, are refused with -1.
+int frame_ring_push(frame_ring_t *ring, const uint8_t *data, uint32_t len,
+                    uint64_t pts_us, bool keyframe);
+
+// Entry of seq, NULL when it is not in the ring (any more, or yet)
+const frame_ring_entry_t *frame_ring_get(const frame_ring_t *ring,
+                                         uint64_t seq);
+
+static inline const uint8_t *frame_ring_data(const frame_ring_t *ring,
+                                             const frame_ring_entry_t *e) {
+  return ring->data + e->offset;
+}
+
+#endif //_RKNN_DEMO_FRAME_RING_H_
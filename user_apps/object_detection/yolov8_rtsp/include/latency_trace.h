@@ -0,0 +1,70 @@
+#ifndef _RKNN_DEMO_LATENCY_TRACE_H_
+#define _RKNN_DEMO_LATENCY_TRACE_H_
+
+#include <stdint.h>
+
+// Points a frame passes through, in pipeline order
+typedef enum {
+  TRACE_CAPTURE = 0,
+  TRACE_PREPROCESS,
+  TRACE_NPU_SUBMIT,
+  TRACE_NPU_DONE,
+  TRACE_POSTPROCESS,
+  TRACE_OVERLAY,
+  TRACE_ENCODE,
+  TRACE_RTSP_TX,
+  TRACE_POINT_NUM,
+} trace_point;
+
+// Log-linear buckets: exact below 16 us, then 16 buckets per power of two,
+// which keeps every recorded value within 1/16 of the truth up to 2^32 us.
+#define TRACE_HIST_SUB_BITS 4
+#define TRACE_HIST_SUB_COUNT (1 << TRACE_HIST_SUB_BITS)
+#define TRACE_HIST_BUCKETS ((32 - TRACE_HIST_SUB_BITS + 1) * TRACE_HIST_SUB_COUNT)
+
+#ifdef ENABLE_LATENCY_TRACE
+
+// Install the SIGUSR1 dump trigger, and dump every interval_s seconds when
+// interval_s > 0
+void latency_trace_init(int interval_s);
+
+// Stamp the current frame. A frame starts at TRACE_CAPTURE, every later
+// point records the time since the previous point it passed, and
+// TRACE_RTSP_TX also records the capture to transmit total.
+void latency_trace_mark(trace_point point);
+
+// Print and reset the histograms when a dump is due. Call from the frame loop.
+void latency_trace_poll();
+
+void latency_trace_dump();
+
+// Histogram maths, exposed for the tests. A value goes to
+// latency_hist_bucket(value); latency_hist_bucket_value() is the highest
+// value a bucket holds.
+int latency_hist_bucket(uint32_t value);
+uint32_t latency_hist_bucket_value(int bucket);
+
+// The pct-th percentile of count recorded values, as the upper bound of its
+// bucket but never above the exact max
+uint32_t latency_hist_percentile(const uint32_t *counts, uint64_t count,
+                                 int pct, uint32_t max);
+
+#define LATENCY_TRACE_INIT(interval_s) latency_trace_init(interval_s)
+#define LATENCY_TRACE_MARK(point) latency_trace_mark(point)
+#define LATENCY_TRACE_POLL() latency_trace_poll()
+
+#else
+
+#define LATENCY_TRACE_INIT(interval_s) \
+  do {                                 \
+  } while (0)
+#define LATENCY_TRACE_MARK(point) \
+  do {                            \
+  } while (0)
+#define LATENCY_TRACE_POLL() \
+  do {                       \
+  } while (0)
+
+#endif // ENABLE_LATENCY_TRACE
+
+#endif //_RKNN_DEMO_LATENCY_TRACE_H_
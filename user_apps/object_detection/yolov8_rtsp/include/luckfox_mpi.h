@@ -17,6 +17,8 @@
 #include <vector>
 
 #include "sample_comm.h"
+#include "venc_config.h"
+#include "venc_roi.h"
 
 #define TEST_ARGB32_PIX_SIZE 4
 #define TEST_ARGB32_RED 0xFF0000FF
@@ -33,6 +35,9 @@ RK_S32 rgn_overlay_release(int group);
 int vi_dev_init();
 int vi_chn_init(int channelId, int width, int height);
 int vpss_init(int VpssChn, int width, int height);
-int venc_init(int chnId, int width, int height, RK_CODEC_ID_E enType);
+int venc_init(int chnId, int width, int height, const venc_config_t *config);
+int jpeg_venc_init(int chnId, int width, int height, int quality);
+int venc_set_bitrate(int chnId, const venc_config_t *config, int kbps);
+int venc_apply_roi(int chnId, venc_roi_t *roi);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef _RKNN_DEMO_METRICS_H_
+#define _RKNN_DEMO_METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#define METRICS_MAX 32
+#define METRIC_MAX_BUCKETS 12
+
+typedef enum {
+  METRIC_COUNTER = 0,
+  METRIC_GAUGE,
+  METRIC_HISTOGRAM,
+} metric_type;
+
+// Updated with atomics only, so the pipeline never waits for a scrape
+typedef struct {
+  const char *name;
+  const char *help;
+  metric_type type;
+  std::atomic<uint64_t> count; // counter value
+  std::atomic<double> value;   // gauge value, or histogram sum
+  int n_bounds;
+  double bounds[METRIC_MAX_BUCKETS]; // histogram upper bounds, ascending
+  std::atomic<uint64_t> buckets[METRIC_MAX_BUCKETS + 1]; // last one is +Inf
+} metric_t;
+
+// Register before metrics_server_start. They return NULL when the registry
+// is full, and every update accepts NULL.
+metric_t *metrics_counter(const char *name, const char *help);
+metric_t *metrics_gauge(const char *name, const char *help);
+metric_t *metrics_histogram(const char *name, const char *help,
+                            const double *bounds, int n_bounds);
+
+static inline void metric_add(metric_t *metric, uint64_t n) {
+  if (metric != NULL) {
+    metric->count.fetch_add(n, std::memory_order_relaxed);
+  }
+}
+
+static inline void metric_inc(metric_t *metric) { metric_add(metric, 1); }
+
+static inline void metric_set(metric_t *metric, double value) {
+  if (metric != NULL) {
+    metric->value.store(value, std::memory_order_relaxed);
+  }
+}
+
+void metric_observe(metric_t *metric, double value);
+
+// Render every metric in the Prometheus text exposition format. Returns the
+// length, truncated to size - 1.
+int metrics_format(char *buf, size_t size);
+
+// Serve GET /metrics on 127.0.0.1:port from a thread of its own
+int metrics_server_start(int port);
+
+void metrics_server_stop();
+
+#endif //_RKNN_DEMO_METRICS_H_
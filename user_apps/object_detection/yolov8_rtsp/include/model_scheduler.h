@@ -0,0 +1,66 @@
+#ifndef _RKNN_DEMO_MODEL_SCHEDULER_H_
+#define _RKNN_DEMO_MODEL_SCHEDULER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "box_tracker.h"
+#include "frame_buffer.h"
+#include "im2d.hpp"
+#include "yolov8.h"
+
+#define SCHED_MAX_CROPS 8
+#define SCHED_MAX_ATTR_CLASS 64
+
+// Second-stage result of one detection
+typedef struct {
+  int cls_id; // -1 while the object has not been classified
+  float prop;
+} object_attr_result;
+
+typedef struct {
+  uint32_t track_id;
+  uint32_t frame;
+  object_attr_result attr;
+} sched_attr_cache_t;
+
+// Runs a classifier on crops of the detector output. The detector context is
+// borrowed, the classifier context is owned by the scheduler.
+typedef struct {
+  rknn_app_context_t *det_ctx;
+  rknn_app_context_t cls_ctx;
+  char *cls_labels[SCHED_MAX_ATTR_CLASS];
+
+  int top_n;             // crops classified per frame at most
+  int budget_us;         // NPU time the classifier may take per frame
+  uint32_t refresh_frames; // reclassify a tracked object after this long
+  int avg_run_us;
+
+  // pooled batch of classifier inputs, one slot per crop stacked vertically
+  rknn_tensor_mem *batch_mem;
+  rknn_tensor_mem *slot_mems[SCHED_MAX_CROPS];
+  rga_buffer_handle_t batch_handle;
+  int slot_wstride;
+
+  box_tracker_t tracker;
+  sched_attr_cache_t cache[BOX_TRACK_MAX_NUM];
+  uint32_t frame;
+} model_scheduler_t;
+
+int init_model_scheduler(model_scheduler_t *sched, rknn_app_context_t *det_ctx,
+                         const char *cls_model_path,
+                         const char *cls_labels_path, int top_n,
+                         int budget_us);
+
+int release_model_scheduler(model_scheduler_t *sched);
+
+// Classify the detections of one frame. Boxes must be in src image
+// coordinates. attrs[i] receives the latest result for od_results->results[i],
+// carried over from earlier frames for objects not classified this time.
+int scheduler_classify(model_scheduler_t *sched, frame_buffer_t *src,
+                       object_detect_result_list *od_results,
+                       object_attr_result *attrs);
+
+const char *scheduler_attr_name(model_scheduler_t *sched, int cls_id);
+
+#endif //_RKNN_DEMO_MODEL_SCHEDULER_H_
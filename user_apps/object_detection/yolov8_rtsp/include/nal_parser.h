@@ -0,0 +1,62 @@
+#ifndef _RKNN_DEMO_NAL_PARSER_H_
+#define _RKNN_DEMO_NAL_PARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Annex-B H.264 / H.265 helpers for the encoder output
+
+typedef enum {
+  NAL_CODEC_H264 = 0,
+  NAL_CODEC_H265,
+} nal_codec;
+
+// H.264 nal_unit_type
+#define NAL_H264_IDR 5
+#define NAL_H264_SPS 7
+#define NAL_H264_PPS 8
+#define NAL_H264_AUD 9
+
+// H.265 nal_unit_type
+#define NAL_H265_IDR_W_RADL 19
+#define NAL_H265_CRA 21
+#define NAL_H265_VPS 32
+#define NAL_H265_SPS 33
+#define NAL_H265_PPS 34
+#define NAL_H265_AUD 35
+
+typedef struct {
+  uint32_t offset; // first byte after the start code
+  uint32_t len;    // trailing zero bytes excluded
+  uint8_t type;
+} nal_unit_t;
+
+// Split an Annex-B buffer at its 3 and 4 byte start codes. Bytes before the
+// first start code are skipped. Returns the number of NAL units found, at
+// most max_nals.
+int nal_split(nal_codec codec, const uint8_t *data, size_t len,
+              nal_unit_t *nals, int max_nals);
+
+static inline uint8_t nal_type(nal_codec codec, const uint8_t *nal) {
+  return codec == NAL_CODEC_H264 ? nal[0] & 0x1f : (nal[0] >> 1) & 0x3f;
+}
+
+// Random access point: IDR, or for H.265 also CRA
+static inline bool nal_is_keyframe(nal_codec codec, uint8_t type) {
+  return codec == NAL_CODEC_H264
+             ? type == NAL_H264_IDR
+             : type >= NAL_H265_IDR_W_RADL && type <= NAL_H265_CRA;
+}
+
+// VPS, SPS or PPS
+static inline bool nal_is_parameter_set(nal_codec codec, uint8_t type) {
+  return codec == NAL_CODEC_H264
+             ? type == NAL_H264_SPS || type == NAL_H264_PPS
+             : type >= NAL_H265_VPS && type <= NAL_H265_PPS;
+}
+
+// Base64 as used by sprop-parameter-sets. Returns the length written, -1 if
+// out is too small.
+int nal_base64(const uint8_t *data, size_t len, char *out, size_t size);
+
+#endif //_RKNN_DEMO_NAL_PARSER_H_
@@ -0,0 +1,72 @@
+#ifndef _RKNN_DEMO_OSD_DRAW_H_
+#define _RKNN_DEMO_OSD_DRAW_H_
+
+#include <stdint.h>
+
+// Boxes and labels drawn by the CPU straight into the frame, NV12 or packed
+// BGR, so the overlay needs neither OpenCV nor an RGB copy of a YUV frame.
+// Everything is drawn as horizontal spans. On NV12, luma is set per pixel
+// in the Y plane and chroma in the 2x2 subsampled UV plane for every block
+// a span touches, so a colored edge may reach one pixel further in chroma
+// than in luma. Text uses the 6x8 bitmap font of the SSD1306 driver, scaled
+// by whole pixels. All drawing is clipped to the image.
+
+#define OSD_FONT_WIDTH 6
+#define OSD_FONT_HEIGHT 8
+
+typedef enum {
+  OSD_FORMAT_NV12,
+  OSD_FORMAT_BGR888,
+} osd_format_t;
+
+typedef struct {
+  osd_format_t format;
+  uint8_t *data; // Y plane on NV12
+  uint8_t *uv;   // interleaved U, V at half the resolution, NV12 only
+  int width;
+  int height;
+  int stride; // bytes per row
+  int uv_stride;
+} osd_image_t;
+
+typedef struct {
+  uint8_t y;
+  uint8_t u;
+  uint8_t v;
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+} osd_color_t;
+
+// Y and UV planes of a contiguous buffer, UV right after height rows of Y
+void osd_image_wrap_nv12(osd_image_t *img, uint8_t *data, int width,
+                         int height, int stride);
+
+void osd_image_wrap_bgr(osd_image_t *img, uint8_t *data, int width,
+                        int height, int stride);
+
+// YUV in BT.601 limited range, as the VI and VENC use it
+osd_color_t osd_color_rgb(uint8_t r, uint8_t g, uint8_t b);
+
+void osd_fill_rect(const osd_image_t *img, int x, int y, int w, int h,
+                   osd_color_t color);
+
+// Box outline with corners (x0, y0) and (x1, y1) inclusive and the lines
+// centered on the edges, like cv::rectangle
+void osd_draw_rect(const osd_image_t *img, int x0, int y0, int x1, int y1,
+                   int thickness, osd_color_t color);
+
+// Text with its top left corner at (x, y). Characters outside printable
+// ASCII are drawn as '?'. Returns the width of the text in pixels.
+int osd_draw_text(const osd_image_t *img, int x, int y, const char *text,
+                  int scale, osd_color_t color);
+
+int osd_text_width(const char *text, int scale);
+
+// Text on a filled background padded by scale pixels, its bottom left
+// corner at (x, y) like cv::putText; moved below y when it would leave the
+// top of the image. Returns the label height.
+int osd_draw_label(const osd_image_t *img, int x, int y, const char *text,
+                   int scale, osd_color_t fg, osd_color_t bg);
+
+#endif //_RKNN_DEMO_OSD_DRAW_H_
@@ -0,0 +1,70 @@
+#ifndef _RKNN_DEMO_PIPELINE_TRACE_H_
+#define _RKNN_DEMO_PIPELINE_TRACE_H_
+
+#include <stdint.h>
+
+// One timeline row per execution unit in the exported trace
+typedef enum {
+  TRACE_TRACK_CPU = 0,
+  TRACE_TRACK_NPU,
+  TRACE_TRACK_RGA,
+  TRACE_TRACK_VENC,
+  TRACE_TRACK_RTSP,
+  TRACE_TRACK_NUM,
+} trace_track;
+
+#define PIPELINE_TRACE_PATH "/tmp/pipeline_trace.json"
+
+#ifdef ENABLE_PIPELINE_TRACE
+
+// Preallocate room for capacity events (rounded up to a power of two); the
+// oldest events are overwritten once it is full. SIGUSR2 requests a flush.
+int pipeline_trace_init(uint32_t capacity);
+
+void pipeline_trace_deinit();
+
+// Frame the following events belong to, linked as a flow in the trace
+void pipeline_trace_frame(uint32_t frame_id);
+
+// name must be a string literal, only the pointer is stored
+void pipeline_trace_begin(trace_track track, const char *name);
+void pipeline_trace_end(trace_track track, const char *name);
+
+// Write the buffered events as Chrome trace event JSON, loadable in
+// Perfetto or chrome://tracing
+int pipeline_trace_flush(const char *path);
+
+// Flush to PIPELINE_TRACE_PATH when SIGUSR2 was received
+void pipeline_trace_poll();
+
+#define PIPELINE_TRACE_INIT(capacity) pipeline_trace_init(capacity)
+#define PIPELINE_TRACE_DEINIT() pipeline_trace_deinit()
+#define PIPELINE_TRACE_FRAME(frame_id) pipeline_trace_frame(frame_id)
+#define PIPELINE_TRACE_BEGIN(track, name) pipeline_trace_begin(track, name)
+#define PIPELINE_TRACE_END(track, name) pipeline_trace_end(track, name)
+#define PIPELINE_TRACE_POLL() pipeline_trace_poll()
+
+#else
+
+#define PIPELINE_TRACE_INIT(capacity) \
+  do {                                \
+  } while (0)
+#define PIPELINE_TRACE_DEINIT() \
+  do {                          \
+  } while (0)
+#define PIPELINE_TRACE_FRAME(frame_id) \
+  do {                                 \
+  } while (0)
+#define PIPELINE_TRACE_BEGIN(track, name) \
+  do {                                    \
+  } while (0)
+#define PIPELINE_TRACE_END(track, name) \
+  do {                                  \
+  } while (0)
+#define PIPELINE_TRACE_POLL() \
+  do {                        \
+  } while (0)
+
+#endif // ENABLE_PIPELINE_TRACE
+
+#endif //_RKNN_DEMO_PIPELINE_TRACE_H_
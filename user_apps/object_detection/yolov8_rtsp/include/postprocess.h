@@ -35,9 +35,18 @@ typedef struct {
 int init_post_process();
 void deinit_post_process();
 const char *coco_cls_to_name(int cls_id);
+// Read up to max_line lines of a label list, caller frees each line
+int read_label_file(const char *fileName, char *lines[], int max_line);
 int post_process(rknn_app_context_t *app_ctx, void *outputs,
                  float conf_threshold, float nms_threshold,
                  object_detect_result_list *od_results);
+// Sort candidate boxes (x, y, w, h in model input space), run per-class NMS
+// and store the survivors into od_results. Shared by all detector decoders.
+int filter_detect_results(int validCount, std::vector<float> &filterBoxes,
+                          std::vector<float> &objProbs,
+                          std::vector<int> &classId, float nms_threshold,
+                          int model_in_w, int model_in_h,
+                          object_detect_result_list *od_results);
 
 void deinitPostProcess();
 
@@ -0,0 +1,39 @@
+#ifndef _RKNN_DEMO_PRIVACY_MASK_H_
+#define _RKNN_DEMO_PRIVACY_MASK_H_
+
+#include <stdint.h>
+
+#include "box_tracker.h"
+
+// Mask geometry for mosaicking people in the stream. Detections of one class
+// are followed by IoU and a track keeps its mask for a few frames after the
+// detector loses it, so a missed detection does not unmask anyone for a
+// frame. Boxes are dilated and snapped outwards to the mosaic block grid:
+// the mosaic blocks then line up from frame to frame, and overlapping masks
+// give the same pixels as one. The RGA call itself is left to the caller.
+
+#define PRIVACY_MASK_MAX 16
+#define PRIVACY_MASK_DILATE 0.1f   // per side, of the box size
+#define PRIVACY_MASK_HOLD_FRAMES 8 // a lost track stays masked this long
+#define PRIVACY_MASK_TRACK_IOU 0.2f
+
+typedef struct {
+  box_tracker_t tracker;
+  int cls_id;
+  int width;
+  int height;
+  int block; // mosaic block size in pixels
+  image_rect_t rects[PRIVACY_MASK_MAX];
+  int n_rects;
+} privacy_mask_t;
+
+void privacy_mask_init(privacy_mask_t *mask, int cls_id, int width,
+                       int height, int block);
+
+// Masks for the detections of a frame, boxes in frame coordinates. When
+// there are more objects than PRIVACY_MASK_MAX the last mask covers all the
+// remaining ones. Returns n_rects.
+int privacy_mask_update(privacy_mask_t *mask,
+                        const object_detect_result_list *od_results);
+
+#endif //_RKNN_DEMO_PRIVACY_MASK_H_
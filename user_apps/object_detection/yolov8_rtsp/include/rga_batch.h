@@ -0,0 +1,72 @@
+#ifndef _RKNN_DEMO_RGA_BATCH_H_
+#define _RKNN_DEMO_RGA_BATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "im2d.hpp"
+
+// RGA operations of one frame collected into a single job and submitted
+// with one ioctl. The job runs asynchronously and signals a release fence;
+// the caller does other work and waits on the fence only when it needs the
+// result. Tasks of a job run in the order they were added.
+//
+// A task that cannot be added fails the whole batch: submit cancels the job
+// and returns -1, so the caller can fall back to the CPU for that frame. A
+// driver that gives no release fence fails the frame the same way, and from
+// then on jobs are submitted IM_SYNC and done when submit returns.
+
+#define RGA_BATCH_MAX_BUFFERS 8
+
+typedef struct {
+  int fd;
+  size_t size;
+  rga_buffer_handle_t handle;
+} rga_batch_buffer_t;
+
+typedef struct {
+  im_job_handle_t job; // 0 while no batch is open
+  int n_tasks;
+  bool failed;
+  int fence_fd; // release fence of the submitted job, -1 when none
+  bool sync;    // the driver gave no fence once, jobs run IM_SYNC
+
+  // imported dma-bufs, kept while the fd is in use
+  rga_batch_buffer_t buffers[RGA_BATCH_MAX_BUFFERS];
+  int n_buffers;
+  int next_evict;
+} rga_batch_t;
+
+void rga_batch_init(rga_batch_t *batch);
+
+// Wait for a pending job and release the imported buffers
+void rga_batch_deinit(rga_batch_t *batch);
+
+// Handle of a dma-buf, imported on first use. VI and VENC rotate through a
+// few blocks, so their fds are imported once instead of every frame.
+rga_buffer_handle_t rga_batch_import(rga_batch_t *batch, int fd, size_t size);
+
+int rga_batch_begin(rga_batch_t *batch);
+
+// Color conversion of the whole image
+void rga_batch_cvtcolor(rga_batch_t *batch, rga_buffer_t src, rga_buffer_t dst,
+                        int src_format, int dst_format);
+// Crop srect and scale it into drect
+void rga_batch_process(rga_batch_t *batch, rga_buffer_t src, rga_buffer_t dst,
+                       im_rect srect, im_rect drect);
+void rga_batch_fill(rga_batch_t *batch, rga_buffer_t dst, im_rect rect,
+                    uint32_t color);
+// Outlines of all rects, lines drawn inside them, -1 thickness fills
+void rga_batch_rectangles(rga_batch_t *batch, rga_buffer_t dst,
+                          im_rect *rects, int n_rects, uint32_t color,
+                          int thickness);
+
+// Submit the job and return at once. -1 when a task failed or the driver
+// refused the job; nothing is pending then.
+int rga_batch_submit(rga_batch_t *batch);
+
+// Block until the submitted job is done, at most timeout_ms. Returns 0 when
+// it completed (or nothing was pending), -1 on error or timeout.
+int rga_batch_wait(rga_batch_t *batch, int timeout_ms);
+
+#endif //_RKNN_DEMO_RGA_BATCH_H_
@@ -0,0 +1,34 @@
+#ifndef _RKNN_DEMO_MEM_POOL_H_
+#define _RKNN_DEMO_MEM_POOL_H_
+
+#include "yolov8.h"
+
+#define RKNN_MEM_POOL_MAX_CTX 4
+
+// One internal scratch buffer shared by contexts that never run at the same
+// time. The contexts must be loaded with RKNN_FLAG_INTERNAL_ALLOC_OUTSIDE and
+// must not rknn_run before commit.
+typedef struct {
+  rknn_app_context_t *ctxs[RKNN_MEM_POOL_MAX_CTX];
+  int n_ctx;
+  rknn_tensor_mem *internal_mem; // allocated through ctxs[0]
+} rknn_mem_pool_t;
+
+void rknn_mem_pool_init(rknn_mem_pool_t *pool);
+
+int rknn_mem_pool_add(rknn_mem_pool_t *pool, rknn_app_context_t *app_ctx);
+
+// Allocate the scratch for the largest model and hand a view of it to every
+// context, printing what the private allocations would have cost.
+int rknn_mem_pool_commit(rknn_mem_pool_t *pool);
+
+// Must run before the contexts are released
+void rknn_mem_pool_release(rknn_mem_pool_t *pool);
+
+// Print VmRSS of the process and the free CMA, tagged for before/after logs
+void print_mem_usage(const char *tag);
+
+// Free CMA in kB, -1 when /proc/meminfo does not report it
+long get_cma_free_kb();
+
+#endif //_RKNN_DEMO_MEM_POOL_H_
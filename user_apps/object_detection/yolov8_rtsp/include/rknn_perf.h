@@ -0,0 +1,55 @@
+#ifndef _RKNN_DEMO_PERF_H_
+#define _RKNN_DEMO_PERF_H_
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "rknn_api.h"
+
+// One row of the RKNN_QUERY_PERF_DETAIL table
+typedef struct {
+  int id;
+  char op_type[32];
+  char data_type[16];
+  char target[8];
+  char output_shape[64];
+  uint64_t npu_cycles;
+  uint64_t time_us;
+  float mac_usage; // -1 when the runtime leaves it empty
+  float rw_kb;
+  char name[128];
+} rknn_layer_perf;
+
+typedef struct {
+  uint64_t total_us;   // "Total Operator Elapsed Per Frame Time(us)"
+  float total_rw_kb;   // "Total Memory Read/Write Per Frame Size(KB)"
+} rknn_perf_summary;
+
+// Parse the text of rknn_perf_detail.perf_data. Columns are located by the
+// header so runtimes that add or reorder columns still parse. Returns the
+// number of layers, -1 when no layer table is found.
+int rknn_perf_parse_detail(const char *text,
+                           std::vector<rknn_layer_perf> &layers,
+                           rknn_perf_summary *summary);
+
+// Opt-in profiling of one context. Set rknn_app_context_t.perf before the
+// model is loaded, inference then reports every frame to a JSON lines file.
+typedef struct _rknn_perf_profiler {
+  FILE *report;
+  uint32_t frame;
+  volatile sig_atomic_t detail_requested;
+} rknn_perf_profiler_t;
+
+// The first frame always carries the layer table, later ones on SIGHUP
+int rknn_perf_open(rknn_perf_profiler_t *profiler, const char *report_path);
+
+void rknn_perf_close(rknn_perf_profiler_t *profiler);
+
+// Report the frame just run on ctx, which must have been initialized with
+// RKNN_FLAG_COLLECT_PERF_MASK
+int rknn_perf_collect(rknn_perf_profiler_t *profiler, rknn_context ctx);
+
+#endif //_RKNN_DEMO_PERF_H_
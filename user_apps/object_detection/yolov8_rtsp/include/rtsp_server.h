@@ -0,0 +1,62 @@
+#ifndef _RKNN_DEMO_RTSP_SERVER_H_
+#define _RKNN_DEMO_RTSP_SERVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nal_parser.h"
+
+// RTSP server with a thread of its own. The capture loop only hands over
+// encoded access units; sessions, RTP packetization and sending all happen on
+// the server thread, so a slow or stuck client never holds up detection.
+//
+// An access unit is copied once into a reference-counted buffer that every
+// client of the stream sends from. RTP packets are described as header +
+// slice of that buffer and go out with sendmmsg (UDP) or one sendmsg per
+// batch (TCP interleaved). A client that falls RTSP_CLIENT_QUEUE access units
+// behind loses its backlog and resumes at the next IDR.
+//
+// The server keeps the latest parameter sets and the access units since the
+// last IDR. A new client gets that GOP at once, so it shows a picture right
+// away instead of waiting for the next IDR, and DESCRIBE answers with
+// sprop-parameter-sets.
+
+#define RTSP_MAX_STREAMS 4
+#define RTSP_MAX_CLIENTS 16
+#define RTSP_CLIENT_QUEUE 64     // access units a client may lag behind
+#define RTSP_GOP_CACHE_AUS 48    // longer GOPs make joins wait for an IDR
+#define RTSP_GOP_CACHE_BYTES (1024 * 1024)
+
+typedef enum {
+  RTSP_CODEC_H264 = NAL_CODEC_H264,
+  RTSP_CODEC_H265 = NAL_CODEC_H265,
+} rtsp_codec;
+
+typedef struct _rtsp_server rtsp_server_t;
+
+// Listen on port, NULL when the socket cannot be bound
+rtsp_server_t *rtsp_server_create(int port);
+
+// Serve a stream at rtsp://<host>:<port><path>, before rtsp_server_start.
+// Returns the stream index passed to rtsp_server_push.
+int rtsp_server_add_stream(rtsp_server_t *server, const char *path,
+                           rtsp_codec codec);
+
+int rtsp_server_start(rtsp_server_t *server);
+
+// Queue one Annex-B access unit, as returned by RK_MPI_VENC_GetStream.
+// Returns at once, the copy is sent by the server thread.
+int rtsp_server_push(rtsp_server_t *server, int stream, const uint8_t *data,
+                     size_t len, uint64_t pts_us);
+
+// Clients currently playing the stream
+int rtsp_server_client_count(rtsp_server_t *server, int stream);
+
+// Access units the furthest behind client of the stream had queued, at most
+// RTSP_CLIENT_QUEUE, since the previous call. The GOP replayed to a client
+// that just started playing is not counted. Feeds the bitrate controller.
+int rtsp_server_take_queue_peak(rtsp_server_t *server, int stream);
+
+void rtsp_server_destroy(rtsp_server_t *server);
+
+#endif //_RKNN_DEMO_RTSP_SERVER_H_
@@ -0,0 +1,61 @@
+#ifndef _RKNN_DEMO_SNAPSHOT_POLICY_H_
+#define _RKNN_DEMO_SNAPSHOT_POLICY_H_
+
+#include <stdint.h>
+
+#include "box_tracker.h"
+
+// Which detections get a thumbnail. Objects are followed by IoU; an object
+// gets one snapshot once it has been seen for a few frames, and another only
+// after repeat_us and once it has moved away from where the last one was
+// taken, so a parked car is sent once instead of every frame.
+
+#define SNAPSHOT_TRACK_IOU 0.3f
+#define SNAPSHOT_TRACK_MAX_MISSED 30
+#define SNAPSHOT_MIN_HITS 3      // frames before a new object is trusted
+#define SNAPSHOT_MOVE_IOU 0.5f   // below this overlap the object has moved
+#define SNAPSHOT_MARGIN 0.15f    // context around the box, per side
+
+typedef struct {
+  uint32_t track_id; // 0 until the track got its first snapshot
+  image_rect_t box;
+  uint64_t pts_us;
+} snapshot_mark_t;
+
+typedef struct {
+  box_tracker_t tracker;
+  snapshot_mark_t marks[BOX_TRACK_MAX_NUM]; // by track slot
+  uint64_t repeat_us;
+} snapshot_policy_t;
+
+typedef struct {
+  int index; // into od_results->results
+  uint32_t track_id;
+  int slot;             // tracker slot, for snapshot_policy_undo
+  snapshot_mark_t prev; // the slot's mark before this pick
+} snapshot_pick_t;
+
+void snapshot_policy_init(snapshot_policy_t *policy, uint64_t repeat_us);
+
+// Follow the detections of a frame and pick up to max_picks objects due for
+// a snapshot, objects without one first, then the most confident. Picked
+// objects count as snapped from pts_us on, so one in flight is not picked
+// again. Returns the number of picks.
+int snapshot_policy_select(snapshot_policy_t *policy,
+                           const object_detect_result_list *od_results,
+                           uint64_t pts_us, snapshot_pick_t *picks,
+                           int max_picks);
+
+// Take back a pick whose snapshot failed, the object is due again on the
+// next frame. Does nothing once the slot went to another object.
+void snapshot_policy_undo(snapshot_policy_t *policy,
+                          const snapshot_pick_t *pick);
+
+// Source rectangle for a thumbnail of out_width x out_height: the box with a
+// margin, widened to the thumbnail aspect ratio and moved inside the frame,
+// with even coordinates.
+void snapshot_crop_rect(const image_rect_t *box, int src_width,
+                        int src_height, int out_width, int out_height,
+                        image_rect_t *crop);
+
+#endif //_RKNN_DEMO_SNAPSHOT_POLICY_H_
@@ -0,0 +1,53 @@
+#ifndef _RKNN_DEMO_SNAPSHOT_SERVICE_H_
+#define _RKNN_DEMO_SNAPSHOT_SERVICE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame_buffer.h"
+#include "yolov8.h"
+
+// JPEG thumbnails of detected objects from a VENC channel of their own. The
+// frame loop only crops the picked objects out of the clean frame with one
+// RGA job, into a small pool of buffers; a worker thread feeds them to the
+// MJPEG encoder and hands each JPEG to the callback. When every buffer is in
+// flight further objects wait for a later frame. snapshot_policy decides
+// which objects are due.
+
+#define SNAPSHOT_WIDTH 192 // multiples of 16
+#define SNAPSHOT_HEIGHT 192
+#define SNAPSHOT_SLOTS 4
+#define SNAPSHOT_QUALITY 80 // JPEG quality factor, 1-99
+#define SNAPSHOT_REPEAT_US (30 * 1000000ULL)
+
+typedef struct {
+  uint32_t track_id;
+  int cls_id;
+  float prop;
+  image_rect_t box; // in the source frame
+  uint64_t pts_us;  // of the frame the crop was taken from
+} snapshot_info_t;
+
+// Called on the worker thread; jpeg is only valid during the call
+typedef void (*snapshot_callback)(const snapshot_info_t *info,
+                                  const uint8_t *jpeg, size_t len,
+                                  void *user);
+
+typedef struct _snapshot_service snapshot_service_t;
+
+// Create the MJPEG channel chn, NULL on failure
+snapshot_service_t *snapshot_service_create(int chn,
+                                            snapshot_callback callback,
+                                            void *user);
+
+// Crop the objects due for a snapshot out of the frame src and queue them
+// for encoding. Boxes are in source coordinates. Returns the number of
+// objects queued, -1 on error.
+int snapshot_service_capture(snapshot_service_t *svc, frame_buffer_t *src,
+                             const object_detect_result_list *od_results,
+                             uint64_t pts_us);
+
+// Encode what is queued, then stop the worker and destroy the channel
+void snapshot_service_destroy(snapshot_service_t *svc);
+
+#endif //_RKNN_DEMO_SNAPSHOT_SERVICE_H_
@@ -0,0 +1,28 @@
+#ifndef _RKNN_DEMO_SSD_POSTPROCESS_H_
+#define _RKNN_DEMO_SSD_POSTPROCESS_H_
+
+#include "yolov8.h"
+
+// rknn_box_priors.h ships 4200 (cx, cy, w, h) priors for a 320x320 input
+#define SSD_NUM_PRIORS 4200
+#define SSD_CENTER_VARIANCE 0.1f
+#define SSD_SIZE_VARIANCE 0.2f
+
+// 80 class heads plus background, or the 91 class COCO export
+#define SSD_MAX_CLASSES 91
+
+// Class 0 of the SSD score tensor is background. The other columns map onto
+// the 80 class COCO list, so the labels come from coco_cls_to_name(): class
+// c is the label c - 1 of an 81 column head, and the 91 column head carries
+// the COCO category ids, whose unused ids are skipped.
+int init_ssd_post_process();
+void deinit_ssd_post_process();
+
+// Check the model outputs and pick the class mapping, -1 when the model
+// does not fit
+int ssd_post_process_check(rknn_app_context_t *app_ctx);
+int ssd_post_process(rknn_app_context_t *app_ctx, void *outputs,
+                     float conf_threshold, float nms_threshold,
+                     object_detect_result_list *od_results);
+
+#endif //_RKNN_DEMO_SSD_POSTPROCESS_H_
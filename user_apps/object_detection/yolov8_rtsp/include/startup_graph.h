@@ -0,0 +1,81 @@
+#ifndef _RKNN_DEMO_STARTUP_GRAPH_H_
+#define _RKNN_DEMO_STARTUP_GRAPH_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define STARTUP_MAX_STAGES 16
+#define STARTUP_MAX_DEPS 4
+
+typedef int (*startup_stage_fn)(void *arg);
+typedef void (*startup_undo_fn)(void *arg);
+
+typedef enum {
+  STARTUP_STAGE_PENDING = 0,
+  STARTUP_STAGE_RUNNING,
+  STARTUP_STAGE_DONE,
+  STARTUP_STAGE_FAILED,
+  STARTUP_STAGE_SKIPPED, // a dependency failed, the stage never ran
+} startup_stage_state;
+
+typedef struct {
+  const char *name;
+  startup_stage_fn fn; // returns 0 on success
+  startup_undo_fn undo; // optional, also gets a partly done stage
+  void *arg;
+  int deps[STARTUP_MAX_DEPS];
+  int n_deps;
+  int undo_after[STARTUP_MAX_DEPS]; // stages undone before this one
+  int n_undo_after;
+
+  startup_stage_state state;
+  int ret;
+  uint64_t start_us; // relative to the start of startup_graph_run
+  uint64_t end_us;
+} startup_stage_t;
+
+// Startup stages with their dependencies. Stages whose dependencies are done
+// run concurrently on a small set of threads, the caller being one of them.
+typedef struct {
+  startup_stage_t stages[STARTUP_MAX_STAGES];
+  int n_stages;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int n_running;
+  uint64_t base_us;
+  uint64_t total_us;
+} startup_graph_t;
+
+void startup_graph_init(startup_graph_t *graph);
+
+// Returns the stage id, or -1 when the graph is full
+int startup_graph_add(startup_graph_t *graph, const char *name,
+                      startup_stage_fn fn, void *arg);
+
+// stage waits for dep, which must have been added before it
+int startup_graph_depend(startup_graph_t *graph, int stage, int dep);
+
+// Teardown of a stage, for startup_graph_undo
+int startup_graph_set_undo(startup_graph_t *graph, int stage,
+                           startup_undo_fn undo);
+
+// Undo stage before other, which would otherwise go first, e.g. when the SDK
+// tears a dependency down before its dependent
+int startup_graph_undo_before(startup_graph_t *graph, int stage, int other);
+
+// Run every stage on at most max_threads threads. Returns 0 when all stages
+// succeeded, -1 otherwise; dependents of a failed stage are skipped.
+int startup_graph_run(startup_graph_t *graph, int max_threads);
+
+// Undo every stage that ran, failed ones included, the last added first so
+// dependents go before what they depend on, apart from the orderings set by
+// startup_graph_undo_before. The same order after a failed run and at exit.
+void startup_graph_undo(startup_graph_t *graph);
+
+// Print the timeline of the last run
+void startup_graph_print(const startup_graph_t *graph);
+
+void startup_graph_deinit(startup_graph_t *graph);
+
+#endif //_RKNN_DEMO_STARTUP_GRAPH_H_
@@ -0,0 +1,39 @@
+#ifndef _RKNN_DEMO_TS_MUX_H_
+#define _RKNN_DEMO_TS_MUX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nal_parser.h"
+
+// MPEG-TS (ISO 13818-1) for one H.264 or H.265 elementary stream. A clip
+// starts with PAT and PMT, every key frame repeats them, and every access
+// unit is one PES packet with its PTS and a PCR. A TS file stays playable
+// up to the last complete packet, so a clip cut short by power loss is not
+// lost, unlike an MP4 without its index.
+
+#define TS_PACKET_SIZE 188
+#define TS_PID_PMT 0x1000
+#define TS_PID_VIDEO 0x100
+
+typedef struct {
+  nal_codec codec;
+  uint8_t cc_pat;
+  uint8_t cc_pmt;
+  uint8_t cc_video;
+  bool started;
+  uint64_t base_us; // PTS of the first access unit, the clip starts at 0
+} ts_mux_t;
+
+void ts_mux_init(ts_mux_t *mux, nal_codec codec);
+
+// Bytes ts_mux_write may need for an access unit of len bytes
+size_t ts_mux_max_size(size_t len);
+
+// Mux one Annex-B access unit into out. Returns the bytes written, 0 when
+// more than size would be needed; nothing is written then.
+size_t ts_mux_write(ts_mux_t *mux, const uint8_t *au, size_t len,
+                    uint64_t pts_us, bool keyframe, uint8_t *out,
+                    size_t size);
+
+#endif //_RKNN_DEMO_TS_MUX_H_
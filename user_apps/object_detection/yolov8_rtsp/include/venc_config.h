@@ -0,0 +1,50 @@
+#ifndef _RKNN_DEMO_VENC_CONFIG_H_
+#define _RKNN_DEMO_VENC_CONFIG_H_
+
+// Encoder settings, given on the command line as a comma separated list of
+// key=value pairs, e.g. -E codec=h265,rc=avbr,kbps=2048,gop=60,smartp=30
+//
+//   codec    h264 | h265
+//   size     WxH, multiples of 16, for a scaled sub-stream
+//   rc       cbr | vbr | avbr
+//   kbps     target bitrate, where the adaptive controller starts
+//   min_kbps lowest bitrate, VBR floor and adaptive floor
+//   max_kbps highest bitrate, VBR ceiling and adaptive ceiling
+//   gop      frames between IDRs
+//   smartp   frames between virtual IDRs, 0 for normal P frames
+//   qp       P frame QP range as min-max, 0-0 keeps the encoder default
+//   iqp      I frame QP range as min-max
+//   adaptive 1 to follow RTSP load and scene activity, 0 for a fixed rate
+//   roi      QP offset inside detected objects, e.g. -6, 0 to disable
+
+typedef enum {
+  VENC_RC_CBR = 0,
+  VENC_RC_VBR,
+  VENC_RC_AVBR,
+} venc_rc_mode;
+
+typedef struct {
+  int width; // 0 for the capture size
+  int height;
+  bool h265;
+  venc_rc_mode rc_mode;
+  int kbps;
+  int min_kbps;
+  int max_kbps;
+  int gop;
+  int smartp_vir_idr;
+  int min_qp, max_qp;
+  int min_i_qp, max_i_qp;
+  bool adaptive;
+  int roi_qp;
+} venc_config_t;
+
+void venc_config_default(venc_config_t *config);
+
+// Apply the key=value list on top of config. Returns -1 on an unknown key
+// or a value out of range, config is left partly updated then.
+int venc_config_parse(venc_config_t *config, const char *spec);
+
+void venc_config_print(const venc_config_t *config);
+
+#endif //_RKNN_DEMO_VENC_CONFIG_H_
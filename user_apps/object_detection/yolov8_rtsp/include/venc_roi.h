@@ -0,0 +1,45 @@
+#ifndef _RKNN_DEMO_VENC_ROI_H_
+#define _RKNN_DEMO_VENC_ROI_H_
+
+#include "yolov8.h"
+
+// Encoder ROI regions placed on the detected objects, so they get a lower QP
+// than the background. The encoder has a few regions only and every change
+// is a driver call, so regions are sticky:
+//  - a region follows its object only once the object has clearly moved
+//    out of it (IoU with the new box below VENC_ROI_MOVE_IOU);
+//  - a region outlives its object by VENC_ROI_HOLD_FRAMES, so a detection
+//    dropping out for a frame or two does not toggle it;
+//  - when there are more objects than regions, the most confident ones win
+//    and keep their region until they leave.
+
+#define VENC_ROI_MAX 8           // regions of RK_MPI_VENC_SetRoiAttr
+#define VENC_ROI_ALIGN 16        // macroblock grid
+#define VENC_ROI_MARGIN 0.1f     // of the box size, added on every side
+#define VENC_ROI_MATCH_IOU 0.3f  // same object as the region
+#define VENC_ROI_MOVE_IOU 0.6f   // below this the region is moved
+#define VENC_ROI_HOLD_FRAMES 10
+
+typedef struct {
+  bool enabled;
+  image_rect_t rect; // aligned and inside the frame
+  int idle;          // frames since an object last matched the region
+} venc_roi_region_t;
+
+typedef struct {
+  venc_roi_region_t regions[VENC_ROI_MAX];
+  bool dirty[VENC_ROI_MAX]; // changed since the encoder was last told
+  int n_regions;
+  int width;
+  int height;
+  int qp; // relative QP inside the regions, negative for more detail, 0 off
+} venc_roi_t;
+
+void venc_roi_init(venc_roi_t *roi, int width, int height, int qp,
+                   int n_regions);
+
+// Fit the regions to this frame's detections, in frame coordinates. Returns
+// the number of regions marked dirty.
+int venc_roi_update(venc_roi_t *roi, const object_detect_result_list *results);
+
+#endif //_RKNN_DEMO_VENC_ROI_H_
@@ -0,0 +1,57 @@
+#ifndef _RKNN_DEMO_VIDEO_OUTPUT_H_
+#define _RKNN_DEMO_VIDEO_OUTPUT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitrate_ctrl.h"
+#include "frame_buffer.h"
+#include "im2d.hpp"
+#include "luckfox_mpi.h"
+#include "venc_config.h"
+
+// One encoded stream of the overlaid frame. The main output encodes the
+// frame buffer in place; a sub-stream gets an RGA scaled copy in a DMA block
+// of its own, so any number of resolutions share one overlay pass and cost
+// no CPU beyond the job submission.
+
+#define VIDEO_OUTPUT_MAX 3
+
+typedef struct {
+  venc_config_t config;
+  int chn; // VENC channel
+  int width;
+  int height;
+  const char *path; // RTSP path, for messages
+  bitrate_ctrl_t bitrate;
+
+  frame_buffer_t *src; // a reference on the frame all outputs are made from
+  MB_BLK blk;          // what VENC encodes
+
+  // scaled copy, unused by the main output
+  bool scaled;
+  MB_POOL pool;
+  frame_buffer_t *dst;
+
+  VIDEO_FRAME_INFO_S frame;
+  VENC_STREAM_S stream;
+  VENC_PACK_S pack;
+} video_output_t;
+
+// Set up the output and its VENC channel. src is the BGR frame in an MB
+// block all outputs are made from; the output is scaled when config gives a
+// size other than the one of src.
+int video_output_init(video_output_t *out, int chn, const char *path,
+                      const venc_config_t *config, frame_buffer_t *src);
+
+// Hand the current source frame to the encoder, scaled first if needed
+int video_output_send(video_output_t *out, uint32_t time_ref, uint64_t pts_us);
+
+// Wait for the encoded frame, valid in out->stream until
+// video_output_release.
+int video_output_get(video_output_t *out);
+void video_output_release(video_output_t *out);
+
+void video_output_deinit(video_output_t *out);
+
+#endif //_RKNN_DEMO_VIDEO_OUTPUT_H_
@@ -45,12 +45,24 @@ typedef struct {
   int model_width;
   int model_height;
   bool is_quant;
+  // RKNN_FLAG_* for rknn_init and tensor dump on load, set before init
+  uint32_t init_flags;
+  bool verbose;
+  rknn_mem_size mem_size;
+  // view of a scratch buffer shared with other contexts, see rknn_mem_pool.h
+  rknn_tensor_mem *internal_mem;
+  // per-frame NPU profiling report when set before init, see rknn_perf.h
+  struct _rknn_perf_profiler *perf;
 } rknn_app_context_t;
 
 #include "postprocess.h"
 
 int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx);
 
+// Same as init_yolov8_model for a model already in memory (e.g. embedded)
+int init_yolov8_model_from_buffer(const void *model, uint32_t model_len,
+                                  rknn_app_context_t *app_ctx);
+
 int release_yolov8_model(rknn_app_context_t *app_ctx);
 
 int inference_yolov8_model(rknn_app_context_t *app_ctx,
@@ -0,0 +1,323 @@
+#include "async_log.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ALOG_LINE_BYTES 512
+
+std::atomic<int> async_log_level(ALOG_LEVEL_INFO);
+
+// Bounded queue in the style of Vyukov: a cell may be written when its seq
+// equals the enqueue position and read once it is position + 1.
+typedef struct {
+  std::atomic<uint32_t> seq;
+  alog_record_t rec;
+} alog_cell_t;
+
+static alog_cell_t ring[ALOG_RING_SIZE];
+static std::atomic<uint32_t> enqueue_pos;
+static std::atomic<uint32_t> dequeue_pos; // advanced by the writer only
+static std::atomic<uint32_t> dropped;
+
+static pthread_t writer_thread;
+static std::atomic<bool> writer_running;
+static bool writer_started;
+// The writer sleeps on wakeup_fd once the ring is empty. Only the producer
+// that finds it asleep signals, so a busy ring costs no syscall.
+static int wakeup_fd = -1;
+static std::atomic<bool> writer_sleeping;
+
+static uint64_t get_now_us() {
+  struct timespec time = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000 + (uint64_t)time.tv_nsec / 1000;
+}
+
+// Format one conversion of spec (without its length modifier) with arg
+static int format_arg(char *out, size_t size, const char *spec, char conv,
+                      const alog_record_t *rec, int index) {
+  if (index >= rec->n_args) {
+    return snprintf(out, size, "?");
+  }
+  char fmt[32];
+  const alog_arg_t *arg = &rec->args[index];
+  uint8_t type = rec->types[index];
+
+  switch (conv) {
+  case 'd':
+  case 'i':
+    snprintf(fmt, sizeof(fmt), "%sll%c", spec, conv);
+    return snprintf(out, size, fmt,
+                    type == ALOG_ARG_DOUBLE ? (long long)arg->d
+                                            : (long long)arg->i);
+  case 'u':
+  case 'x':
+  case 'X':
+  case 'o':
+    snprintf(fmt, sizeof(fmt), "%sll%c", spec, conv);
+    return snprintf(out, size, fmt,
+                    type == ALOG_ARG_DOUBLE ? (unsigned long long)arg->d
+                                            : (unsigned long long)arg->u);
+  case 'c':
+    snprintf(fmt, sizeof(fmt), "%sc", spec);
+    return snprintf(out, size, fmt, (int)arg->i);
+  case 'f':
+  case 'F':
+  case 'e':
+  case 'E':
+  case 'g':
+  case 'G':
+  case 'a':
+  case 'A':
+    snprintf(fmt, sizeof(fmt), "%s%c", spec, conv);
+    return snprintf(out, size, fmt,
+                    type == ALOG_ARG_DOUBLE ? arg->d
+                    : type == ALOG_ARG_INT  ? (double)arg->i
+                                            : (double)arg->u);
+  case 's':
+    snprintf(fmt, sizeof(fmt), "%ss", spec);
+    return snprintf(out, size, fmt,
+                    type == ALOG_ARG_STR ? rec->str + arg->u : "?");
+  case 'p':
+    snprintf(fmt, sizeof(fmt), "%sp", spec);
+    return snprintf(out, size, fmt, arg->p);
+  }
+  return snprintf(out, size, "%s%c", spec, conv);
+}
+
+// printf of the record's format string over its packed arguments
+static int format_record(const alog_record_t *rec, char *out, size_t size) {
+  const char *f = rec->site->fmt;
+  size_t n = 0;
+  int index = 0;
+
+  while (*f != '\0' && n + 1 < size) {
+    if (*f != '%') {
+      out[n++] = *f++;
+      continue;
+    }
+    if (f[1] == '%') {
+      out[n++] = '%';
+      f += 2;
+      continue;
+    }
+
+    // flags, width and precision are kept, length modifiers dropped
+    char spec[24];
+    size_t s = 0;
+    spec[s++] = *f++;
+    while (*f != '\0' && strchr("-+ #0123456789.", *f) != NULL &&
+           s < sizeof(spec) - 1) {
+      spec[s++] = *f++;
+    }
+    spec[s] = '\0';
+    while (*f != '\0' && strchr("hlLqjzt", *f) != NULL) {
+      f++;
+    }
+    if (*f == '\0') {
+      break;
+    }
+    int len = format_arg(out + n, size - n, spec, *f++, rec, index++);
+    if (len > 0) {
+      n += (size_t)len < size - n ? (size_t)len : size - n - 1;
+    }
+  }
+  out[n] = '\0';
+  if (rec->suppressed > 0) {
+    size_t end = n > 0 && out[n - 1] == '\n' ? n - 1 : n;
+    snprintf(out + end, size - end, " (%u more suppressed)%s", rec->suppressed,
+             end < n ? "\n" : "");
+  }
+  return (int)strlen(out);
+}
+
+static void write_record(const alog_record_t *rec) {
+  char line[ALOG_LINE_BYTES];
+  int len = format_record(rec, line, sizeof(line));
+  fwrite(line, 1, len, stdout);
+}
+
+static bool dequeue(alog_record_t *rec) {
+  uint32_t pos = dequeue_pos.load(std::memory_order_relaxed);
+  alog_cell_t *cell = &ring[pos & (ALOG_RING_SIZE - 1)];
+  uint32_t seq = cell->seq.load(std::memory_order_acquire);
+  if (seq != pos + 1) {
+    return false;
+  }
+  *rec = cell->rec;
+  cell->seq.store(pos + ALOG_RING_SIZE, std::memory_order_release);
+  dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+  return true;
+}
+
+static void wake_writer() {
+  uint64_t one = 1;
+  if (write(wakeup_fd, &one, sizeof(one)) != sizeof(one)) {
+    // the counter is already non-zero, the writer wakes up anyway
+  }
+}
+
+// Block until a producer queues a record or deinit is called
+static void wait_for_records() {
+  writer_sleeping.store(true, std::memory_order_seq_cst);
+  // a record queued before the flag was seen gets no signal, look again
+  uint32_t pos = dequeue_pos.load(std::memory_order_relaxed);
+  alog_cell_t *cell = &ring[pos & (ALOG_RING_SIZE - 1)];
+  if (cell->seq.load(std::memory_order_seq_cst) == pos + 1 ||
+      !writer_running.load(std::memory_order_seq_cst)) {
+    if (writer_sleeping.exchange(false, std::memory_order_seq_cst)) {
+      return;
+    }
+    // a producer took the flag and signals, fall through to consume it
+  }
+  uint64_t count;
+  if (read(wakeup_fd, &count, sizeof(count)) != sizeof(count)) {
+    usleep(1000);
+  }
+  writer_sleeping.store(false, std::memory_order_relaxed);
+}
+
+static void *writer_loop(void *arg) {
+  alog_record_t rec;
+  uint32_t reported_drops = 0;
+
+  while (1) {
+    bool running = writer_running.load(std::memory_order_acquire);
+    if (dequeue(&rec)) {
+      write_record(&rec);
+      continue;
+    }
+    uint32_t drops = dropped.load(std::memory_order_relaxed);
+    if (drops != reported_drops) {
+      printf("log ring full, %u records dropped\n", drops - reported_drops);
+      reported_drops = drops;
+    }
+    fflush(stdout);
+    if (!running) {
+      break;
+    }
+    wait_for_records();
+  }
+  return NULL;
+}
+
+int async_log_init(alog_level level) {
+  async_log_set_level(level);
+  for (uint32_t i = 0; i < ALOG_RING_SIZE; i++) {
+    ring[i].seq.store(i, std::memory_order_relaxed);
+  }
+  enqueue_pos.store(0, std::memory_order_relaxed);
+  dequeue_pos.store(0, std::memory_order_relaxed);
+
+  wakeup_fd = eventfd(0, EFD_CLOEXEC);
+  if (wakeup_fd < 0) {
+    printf("async log eventfd fail, logging synchronously\n");
+    return -1;
+  }
+  writer_sleeping.store(false, std::memory_order_relaxed);
+  writer_running.store(true, std::memory_order_release);
+  if (pthread_create(&writer_thread, NULL, writer_loop, NULL) != 0) {
+    writer_running.store(false);
+    close(wakeup_fd);
+    wakeup_fd = -1;
+    printf("async log thread create fail, logging synchronously\n");
+    return -1;
+  }
+  writer_started = true;
+  return 0;
+}
+
+void async_log_deinit() {
+  if (!writer_started) {
+    return;
+  }
+  writer_running.store(false, std::memory_order_seq_cst);
+  wake_writer();
+  pthread_join(writer_thread, NULL);
+  writer_started = false;
+  close(wakeup_fd);
+  wakeup_fd = -1;
+}
+
+void async_log_set_level(alog_level level) {
+  async_log_level.store(level, std::memory_order_relaxed);
+}
+
+uint32_t async_log_queue_depth() {
+  // both ends move while we look, this is an estimate
+  uint32_t tail = dequeue_pos.load(std::memory_order_relaxed);
+  uint32_t head = enqueue_pos.load(std::memory_order_relaxed);
+  return head - tail <= ALOG_RING_SIZE ? head - tail : 0;
+}
+
+int async_log_parse_level(const char *name) {
+  static const char *names[] = {"error", "warn", "info", "debug"};
+  for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+    if (strcmp(name, names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool async_log_admit(alog_site_t *site) {
+  if (site->max_per_sec == 0) {
+    return true;
+  }
+  uint32_t now_sec = (uint32_t)(get_now_us() / 1000000);
+  uint32_t window = site->window_sec.load(std::memory_order_relaxed);
+  if (window != now_sec &&
+      site->window_sec.compare_exchange_strong(window, now_sec,
+                                               std::memory_order_relaxed)) {
+    site->window_count.store(0, std::memory_order_relaxed);
+  }
+  if (site->window_count.fetch_add(1, std::memory_order_relaxed) >=
+      site->max_per_sec) {
+    site->suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+void async_log_submit(alog_record_t *record) {
+  record->suppressed =
+      record->site->suppressed.exchange(0, std::memory_order_relaxed);
+
+  if (!writer_running.load(std::memory_order_acquire)) {
+    write_record(record);
+    return;
+  }
+
+  uint32_t pos = enqueue_pos.load(std::memory_order_relaxed);
+  alog_cell_t *cell;
+  while (1) {
+    cell = &ring[pos & (ALOG_RING_SIZE - 1)];
+    uint32_t seq = cell->seq.load(std::memory_order_acquire);
+    int32_t diff = (int32_t)(seq - pos);
+    if (diff == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // full: drop rather than wait for the console
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      record->site->suppressed.fetch_add(record->suppressed,
+                                         std::memory_order_relaxed);
+      return;
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  cell->rec = *record;
+  cell->seq.store(pos + 1, std::memory_order_seq_cst);
+  // pairs with the store of writer_sleeping and the look at the ring in
+  // wait_for_records: either the writer sees this record or we see it asleep
+  if (writer_sleeping.load(std::memory_order_seq_cst) &&
+      writer_sleeping.exchange(false, std::memory_order_seq_cst)) {
+    wake_writer();
+  }
+}
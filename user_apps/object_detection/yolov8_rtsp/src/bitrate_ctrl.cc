@@ -0,0 +1,83 @@
+#include "bitrate_ctrl.h"
+
+#include <math.h>
+#include <string.h>
+
+// weight of the newest interval in the activity average
+#define ACTIVITY_SMOOTHING 0.3f
+
+void bitrate_ctrl_init(bitrate_ctrl_t *ctrl, int min_kbps, int max_kbps,
+                       int start_kbps) {
+  memset(ctrl, 0, sizeof(bitrate_ctrl_t));
+  ctrl->min_kbps = min_kbps;
+  ctrl->max_kbps = max_kbps;
+  ctrl->kbps = start_kbps;
+  ctrl->target = start_kbps;
+  // start as if the scene were busy, so the first idle seconds step down
+  ctrl->activity = 1.f;
+}
+
+void bitrate_ctrl_frame(bitrate_ctrl_t *ctrl, int n_objects) {
+  ctrl->frames++;
+  if (n_objects > 0) {
+    ctrl->active_frames++;
+  }
+}
+
+static float ceiling_kbps(const bitrate_ctrl_t *ctrl) {
+  float share =
+      BITRATE_CTRL_IDLE_SHARE + (1.f - BITRATE_CTRL_IDLE_SHARE) * ctrl->activity;
+  return ctrl->min_kbps + (ctrl->max_kbps - ctrl->min_kbps) * share;
+}
+
+int bitrate_ctrl_update(bitrate_ctrl_t *ctrl, uint64_t now_us, int queue_peak,
+                        int queue_capacity) {
+  if (queue_peak > ctrl->queue_peak) {
+    ctrl->queue_peak = queue_peak;
+  }
+  if (ctrl->interval_start_us == 0) {
+    ctrl->interval_start_us = now_us;
+    return 0;
+  }
+  if (now_us - ctrl->interval_start_us < BITRATE_CTRL_INTERVAL_US) {
+    return 0;
+  }
+
+  if (ctrl->frames > 0) {
+    float active = (float)ctrl->active_frames / ctrl->frames;
+    ctrl->activity += ACTIVITY_SMOOTHING * (active - ctrl->activity);
+  }
+  float pressure =
+      queue_capacity > 0 ? (float)ctrl->queue_peak / queue_capacity : 0.f;
+  float step = (ctrl->max_kbps - ctrl->min_kbps) * BITRATE_CTRL_INCREASE;
+  float ceiling = ceiling_kbps(ctrl);
+
+  if (pressure >= BITRATE_CTRL_HIGH_PRESSURE) {
+    ctrl->target *= BITRATE_CTRL_DECREASE;
+    ctrl->calm = 0;
+  } else if (pressure > BITRATE_CTRL_LOW_PRESSURE) {
+    ctrl->calm = 0;
+  } else if (++ctrl->calm >= BITRATE_CTRL_CALM_INTERVALS &&
+             ctrl->target < ceiling) {
+    ctrl->target = fminf(ctrl->target + step, ceiling);
+  }
+  // the scene calmed down: give bits back gradually
+  if (ctrl->target > ceiling) {
+    ctrl->target = fmaxf(ctrl->target - step, ceiling);
+  }
+  ctrl->target = fmaxf(ctrl->target, (float)ctrl->min_kbps);
+  ctrl->target = fminf(ctrl->target, (float)ctrl->max_kbps);
+
+  ctrl->interval_start_us = now_us;
+  ctrl->queue_peak = 0;
+  ctrl->frames = 0;
+  ctrl->active_frames = 0;
+
+  int kbps = (int)(ctrl->target + 0.5f);
+  if (kbps == ctrl->kbps ||
+      fabsf((float)(kbps - ctrl->kbps)) < ctrl->kbps * BITRATE_CTRL_MIN_CHANGE) {
+    return 0;
+  }
+  ctrl->kbps = kbps;
+  return kbps;
+}
@@ -0,0 +1,54 @@
+#include "box_overlay.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+void box_overlay_map_box(const box_overlay_map_t *map, image_rect_t *box) {
+  box->left = (int)((float)(box->left - map->pad_x) / map->scale_x);
+  box->top = (int)((float)(box->top - map->pad_y) / map->scale_y);
+  box->right = (int)((float)(box->right - map->pad_x) / map->scale_x);
+  box->bottom = (int)((float)(box->bottom - map->pad_y) / map->scale_y);
+}
+
+void box_overlay_init(box_overlay_t *overlay, int width, int height,
+                      int thickness, int align) {
+  memset(overlay, 0, sizeof(box_overlay_t));
+  overlay->width = width;
+  overlay->height = height;
+  overlay->thickness = thickness;
+  overlay->align = align > 1 ? align : 1;
+}
+
+void box_overlay_reset(box_overlay_t *overlay) { overlay->n_rects = 0; }
+
+int box_overlay_add(box_overlay_t *overlay, const image_rect_t *box) {
+  if (overlay->n_rects >= BOX_OVERLAY_MAX) {
+    return -1;
+  }
+  int a = overlay->align;
+  int half = overlay->thickness / 2;
+  int left = std::max(0, box->left - half);
+  int top = std::max(0, box->top - half);
+  int right = std::min(overlay->width, box->right + 1 + half);
+  int bottom = std::min(overlay->height, box->bottom + 1 + half);
+  // outwards to the alignment, the frame size is a multiple of it
+  left = left / a * a;
+  top = top / a * a;
+  right = std::min(overlay->width, (right + a - 1) / a * a);
+  bottom = std::min(overlay->height, (bottom + a - 1) / a * a);
+  if (right <= left || bottom <= top) {
+    return -1;
+  }
+  // RGA wants lines that leave an inside
+  if (right - left <= 2 * overlay->thickness ||
+      bottom - top <= 2 * overlay->thickness) {
+    return BOX_OVERLAY_TOO_SMALL;
+  }
+  image_rect_t *r = &overlay->rects[overlay->n_rects];
+  r->left = left;
+  r->top = top;
+  r->right = right;
+  r->bottom = bottom;
+  return overlay->n_rects++;
+}
@@ -0,0 +1,108 @@
+#include "box_tracker.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+typedef struct {
+  float iou;
+  int det;
+  int slot;
+} track_match_t;
+
+float box_iou(const image_rect_t *a, const image_rect_t *b) {
+  int w = std::min(a->right, b->right) - std::max(a->left, b->left);
+  int h = std::min(a->bottom, b->bottom) - std::max(a->top, b->top);
+  if (w <= 0 || h <= 0) {
+    return 0.f;
+  }
+  float inter = (float)w * h;
+  float area_a = (float)(a->right - a->left) * (a->bottom - a->top);
+  float area_b = (float)(b->right - b->left) * (b->bottom - b->top);
+  float uni = area_a + area_b - inter;
+  return uni <= 0.f ? 0.f : inter / uni;
+}
+
+void box_tracker_init(box_tracker_t *tracker, float iou_threshold,
+                      int max_missed) {
+  memset(tracker, 0, sizeof(box_tracker_t));
+  tracker->next_id = 1;
+  tracker->iou_threshold = iou_threshold;
+  tracker->max_missed = max_missed;
+}
+
+int box_tracker_update(box_tracker_t *tracker,
+                       const object_detect_result_list *od_results,
+                       int *track_slots) {
+  int count = od_results->count;
+  bool slot_used[BOX_TRACK_MAX_NUM] = {false};
+  std::vector<track_match_t> matches;
+
+  for (int i = 0; i < count; i++) {
+    track_slots[i] = -1;
+    const object_detect_result *det = &od_results->results[i];
+    for (int s = 0; s < BOX_TRACK_MAX_NUM; s++) {
+      box_track_t *track = &tracker->tracks[s];
+      if (track->id == 0 || track->cls_id != det->cls_id) {
+        continue;
+      }
+      float iou = box_iou(&track->box, &det->box);
+      if (iou >= tracker->iou_threshold) {
+        matches.push_back({iou, i, s});
+      }
+    }
+  }
+  std::sort(matches.begin(), matches.end(),
+            [](const track_match_t &a, const track_match_t &b) {
+              return a.iou > b.iou;
+            });
+
+  for (size_t m = 0; m < matches.size(); m++) {
+    if (track_slots[matches[m].det] != -1 || slot_used[matches[m].slot]) {
+      continue;
+    }
+    box_track_t *track = &tracker->tracks[matches[m].slot];
+    track->box = od_results->results[matches[m].det].box;
+    track->hits++;
+    track->missed = 0;
+    track_slots[matches[m].det] = matches[m].slot;
+    slot_used[matches[m].slot] = true;
+  }
+
+  // age the tracks that were not seen this frame
+  for (int s = 0; s < BOX_TRACK_MAX_NUM; s++) {
+    box_track_t *track = &tracker->tracks[s];
+    if (track->id != 0 && !slot_used[s] &&
+        ++track->missed > tracker->max_missed) {
+      track->id = 0;
+    }
+  }
+
+  // new objects take the free slots
+  int s = 0;
+  for (int i = 0; i < count; i++) {
+    if (track_slots[i] != -1) {
+      continue;
+    }
+    while (s < BOX_TRACK_MAX_NUM &&
+           (tracker->tracks[s].id != 0 || slot_used[s])) {
+      s++;
+    }
+    if (s == BOX_TRACK_MAX_NUM) {
+      break;
+    }
+    box_track_t *track = &tracker->tracks[s];
+    track->id = tracker->next_id++;
+    if (tracker->next_id == 0) {
+      tracker->next_id = 1;
+    }
+    track->box = od_results->results[i].box;
+    track->cls_id = od_results->results[i].cls_id;
+    track->hits = 1;
+    track->missed = 0;
+    track_slots[i] = s;
+    slot_used[s] = true;
+  }
+  return 0;
+}
@@ -0,0 +1,324 @@
+#include "detect_bus.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// not every libc of the toolchains wraps memfd_create or knows the seals
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+#define DETECT_BUS_POLL_MS 500
+#define DETECT_BUS_READ_RETRIES 16
+
+static socklen_t abstract_addr(struct sockaddr_un *addr, const char *name) {
+  size_t len = strlen(name);
+  if (len > sizeof(addr->sun_path) - 1) {
+    len = sizeof(addr->sun_path) - 1;
+  }
+  memset(addr, 0, sizeof(struct sockaddr_un));
+  addr->sun_family = AF_UNIX;
+  // a leading NUL keeps the name out of the filesystem
+  memcpy(addr->sun_path + 1, name, len);
+  return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + len);
+}
+
+static int send_fd(int sock, int fd) {
+  char byte = 'D';
+  struct iovec iov = {&byte, 1};
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+static int recv_fd(int sock) {
+  char byte;
+  struct iovec iov = {&byte, 1};
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg;
+  int fd = -1;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) {
+    return -1;
+  }
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS) {
+    return -1;
+  }
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
+
+static void *serve_loop(void *arg) {
+  detect_bus_t *bus = (detect_bus_t *)arg;
+  struct pollfd pfd = {bus->listen_fd, POLLIN, 0};
+
+  while (bus->running.load(std::memory_order_relaxed)) {
+    if (poll(&pfd, 1, DETECT_BUS_POLL_MS) <= 0) {
+      continue;
+    }
+    int client = accept4(bus->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (client < 0) {
+      continue;
+    }
+    send_fd(client, bus->shm_fd);
+    close(client);
+  }
+  return NULL;
+}
+
+int detect_bus_open(detect_bus_t *bus, const char *name) {
+  struct sockaddr_un addr;
+
+  bus->shm = NULL;
+  bus->listen_fd = -1;
+  bus->shm_fd = syscall(SYS_memfd_create, "detect_bus",
+                        MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (bus->shm_fd < 0) {
+    printf("detect bus memfd_create fail!\n");
+    return -1;
+  }
+  if (ftruncate(bus->shm_fd, sizeof(detect_bus_shm_t)) < 0) {
+    printf("detect bus ftruncate fail!\n");
+    goto fail;
+  }
+  bus->shm = (detect_bus_shm_t *)mmap(NULL, sizeof(detect_bus_shm_t),
+                                      PROT_READ | PROT_WRITE, MAP_SHARED,
+                                      bus->shm_fd, 0);
+  if (bus->shm == MAP_FAILED) {
+    bus->shm = NULL;
+    printf("detect bus mmap fail!\n");
+    goto fail;
+  }
+  bus->shm->magic = DETECT_BUS_MAGIC;
+  bus->shm->version = DETECT_BUS_VERSION;
+  bus->shm->record_size = sizeof(detect_bus_record_t);
+  bus->shm->n_slots = DETECT_BUS_SLOTS;
+
+  // readers can neither resize the ring under us nor map it writable; the
+  // write seal needs 5.1+, older kernels still get the size seals
+  if (fcntl(bus->shm_fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) <
+      0) {
+    fcntl(bus->shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+  }
+
+  bus->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (bus->listen_fd < 0 ||
+      bind(bus->listen_fd, (struct sockaddr *)&addr,
+           abstract_addr(&addr, name)) < 0 ||
+      listen(bus->listen_fd, 4) < 0) {
+    printf("detect bus socket @%s fail!\n", name);
+    goto fail;
+  }
+
+  bus->running.store(true);
+  if (pthread_create(&bus->thread, NULL, serve_loop, bus) != 0) {
+    bus->running.store(false);
+    goto fail;
+  }
+  printf("detections published on @%s\n", name);
+  return 0;
+
+fail:
+  if (bus->listen_fd >= 0) {
+    close(bus->listen_fd);
+    bus->listen_fd = -1;
+  }
+  if (bus->shm != NULL) {
+    munmap(bus->shm, sizeof(detect_bus_shm_t));
+    bus->shm = NULL;
+  }
+  close(bus->shm_fd);
+  bus->shm_fd = -1;
+  return -1;
+}
+
+void detect_bus_close(detect_bus_t *bus) {
+  if (bus->shm == NULL) {
+    return;
+  }
+  bus->running.store(false);
+  pthread_join(bus->thread, NULL);
+  close(bus->listen_fd);
+  bus->listen_fd = -1;
+  // readers keep their mapping, the memory goes with the last of them
+  munmap(bus->shm, sizeof(detect_bus_shm_t));
+  bus->shm = NULL;
+  close(bus->shm_fd);
+  bus->shm_fd = -1;
+}
+
+void detect_bus_publish(detect_bus_t *bus, uint64_t timestamp_us, int width,
+                        int height, const object_detect_result_list *results) {
+  if (bus->shm == NULL) {
+    return;
+  }
+  uint32_t n = bus->shm->published.load(std::memory_order_relaxed);
+  detect_bus_slot_t *slot = &bus->shm->slots[n & (DETECT_BUS_SLOTS - 1)];
+  uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+
+  slot->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->rec.frame_id = n;
+  slot->rec.timestamp_us = timestamp_us;
+  slot->rec.width = width;
+  slot->rec.height = height;
+  slot->rec.count = results->count;
+  memcpy(slot->rec.results, results->results,
+         results->count * sizeof(object_detect_result));
+  slot->seq.store(seq + 2, std::memory_order_release);
+  bus->shm->published.store(n + 1, std::memory_order_release);
+}
+
+int detect_bus_reader_open(detect_bus_reader_t *reader, const char *name) {
+  struct sockaddr_un addr;
+
+  reader->shm = NULL;
+  reader->shm_fd = -1;
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    return -1;
+  }
+  if (connect(sock, (struct sockaddr *)&addr, abstract_addr(&addr, name)) <
+      0) {
+    printf("detect bus @%s not running\n", name);
+    close(sock);
+    return -1;
+  }
+  reader->shm_fd = recv_fd(sock);
+  close(sock);
+  if (reader->shm_fd < 0) {
+    printf("detect bus fd not received\n");
+    return -1;
+  }
+
+  void *shm = mmap(NULL, sizeof(detect_bus_shm_t), PROT_READ, MAP_SHARED,
+                   reader->shm_fd, 0);
+  if (shm == MAP_FAILED) {
+    printf("detect bus mmap fail!\n");
+    close(reader->shm_fd);
+    reader->shm_fd = -1;
+    return -1;
+  }
+  reader->shm = (const detect_bus_shm_t *)shm;
+  if (reader->shm->magic != DETECT_BUS_MAGIC ||
+      reader->shm->version != DETECT_BUS_VERSION ||
+      reader->shm->record_size != sizeof(detect_bus_record_t) ||
+      reader->shm->n_slots != DETECT_BUS_SLOTS) {
+    printf("detect bus version %u, reader built for %u\n",
+           reader->shm->version, DETECT_BUS_VERSION);
+    detect_bus_reader_close(reader);
+    return -1;
+  }
+  reader->next = reader->shm->published.load(std::memory_order_acquire);
+  return 0;
+}
+
+void detect_bus_reader_close(detect_bus_reader_t *reader) {
+  if (reader->shm != NULL) {
+    munmap((void *)reader->shm, sizeof(detect_bus_shm_t));
+    reader->shm = NULL;
+  }
+  if (reader->shm_fd >= 0) {
+    close(reader->shm_fd);
+    reader->shm_fd = -1;
+  }
+}
+
+// Copy record n out of its slot, false if it was torn or already replaced
+static bool read_record(const detect_bus_shm_t *shm, uint32_t n,
+                        detect_bus_record_t *rec) {
+  const detect_bus_slot_t *slot = &shm->slots[n & (DETECT_BUS_SLOTS - 1)];
+  uint32_t seq = slot->seq.load(std::memory_order_acquire);
+  if (seq & 1) {
+    return false;
+  }
+  memcpy(rec, &slot->rec, offsetof(detect_bus_record_t, results));
+  // count may be garbage in a torn copy, the check below throws it away
+  int count = rec->count;
+  if (count < 0) {
+    count = 0;
+  } else if (count > OBJ_NUMB_MAX_SIZE) {
+    count = OBJ_NUMB_MAX_SIZE;
+  }
+  memcpy(rec->results, slot->rec.results, count * sizeof(object_detect_result));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot->seq.load(std::memory_order_relaxed) != seq) {
+    return false;
+  }
+  return (uint32_t)rec->frame_id == n;
+}
+
+int detect_bus_read_latest(detect_bus_reader_t *reader,
+                           detect_bus_record_t *rec) {
+  for (int i = 0; i < DETECT_BUS_READ_RETRIES; i++) {
+    uint32_t published = reader->shm->published.load(std::memory_order_acquire);
+    if (published == 0) {
+      return -1;
+    }
+    if (read_record(reader->shm, published - 1, rec)) {
+      reader->next = published;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int detect_bus_read_next(detect_bus_reader_t *reader, detect_bus_record_t *rec,
+                         uint32_t *missed) {
+  while (1) {
+    uint32_t published = reader->shm->published.load(std::memory_order_acquire);
+    if (reader->next == published) {
+      return 0;
+    }
+    // the oldest slot may already be rewritten, stay one slot clear of it
+    uint32_t behind = published - reader->next;
+    if (behind > DETECT_BUS_SLOTS - 1) {
+      *missed += behind - (DETECT_BUS_SLOTS - 1);
+      reader->next = published - (DETECT_BUS_SLOTS - 1);
+    }
+    if (read_record(reader->shm, reader->next, rec)) {
+      reader->next++;
+      return 1;
+    }
+    reader->next++;
+    (*missed)++;
+  }
+}
@@ -0,0 +1,309 @@
+#include "detect_stream.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define DETECT_STREAM_MAGIC0 'D'
+#define DETECT_STREAM_MAGIC1 'S'
+#define VARINT_MAX_BYTES 10
+
+typedef struct {
+  uint8_t *p;
+  uint8_t *end;
+} byte_writer;
+
+typedef struct {
+  const uint8_t *p;
+  const uint8_t *end;
+  bool ok;
+} byte_reader;
+
+static void put_byte(byte_writer *w, uint8_t v) {
+  if (w->p < w->end) {
+    *w->p = v;
+  }
+  w->p++; // past end marks an overflow, checked by the caller
+}
+
+static void put_varint(byte_writer *w, uint64_t v) {
+  while (v >= 0x80) {
+    put_byte(w, (uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  put_byte(w, (uint8_t)v);
+}
+
+static void put_zigzag(byte_writer *w, int64_t v) {
+  put_varint(w, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static uint8_t get_byte(byte_reader *r) {
+  if (r->p >= r->end) {
+    r->ok = false;
+    return 0;
+  }
+  return *r->p++;
+}
+
+static uint64_t get_varint(byte_reader *r) {
+  uint64_t v = 0;
+  for (int i = 0; i < VARINT_MAX_BYTES && r->ok; i++) {
+    uint8_t b = get_byte(r);
+    v |= (uint64_t)(b & 0x7f) << (7 * i);
+    if ((b & 0x80) == 0) {
+      return v;
+    }
+  }
+  r->ok = false;
+  return 0;
+}
+
+static int64_t get_zigzag(byte_reader *r) {
+  uint64_t v = get_varint(r);
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+int detect_stream_open(detect_stream_t *stream, const char *dest) {
+  char host[64];
+  const char *colon = strrchr(dest, ':');
+
+  memset(stream, 0, sizeof(detect_stream_t));
+  stream->fd = -1;
+  if (colon == NULL || (size_t)(colon - dest) >= sizeof(host)) {
+    printf("detect stream destination %s is not ip:port\n", dest);
+    return -1;
+  }
+  memcpy(host, dest, colon - dest);
+  host[colon - dest] = '\0';
+  stream->dest.sin_family = AF_INET;
+  stream->dest.sin_port = htons(atoi(colon + 1));
+  if (inet_pton(AF_INET, host, &stream->dest.sin_addr) != 1) {
+    printf("detect stream destination %s is not ip:port\n", dest);
+    return -1;
+  }
+
+  stream->fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (stream->fd < 0) {
+    printf("detect stream socket fail!\n");
+    return -1;
+  }
+  if (IN_MULTICAST(ntohl(stream->dest.sin_addr.s_addr))) {
+    // stay on the camera's own network segment
+    unsigned char ttl = 1;
+    setsockopt(stream->fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  }
+  printf("detections streamed to %s\n", dest);
+  return 0;
+}
+
+void detect_stream_close(detect_stream_t *stream) {
+  if (stream->fd < 0) {
+    return;
+  }
+  detect_stream_flush(stream);
+  close(stream->fd);
+  stream->fd = -1;
+}
+
+static void begin_packet(detect_stream_t *stream, int width, int height) {
+  byte_writer w = {stream->packet, stream->packet + DETECT_STREAM_MTU};
+  put_byte(&w, DETECT_STREAM_MAGIC0);
+  put_byte(&w, DETECT_STREAM_MAGIC1);
+  put_byte(&w, DETECT_STREAM_VERSION);
+  put_byte(&w, 0); // n_frames, patched as frames are added
+  put_varint(&w, stream->packet_seq);
+  put_varint(&w, width);
+  put_varint(&w, height);
+  stream->len = w.p - stream->packet;
+  stream->width = width;
+  stream->height = height;
+}
+
+int detect_stream_flush(detect_stream_t *stream) {
+  if (stream->fd < 0 || stream->n_frames == 0) {
+    return 0;
+  }
+  stream->packet[3] = stream->n_frames;
+  ssize_t ret = sendto(stream->fd, stream->packet, stream->len, MSG_DONTWAIT,
+                       (struct sockaddr *)&stream->dest, sizeof(stream->dest));
+  // a full socket buffer drops the packet, the loop must not wait on it
+  stream->packet_seq++;
+  stream->n_frames = 0;
+  stream->len = 0;
+  return ret < 0 ? -1 : 0;
+}
+
+// Frame header as it would be written at the current packet position
+static size_t encode_frame_header(detect_stream_t *stream, uint8_t *buf,
+                                  uint32_t frame_id, uint64_t pts_us,
+                                  uint8_t flags, int count) {
+  byte_writer w = {buf, buf + 3 * VARINT_MAX_BYTES + 1};
+  if (stream->n_frames == 0) {
+    put_varint(&w, frame_id);
+    put_varint(&w, pts_us);
+  } else {
+    put_varint(&w, frame_id - stream->last_frame_id);
+    put_varint(&w, pts_us - stream->last_pts_us);
+  }
+  put_byte(&w, flags);
+  put_varint(&w, count);
+  return w.p - buf;
+}
+
+int detect_stream_send(detect_stream_t *stream, uint32_t frame_id,
+                       uint64_t pts_us, int width, int height,
+                       const object_detect_result_list *results,
+                       const uint32_t *object_ids) {
+  uint8_t body[DETECT_STREAM_MTU];
+  size_t ends[OBJ_NUMB_MAX_SIZE + 1];
+  uint8_t header[3 * VARINT_MAX_BYTES + 1];
+
+  if (stream->fd < 0) {
+    return -1;
+  }
+
+  // objects are encoded once, then as many as fit the datagram are taken
+  byte_writer w = {body, body + sizeof(body)};
+  int prev_left = 0, prev_top = 0;
+  uint32_t prev_id = 0;
+  int encoded = 0;
+  ends[0] = 0;
+  for (int i = 0; i < results->count; i++) {
+    const object_detect_result *det = &results->results[i];
+    int box_w = det->box.right - det->box.left;
+    int box_h = det->box.bottom - det->box.top;
+    float prop = det->prop < 0 ? 0 : (det->prop > 1 ? 1 : det->prop);
+
+    put_zigzag(&w, (int64_t)det->box.left - prev_left);
+    put_zigzag(&w, (int64_t)det->box.top - prev_top);
+    put_varint(&w, box_w > 0 ? box_w : 0);
+    put_varint(&w, box_h > 0 ? box_h : 0);
+    put_varint(&w, det->cls_id > 0 ? det->cls_id : 0);
+    put_byte(&w, (uint8_t)(prop * 255 + 0.5f));
+    if (object_ids != NULL) {
+      put_zigzag(&w, (int64_t)object_ids[i] - prev_id);
+      prev_id = object_ids[i];
+    }
+    if (w.p > w.end) {
+      break;
+    }
+    prev_left = det->box.left;
+    prev_top = det->box.top;
+    ends[++encoded] = w.p - body;
+  }
+
+  if (stream->n_frames > 0 &&
+      (width != stream->width || height != stream->height)) {
+    detect_stream_flush(stream);
+  }
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (stream->n_frames == 0) {
+      begin_packet(stream, width, height);
+    }
+    size_t room = DETECT_STREAM_MTU - stream->len;
+    int count = encoded;
+    size_t header_len = 0;
+    while (1) {
+      uint8_t flags = object_ids != NULL ? DETECT_STREAM_FLAG_IDS : 0;
+      if (count < results->count) {
+        flags |= DETECT_STREAM_FLAG_TRUNCATED;
+      }
+      header_len = encode_frame_header(stream, header, frame_id, pts_us,
+                                       flags, count);
+      if (header_len + ends[count] <= room || count == 0) {
+        break;
+      }
+      count--;
+    }
+    // rather start a new packet than cut objects from this frame
+    if (header_len + ends[count] > room ||
+        (count < encoded && stream->n_frames > 0)) {
+      detect_stream_flush(stream);
+      continue;
+    }
+
+    memcpy(stream->packet + stream->len, header, header_len);
+    memcpy(stream->packet + stream->len + header_len, body, ends[count]);
+    stream->len += header_len + ends[count];
+    uint64_t interval_us = pts_us - stream->last_pts_us;
+    if (stream->n_frames++ == 0) {
+      stream->first_pts_us = pts_us;
+    }
+    stream->last_frame_id = frame_id;
+    stream->last_pts_us = pts_us;
+
+    // batch only while frames come faster than the window; a slow stream
+    // would otherwise hold every frame until the next one arrives
+    if (stream->n_frames >= DETECT_STREAM_MAX_BATCH ||
+        pts_us - stream->first_pts_us >= DETECT_STREAM_BATCH_US ||
+        interval_us >= DETECT_STREAM_BATCH_US ||
+        DETECT_STREAM_MTU - stream->len < 16) {
+      return detect_stream_flush(stream);
+    }
+    return 0;
+  }
+  return -1;
+}
+
+int detect_stream_decode(const uint8_t *data, size_t len, uint32_t *packet_seq,
+                         std::vector<detect_stream_frame_t> &frames) {
+  byte_reader r = {data, data + len, true};
+  size_t first = frames.size();
+
+  if (get_byte(&r) != DETECT_STREAM_MAGIC0 ||
+      get_byte(&r) != DETECT_STREAM_MAGIC1 ||
+      get_byte(&r) != DETECT_STREAM_VERSION) {
+    return -1;
+  }
+  int n_frames = get_byte(&r);
+  *packet_seq = (uint32_t)get_varint(&r);
+  int width = (int)get_varint(&r);
+  int height = (int)get_varint(&r);
+
+  uint32_t frame_id = 0;
+  uint64_t pts_us = 0;
+  for (int f = 0; f < n_frames && r.ok; f++) {
+    frames.resize(frames.size() + 1);
+    detect_stream_frame_t *frame = &frames.back();
+    frame_id += (uint32_t)get_varint(&r);
+    pts_us += get_varint(&r);
+    frame->frame_id = frame_id;
+    frame->pts_us = pts_us;
+    frame->width = width;
+    frame->height = height;
+    frame->flags = get_byte(&r);
+    uint64_t count = get_varint(&r);
+    if (count > OBJ_NUMB_MAX_SIZE) {
+      r.ok = false;
+      break;
+    }
+    frame->count = (int)count;
+
+    int left = 0, top = 0;
+    uint32_t object_id = 0;
+    for (int i = 0; i < frame->count && r.ok; i++) {
+      object_detect_result *det = &frame->results[i];
+      left += (int)get_zigzag(&r);
+      top += (int)get_zigzag(&r);
+      det->box.left = left;
+      det->box.top = top;
+      det->box.right = left + (int)get_varint(&r);
+      det->box.bottom = top + (int)get_varint(&r);
+      det->cls_id = (int)get_varint(&r);
+      det->prop = get_byte(&r) / 255.0f;
+      if (frame->flags & DETECT_STREAM_FLAG_IDS) {
+        object_id += (uint32_t)get_zigzag(&r);
+      }
+      frame->object_ids[i] = object_id;
+    }
+  }
+  if (!r.ok || r.p != r.end) {
+    frames.resize(first);
+    return -1;
+  }
+  return n_frames;
+}
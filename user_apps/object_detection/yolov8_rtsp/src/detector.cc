@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "async_log.h"
+#include "detector.h"
+#include "latency_trace.h"
+#include "pipeline_trace.h"
+#include "rknn_perf.h"
+#include "ssd_postprocess.h"
+
+static uint64_t get_now_us() {
+  struct timespec time = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000 + (uint64_t)time.tv_nsec / 1000;
+}
+
+static void get_model_input_spec(rknn_app_context_t *app_ctx,
+                                 detector_preprocess_spec *spec) {
+  spec->width = app_ctx->model_width;
+  spec->height = app_ctx->model_height;
+  spec->channel = app_ctx->model_channel;
+}
+
+/*
+ * YOLOv8
+ */
+static int yolov8_init(const char *model_path, rknn_app_context_t *app_ctx) {
+  if (init_yolov8_model(model_path, app_ctx) != 0) {
+    return -1;
+  }
+  return init_post_process();
+}
+
+static int yolov8_release(rknn_app_context_t *app_ctx) {
+  deinit_post_process();
+  return release_yolov8_model(app_ctx);
+}
+
+static void yolov8_preprocess_spec(rknn_app_context_t *app_ctx,
+                                   detector_preprocess_spec *spec) {
+  get_model_input_spec(app_ctx, spec);
+  spec->letterbox = true;
+  spec->pad_value = 0;
+}
+
+static int yolov8_decode(rknn_app_context_t *app_ctx, float conf_threshold,
+                         float nms_threshold,
+                         object_detect_result_list *od_results) {
+  return post_process(app_ctx, app_ctx->output_mems, conf_threshold,
+                      nms_threshold, od_results);
+}
+
+/*
+ * SSD-MobileNet, box regression against rknn_box_priors.h
+ */
+static int ssd_init(const char *model_path, rknn_app_context_t *app_ctx) {
+  // the zero-copy loader is model agnostic
+  if (init_yolov8_model(model_path, app_ctx) != 0) {
+    return -1;
+  }
+  if (init_ssd_post_process() != 0 || ssd_post_process_check(app_ctx) != 0) {
+    return -1;
+  }
+  return init_post_process();
+}
+
+static int ssd_release(rknn_app_context_t *app_ctx) {
+  deinit_ssd_post_process();
+  deinit_post_process();
+  return release_yolov8_model(app_ctx);
+}
+
+static void ssd_preprocess_spec(rknn_app_context_t *app_ctx,
+                                detector_preprocess_spec *spec) {
+  get_model_input_spec(app_ctx, spec);
+  // priors are normalized to the full input, the frame is stretched
+  spec->letterbox = false;
+  spec->pad_value = 0;
+}
+
+static int ssd_decode(rknn_app_context_t *app_ctx, float conf_threshold,
+                      float nms_threshold,
+                      object_detect_result_list *od_results) {
+  return ssd_post_process(app_ctx, app_ctx->output_mems, conf_threshold,
+                          nms_threshold, od_results);
+}
+
+static const detector_backend_t detector_backends[] = {
+    {"yolov8", yolov8_init, yolov8_release, yolov8_preprocess_spec,
+     yolov8_decode},
+    {"ssd", ssd_init, ssd_release, ssd_preprocess_spec, ssd_decode},
+};
+
+const detector_backend_t *get_detector_backend(const char *name) {
+  for (size_t i = 0;
+       i < sizeof(detector_backends) / sizeof(detector_backends[0]); i++) {
+    if (strcmp(detector_backends[i].name, name) == 0) {
+      return &detector_backends[i];
+    }
+  }
+  return NULL;
+}
+
+int detector_inference(const detector_backend_t *backend,
+                       rknn_app_context_t *app_ctx,
+                       object_detect_result_list *od_results) {
+  int ret;
+
+  if ((!backend) || (!app_ctx) || (!od_results)) {
+    return -1;
+  }
+
+  LATENCY_TRACE_MARK(TRACE_NPU_SUBMIT);
+  PIPELINE_TRACE_BEGIN(TRACE_TRACK_NPU, "detector");
+  ret = rknn_run(app_ctx->rknn_ctx, nullptr);
+  PIPELINE_TRACE_END(TRACE_TRACK_NPU, "detector");
+  if (ret < 0) {
+    ALOGE("rknn_run fail! ret=%d\n", ret);
+    return -1;
+  }
+  LATENCY_TRACE_MARK(TRACE_NPU_DONE);
+  if (app_ctx->perf != NULL) {
+    rknn_perf_collect(app_ctx->perf, app_ctx->rknn_ctx);
+  }
+
+  PIPELINE_TRACE_BEGIN(TRACE_TRACK_CPU, "decode");
+  ret = backend->decode(app_ctx, BOX_THRESH, NMS_THRESH, od_results);
+  PIPELINE_TRACE_END(TRACE_TRACK_CPU, "decode");
+  LATENCY_TRACE_MARK(TRACE_POSTPROCESS);
+  return ret;
+}
+
+int detector_warmup(rknn_app_context_t *app_ctx, frame_buffer_t *input) {
+  uint64_t start_us = get_now_us();
+
+  // through the frame buffer, so the zeros reach the NPU and its cache
+  // state stays right for the first real frame
+  frame_buffer_sync_for_cpu(input);
+  memset(input->vaddr, 0, input->size);
+  frame_buffer_cpu_wrote(input);
+  frame_buffer_sync_for_device(input);
+  int ret = rknn_run(app_ctx->rknn_ctx, nullptr);
+  if (ret < 0) {
+    printf("warm-up rknn_run fail! ret=%d\n", ret);
+    return -1;
+  }
+  printf("model warm-up %llu us\n",
+         (unsigned long long)(get_now_us() - start_us));
+  return 0;
+}
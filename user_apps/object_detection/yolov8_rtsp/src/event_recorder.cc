@@ -0,0 +1,297 @@
+#include "event_recorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame_ring.h"
+#include "ts_mux.h"
+
+#define EVENT_MAX_NALS 16
+
+struct _event_recorder {
+  char dir[128];
+  nal_codec codec;
+
+  pthread_mutex_t lock; // guards ring and the fields up to thread
+  pthread_cond_t cond;
+  frame_ring_t ring;
+  bool triggered; // a trigger arrived while no clip was open
+  bool recording;
+  uint64_t stop_us; // frames up to this PTS go into the clip
+  bool running;
+
+  pthread_t thread;
+  bool started;
+
+  // writer thread only
+  int fd;
+  char path[192];
+  ts_mux_t mux;
+  uint8_t *staging;
+  size_t staged;
+  uint64_t seq; // next frame to mux
+  uint64_t clip_start_us;
+  uint64_t clip_end_us;
+  uint32_t clip_frames;
+  uint64_t clip_bytes;
+  uint32_t gaps;
+  bool write_error;
+};
+
+static int write_all(int fd, const uint8_t *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    data += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static void flush_staging(event_recorder_t *rec) {
+  if (rec->staged == 0 || rec->write_error) {
+    rec->staged = 0;
+    return;
+  }
+  if (write_all(rec->fd, rec->staging, rec->staged) < 0) {
+    printf("event clip %s write fail: %s\n", rec->path, strerror(errno));
+    rec->write_error = true;
+  }
+  rec->clip_bytes += rec->staged;
+  rec->staged = 0;
+}
+
+static int open_clip(event_recorder_t *rec) {
+  char stamp[32];
+  struct tm tm;
+  time_t now = time(NULL);
+  localtime_r(&now, &tm);
+  strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &tm);
+
+  // a second clip within the same second gets a suffix
+  for (int i = 0; i < 10; i++) {
+    if (i == 0) {
+      snprintf(rec->path, sizeof(rec->path), "%s/event_%s.ts", rec->dir,
+               stamp);
+    } else {
+      snprintf(rec->path, sizeof(rec->path), "%s/event_%s_%d.ts", rec->dir,
+               stamp, i);
+    }
+    rec->fd = open(rec->path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (rec->fd >= 0 || errno != EEXIST) {
+      break;
+    }
+  }
+  if (rec->fd < 0) {
+    printf("event clip %s open fail: %s\n", rec->path, strerror(errno));
+    return -1;
+  }
+  ts_mux_init(&rec->mux, rec->codec);
+  rec->staged = 0;
+  rec->clip_frames = 0;
+  rec->clip_bytes = 0;
+  rec->gaps = 0;
+  rec->write_error = false;
+  printf("event clip %s started\n", rec->path);
+  return 0;
+}
+
+static void close_clip(event_recorder_t *rec) {
+  flush_staging(rec);
+  // the clip is complete on flash before the next one starts
+  fdatasync(rec->fd);
+  close(rec->fd);
+  rec->fd = -1;
+  printf("event clip %s: %u frames, %.1f s, %llu KB, %u gaps\n", rec->path,
+         rec->clip_frames, (rec->clip_end_us - rec->clip_start_us) / 1e6,
+         (unsigned long long)rec->clip_bytes / 1024, rec->gaps);
+}
+
+// The lock is dropped around file I/O only
+static void *writer_loop(void *arg) {
+  event_recorder_t *rec = (event_recorder_t *)arg;
+  frame_ring_t *ring = &rec->ring;
+
+  pthread_mutex_lock(&rec->lock);
+  while (1) {
+    if (!rec->recording) {
+      while (rec->running && !rec->triggered) {
+        pthread_cond_wait(&rec->cond, &rec->lock);
+      }
+      if (!rec->triggered) {
+        break;
+      }
+      rec->triggered = false;
+      // pre-roll: everything still in the ring, which starts at a key frame
+      rec->seq = ring->head;
+      ring->pin = rec->seq;
+      rec->recording = true;
+      pthread_mutex_unlock(&rec->lock);
+      int ret = open_clip(rec);
+      pthread_mutex_lock(&rec->lock);
+      if (ret < 0) {
+        ring->pin = FRAME_RING_NO_PIN;
+        rec->recording = false;
+      }
+      continue;
+    }
+
+    while (rec->running && rec->seq >= ring->tail) {
+      pthread_cond_wait(&rec->cond, &rec->lock);
+    }
+    if (rec->seq >= ring->tail) {
+      // stopping, keep what was recorded so far
+      pthread_mutex_unlock(&rec->lock);
+      close_clip(rec);
+      pthread_mutex_lock(&rec->lock);
+      ring->pin = FRAME_RING_NO_PIN;
+      rec->recording = false;
+      break;
+    }
+    if (rec->seq < ring->head) {
+      // the ring overtook the writer, continue at its oldest key frame
+      rec->gaps++;
+      rec->seq = ring->head;
+    }
+
+    const frame_ring_entry_t *e = frame_ring_get(ring, rec->seq);
+    bool done = e->pts_us > rec->stop_us || rec->write_error;
+    bool split = rec->clip_frames > 0 && e->keyframe &&
+                 e->pts_us - rec->clip_start_us >= EVENT_MAX_CLIP_US;
+    if (done || split) {
+      if (done) {
+        ring->pin = FRAME_RING_NO_PIN;
+        rec->recording = false;
+      }
+      pthread_mutex_unlock(&rec->lock);
+      close_clip(rec);
+      int ret = split && !done ? open_clip(rec) : 0;
+      pthread_mutex_lock(&rec->lock);
+      if (ret < 0) {
+        ring->pin = FRAME_RING_NO_PIN;
+        rec->recording = false;
+      }
+      continue;
+    }
+
+    size_t need = ts_mux_max_size(e->len);
+    if (need > EVENT_WRITE_BYTES) {
+      printf("event frame of %u bytes does not fit the staging buffer\n",
+             e->len);
+      rec->seq++;
+      continue;
+    }
+    if (rec->staged + need > EVENT_WRITE_BYTES) {
+      pthread_mutex_unlock(&rec->lock);
+      flush_staging(rec);
+      pthread_mutex_lock(&rec->lock);
+      continue;
+    }
+    if (rec->clip_frames == 0) {
+      rec->clip_start_us = e->pts_us;
+    }
+    rec->clip_end_us = e->pts_us;
+    rec->staged += ts_mux_write(&rec->mux, frame_ring_data(ring, e), e->len,
+                                e->pts_us, e->keyframe,
+                                rec->staging + rec->staged,
+                                EVENT_WRITE_BYTES - rec->staged);
+    rec->clip_frames++;
+    rec->seq++;
+    ring->pin = rec->seq;
+  }
+  pthread_mutex_unlock(&rec->lock);
+  return NULL;
+}
+
+event_recorder_t *event_recorder_create(const char *dir, nal_codec codec) {
+  if (access(dir, W_OK) != 0) {
+    printf("event dir %s not writable!\n", dir);
+    return NULL;
+  }
+  event_recorder_t *rec = new event_recorder_t();
+  snprintf(rec->dir, sizeof(rec->dir), "%s", dir);
+  rec->codec = codec;
+  rec->fd = -1;
+  pthread_mutex_init(&rec->lock, NULL);
+  pthread_cond_init(&rec->cond, NULL);
+
+  rec->staging = (uint8_t *)malloc(EVENT_WRITE_BYTES);
+  if (rec->staging == NULL ||
+      frame_ring_init(&rec->ring, EVENT_RING_BYTES, EVENT_RING_FRAMES,
+                      EVENT_PREROLL_US) < 0) {
+    printf("event recorder alloc fail!\n");
+    event_recorder_destroy(rec);
+    return NULL;
+  }
+
+  rec->running = true;
+  if (pthread_create(&rec->thread, NULL, writer_loop, rec) != 0) {
+    printf("event recorder thread create fail!\n");
+    event_recorder_destroy(rec);
+    return NULL;
+  }
+  rec->started = true;
+  return rec;
+}
+
+int event_recorder_push(event_recorder_t *rec, const uint8_t *data,
+                        size_t len, uint64_t pts_us) {
+  nal_unit_t nals[EVENT_MAX_NALS];
+  int n_nals = nal_split(rec->codec, data, len, nals, EVENT_MAX_NALS);
+  bool keyframe = false;
+  for (int i = 0; i < n_nals; i++) {
+    keyframe |= nal_is_keyframe(rec->codec, nals[i].type);
+  }
+
+  pthread_mutex_lock(&rec->lock);
+  int ret = frame_ring_push(&rec->ring, data, len, pts_us, keyframe);
+  bool wake = rec->recording;
+  pthread_mutex_unlock(&rec->lock);
+  if (wake) {
+    pthread_cond_signal(&rec->cond);
+  }
+  return ret;
+}
+
+void event_recorder_trigger(event_recorder_t *rec, uint64_t pts_us) {
+  pthread_mutex_lock(&rec->lock);
+  uint64_t stop_us = pts_us + EVENT_POSTROLL_US;
+  bool wake = !rec->recording && !rec->triggered;
+  if (wake || stop_us > rec->stop_us) {
+    rec->stop_us = stop_us;
+  }
+  rec->triggered |= !rec->recording;
+  pthread_mutex_unlock(&rec->lock);
+  if (wake) {
+    pthread_cond_signal(&rec->cond);
+  }
+}
+
+void event_recorder_destroy(event_recorder_t *rec) {
+  if (rec == NULL) {
+    return;
+  }
+  if (rec->started) {
+    pthread_mutex_lock(&rec->lock);
+    rec->running = false;
+    pthread_mutex_unlock(&rec->lock);
+    pthread_cond_signal(&rec->cond);
+    pthread_join(rec->thread, NULL);
+  }
+  frame_ring_deinit(&rec->ring);
+  free(rec->staging);
+  pthread_cond_destroy(&rec->cond);
+  pthread_mutex_destroy(&rec->lock);
+  delete rec;
+}
@@ -0,0 +1,143 @@
+#include "frame_buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "async_log.h"
+
+frame_buffer_t *frame_buffer_wrap(int fd, void *vaddr, size_t size, int width,
+                                  int height, int stride, int format,
+                                  const frame_buffer_ops_t *ops,
+                                  void *origin) {
+  frame_buffer_t *buf = (frame_buffer_t *)calloc(1, sizeof(frame_buffer_t));
+  if (buf == NULL) {
+    return NULL;
+  }
+  buf->fd = fd;
+  buf->vaddr = vaddr;
+  buf->size = size;
+  buf->width = width;
+  buf->height = height;
+  buf->stride = stride;
+  buf->format = format;
+  buf->cache = FRAME_BUFFER_CLEAN;
+  buf->ops = ops;
+  buf->origin = origin;
+  buf->refs = 1;
+  pthread_mutex_init(&buf->lock, NULL);
+  return buf;
+}
+
+frame_buffer_t *frame_buffer_ref(frame_buffer_t *buf) {
+  __atomic_add_fetch(&buf->refs, 1, __ATOMIC_RELAXED);
+  return buf;
+}
+
+void frame_buffer_unref(frame_buffer_t *buf) {
+  if (buf == NULL || __atomic_sub_fetch(&buf->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+    return;
+  }
+  // the handles point into the memory, so they go before it
+  if (buf->rga_handle != 0) {
+    releasebuffer_handle(buf->rga_handle);
+  }
+  if (buf->rknn_mem != NULL && buf->owns_rknn_mem) {
+    rknn_destroy_mem(buf->rknn_ctx, buf->rknn_mem);
+  }
+  if (buf->ops != NULL && buf->ops->release != NULL) {
+    buf->ops->release(buf);
+  }
+  pthread_mutex_destroy(&buf->lock);
+  free(buf);
+}
+
+int frame_buffer_sync_for_device(frame_buffer_t *buf) {
+  if (buf->cache != FRAME_BUFFER_CPU_DIRTY) {
+    return 0;
+  }
+  int ret = 0;
+  if (buf->ops != NULL && buf->ops->flush != NULL) {
+    ret = buf->ops->flush(buf);
+  }
+  buf->cache = FRAME_BUFFER_CLEAN;
+  return ret;
+}
+
+int frame_buffer_sync_for_cpu(frame_buffer_t *buf) {
+  if (buf->cache != FRAME_BUFFER_DEVICE_DIRTY) {
+    return 0;
+  }
+  int ret = 0;
+  if (buf->ops != NULL && buf->ops->invalidate != NULL) {
+    ret = buf->ops->invalidate(buf);
+  }
+  buf->cache = FRAME_BUFFER_CLEAN;
+  return ret;
+}
+
+void frame_buffer_cpu_wrote(frame_buffer_t *buf) {
+  buf->cache = FRAME_BUFFER_CPU_DIRTY;
+}
+
+void frame_buffer_device_wrote(frame_buffer_t *buf) {
+  buf->cache = FRAME_BUFFER_DEVICE_DIRTY;
+}
+
+rga_buffer_handle_t frame_buffer_rga_handle(frame_buffer_t *buf) {
+  pthread_mutex_lock(&buf->lock);
+  if (buf->rga_handle == 0) {
+    buf->rga_handle = importbuffer_fd(buf->fd, buf->size);
+    if (buf->rga_handle == 0) {
+      ALOGE("rga importbuffer_fd %d fail!\n", buf->fd);
+    }
+  }
+  rga_buffer_handle_t handle = buf->rga_handle;
+  pthread_mutex_unlock(&buf->lock);
+  return handle;
+}
+
+// Bytes per pixel of the first plane, for the stride in pixels RGA wants
+static int rga_bytes_per_pixel(int format) {
+  switch (format) {
+  case RK_FORMAT_RGBA_8888:
+  case RK_FORMAT_BGRA_8888:
+  case RK_FORMAT_RGBX_8888:
+  case RK_FORMAT_BGRX_8888:
+    return 4;
+  case RK_FORMAT_RGB_888:
+  case RK_FORMAT_BGR_888:
+    return 3;
+  case RK_FORMAT_RGB_565:
+  case RK_FORMAT_BGR_565:
+    return 2;
+  default: // YUV planes
+    return 1;
+  }
+}
+
+rga_buffer_t frame_buffer_rga(frame_buffer_t *buf) {
+  int wstride = buf->stride / rga_bytes_per_pixel(buf->format);
+  return wrapbuffer_handle(frame_buffer_rga_handle(buf), buf->width,
+                           buf->height, buf->format, wstride, buf->height);
+}
+
+rknn_tensor_mem *frame_buffer_rknn_mem(frame_buffer_t *buf,
+                                       rknn_context ctx) {
+  pthread_mutex_lock(&buf->lock);
+  rknn_tensor_mem *mem = NULL;
+  if (buf->rknn_mem == NULL) {
+    buf->rknn_mem = rknn_create_mem_from_fd(ctx, buf->fd, buf->vaddr,
+                                            buf->size, 0);
+    if (buf->rknn_mem != NULL) {
+      buf->rknn_ctx = ctx;
+      buf->owns_rknn_mem = true;
+    } else {
+      ALOGE("rknn_create_mem_from_fd %d fail!\n", buf->fd);
+    }
+  }
+  if (buf->rknn_mem != NULL && buf->rknn_ctx == ctx) {
+    mem = buf->rknn_mem;
+  }
+  pthread_mutex_unlock(&buf->lock);
+  return mem;
+}
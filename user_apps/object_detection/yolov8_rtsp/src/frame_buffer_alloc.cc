@@ -0,0 +1,105 @@
+#include "frame_buffer.h"
+
+#include <stdio.h>
+
+#include "dma_alloc.h"
+
+static int mb_flush(frame_buffer_t *buf) {
+  return RK_MPI_SYS_MmzFlushCache((MB_BLK)buf->origin, RK_FALSE) == RK_SUCCESS
+             ? 0
+             : -1;
+}
+
+static int mb_invalidate(frame_buffer_t *buf) {
+  return RK_MPI_SYS_MmzFlushCache((MB_BLK)buf->origin, RK_TRUE) == RK_SUCCESS
+             ? 0
+             : -1;
+}
+
+static void mb_release(frame_buffer_t *buf) {
+  RK_MPI_MB_ReleaseMB((MB_BLK)buf->origin);
+}
+
+static const frame_buffer_ops_t mb_ops = {mb_flush, mb_invalidate,
+                                          mb_release};
+
+frame_buffer_t *frame_buffer_from_mb(MB_BLK blk, int width, int height,
+                                     int stride, int format) {
+  frame_buffer_t *buf = frame_buffer_wrap(
+      RK_MPI_MB_Handle2Fd(blk), RK_MPI_MB_Handle2VirAddr(blk),
+      RK_MPI_MB_GetSize(blk), width, height, stride, format, &mb_ops, blk);
+  if (buf == NULL) {
+    RK_MPI_MB_ReleaseMB(blk);
+  }
+  return buf;
+}
+
+MB_BLK frame_buffer_mb(const frame_buffer_t *buf) {
+  return buf->ops == &mb_ops ? (MB_BLK)buf->origin : MB_INVALID_HANDLE;
+}
+
+static int dma_flush(frame_buffer_t *buf) {
+  return dma_sync_cpu_to_device(buf->fd);
+}
+
+static int dma_invalidate(frame_buffer_t *buf) {
+  return dma_sync_device_to_cpu(buf->fd);
+}
+
+static void dma_release(frame_buffer_t *buf) {
+  int fd = buf->fd;
+  dma_buf_free(buf->size, &fd, buf->vaddr);
+}
+
+static const frame_buffer_ops_t dma_ops = {dma_flush, dma_invalidate,
+                                           dma_release};
+
+frame_buffer_t *frame_buffer_alloc_dma(const char *heap, int width,
+                                       int height, int stride, int format) {
+  // a second plane at half height for YUV 4:2:0
+  size_t size = (size_t)stride * height;
+  if (format == RK_FORMAT_YCbCr_420_SP || format == RK_FORMAT_YCrCb_420_SP) {
+    size = size * 3 / 2;
+  }
+  int fd = -1;
+  void *vaddr = NULL;
+  if (dma_buf_alloc(heap, size, &fd, &vaddr) < 0) {
+    printf("dma_buf_alloc %zu bytes from %s fail!\n", size, heap);
+    return NULL;
+  }
+  frame_buffer_t *buf = frame_buffer_wrap(fd, vaddr, size, width, height,
+                                          stride, format, &dma_ops, NULL);
+  if (buf == NULL) {
+    dma_buf_free(size, &fd, vaddr);
+  }
+  return buf;
+}
+
+static int rknn_flush(frame_buffer_t *buf) {
+  return rknn_mem_sync(buf->rknn_ctx, buf->rknn_mem,
+                       RKNN_MEMORY_SYNC_TO_DEVICE);
+}
+
+static int rknn_invalidate(frame_buffer_t *buf) {
+  return rknn_mem_sync(buf->rknn_ctx, buf->rknn_mem,
+                       RKNN_MEMORY_SYNC_FROM_DEVICE);
+}
+
+static const frame_buffer_ops_t rknn_ops = {rknn_flush, rknn_invalidate,
+                                            NULL};
+
+frame_buffer_t *frame_buffer_from_rknn_mem(rknn_context ctx,
+                                           rknn_tensor_mem *mem, int width,
+                                           int height, int stride,
+                                           int format) {
+  frame_buffer_t *buf =
+      frame_buffer_wrap(mem->fd, mem->virt_addr, mem->size, width, height,
+                        stride, format, &rknn_ops, NULL);
+  if (buf != NULL) {
+    // the context's own mem, so frame_buffer_rknn_mem hands it out as is
+    buf->rknn_ctx = ctx;
+    buf->rknn_mem = mem;
+    buf->owns_rknn_mem = false;
+  }
+  return buf;
+}
@@ -0,0 +1,92 @@
+#include "frame_convert.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+// BT.601 limited range in 20 bit fixed point, as in OpenCV
+#define YUV_SHIFT 20
+#define YUV_CY 1220542
+#define YUV_CUB 2116026
+#define YUV_CUG -409993
+#define YUV_CVG -852492
+#define YUV_CVR 1673527
+
+// bilinear weights in 11 bit fixed point
+#define RESIZE_BITS 11
+#define RESIZE_ONE (1 << RESIZE_BITS)
+
+static inline uint8_t clamp_u8(int v) {
+  return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+void yuv420sp_to_bgr(const uint8_t *yuv, int width, int height, int stride,
+                     uint8_t *bgr) {
+  const uint8_t *vu_plane = yuv + stride * height;
+  for (int row = 0; row < height; row++) {
+    const uint8_t *y_row = yuv + row * stride;
+    const uint8_t *vu = vu_plane + (row / 2) * stride;
+    uint8_t *out = bgr + row * width * 3;
+    for (int col = 0; col < width; col++, out += 3) {
+      int v = vu[col & ~1] - 128;
+      int u = vu[col | 1] - 128;
+      int y = std::max(0, y_row[col] - 16) * YUV_CY;
+      int round = 1 << (YUV_SHIFT - 1);
+      out[0] = clamp_u8((y + round + YUV_CUB * u) >> YUV_SHIFT);
+      out[1] = clamp_u8((y + round + YUV_CVG * v + YUV_CUG * u) >> YUV_SHIFT);
+      out[2] = clamp_u8((y + round + YUV_CVR * v) >> YUV_SHIFT);
+    }
+  }
+}
+
+// Source index and weight of the next one for each destination index,
+// pixel centers aligned like INTER_LINEAR
+static void resize_taps(int src_size, int dst_size, int *index,
+                        int *weight) {
+  float scale = (float)src_size / (float)dst_size;
+  for (int d = 0; d < dst_size; d++) {
+    float s = std::max(0.0f, (d + 0.5f) * scale - 0.5f);
+    int i = std::min((int)s, src_size - 1);
+    index[d] = i;
+    weight[d] = i < src_size - 1 ? (int)((s - i) * RESIZE_ONE + 0.5f) : 0;
+  }
+}
+
+void bgr_letterbox(const uint8_t *src, int src_width, int src_height,
+                   uint8_t *dst, int dst_width, int dst_height, int x, int y,
+                   int w, int h, uint8_t pad) {
+  int dst_row_bytes = dst_width * 3;
+  if (w < dst_width || h < dst_height) {
+    memset(dst, pad, dst_row_bytes * dst_height);
+  }
+  uint8_t *roi = dst + y * dst_row_bytes + x * 3;
+  if (w == src_width && h == src_height) {
+    for (int row = 0; row < h; row++) {
+      memcpy(roi + row * dst_row_bytes, src + row * src_width * 3, w * 3);
+    }
+    return;
+  }
+
+  std::vector<int> xi(w), xw(w), yi(h), yw(h);
+  resize_taps(src_width, w, xi.data(), xw.data());
+  resize_taps(src_height, h, yi.data(), yw.data());
+  for (int row = 0; row < h; row++) {
+    const uint8_t *s0 = src + yi[row] * src_width * 3;
+    const uint8_t *s1 = yw[row] > 0 ? s0 + src_width * 3 : s0;
+    int wy = yw[row];
+    uint8_t *out = roi + row * dst_row_bytes;
+    for (int col = 0; col < w; col++, out += 3) {
+      int i0 = xi[col] * 3;
+      int i1 = xw[col] > 0 ? i0 + 3 : i0;
+      int wx = xw[col];
+      for (int c = 0; c < 3; c++) {
+        int top = s0[i0 + c] * (RESIZE_ONE - wx) + s0[i1 + c] * wx;
+        int bottom = s1[i0 + c] * (RESIZE_ONE - wx) + s1[i1 + c] * wx;
+        out[c] = (uint8_t)((top * (RESIZE_ONE - wy) + bottom * wy +
+                            (1 << (2 * RESIZE_BITS - 1))) >>
+                           (2 * RESIZE_BITS));
+      }
+    }
+  }
+}
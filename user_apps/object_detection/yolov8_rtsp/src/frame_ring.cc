@@ -0,0 +1,112 @@
+#include "frame_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static frame_ring_entry_t *entry(const frame_ring_t *ring, uint64_t seq) {
+  return &ring->entries[seq % ring->max_entries];
+}
+
+int frame_ring_init(frame_ring_t *ring, uint32_t size, uint32_t max_entries,
+                    uint64_t keep_us) {
+  memset(ring, 0, sizeof(frame_ring_t));
+  ring->data = (uint8_t *)malloc(size);
+  ring->entries =
+      (frame_ring_entry_t *)calloc(max_entries, sizeof(frame_ring_entry_t));
+  if (ring->data == NULL || ring->entries == NULL) {
+    printf("frame ring alloc fail!\n");
+    frame_ring_deinit(ring);
+    return -1;
+  }
+  ring->size = size;
+  ring->max_entries = max_entries;
+  ring->keep_us = keep_us;
+  ring->pin = FRAME_RING_NO_PIN;
+  return 0;
+}
+
+void frame_ring_deinit(frame_ring_t *ring) {
+  free(ring->data);
+  free(ring->entries);
+  ring->data = NULL;
+  ring->entries = NULL;
+}
+
+// Start of the second GOP, tail when only one is stored
+static uint64_t next_gop(const frame_ring_t *ring) {
+  for (uint64_t seq = ring->head + 1; seq < ring->tail; seq++) {
+    if (entry(ring, seq)->keyframe) {
+      return seq;
+    }
+  }
+  return ring->tail;
+}
+
+// Room for len contiguous bytes, at *offset
+static bool find_room(const frame_ring_t *ring, uint32_t len,
+                      uint32_t *offset) {
+  if (ring->head == ring->tail) {
+    *offset = 0;
+    return len <= ring->size;
+  }
+  uint32_t start = entry(ring, ring->head)->offset;
+  uint32_t w = ring->write_offset;
+  if (w > start) {
+    // live bytes in [start, w)
+    if (ring->size - w >= len) {
+      *offset = w;
+      return true;
+    }
+    *offset = 0;
+    return start >= len;
+  }
+  // wrapped, live bytes in [start, size) and [0, w)
+  *offset = w;
+  return start - w >= len;
+}
+
+int frame_ring_push(frame_ring_t *ring, const uint8_t *data, uint32_t len,
+                    uint64_t pts_us, bool keyframe) {
+  uint32_t offset;
+
+  if (len == 0 || len > ring->size) {
+    return -1;
+  }
+  while (ring->tail - ring->head >= ring->max_entries ||
+         !find_room(ring, len, &offset)) {
+    ring->head = next_gop(ring);
+  }
+  // the ring always starts at a key frame
+  if (ring->head == ring->tail && !keyframe) {
+    return -1;
+  }
+
+  frame_ring_entry_t *e = entry(ring, ring->tail);
+  e->offset = offset;
+  e->len = len;
+  e->pts_us = pts_us;
+  e->keyframe = keyframe;
+  memcpy(ring->data + offset, data, len);
+  ring->tail++;
+  ring->write_offset = offset + len;
+
+  // only as much history as asked for, unless a reader still needs it
+  while (1) {
+    uint64_t next = next_gop(ring);
+    if (next == ring->tail || ring->pin < next ||
+        pts_us - entry(ring, next)->pts_us < ring->keep_us) {
+      break;
+    }
+    ring->head = next;
+  }
+  return 0;
+}
+
+const frame_ring_entry_t *frame_ring_get(const frame_ring_t *ring,
+                                         uint64_t seq) {
+  if (seq < ring->head || seq >= ring->tail) {
+    return NULL;
+  }
+  return entry(ring, seq);
+}
@@ -0,0 +1,175 @@
+#include "latency_trace.h"
+
+#ifdef ENABLE_LATENCY_TRACE
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+
+// Histograms are only touched with relaxed atomics, so the frame loop never
+// blocks on a dump, whichever thread performs it.
+typedef struct {
+  std::atomic<uint32_t> buckets[TRACE_HIST_BUCKETS];
+  std::atomic<uint32_t> max;
+  std::atomic<uint64_t> sum;
+} trace_hist_t;
+
+// TRACE_CAPTURE holds the frame interval, the others the time from the
+// previous point; the total is capture to RTSP transmit
+static trace_hist_t stage_hists[TRACE_POINT_NUM];
+static trace_hist_t total_hist;
+
+static const char *trace_point_names[TRACE_POINT_NUM] = {
+    "frame",      "preprocess", "npu_submit", "npu_run",
+    "postprocess", "overlay",   "encode",     "rtsp_tx",
+};
+
+// frame state, only used by the pipeline thread
+static uint64_t capture_us;
+static uint64_t last_us;
+static int last_point = -1;
+
+static volatile sig_atomic_t dump_requested;
+static uint64_t dump_interval_us;
+static uint64_t next_dump_us;
+
+static uint64_t get_now_us() {
+  struct timespec time = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000 + (uint64_t)time.tv_nsec / 1000;
+}
+
+int latency_hist_bucket(uint32_t value) {
+  if (value < TRACE_HIST_SUB_COUNT) {
+    return value;
+  }
+  int shift = 31 - __builtin_clz(value) - TRACE_HIST_SUB_BITS;
+  return (shift + 1) * TRACE_HIST_SUB_COUNT +
+         ((value >> shift) & (TRACE_HIST_SUB_COUNT - 1));
+}
+
+uint32_t latency_hist_bucket_value(int bucket) {
+  if (bucket < TRACE_HIST_SUB_COUNT) {
+    return bucket;
+  }
+  int shift = bucket / TRACE_HIST_SUB_COUNT - 1;
+  uint32_t sub = bucket % TRACE_HIST_SUB_COUNT;
+  uint64_t low = (uint64_t)(TRACE_HIST_SUB_COUNT + sub) << shift;
+  return (uint32_t)(low + ((uint64_t)1 << shift) - 1);
+}
+
+static void hist_record(trace_hist_t *hist, uint64_t value_us) {
+  uint32_t value = value_us > UINT32_MAX ? UINT32_MAX : (uint32_t)value_us;
+  int bucket = latency_hist_bucket(value);
+  hist->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  hist->sum.fetch_add(value, std::memory_order_relaxed);
+  uint32_t max = hist->max.load(std::memory_order_relaxed);
+  while (value > max && !hist->max.compare_exchange_weak(
+                            max, value, std::memory_order_relaxed)) {
+  }
+}
+
+uint32_t latency_hist_percentile(const uint32_t *counts, uint64_t count,
+                                 int pct, uint32_t max) {
+  // the rank-th smallest value, rank counted from 1
+  uint64_t rank = (count * pct + 99) / 100;
+  uint64_t seen = 0;
+  for (int b = 0; b < TRACE_HIST_BUCKETS; b++) {
+    seen += counts[b];
+    if (seen > 0 && seen >= rank) {
+      // bucket bounds overshoot, the max is exact
+      uint32_t value = latency_hist_bucket_value(b);
+      return value < max ? value : max;
+    }
+  }
+  return max;
+}
+
+static void hist_dump(const char *name, trace_hist_t *hist) {
+  uint32_t counts[TRACE_HIST_BUCKETS];
+  uint64_t count = 0;
+
+  // take and clear, so each dump covers the time since the previous one
+  for (int b = 0; b < TRACE_HIST_BUCKETS; b++) {
+    counts[b] = hist->buckets[b].exchange(0, std::memory_order_relaxed);
+    count += counts[b];
+  }
+  uint64_t sum = hist->sum.exchange(0, std::memory_order_relaxed);
+  uint32_t max = hist->max.exchange(0, std::memory_order_relaxed);
+  if (count == 0) {
+    return;
+  }
+
+  uint32_t p50 = latency_hist_percentile(counts, count, 50, max);
+  uint32_t p99 = latency_hist_percentile(counts, count, 99, max);
+  printf("  %-12s %8llu %8llu %8u %8u %8u\n", name,
+         (unsigned long long)count, (unsigned long long)(sum / count), p50,
+         p99, max);
+}
+
+static void dump_signal_handler(int signo) { dump_requested = 1; }
+
+void latency_trace_init(int interval_s) {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = dump_signal_handler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &sa, NULL);
+
+  dump_interval_us = interval_s > 0 ? (uint64_t)interval_s * 1000000 : 0;
+  next_dump_us = get_now_us() + dump_interval_us;
+}
+
+void latency_trace_mark(trace_point point) {
+  uint64_t now_us = get_now_us();
+
+  if (point == TRACE_CAPTURE) {
+    if (capture_us != 0) {
+      hist_record(&stage_hists[TRACE_CAPTURE], now_us - capture_us);
+    }
+    capture_us = now_us;
+    last_us = now_us;
+    last_point = TRACE_CAPTURE;
+    return;
+  }
+  // a frame that was never captured, or a point out of order
+  if (last_point < 0 || (int)point <= last_point) {
+    return;
+  }
+  hist_record(&stage_hists[point], now_us - last_us);
+  last_us = now_us;
+  last_point = point;
+  if (point == TRACE_RTSP_TX) {
+    hist_record(&total_hist, now_us - capture_us);
+    last_point = -1;
+  }
+}
+
+void latency_trace_dump() {
+  printf("latency (us)     count     mean      p50      p99      max\n");
+  for (int p = 0; p < TRACE_POINT_NUM; p++) {
+    hist_dump(trace_point_names[p], &stage_hists[p]);
+  }
+  hist_dump("total", &total_hist);
+}
+
+void latency_trace_poll() {
+  if (dump_requested) {
+    dump_requested = 0;
+    latency_trace_dump();
+    return;
+  }
+  if (dump_interval_us > 0) {
+    uint64_t now_us = get_now_us();
+    if (now_us >= next_dump_us) {
+      next_dump_us = now_us + dump_interval_us;
+      latency_trace_dump();
+    }
+  }
+}
+
+#endif // ENABLE_LATENCY_TRACE
@@ -88,28 +88,84 @@ int vi_chn_init(int channelId, int width, int height) {
 	return ret;
 }
 
-int venc_init(int chnId, int width, int height, RK_CODEC_ID_E enType) {
+static void venc_fill_rc_attr(VENC_RC_ATTR_S *rc, const venc_config_t *config,
+                              int kbps) {
+	bool h265 = config->h265;
+	// the VBR bounds follow the target, within the configured range
+	int max_kbps = kbps * 3 / 2 < config->max_kbps ? kbps * 3 / 2 : config->max_kbps;
+	int min_kbps = kbps < config->min_kbps ? kbps : config->min_kbps;
+	if (max_kbps < kbps)
+		max_kbps = kbps;
+
+	if (config->rc_mode == VENC_RC_CBR) {
+		rc->enRcMode = h265 ? VENC_RC_MODE_H265CBR : VENC_RC_MODE_H264CBR;
+		VENC_H264_CBR_S *cbr = h265 ? &rc->stH265Cbr : &rc->stH264Cbr;
+		cbr->u32BitRate = kbps;
+		cbr->u32Gop = config->gop;
+	} else if (config->rc_mode == VENC_RC_VBR) {
+		rc->enRcMode = h265 ? VENC_RC_MODE_H265VBR : VENC_RC_MODE_H264VBR;
+		VENC_H264_VBR_S *vbr = h265 ? &rc->stH265Vbr : &rc->stH264Vbr;
+		vbr->u32BitRate = kbps;
+		vbr->u32MaxBitRate = max_kbps;
+		vbr->u32MinBitRate = min_kbps;
+		vbr->u32Gop = config->gop;
+	} else {
+		rc->enRcMode = h265 ? VENC_RC_MODE_H265AVBR : VENC_RC_MODE_H264AVBR;
+		VENC_H264_AVBR_S *avbr = h265 ? &rc->stH265Avbr : &rc->stH264Avbr;
+		avbr->u32BitRate = kbps;
+		avbr->u32MaxBitRate = max_kbps;
+		avbr->u32MinBitRate = min_kbps;
+		avbr->u32Gop = config->gop;
+	}
+}
+
+static int venc_set_qp(int chnId, const venc_config_t *config) {
+	VENC_RC_PARAM_S stRcParam;
+	memset(&stRcParam, 0, sizeof(VENC_RC_PARAM_S));
+	if (RK_MPI_VENC_GetRcParam(chnId, &stRcParam) != RK_SUCCESS) {
+		printf("RK_MPI_VENC_GetRcParam fail\n");
+		return -1;
+	}
+	// same layout for both codecs
+	VENC_PARAM_H264_S *param = config->h265
+	    ? (VENC_PARAM_H264_S *)&stRcParam.stParamH265 : &stRcParam.stParamH264;
+	if (config->max_qp > 0) {
+		param->u32MinQp = config->min_qp;
+		param->u32MaxQp = config->max_qp;
+	}
+	if (config->max_i_qp > 0) {
+		param->u32MinIQp = config->min_i_qp;
+		param->u32MaxIQp = config->max_i_qp;
+	}
+	if (RK_MPI_VENC_SetRcParam(chnId, &stRcParam) != RK_SUCCESS) {
+		printf("RK_MPI_VENC_SetRcParam fail\n");
+		return -1;
+	}
+	return 0;
+}
+
+int venc_init(int chnId, int width, int height, const venc_config_t *config) {
 	printf("%s\n",__func__);
 	VENC_RECV_PIC_PARAM_S stRecvParam;
 	VENC_CHN_ATTR_S stAttr;
 	memset(&stAttr, 0, sizeof(VENC_CHN_ATTR_S));
 
-	if (enType == RK_VIDEO_ID_AVC) {
-		stAttr.stRcAttr.enRcMode = VENC_RC_MODE_H264CBR;
-		stAttr.stRcAttr.stH264Cbr.u32BitRate = 10 * 1024;
-		stAttr.stRcAttr.stH264Cbr.u32Gop = 1;
-	} else if (enType == RK_VIDEO_ID_HEVC) {
-		stAttr.stRcAttr.enRcMode = VENC_RC_MODE_H265CBR;
-		stAttr.stRcAttr.stH265Cbr.u32BitRate = 10 * 1024;
-		stAttr.stRcAttr.stH265Cbr.u32Gop = 60;
-	} else if (enType == RK_VIDEO_ID_MJPEG) {
-		stAttr.stRcAttr.enRcMode = VENC_RC_MODE_MJPEGCBR;
-		stAttr.stRcAttr.stMjpegCbr.u32BitRate = 10 * 1024;
+	venc_fill_rc_attr(&stAttr.stRcAttr, config, config->kbps);
+	if (config->smartp_vir_idr > 0) {
+		// P frames reference a long term frame refreshed every virtual IDR,
+		// real IDRs only come every gop frames
+		stAttr.stGopAttr.enGopMode = VENC_GOPMODE_SMARTP;
+		stAttr.stGopAttr.s32VirIdrLen = config->smartp_vir_idr;
+		stAttr.stGopAttr.u32MaxLtrCount = 1;
+	} else {
+		stAttr.stGopAttr.enGopMode = VENC_GOPMODE_NORMALP;
 	}
 
-	stAttr.stVencAttr.enType = enType;
+	stAttr.stVencAttr.enType = config->h265 ? RK_VIDEO_ID_HEVC : RK_VIDEO_ID_AVC;
 	stAttr.stVencAttr.enPixelFormat = RK_FMT_RGB888;
-	if (enType == RK_VIDEO_ID_AVC)
+	if (config->h265)
+		stAttr.stVencAttr.u32Profile = H265E_PROFILE_MAIN;
+	else
 		stAttr.stVencAttr.u32Profile = H264E_PROFILE_HIGH;
 	stAttr.stVencAttr.u32PicWidth = width;
 	stAttr.stVencAttr.u32PicHeight = height;
@@ -119,11 +175,95 @@ int venc_init(int chnId, int width, int height, RK_CODEC_ID_E enType) {
 	stAttr.stVencAttr.u32BufSize = width * height * 3 / 2;
 	stAttr.stVencAttr.enMirror = MIRROR_NONE;
 
-	RK_MPI_VENC_CreateChn(chnId, &stAttr);
+	if (RK_MPI_VENC_CreateChn(chnId, &stAttr) != RK_SUCCESS) {
+		printf("RK_MPI_VENC_CreateChn fail\n");
+		return -1;
+	}
+	if (config->max_qp > 0 || config->max_i_qp > 0)
+		venc_set_qp(chnId, config);
+
+	memset(&stRecvParam, 0, sizeof(VENC_RECV_PIC_PARAM_S));
+	stRecvParam.s32RecvPicNum = -1;
+	RK_MPI_VENC_StartRecvFrame(chnId, &stRecvParam);
+
+	return 0;
+}
+
+int jpeg_venc_init(int chnId, int width, int height, int quality) {
+	printf("%s\n",__func__);
+	VENC_RECV_PIC_PARAM_S stRecvParam;
+	VENC_CHN_ATTR_S stAttr;
+	memset(&stAttr, 0, sizeof(VENC_CHN_ATTR_S));
+
+	// fixed quality, every picture is a stand-alone JPEG
+	stAttr.stRcAttr.enRcMode = VENC_RC_MODE_MJPEGFIXQP;
+	stAttr.stRcAttr.stMjpegFixQp.u32Qfactor = quality;
+
+	stAttr.stVencAttr.enType = RK_VIDEO_ID_MJPEG;
+	stAttr.stVencAttr.enPixelFormat = RK_FMT_RGB888;
+	stAttr.stVencAttr.u32PicWidth = width;
+	stAttr.stVencAttr.u32PicHeight = height;
+	stAttr.stVencAttr.u32VirWidth = width;
+	stAttr.stVencAttr.u32VirHeight = height;
+	stAttr.stVencAttr.u32StreamBufCnt = 2;
+	stAttr.stVencAttr.u32BufSize = width * height * 3 / 2;
+	stAttr.stVencAttr.enMirror = MIRROR_NONE;
+
+	if (RK_MPI_VENC_CreateChn(chnId, &stAttr) != RK_SUCCESS) {
+		printf("RK_MPI_VENC_CreateChn fail\n");
+		return -1;
+	}
 
 	memset(&stRecvParam, 0, sizeof(VENC_RECV_PIC_PARAM_S));
 	stRecvParam.s32RecvPicNum = -1;
 	RK_MPI_VENC_StartRecvFrame(chnId, &stRecvParam);
 
 	return 0;
-}
\ No newline at end of file
+}
+
+int venc_set_bitrate(int chnId, const venc_config_t *config, int kbps) {
+	VENC_CHN_ATTR_S stAttr;
+	memset(&stAttr, 0, sizeof(VENC_CHN_ATTR_S));
+	if (RK_MPI_VENC_GetChnAttr(chnId, &stAttr) != RK_SUCCESS) {
+		printf("RK_MPI_VENC_GetChnAttr fail\n");
+		return -1;
+	}
+	// rate control attributes may change while the channel runs
+	venc_fill_rc_attr(&stAttr.stRcAttr, config, kbps);
+	if (RK_MPI_VENC_SetChnAttr(chnId, &stAttr) != RK_SUCCESS) {
+		printf("RK_MPI_VENC_SetChnAttr fail\n");
+		return -1;
+	}
+	return 0;
+}
+
+int venc_apply_roi(int chnId, venc_roi_t *roi) {
+	for (int i = 0; i < roi->n_regions; i++) {
+		if (!roi->dirty[i])
+			continue;
+		const venc_roi_region_t *region = &roi->regions[i];
+		VENC_ROI_ATTR_S stRoiAttr;
+		memset(&stRoiAttr, 0, sizeof(VENC_ROI_ATTR_S));
+		stRoiAttr.u32Index = i;
+		stRoiAttr.bEnable = region->enabled ? RK_TRUE : RK_FALSE;
+		stRoiAttr.bAbsQp = RK_FALSE;
+		stRoiAttr.s32Qp = roi->qp;
+		stRoiAttr.bIntra = RK_FALSE;
+		stRoiAttr.stRect.s32X = region->rect.left;
+		stRoiAttr.stRect.s32Y = region->rect.top;
+		stRoiAttr.stRect.u32Width = region->rect.right - region->rect.left;
+		stRoiAttr.stRect.u32Height = region->rect.bottom - region->rect.top;
+		RK_S32 s32Ret = RK_MPI_VENC_SetRoiAttr(chnId, &stRoiAttr);
+		if (s32Ret != RK_SUCCESS) {
+			// the channel will not take it next frame either, stop
+			// instead of retrying and printing every frame
+			printf("RK_MPI_VENC_SetRoiAttr %d fail %x, encoder ROI off\n",
+			       i, s32Ret);
+			roi->qp = 0;
+			memset(roi->dirty, 0, sizeof(roi->dirty));
+			return -1;
+		}
+		roi->dirty[i] = false;
+	}
+	return 0;
+}
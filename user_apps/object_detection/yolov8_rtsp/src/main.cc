@@ -13,196 +13,1181 @@
 #include <unistd.h>
 #include <vector>
 
+#include "async_log.h"
+#include "box_overlay.h"
+#include "detect_bus.h"
+#include "detect_stream.h"
+#include "detector.h"
+#include "event_recorder.h"
+#include "frame_buffer.h"
+#include "frame_convert.h"
+#include "latency_trace.h"
 #include "luckfox_mpi.h"
-#include "rtsp_demo.h"
+#include "metrics.h"
+#include "model_scheduler.h"
+#include "osd_draw.h"
+#include "pipeline_trace.h"
+#include "privacy_mask.h"
+#include "rga_batch.h"
+#include "rknn_mem_pool.h"
+#include "rknn_perf.h"
+#include "rtsp_server.h"
+#include "snapshot_service.h"
+#include "startup_graph.h"
+#include "venc_config.h"
+#include "video_output.h"
 #include "yolov8.h"
 
+#ifdef ENABLE_OPENCV
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#endif
 
 #define DISP_WIDTH 640
 #define DISP_HEIGHT 480
 
+// period of the latency histogram dumps, SIGUSR1 dumps on demand
+#define LATENCY_DUMP_INTERVAL_S 10
+
+// events kept for the Chrome trace export, about 20 s of frames
+#define PIPELINE_TRACE_EVENTS 8192
+
+// Prometheus endpoint on the loopback, -M 0 turns it off
+#define METRICS_PORT 9464
+#define NPU_LOAD_PATH "/sys/kernel/debug/rknpu/load"
+
+// object ids of the UDP detection stream come from an IoU tracker
+#define STREAM_TRACK_IOU 0.3f
+#define STREAM_TRACK_MAX_MISSED 15
+
+// encoder ROI regions on the most confident objects, at most VENC_ROI_MAX
+#define ROI_REGIONS 4
+
+// the JPEG snapshot channel follows the stream channels
+#define SNAPSHOT_VENC_CHN VIDEO_OUTPUT_MAX
+
+// -B mosaics people (COCO class 0) in 16 pixel blocks
+#define PRIVACY_CLASS 0
+#define PRIVACY_BLOCK 16
+#define PRIVACY_MOSAIC IM_MOSAIC_16
+
+// box outlines as thick as the cv::rectangle ones, 0xff00ff00 is green in
+// either byte order
+#define OVERLAY_THICKNESS 3
+#define OVERLAY_COLOR 0xff00ff00
+// font scale of the labels drawn without OpenCV, 16 pixels high
+#define LABEL_SCALE 2
+
+// threads bringing up the independent startup stages
+#define STARTUP_THREADS 4
+
 // disp size
 int width = DISP_WIDTH;
 int height = DISP_HEIGHT;
 
-// model size
-int model_width = 640;
-int model_height = 640;
-float scale;
+// model input, filled from the detector backend
+detector_preprocess_spec input_spec;
+float scaleX;
+float scaleY;
 int leftPadding;
 int topPadding;
 
-cv::Mat letterbox(cv::Mat input) {
-  float scaleX = (float)model_width / (float)width;
-  float scaleY = (float)model_height / (float)height;
-  scale = scaleX < scaleY ? scaleX : scaleY;
+// Where the frame lands in the model input, sets what the letterbox map uses
+static im_rect letterbox_rect() {
+  scaleX = (float)input_spec.width / (float)width;
+  scaleY = (float)input_spec.height / (float)height;
+  if (input_spec.letterbox) {
+    scaleX = scaleX < scaleY ? scaleX : scaleY;
+    scaleY = scaleX;
+  }
 
-  int inputWidth = (int)((float)width * scale);
-  int inputHeight = (int)((float)height * scale);
+  int inputWidth = (int)((float)width * scaleX);
+  int inputHeight = (int)((float)height * scaleY);
+
+  leftPadding = (input_spec.width - inputWidth) / 2;
+  topPadding = (input_spec.height - inputHeight) / 2;
+  return {leftPadding, topPadding, inputWidth, inputHeight};
+}
 
-  leftPadding = (model_width - inputWidth) / 2;
-  topPadding = (model_height - inputHeight) / 2;
+#ifdef ENABLE_OPENCV
+cv::Mat letterbox(cv::Mat input) {
+  im_rect rect = letterbox_rect();
+  cv::Rect roi(rect.x, rect.y, rect.width, rect.height);
 
   cv::Mat inputScale;
-  cv::resize(input, inputScale, cv::Size(inputWidth, inputHeight), 0, 0,
-             cv::INTER_LINEAR);
-  cv::Mat letterboxImage(640, 640, CV_8UC3, cv::Scalar(0, 0, 0));
-  cv::Rect roi(leftPadding, topPadding, inputWidth, inputHeight);
+  cv::resize(input, inputScale, roi.size(), 0, 0, cv::INTER_LINEAR);
+  cv::Mat letterboxImage(input_spec.height, input_spec.width, CV_8UC3,
+                         cv::Scalar::all(input_spec.pad_value));
   inputScale.copyTo(letterboxImage(roi));
 
   return letterboxImage;
 }
+#endif
+
+// The frame buffer and the letterboxed model input from a VI frame, as one
+// RGA job that runs while the CPU does other work. Same conversion as the
+// OpenCV path (YUV420sp read as NV21, BGR out), so both give the same bytes.
+static int preprocess_submit(rga_batch_t *rga, const VIDEO_FRAME_S *vframe,
+                             frame_buffer_t *frame_buf,
+                             frame_buffer_t *input_buf) {
+  int vir_width = vframe->u32VirWidth ? vframe->u32VirWidth : width;
+  int vir_height = vframe->u32VirHeight ? vframe->u32VirHeight : height;
+  rga_buffer_handle_t vi_handle =
+      rga_batch_import(rga, RK_MPI_MB_Handle2Fd(vframe->pMbBlk),
+                       vir_width * vir_height * 3 / 2);
+  rga_buffer_t frame = frame_buffer_rga(frame_buf);
+  rga_buffer_t model = frame_buffer_rga(input_buf);
+  if (vi_handle == 0 || frame.handle == 0 || model.handle == 0) {
+    return -1;
+  }
 
-void mapCoordinates(int *x, int *y) {
-  int mx = *x - leftPadding;
-  int my = *y - topPadding;
+  rga_buffer_t vi = wrapbuffer_handle(vi_handle, width, height,
+                                      RK_FORMAT_YCrCb_420_SP, vir_width,
+                                      vir_height);
+  im_rect roi = letterbox_rect();
 
-  *x = (int)((float)mx / scale);
-  *y = (int)((float)my / scale);
+  // the last overlay must be in memory before RGA writes over it
+  frame_buffer_sync_for_device(frame_buf);
+  if (rga_batch_begin(rga) != 0) {
+    return -1;
+  }
+  rga_batch_cvtcolor(rga, vi, frame, RK_FORMAT_YCrCb_420_SP,
+                     RK_FORMAT_BGR_888);
+  if (roi.width < input_spec.width || roi.height < input_spec.height) {
+    uint8_t v = input_spec.pad_value;
+    rga_batch_fill(rga, model, {0, 0, input_spec.width, input_spec.height},
+                   0xff000000 | v << 16 | v << 8 | v);
+  }
+  rga_batch_process(rga, frame, model, {0, 0, width, height}, roi);
+  if (rga_batch_submit(rga) != 0) {
+    return -1;
+  }
+  frame_buffer_device_wrote(frame_buf);
+  frame_buffer_device_wrote(input_buf);
+  return 0;
 }
 
-int main(int argc, char *argv[]) {
-  RK_S32 s32Ret = 0;
-  int sX, sY, eX, eY;
+// The same on the CPU, for frames RGA failed on
+static void preprocess_cpu(void *vi_data, frame_buffer_t *frame_buf,
+                           frame_buffer_t *input_buf) {
+  unsigned char *frame_data = (unsigned char *)frame_buf->vaddr;
+  frame_buffer_sync_for_cpu(frame_buf);
+  frame_buffer_sync_for_cpu(input_buf);
+#ifdef ENABLE_OPENCV
+  cv::Mat yuv420sp(height + height / 2, width, CV_8UC1, vi_data);
+  cv::Mat frame(height, width, CV_8UC3, frame_data);
+
+  cv::cvtColor(yuv420sp, frame, cv::COLOR_YUV420sp2BGR);
+
+  // letterbox
+  cv::Mat letterboxImage = letterbox(frame);
+  memcpy(input_buf->vaddr, letterboxImage.data,
+         input_spec.width * input_spec.height * 3);
+#else
+  im_rect roi = letterbox_rect();
+  yuv420sp_to_bgr((const uint8_t *)vi_data, width, height, width, frame_data);
+  bgr_letterbox(frame_data, width, height, (uint8_t *)input_buf->vaddr,
+                input_spec.width, input_spec.height, roi.x, roi.y, roi.width,
+                roi.height, input_spec.pad_value);
+#endif
+  frame_buffer_cpu_wrote(frame_buf);
+  frame_buffer_cpu_wrote(input_buf);
+}
+
+// Box outline on the CPU, for frames RGA failed on
+static void draw_box_cpu(unsigned char *frame_data, int sX, int sY, int eX,
+                         int eY) {
+#ifdef ENABLE_OPENCV
+  cv::Mat frame(height, width, CV_8UC3, frame_data);
+  cv::rectangle(frame, cv::Point(sX, sY), cv::Point(eX, eY),
+                cv::Scalar(0, 255, 0), OVERLAY_THICKNESS);
+#else
+  osd_image_t img;
+  osd_image_wrap_bgr(&img, frame_data, width, height, width * 3);
+  osd_draw_rect(&img, sX, sY, eX, eY, OVERLAY_THICKNESS,
+                osd_color_rgb(0, 255, 0));
+#endif
+}
+
+// Label above the top left corner of a box
+static void draw_label_cpu(unsigned char *frame_data, int sX, int sY,
+                           const char *text) {
+#ifdef ENABLE_OPENCV
+  cv::Mat frame(height, width, CV_8UC3, frame_data);
+  cv::putText(frame, text, cv::Point(sX, sY - 8), cv::FONT_HERSHEY_SIMPLEX, 1,
+              cv::Scalar(0, 255, 0), 2);
+#else
+  // on a green background outside the box outline
+  osd_image_t img;
+  osd_image_wrap_bgr(&img, frame_data, width, height, width * 3);
+  int edge = OVERLAY_THICKNESS / 2;
+  osd_draw_label(&img, sX - edge, sY - edge, text, LABEL_SCALE,
+                 osd_color_rgb(0, 0, 0), osd_color_rgb(0, 255, 0));
+#endif
+}
+
+// All masks of a frame in one RGA call, in place on the frame
+static int apply_privacy_mask(const privacy_mask_t *mask,
+                              frame_buffer_t *frame_buf) {
+  im_rect rects[PRIVACY_MASK_MAX];
+  for (int k = 0; k < mask->n_rects; k++) {
+    const image_rect_t *r = &mask->rects[k];
+    rects[k] = {r->left, r->top, r->right - r->left, r->bottom - r->top};
+  }
+  rga_buffer_t image = frame_buffer_rga(frame_buf);
+  if (image.handle == 0) {
+    return -1;
+  }
+  frame_buffer_sync_for_device(frame_buf);
+  frame_buffer_device_wrote(frame_buf);
+  return immosaicArray(image, rects, mask->n_rects, PRIVACY_MOSAIC) ==
+                 IM_STATUS_SUCCESS
+             ? 0
+             : -1;
+}
+
+// The masks as solid blocks drawn by the CPU, for frames RGA failed to
+// mosaic: a frame never leaves with the masked class in it
+static void fill_privacy_mask_cpu(const privacy_mask_t *mask,
+                                  frame_buffer_t *frame_buf) {
+  unsigned char *frame_data = (unsigned char *)frame_buf->vaddr;
+  frame_buffer_sync_for_cpu(frame_buf);
+#ifdef ENABLE_OPENCV
+  cv::Mat frame(height, width, CV_8UC3, frame_data);
+  for (int k = 0; k < mask->n_rects; k++) {
+    const image_rect_t *r = &mask->rects[k];
+    cv::rectangle(frame, cv::Rect(r->left, r->top, r->right - r->left,
+                                  r->bottom - r->top),
+                  cv::Scalar(128, 128, 128), cv::FILLED);
+  }
+#else
+  osd_image_t img;
+  osd_image_wrap_bgr(&img, frame_data, width, height, width * 3);
+  for (int k = 0; k < mask->n_rects; k++) {
+    const image_rect_t *r = &mask->rects[k];
+    osd_fill_rect(&img, r->left, r->top, r->right - r->left,
+                  r->bottom - r->top, osd_color_rgb(128, 128, 128));
+  }
+#endif
+  frame_buffer_cpu_wrote(frame_buf);
+}
+
+// All box outlines of a frame as one RGA task on the frame
+static int overlay_submit(rga_batch_t *rga, const box_overlay_t *overlay,
+                          frame_buffer_t *frame_buf) {
+  im_rect rects[BOX_OVERLAY_MAX];
+  rga_buffer_t frame = frame_buffer_rga(frame_buf);
+  if (frame.handle == 0) {
+    return -1;
+  }
+  for (int k = 0; k < overlay->n_rects; k++) {
+    const image_rect_t *r = &overlay->rects[k];
+    rects[k] = {r->left, r->top, r->right - r->left, r->bottom - r->top};
+  }
+
+  frame_buffer_sync_for_device(frame_buf);
+  if (rga_batch_begin(rga) != 0) {
+    return -1;
+  }
+  rga_batch_rectangles(rga, frame, rects, overlay->n_rects, OVERLAY_COLOR,
+                       overlay->thickness);
+  if (rga_batch_submit(rga) != 0) {
+    return -1;
+  }
+  frame_buffer_device_wrote(frame_buf);
+  return 0;
+}
+
+static void usage(const char *prog) {
+  printf("Usage: %s [-m model_path] [-d yolov8|ssd] [-c classifier_model]\n"
+         "          [-l classifier_labels] [-n crops_per_frame]"
+         " [-b classifier_budget_us]\n"
+         "          [-w] warm up the model at startup [-v] verbose model info\n"
+         "          [-p perf_report.jsonl] profile the detector per frame\n"
+         "          [-L error|warn|info|debug] log level (default info)\n"
+         "          [-M metrics_port] Prometheus port on 127.0.0.1, 0 to "
+         "disable\n"
+         "          [-D bus_name] detection bus socket name, none to disable\n"
+         "          [-U ip:port] stream detections as UDP datagrams\n"
+         "          [-E key=value,...] encoder: codec rc kbps min_kbps max_kbps"
+         " gop smartp qp iqp roi adaptive\n"
+         "          [-S key=value,...] add a scaled sub-stream, encoder keys"
+         " plus size=WxH\n"
+         "          [-R clip_dir] record event clips of the main stream\n"
+         "          [-J snapshot_dir] save JPEG thumbnails of detected"
+         " objects\n"
+         "          [-B] mosaic people in the stream\n",
+         prog);
+}
+
+// Everything brought up before the first frame, filled by the startup stages
+typedef struct {
+  const char *model_path;
+  const char *cls_model_path; // NULL when no classifier is loaded
+  const char *cls_labels_path;
+  int cls_top_n;
+  int cls_budget_us;
+  bool warmup;
+  const char *perf_report_path;
+  rknn_perf_profiler_t perf_profiler;
+  const detector_backend_t *detector;
 
-  // Rknn model
-  char text[16];
   rknn_app_context_t rknn_app_ctx;
-  object_detect_result_list od_results;
-  int ret;
-  const char *model_path = "./model/yolov8.rknn";
-  memset(&rknn_app_ctx, 0, sizeof(rknn_app_context_t));
-  init_yolov8_model(model_path, &rknn_app_ctx);
-  printf("init rknn model success!\n");
-  init_post_process();
+  model_scheduler_t scheduler;
+  rknn_mem_pool_t mem_pool;
 
-  // h264_frame
-  VENC_STREAM_S stFrame;
-  stFrame.pstPack = (VENC_PACK_S *)malloc(sizeof(VENC_PACK_S));
-  RK_U64 H264_PTS = 0;
-  RK_U32 H264_TimeRef = 0;
-  VIDEO_FRAME_INFO_S stViFrame;
+  // the BGR frame every stage works on, one block of src_Pool, and the
+  // model input tensor
+  MB_POOL src_Pool;
+  frame_buffer_t *frame;
+  frame_buffer_t *input;
 
-  // Create Pool
-  MB_POOL_CONFIG_S PoolCfg;
-  memset(&PoolCfg, 0, sizeof(MB_POOL_CONFIG_S));
-  PoolCfg.u64MBSize = width * height * 3;
-  PoolCfg.u32MBCnt = 1;
-  PoolCfg.enAllocType = MB_ALLOC_TYPE_DMA;
-  // PoolCfg.bPreAlloc = RK_FALSE;
-  MB_POOL src_Pool = RK_MPI_MB_CreatePool(&PoolCfg);
-  printf("Create Pool success !\n");
+  rtsp_server_t *rtsp;
+  int rtsp_streams[VIDEO_OUTPUT_MAX];
 
-  // Get MB from Pool
-  MB_BLK src_Blk = RK_MPI_MB_GetMB(src_Pool, width * height * 3, RK_TRUE);
-
-  // Build h264_frame
-  VIDEO_FRAME_INFO_S h264_frame;
-  h264_frame.stVFrame.u32Width = width;
-  h264_frame.stVFrame.u32Height = height;
-  h264_frame.stVFrame.u32VirWidth = width;
-  h264_frame.stVFrame.u32VirHeight = height;
-  h264_frame.stVFrame.enPixelFormat = RK_FMT_RGB888;
-  h264_frame.stVFrame.u32FrameFlag = 160;
-  h264_frame.stVFrame.pMbBlk = src_Blk;
-  unsigned char *data = (unsigned char *)RK_MPI_MB_Handle2VirAddr(src_Blk);
-  cv::Mat frame(cv::Size(width, height), CV_8UC3, data);
+  // output 0 is the main stream, the others are scaled sub-streams
+  int n_outputs;
+  venc_config_t venc_config[VIDEO_OUTPUT_MAX];
+  char output_paths[VIDEO_OUTPUT_MAX][16];
+  video_output_t outputs[VIDEO_OUTPUT_MAX];
+
+  const char *record_dir; // NULL when events are not recorded
+  event_recorder_t *recorder;
+  const char *snapshot_dir; // NULL when no thumbnails are taken
+  snapshot_service_t *snapshots;
+} app_context_t;
+
+// Pipeline health for the metrics endpoint. Counters are bumped by the frame
+// loop, gauges are sampled once a second by sample_pipeline_metrics.
+typedef struct {
+  metric_t *frames_captured;
+  metric_t *frames_inferred;
+  metric_t *frames_encoded;
+  metric_t *capture_errors;
+  metric_t *encode_errors;
+  metric_t *detections;
+  metric_t *detections_per_frame;
+  metric_t *inference_ms;
+  metric_t *capture_fps;
+  metric_t *inference_fps;
+  metric_t *vi_lost_frames;
+  metric_t *venc_pending_pics;
+  metric_t *venc_pending_streams;
+  metric_t *vi_buffer_fails;
+  metric_t *frame_block_users;
+  metric_t *log_queue_depth;
+  metric_t *cma_free_kb;
+  metric_t *npu_load;
+  metric_t *rtsp_clients;
+  metric_t *venc_kbps;
+
+  RK_U64 last_sample_us;
+  uint64_t last_captured;
+  uint64_t last_inferred;
+} pipeline_metrics_t;
+
+static void init_pipeline_metrics(pipeline_metrics_t *pm) {
+  static const double inference_bounds[] = {10, 20, 30, 40, 50, 75, 100, 150,
+                                            250};
+  static const double detection_bounds[] = {0, 1, 2, 4, 8, 16, 32, 64};
+
+  memset(pm, 0, sizeof(pipeline_metrics_t));
+  pm->frames_captured =
+      metrics_counter("frames_captured_total", "Frames received from VI");
+  pm->frames_inferred =
+      metrics_counter("frames_inferred_total", "Frames run through the detector");
+  pm->frames_encoded =
+      metrics_counter("frames_encoded_total", "Frames encoded and sent");
+  pm->capture_errors =
+      metrics_counter("capture_errors_total", "Failed VI frame fetches");
+  pm->encode_errors =
+      metrics_counter("encode_errors_total", "Failed VENC stream fetches");
+  pm->detections = metrics_counter("detections_total", "Objects detected");
+  pm->detections_per_frame = metrics_histogram(
+      "detections_per_frame", "Objects detected per frame", detection_bounds,
+      sizeof(detection_bounds) / sizeof(detection_bounds[0]));
+  pm->inference_ms = metrics_histogram(
+      "inference_latency_ms", "NPU run and decode time per frame",
+      inference_bounds, sizeof(inference_bounds) / sizeof(inference_bounds[0]));
+  pm->capture_fps = metrics_gauge("capture_fps", "Frames captured per second");
+  pm->inference_fps =
+      metrics_gauge("inference_fps", "Frames inferred per second");
+  pm->vi_lost_frames =
+      metrics_gauge("vi_lost_frames", "Frames lost by VI since start");
+  pm->venc_pending_pics =
+      metrics_gauge("venc_queue_pictures", "Pictures waiting for VENC");
+  pm->venc_pending_streams =
+      metrics_gauge("venc_queue_streams", "Encoded frames not fetched yet");
+  // rockit has no query for MB pool occupancy; the app's own pools hold
+  // one block each for good, VI running out of buffers shows as fails
+  pm->vi_buffer_fails = metrics_gauge(
+      "vi_buffer_alloc_fails", "VI frames dropped for want of a buffer");
+  pm->frame_block_users = metrics_gauge(
+      "frame_block_users", "Users of the frame MB block, not pool occupancy");
+  pm->log_queue_depth =
+      metrics_gauge("log_queue_depth", "Log records waiting to be written");
+  pm->cma_free_kb = metrics_gauge("cma_free_kb", "Free CMA memory");
+  pm->npu_load = metrics_gauge("npu_load_percent", "NPU core load");
+  pm->rtsp_clients = metrics_gauge("rtsp_clients", "RTSP clients playing");
+  pm->venc_kbps = metrics_gauge("venc_bitrate_kbps", "Encoder target bitrate");
+}
+
+static int read_npu_load() {
+  char line[64];
+  int load = -1;
+  FILE *fp = fopen(NPU_LOAD_PATH, "r");
+  if (fp == NULL) {
+    return -1;
+  }
+  // "NPU load:  Core0: 35%,"
+  if (fgets(line, sizeof(line), fp) != NULL) {
+    char *core = strstr(line, "Core0:");
+    if (core != NULL) {
+      load = atoi(core + 6);
+    }
+  }
+  fclose(fp);
+  return load;
+}
+
+static void sample_pipeline_metrics(pipeline_metrics_t *pm, MB_BLK blk,
+                                    rtsp_server_t *rtsp, int rtsp_stream) {
+  RK_U64 now_us = TEST_COMM_GetNowUs();
+  if (now_us - pm->last_sample_us < 1000000) {
+    return;
+  }
+  if (pm->last_sample_us != 0 && pm->frames_captured != NULL &&
+      pm->frames_inferred != NULL) {
+    double secs = (now_us - pm->last_sample_us) / 1e6;
+    uint64_t captured = pm->frames_captured->count.load();
+    uint64_t inferred = pm->frames_inferred->count.load();
+    metric_set(pm->capture_fps, (captured - pm->last_captured) / secs);
+    metric_set(pm->inference_fps, (inferred - pm->last_inferred) / secs);
+    pm->last_captured = captured;
+    pm->last_inferred = inferred;
+  }
+  pm->last_sample_us = now_us;
+
+  VI_CHN_STATUS_S vi_status;
+  memset(&vi_status, 0, sizeof(vi_status));
+  if (RK_MPI_VI_QueryChnStatus(0, 0, &vi_status) == RK_SUCCESS) {
+    metric_set(pm->vi_lost_frames,
+               vi_status.u32InputLostFrame + vi_status.u32OutputLostFrame);
+    metric_set(pm->vi_buffer_fails, vi_status.u32VbFail);
+  }
+  VENC_CHN_STATUS_S venc_status;
+  memset(&venc_status, 0, sizeof(venc_status));
+  if (RK_MPI_VENC_QueryStatus(0, &venc_status) == RK_SUCCESS) {
+    metric_set(pm->venc_pending_pics, venc_status.u32LeftPics);
+    metric_set(pm->venc_pending_streams, venc_status.u32LeftStreamFrames);
+  }
+  metric_set(pm->frame_block_users, RK_MPI_MB_InquireUserCnt(blk));
+  metric_set(pm->log_queue_depth, async_log_queue_depth());
+  metric_set(pm->cma_free_kb, get_cma_free_kb());
+  metric_set(pm->npu_load, read_npu_load());
+  if (rtsp != NULL) {
+    metric_set(pm->rtsp_clients, rtsp_server_client_count(rtsp, rtsp_stream));
+  }
+}
+
+static int stage_model(void *arg) {
+  app_context_t *app = (app_context_t *)arg;
+  rknn_app_context_t *rknn_app_ctx = &app->rknn_app_ctx;
+  const detector_backend_t *detector = app->detector;
+
+  if (app->perf_report_path != NULL &&
+      rknn_perf_open(&app->perf_profiler, app->perf_report_path) == 0) {
+    rknn_app_ctx->perf = &app->perf_profiler;
+  }
+
+  print_mem_usage("before model load");
+  // detector and classifier never run concurrently, let them share scratch
+  rknn_mem_pool_init(&app->mem_pool);
+  if (app->cls_model_path != NULL) {
+    rknn_app_ctx->init_flags |= RKNN_FLAG_INTERNAL_ALLOC_OUTSIDE;
+  }
+  if (detector->init(app->model_path, rknn_app_ctx) != 0) {
+    printf("init %s model %s fail!\n", detector->name, app->model_path);
+    return -1;
+  }
+  detector->get_preprocess_spec(rknn_app_ctx, &input_spec);
+  rknn_tensor_attr *in_attr = &rknn_app_ctx->input_attrs[0];
+  int in_wstride = in_attr->w_stride ? in_attr->w_stride : input_spec.width;
+  app->input = frame_buffer_from_rknn_mem(
+      rknn_app_ctx->rknn_ctx, rknn_app_ctx->input_mems[0], input_spec.width,
+      input_spec.height, in_wstride * 3, RK_FORMAT_BGR_888);
+  if (app->input == NULL) {
+    return -1;
+  }
+  printf("init rknn model success!\n");
 
+  if (app->cls_model_path != NULL &&
+      init_model_scheduler(&app->scheduler, rknn_app_ctx, app->cls_model_path,
+                           app->cls_labels_path, app->cls_top_n,
+                           app->cls_budget_us) != 0) {
+    release_model_scheduler(&app->scheduler);
+    app->cls_model_path = NULL;
+  }
+  if (rknn_app_ctx->init_flags & RKNN_FLAG_INTERNAL_ALLOC_OUTSIDE) {
+    rknn_mem_pool_add(&app->mem_pool, rknn_app_ctx);
+    if (app->cls_model_path != NULL) {
+      rknn_mem_pool_add(&app->mem_pool, &app->scheduler.cls_ctx);
+    }
+    if (rknn_mem_pool_commit(&app->mem_pool) != 0) {
+      return -1;
+    }
+  }
+  print_mem_usage("after model load");
+  if (app->warmup) {
+    detector_warmup(rknn_app_ctx, app->input);
+  }
+  return 0;
+}
+
+static int stage_isp(void *arg) {
   // rkaiq init
   RK_BOOL multi_sensor = RK_FALSE;
   const char *iq_dir = "/etc/iqfiles";
   rk_aiq_working_mode_t hdr_mode = RK_AIQ_WORKING_MODE_NORMAL;
   // hdr_mode = RK_AIQ_WORKING_MODE_ISP_HDR2;
-  SAMPLE_COMM_ISP_Init(0, hdr_mode, multi_sensor, iq_dir);
-  SAMPLE_COMM_ISP_Run(0);
+  if (SAMPLE_COMM_ISP_Init(0, hdr_mode, multi_sensor, iq_dir) != RK_SUCCESS) {
+    printf("isp init fail!\n");
+    return -1;
+  }
+  return SAMPLE_COMM_ISP_Run(0) == RK_SUCCESS ? 0 : -1;
+}
 
+static int stage_mpi(void *arg) {
   // rkmpi init
   if (RK_MPI_SYS_Init() != RK_SUCCESS) {
     RK_LOGE("rk mpi sys init fail!");
     return -1;
   }
+  return 0;
+}
+
+static int stage_mb_pool(void *arg) {
+  app_context_t *app = (app_context_t *)arg;
+
+  // Create Pool
+  MB_POOL_CONFIG_S PoolCfg;
+  memset(&PoolCfg, 0, sizeof(MB_POOL_CONFIG_S));
+  PoolCfg.u64MBSize = width * height * 3;
+  PoolCfg.u32MBCnt = 1;
+  PoolCfg.enAllocType = MB_ALLOC_TYPE_DMA;
+  // PoolCfg.bPreAlloc = RK_FALSE;
+  app->src_Pool = RK_MPI_MB_CreatePool(&PoolCfg);
+  if (app->src_Pool == MB_INVALID_POOLID) {
+    printf("Create Pool fail!\n");
+    return -1;
+  }
+  printf("Create Pool success !\n");
+
+  // Get MB from Pool
+  MB_BLK blk = RK_MPI_MB_GetMB(app->src_Pool, width * height * 3, RK_TRUE);
+  if (blk == MB_INVALID_HANDLE) {
+    return -1;
+  }
+  app->frame = frame_buffer_from_mb(blk, width, height, width * 3,
+                                    RK_FORMAT_BGR_888);
+  return app->frame != NULL ? 0 : -1;
+}
+
+static int stage_rtsp(void *arg) {
+  app_context_t *app = (app_context_t *)arg;
 
   // rtsp init
-  rtsp_demo_handle g_rtsplive = NULL;
-  rtsp_session_handle g_rtsp_session;
-  g_rtsplive = create_rtsp_demo(554);
-  g_rtsp_session = rtsp_new_session(g_rtsplive, "/live/0");
-  rtsp_set_video(g_rtsp_session, RTSP_CODEC_ID_VIDEO_H264, NULL, 0);
-  rtsp_sync_video_ts(g_rtsp_session, rtsp_get_reltime(), rtsp_get_ntptime());
+  app->rtsp = rtsp_server_create(554);
+  if (app->rtsp == NULL) {
+    printf("create rtsp server fail!\n");
+    return -1;
+  }
+  for (int i = 0; i < app->n_outputs; i++) {
+    app->rtsp_streams[i] = rtsp_server_add_stream(
+        app->rtsp, app->output_paths[i],
+        app->venc_config[i].h265 ? RTSP_CODEC_H265 : RTSP_CODEC_H264);
+  }
+  return rtsp_server_start(app->rtsp);
+}
 
+static int stage_vi(void *arg) {
   // vi init
-  vi_dev_init();
-  vi_chn_init(0, width, height);
+  if (vi_dev_init() != 0) {
+    return -1;
+  }
+  return vi_chn_init(0, width, height) == 0 ? 0 : -1;
+}
 
-  // venc init
-  RK_CODEC_ID_E enCodecType = RK_VIDEO_ID_AVC;
-  venc_init(0, width, height, enCodecType);
+// Thumbnails end up as <class>_<object id>_<pts ms>.jpg; an uploader would
+// hand them on from here instead
+static void save_snapshot(const snapshot_info_t *info, const uint8_t *jpeg,
+                          size_t len, void *user) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s_%u_%llu.jpg", (const char *)user,
+           coco_cls_to_name(info->cls_id), info->track_id,
+           (unsigned long long)info->pts_us / 1000);
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL) {
+    ALOGW("open %s fail\n", path);
+    return;
+  }
+  if (fwrite(jpeg, 1, len, fp) != len) {
+    ALOGW("write %s fail\n", path);
+  }
+  fclose(fp);
+}
 
+static int stage_venc(void *arg) {
+  app_context_t *app = (app_context_t *)arg;
+
+  // venc init, one channel per output
+  for (int i = 0; i < app->n_outputs; i++) {
+    if (video_output_init(&app->outputs[i], i, app->output_paths[i],
+                          &app->venc_config[i], app->frame) != 0) {
+      return -1;
+    }
+    venc_config_print(&app->venc_config[i]);
+  }
   printf("venc init success\n");
 
+  if (app->record_dir != NULL) {
+    app->recorder = event_recorder_create(
+        app->record_dir, app->venc_config[0].h265 ? NAL_CODEC_H265
+                                                  : NAL_CODEC_H264);
+    if (app->recorder == NULL) {
+      return -1;
+    }
+  }
+  if (app->snapshot_dir != NULL) {
+    app->snapshots = snapshot_service_create(SNAPSHOT_VENC_CHN, save_snapshot,
+                                             (void *)app->snapshot_dir);
+    if (app->snapshots == NULL) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Stage teardown, run in reverse on a failed startup and at exit. Each one
+// copes with a stage that only got part of the way.
+static void undo_model(void *arg) {
+  app_context_t *app = (app_context_t *)arg;
+
+  rknn_mem_pool_release(&app->mem_pool);
+  if (app->cls_model_path != NULL) {
+    release_model_scheduler(&app->scheduler);
+  }
+  // the input buffer borrows the model input tensor
+  frame_buffer_unref(app->input);
+  app->input = NULL;
+  app->detector->release(&app->rknn_app_ctx);
+  if (app->rknn_app_ctx.perf != NULL) {
+    rknn_perf_close(app->rknn_app_ctx.perf);
+    app->rknn_app_ctx.perf = NULL;
+  }
+}
+
+static void undo_isp(void *arg) { SAMPLE_COMM_ISP_Stop(0); }
+
+static void undo_mpi(void *arg) { RK_MPI_SYS_Exit(); }
+
+static void undo_rtsp(void *arg) {
+  app_context_t *app = (app_context_t *)arg;
+  rtsp_server_destroy(app->rtsp);
+  app->rtsp = NULL;
+}
+
+static void undo_mb_pool(void *arg) {
+  app_context_t *app = (app_context_t *)arg;
+
+  // the outputs are gone by now, this is the last reference and gives the
+  // block back to the pool
+  frame_buffer_unref(app->frame);
+  app->frame = NULL;
+  if (app->src_Pool != MB_INVALID_POOLID) {
+    RK_MPI_MB_DestroyPool(app->src_Pool);
+    app->src_Pool = MB_INVALID_POOLID;
+  }
+}
+
+static void undo_vi(void *arg) {
+  RK_MPI_VI_DisableChn(0, 0);
+  RK_MPI_VI_DisableDev(0);
+}
+
+static void undo_venc(void *arg) {
+  app_context_t *app = (app_context_t *)arg;
+
+  for (int i = 0; i < app->n_outputs; i++) {
+    // outputs past the one that failed were never set up
+    if (app->outputs[i].src != NULL) {
+      video_output_deinit(&app->outputs[i]);
+      app->outputs[i].src = NULL;
+    }
+  }
+  snapshot_service_destroy(app->snapshots);
+  app->snapshots = NULL;
+  event_recorder_destroy(app->recorder);
+  app->recorder = NULL;
+}
+
+// Once a frame, while RGA prepares the next one: traces, metrics and the
+// bitrate of each output
+static void frame_housekeeping(app_context_t *app,
+                               pipeline_metrics_t *metrics) {
+  rtsp_server_t *rtsp = app->rtsp;
+
+  LATENCY_TRACE_POLL();
+  sample_pipeline_metrics(metrics, frame_buffer_mb(app->frame), rtsp,
+                          app->rtsp_streams[0]);
+  for (int i = 0; i < app->n_outputs; i++) {
+    video_output_t *out = &app->outputs[i];
+    if (!out->config.adaptive) {
+      continue;
+    }
+    // back off when viewers fall behind, spend bits when objects are seen
+    int queue_peak =
+        rtsp != NULL ? rtsp_server_take_queue_peak(rtsp, app->rtsp_streams[i])
+                     : 0;
+    int kbps = bitrate_ctrl_update(&out->bitrate, TEST_COMM_GetNowUs(),
+                                   queue_peak, RTSP_CLIENT_QUEUE);
+    if (kbps > 0 && venc_set_bitrate(out->chn, &out->config, kbps) == 0) {
+      ALOGI("%s bitrate %d kbps\n", out->path, kbps);
+      if (i == 0) {
+        metric_set(metrics->venc_kbps, kbps);
+      }
+    }
+  }
+  PIPELINE_TRACE_POLL();
+}
+
+int main(int argc, char *argv[]) {
+  RK_U64 start_us = TEST_COMM_GetNowUs();
+  RK_S32 s32Ret = 0;
+  int sX, sY, eX, eY;
+
+  // Rknn model
+  char text[64];
+  object_detect_result_list od_results;
+  memset(&od_results, 0, sizeof(od_results));
+  int ret;
+  const char *detector_name = "yolov8";
+  bool first_detection = true;
+  int log_level = ALOG_LEVEL_INFO;
+  int metrics_port = METRICS_PORT;
+  const char *bus_name = DETECT_BUS_NAME;
+  static detect_bus_t detect_bus;
+  const char *stream_dest = NULL;
+  static detect_stream_t detect_stream;
+  static box_tracker_t stream_tracker;
+  int track_slots[OBJ_NUMB_MAX_SIZE];
+  uint32_t object_ids[OBJ_NUMB_MAX_SIZE];
+  bool box_on_cpu[OBJ_NUMB_MAX_SIZE]; // too small for RGA to outline
+  static pipeline_metrics_t metrics;
+  static venc_roi_t venc_roi;
+  static rga_batch_t rga;
+  static box_overlay_t overlay;
+  bool privacy = false;
+  static privacy_mask_t privacy_mask;
+
+  static app_context_t app;
+  memset(&app, 0, sizeof(app_context_t));
+  app.model_path = "./model/yolov8.rknn";
+  // optional second stage classifier on detection crops
+  app.cls_top_n = 4;
+  app.cls_budget_us = 10000;
+  // the sub-stream defaults, before any -S
+  venc_config_t sub_config;
+  venc_config_default(&sub_config);
+  sub_config.width = DISP_WIDTH / 2;
+  sub_config.height = DISP_HEIGHT / 2;
+  sub_config.kbps = 512;
+  sub_config.min_kbps = 128;
+  sub_config.max_kbps = 1024;
+  sub_config.roi_qp = 0;
+  app.n_outputs = 1;
+  venc_config_default(&app.venc_config[0]);
+  object_attr_result od_attrs[OBJ_NUMB_MAX_SIZE];
+
+  int opt;
+  while ((opt = getopt(argc, argv, "m:d:c:l:n:b:p:L:M:D:U:E:S:R:J:Bwvh")) !=
+         -1) {
+    switch (opt) {
+    case 'm':
+      app.model_path = optarg;
+      break;
+    case 'd':
+      detector_name = optarg;
+      break;
+    case 'c':
+      app.cls_model_path = optarg;
+      break;
+    case 'l':
+      app.cls_labels_path = optarg;
+      break;
+    case 'n':
+      app.cls_top_n = atoi(optarg);
+      break;
+    case 'b':
+      app.cls_budget_us = atoi(optarg);
+      break;
+    case 'p':
+      app.perf_report_path = optarg;
+      break;
+    case 'L':
+      log_level = async_log_parse_level(optarg);
+      if (log_level < 0) {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'M':
+      metrics_port = atoi(optarg);
+      break;
+    case 'D':
+      bus_name = strcmp(optarg, "none") == 0 ? NULL : optarg;
+      break;
+    case 'U':
+      stream_dest = optarg;
+      break;
+    case 'E':
+      if (venc_config_parse(&app.venc_config[0], optarg) != 0 ||
+          app.venc_config[0].width != 0) {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'S':
+      if (app.n_outputs == VIDEO_OUTPUT_MAX) {
+        printf("at most %d sub-streams\n", VIDEO_OUTPUT_MAX - 1);
+        return -1;
+      }
+      app.venc_config[app.n_outputs] = sub_config;
+      if (venc_config_parse(&app.venc_config[app.n_outputs], optarg) != 0) {
+        usage(argv[0]);
+        return -1;
+      }
+      app.n_outputs++;
+      break;
+    case 'R':
+      app.record_dir = optarg;
+      break;
+    case 'J':
+      app.snapshot_dir = optarg;
+      break;
+    case 'B':
+      privacy = true;
+      break;
+    case 'w':
+      app.warmup = true;
+      break;
+    case 'v':
+      app.rknn_app_ctx.verbose = true;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : -1;
+    }
+  }
+
+  for (int i = 0; i < app.n_outputs; i++) {
+    snprintf(app.output_paths[i], sizeof(app.output_paths[i]), "/live/%d", i);
+  }
+
+  // the frame loop logs through the writer thread, never on the console
+  async_log_init((alog_level)log_level);
+
+  app.detector = get_detector_backend(detector_name);
+  if (app.detector == NULL) {
+    printf("unknown detector %s\n", detector_name);
+    usage(argv[0]);
+    return -1;
+  }
+
+  // model load and RTSP do not depend on anything, so they come up in
+  // parallel with ISP and then MPI, which the SDK samples always start after
+  // the ISP. VI/VENC follow as soon as their inputs are ready.
+  // Teardown, after a failed startup and at exit, runs in reverse: venc,
+  // mb_pool, vi, isp, mpi, rtsp, model. The ISP stops before MPI exits, as
+  // in the SDK samples.
+  app.src_Pool = MB_INVALID_POOLID;
+  startup_graph_t startup;
+  startup_graph_init(&startup);
+  int model_stage = startup_graph_add(&startup, "model", stage_model, &app);
+  startup_graph_set_undo(&startup, model_stage, undo_model);
+  int rtsp_stage = startup_graph_add(&startup, "rtsp", stage_rtsp, &app);
+  startup_graph_set_undo(&startup, rtsp_stage, undo_rtsp);
+  int isp_stage = startup_graph_add(&startup, "isp", stage_isp, &app);
+  startup_graph_set_undo(&startup, isp_stage, undo_isp);
+  int mpi_stage = startup_graph_add(&startup, "mpi", stage_mpi, &app);
+  startup_graph_set_undo(&startup, mpi_stage, undo_mpi);
+  startup_graph_depend(&startup, mpi_stage, isp_stage);
+  startup_graph_undo_before(&startup, isp_stage, mpi_stage);
+  int vi_stage = startup_graph_add(&startup, "vi", stage_vi, &app);
+  startup_graph_set_undo(&startup, vi_stage, undo_vi);
+  startup_graph_depend(&startup, vi_stage, isp_stage);
+  startup_graph_depend(&startup, vi_stage, mpi_stage);
+  int pool_stage = startup_graph_add(&startup, "mb_pool", stage_mb_pool, &app);
+  startup_graph_set_undo(&startup, pool_stage, undo_mb_pool);
+  startup_graph_depend(&startup, pool_stage, mpi_stage);
+  int venc_stage = startup_graph_add(&startup, "venc", stage_venc, &app);
+  startup_graph_set_undo(&startup, venc_stage, undo_venc);
+  startup_graph_depend(&startup, venc_stage, mpi_stage);
+  startup_graph_depend(&startup, venc_stage, pool_stage);
+  ret = startup_graph_run(&startup, STARTUP_THREADS);
+  startup_graph_print(&startup);
+  if (ret != 0) {
+    printf("startup fail!\n");
+    startup_graph_undo(&startup);
+    startup_graph_deinit(&startup);
+    async_log_deinit();
+    return -1;
+  }
+
+  LATENCY_TRACE_INIT(LATENCY_DUMP_INTERVAL_S);
+  init_pipeline_metrics(&metrics);
+  if (metrics_port > 0) {
+    metrics_server_start(metrics_port);
+  }
+  if (bus_name != NULL) {
+    detect_bus_open(&detect_bus, bus_name);
+  }
+  detect_stream.fd = -1;
+  if (stream_dest != NULL &&
+      detect_stream_open(&detect_stream, stream_dest) == 0) {
+    box_tracker_init(&stream_tracker, STREAM_TRACK_IOU,
+                     STREAM_TRACK_MAX_MISSED);
+  }
+  PIPELINE_TRACE_INIT(PIPELINE_TRACE_EVENTS);
+  metric_set(metrics.venc_kbps, app.venc_config[0].kbps);
+  venc_roi_init(&venc_roi, width, height, app.venc_config[0].roi_qp,
+                ROI_REGIONS);
+  rga_batch_init(&rga);
+  // the frame block is BGR, no alignment
+  box_overlay_init(&overlay, width, height, OVERLAY_THICKNESS, 1);
+  if (privacy) {
+    privacy_mask_init(&privacy_mask, PRIVACY_CLASS, width, height,
+                      PRIVACY_BLOCK);
+  }
+
+  const detector_backend_t *detector = app.detector;
+  rknn_app_context_t &rknn_app_ctx = app.rknn_app_ctx;
+  model_scheduler_t &scheduler = app.scheduler;
+  const char *cls_model_path = app.cls_model_path;
+  frame_buffer_t *frame = app.frame;
+  frame_buffer_t *input = app.input;
+  rtsp_server_t *rtsp = app.rtsp;
+  video_output_t *outputs = app.outputs;
+  event_recorder_t *recorder = app.recorder;
+  snapshot_service_t *snapshots = app.snapshots;
+
+  RK_U64 H264_PTS = 0;
+  RK_U32 H264_TimeRef = 0;
+  VIDEO_FRAME_INFO_S stViFrame;
+
+  unsigned char *data = (unsigned char *)frame->vaddr;
+
   while (1) {
     // get vi frame
-    h264_frame.stVFrame.u32TimeRef = H264_TimeRef++;
-    h264_frame.stVFrame.u64PTS = TEST_COMM_GetNowUs();
+    RK_U32 time_ref = H264_TimeRef++;
+    H264_PTS = TEST_COMM_GetNowUs();
+    PIPELINE_TRACE_FRAME(H264_TimeRef);
+    PIPELINE_TRACE_BEGIN(TRACE_TRACK_CPU, "vi_wait");
     s32Ret = RK_MPI_VI_GetChnFrame(0, 0, &stViFrame, -1);
+    PIPELINE_TRACE_END(TRACE_TRACK_CPU, "vi_wait");
     if (s32Ret == RK_SUCCESS) {
-      void *vi_data = RK_MPI_MB_Handle2VirAddr(stViFrame.stVFrame.pMbBlk);
+      metric_inc(metrics.frames_captured);
+      RK_U64 capture_us = TEST_COMM_GetNowUs();
+      LATENCY_TRACE_MARK(TRACE_CAPTURE);
+
+      // frame buffer and model input on RGA, meanwhile the CPU wraps up
+      // after the previous frame
+      PIPELINE_TRACE_BEGIN(TRACE_TRACK_RGA, "preprocess");
+      bool rga_pending = preprocess_submit(&rga, &stViFrame.stVFrame, frame,
+                                           input) == 0;
+      frame_housekeeping(&app, &metrics);
+      bool rga_done = rga_pending && rga_batch_wait(&rga, -1) == 0;
+      PIPELINE_TRACE_END(TRACE_TRACK_RGA, "preprocess");
+
+      if (!rga_done) {
+        ALOGW("rga preprocess fail, using the CPU\n");
+        PIPELINE_TRACE_BEGIN(TRACE_TRACK_CPU, "preprocess");
+        void *vi_data = RK_MPI_MB_Handle2VirAddr(stViFrame.stVFrame.pMbBlk);
+        preprocess_cpu(vi_data, frame, input);
+        PIPELINE_TRACE_END(TRACE_TRACK_CPU, "preprocess");
+      }
+      LATENCY_TRACE_MARK(TRACE_PREPROCESS);
+      frame_buffer_sync_for_device(input);
+      RK_U64 inference_start_us = TEST_COMM_GetNowUs();
+      if (detector_inference(detector, &rknn_app_ctx, &od_results) != 0) {
+        // a failed run leaves the list half written, treat it as empty
+        ALOGW("inference fail, no detections this frame\n");
+        od_results.count = 0;
+      }
+      metric_observe(metrics.inference_ms,
+                     (TEST_COMM_GetNowUs() - inference_start_us) / 1000.0);
+      metric_inc(metrics.frames_inferred);
+      metric_add(metrics.detections, od_results.count);
+      metric_observe(metrics.detections_per_frame, od_results.count);
+      for (int i = 0; i < app.n_outputs; i++) {
+        bitrate_ctrl_frame(&outputs[i].bitrate, od_results.count);
+      }
+      if (recorder != NULL && od_results.count > 0) {
+        event_recorder_trigger(recorder, H264_PTS);
+      }
+      if (first_detection) {
+        printf("time to first detection: %llu ms\n",
+               (unsigned long long)(TEST_COMM_GetNowUs() - start_us) / 1000);
+        first_detection = false;
+      }
 
-      cv::Mat yuv420sp(height + height / 2, width, CV_8UC1, vi_data);
-      cv::Mat bgr(height, width, CV_8UC3, data);
+      box_overlay_map_t letterbox_map = {scaleX, scaleY, leftPadding,
+                                         topPadding};
+      for (int i = 0; i < od_results.count; i++) {
+        box_overlay_map_box(&letterbox_map, &od_results.results[i].box);
+      }
 
-      cv::cvtColor(yuv420sp, bgr, cv::COLOR_YUV420sp2BGR);
-      cv::resize(bgr, frame, cv::Size(width, height), 0, 0, cv::INTER_LINEAR);
+      // classify and take snapshots before any box is drawn into the frame;
+      // the classifier sees people unmasked, nothing that leaves does
+      int n_masks =
+          privacy ? privacy_mask_update(&privacy_mask, &od_results) : 0;
+      if (cls_model_path != NULL) {
+        scheduler_classify(&scheduler, frame, &od_results, od_attrs);
+      }
+      if (n_masks > 0) {
+        PIPELINE_TRACE_BEGIN(TRACE_TRACK_RGA, "mosaic");
+        if (apply_privacy_mask(&privacy_mask, frame) != 0) {
+          ALOGE("rga immosaicArray fail, masking on the CPU\n");
+          fill_privacy_mask_cpu(&privacy_mask, frame);
+        }
+        PIPELINE_TRACE_END(TRACE_TRACK_RGA, "mosaic");
+      }
+      if (snapshots != NULL) {
+        snapshot_service_capture(snapshots, frame, &od_results, H264_PTS);
+      }
 
-      // letterbox
-      cv::Mat letterboxImage = letterbox(frame);
-      memcpy(rknn_app_ctx.input_mems[0]->virt_addr, letterboxImage.data,
-             model_width * model_height * 3);
-      inference_yolov8_model(&rknn_app_ctx, &od_results);
+      // the boxes go to RGA in one job while the detections are published,
+      // the labels, and boxes too small for RGA, are drawn by the CPU
+      box_overlay_reset(&overlay);
+      for (int i = 0; i < od_results.count; i++) {
+        int index = box_overlay_add(&overlay, &od_results.results[i].box);
+        box_on_cpu[i] = index == BOX_OVERLAY_TOO_SMALL;
+      }
+      bool boxes_pending = false;
+      if (overlay.n_rects > 0) {
+        PIPELINE_TRACE_BEGIN(TRACE_TRACK_RGA, "boxes");
+        boxes_pending = overlay_submit(&rga, &overlay, frame) == 0;
+      }
+      detect_bus_publish(&detect_bus, capture_us, width, height, &od_results);
+      if (detect_stream.fd >= 0) {
+        box_tracker_update(&stream_tracker, &od_results, track_slots);
+        for (int i = 0; i < od_results.count; i++) {
+          object_ids[i] = track_slots[i] >= 0
+                              ? stream_tracker.tracks[track_slots[i]].id
+                              : 0;
+        }
+        // the PTS this frame is encoded with, so the NVR can match them up
+        detect_stream_send(&detect_stream, time_ref, H264_PTS, width, height,
+                           &od_results, object_ids);
+      }
+      bool boxes_drawn = overlay.n_rects == 0;
+      if (overlay.n_rects > 0) {
+        boxes_drawn = boxes_pending && rga_batch_wait(&rga, -1) == 0;
+        PIPELINE_TRACE_END(TRACE_TRACK_RGA, "boxes");
+        if (!boxes_drawn) {
+          ALOGW("rga boxes fail, drawing them on the CPU\n");
+        }
+      }
 
+      // the labels go on top of what the devices wrote, a frame without
+      // objects is never invalidated
+      PIPELINE_TRACE_BEGIN(TRACE_TRACK_CPU, "overlay");
+      if (od_results.count > 0) {
+        frame_buffer_sync_for_cpu(frame);
+        frame_buffer_cpu_wrote(frame);
+      }
       for (int i = 0; i < od_results.count; i++) {
-        if (od_results.count >= 1) {
-          object_detect_result *det_result = &(od_results.results[i]);
-
-          sX = (int)(det_result->box.left);
-          sY = (int)(det_result->box.top);
-          eX = (int)(det_result->box.right);
-          eY = (int)(det_result->box.bottom);
-          mapCoordinates(&sX, &sY);
-          mapCoordinates(&eX, &eY);
-
-          printf("%s @ (%d %d %d %d) %.3f\n",
-                 coco_cls_to_name(det_result->cls_id), sX, sY, eX, eY,
-                 det_result->prop);
-
-          cv::rectangle(frame, cv::Point(sX, sY), cv::Point(eX, eY),
-                        cv::Scalar(0, 255, 0), 3);
-          sprintf(text, "%s %.1f%%", coco_cls_to_name(det_result->cls_id),
-                  det_result->prop * 100);
-          cv::putText(frame, text, cv::Point(sX, sY - 8),
-                      cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
+        object_detect_result *det_result = &(od_results.results[i]);
+
+        sX = (int)(det_result->box.left);
+        sY = (int)(det_result->box.top);
+        eX = (int)(det_result->box.right);
+        eY = (int)(det_result->box.bottom);
+
+        ALOGI("%s @ (%d %d %d %d) %.3f\n",
+              coco_cls_to_name(det_result->cls_id), sX, sY, eX, eY,
+              det_result->prop);
+
+        if (!boxes_drawn || box_on_cpu[i]) {
+          draw_box_cpu(data, sX, sY, eX, eY);
         }
+        if (cls_model_path != NULL && od_attrs[i].cls_id >= 0) {
+          snprintf(text, sizeof(text), "%s %s %.1f%%",
+                   coco_cls_to_name(det_result->cls_id),
+                   scheduler_attr_name(&scheduler, od_attrs[i].cls_id),
+                   det_result->prop * 100);
+        } else {
+          snprintf(text, sizeof(text), "%s %.1f%%",
+                   coco_cls_to_name(det_result->cls_id),
+                   det_result->prop * 100);
+        }
+        draw_label_cpu(data, sX, sY, text);
+      }
+      PIPELINE_TRACE_END(TRACE_TRACK_CPU, "overlay");
+
+      // lower QP on the objects of the frame about to be encoded
+      if (venc_roi.qp != 0 && venc_roi_update(&venc_roi, &od_results) > 0) {
+        venc_apply_roi(outputs[0].chn, &venc_roi);
       }
+    } else {
+      metric_inc(metrics.capture_errors);
+      frame_housekeeping(&app, &metrics);
     }
-    memcpy(data, frame.data, width * height * 3);
+    LATENCY_TRACE_MARK(TRACE_OVERLAY);
 
-    // encode H264
-    RK_MPI_VENC_SendFrame(0, &h264_frame, -1);
+    // encode, all channels at once; sub-streams read the frame through RGA
+    PIPELINE_TRACE_BEGIN(TRACE_TRACK_VENC, "encode");
+    for (int i = 0; i < app.n_outputs; i++) {
+      if (video_output_send(&outputs[i], time_ref, H264_PTS) != 0) {
+        ALOGW("%s encode fail\n", outputs[i].path);
+      }
+    }
 
     // rtsp
-    s32Ret = RK_MPI_VENC_GetStream(0, &stFrame, -1);
-    if (s32Ret == RK_SUCCESS) {
-      if (g_rtsplive && g_rtsp_session) {
-        // printf("len = %d PTS = %d \n",stFrame.pstPack->u32Len,
-        // stFrame.pstPack->u64PTS);
-        void *pData = RK_MPI_MB_Handle2VirAddr(stFrame.pstPack->pMbBlk);
-        rtsp_tx_video(g_rtsp_session, (uint8_t *)pData, stFrame.pstPack->u32Len,
-                      stFrame.pstPack->u64PTS);
-        rtsp_do_event(g_rtsplive);
+    for (int i = 0; i < app.n_outputs; i++) {
+      s32Ret = video_output_get(&outputs[i]);
+      if (i == 0) {
+        PIPELINE_TRACE_END(TRACE_TRACK_VENC, "encode");
       }
+      if (s32Ret != 0) {
+        metric_inc(metrics.encode_errors);
+        continue;
+      }
+      if (i == 0) {
+        metric_inc(metrics.frames_encoded);
+        LATENCY_TRACE_MARK(TRACE_ENCODE);
+      }
+      if (rtsp != NULL) {
+        // the server thread packetizes and sends, this only queues
+        VENC_PACK_S *pack = outputs[i].stream.pstPack;
+        void *pData = RK_MPI_MB_Handle2VirAddr(pack->pMbBlk);
+        PIPELINE_TRACE_BEGIN(TRACE_TRACK_RTSP, "tx");
+        rtsp_server_push(rtsp, app.rtsp_streams[i], (uint8_t *)pData,
+                         pack->u32Len, pack->u64PTS);
+        PIPELINE_TRACE_END(TRACE_TRACK_RTSP, "tx");
+        if (i == 0) {
+          LATENCY_TRACE_MARK(TRACE_RTSP_TX);
+        }
+      }
+      if (recorder != NULL && i == 0) {
+        // a copy into the pre-roll ring, the writer thread does the I/O
+        VENC_PACK_S *pack = outputs[i].stream.pstPack;
+        event_recorder_push(recorder,
+                            (uint8_t *)RK_MPI_MB_Handle2VirAddr(pack->pMbBlk),
+                            pack->u32Len, pack->u64PTS);
+      }
+      video_output_release(&outputs[i]);
     }
 
     // release frame
@@ -210,36 +1195,19 @@ int main(int argc, char *argv[]) {
     if (s32Ret != RK_SUCCESS) {
       RK_LOGE("RK_MPI_VI_ReleaseChnFrame fail %x", s32Ret);
     }
-    s32Ret = RK_MPI_VENC_ReleaseStream(0, &stFrame);
-    if (s32Ret != RK_SUCCESS) {
-      RK_LOGE("RK_MPI_VENC_ReleaseStream fail %x", s32Ret);
-    }
     memset(text, 0, 8);
   }
 
-  // Destory MB
-  RK_MPI_MB_ReleaseMB(src_Blk);
-  // Destory Pool
-  RK_MPI_MB_DestroyPool(src_Pool);
-
-  RK_MPI_VI_DisableChn(0, 0);
-  RK_MPI_VI_DisableDev(0);
-
-  SAMPLE_COMM_ISP_Stop(0);
-
-  RK_MPI_VENC_StopRecvFrame(0);
-  RK_MPI_VENC_DestroyChn(0);
-
-  free(stFrame.pstPack);
-
-  if (g_rtsplive)
-    rtsp_del_demo(g_rtsplive);
-
-  RK_MPI_SYS_Exit();
-
-  // Release rknn model
-  release_yolov8_model(&rknn_app_ctx);
-  deinit_post_process();
+  // the outputs hold references on the frame, the last one gives the block
+  // back to the pool; the stages go in the same order as on a failed startup
+  rga_batch_deinit(&rga);
+  startup_graph_undo(&startup);
+  startup_graph_deinit(&startup);
+  PIPELINE_TRACE_DEINIT();
+  detect_stream_close(&detect_stream);
+  detect_bus_close(&detect_bus);
+  metrics_server_stop();
+  async_log_deinit();
 
   return 0;
 }
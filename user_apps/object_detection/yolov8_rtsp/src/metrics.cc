@@ -0,0 +1,252 @@
+#include "metrics.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define METRICS_PAGE_BYTES 16384
+#define METRICS_POLL_MS 500
+
+static metric_t registry[METRICS_MAX];
+static int n_metrics;
+
+static int listen_fd = -1;
+static pthread_t server_thread;
+static std::atomic<bool> server_running;
+
+static metric_t *register_metric(const char *name, const char *help,
+                                 metric_type type) {
+  if (n_metrics >= METRICS_MAX) {
+    printf("metrics registry full, %s not registered\n", name);
+    return NULL;
+  }
+  metric_t *metric = &registry[n_metrics++];
+  metric->name = name;
+  metric->help = help;
+  metric->type = type;
+  return metric;
+}
+
+metric_t *metrics_counter(const char *name, const char *help) {
+  return register_metric(name, help, METRIC_COUNTER);
+}
+
+metric_t *metrics_gauge(const char *name, const char *help) {
+  return register_metric(name, help, METRIC_GAUGE);
+}
+
+metric_t *metrics_histogram(const char *name, const char *help,
+                            const double *bounds, int n_bounds) {
+  metric_t *metric = register_metric(name, help, METRIC_HISTOGRAM);
+  if (metric == NULL) {
+    return NULL;
+  }
+  metric->n_bounds =
+      n_bounds < METRIC_MAX_BUCKETS ? n_bounds : METRIC_MAX_BUCKETS;
+  memcpy(metric->bounds, bounds, metric->n_bounds * sizeof(double));
+  return metric;
+}
+
+void metric_observe(metric_t *metric, double value) {
+  if (metric == NULL) {
+    return;
+  }
+  int b = 0;
+  while (b < metric->n_bounds && value > metric->bounds[b]) {
+    b++;
+  }
+  metric->buckets[b].fetch_add(1, std::memory_order_relaxed);
+  double sum = metric->value.load(std::memory_order_relaxed);
+  while (!metric->value.compare_exchange_weak(sum, sum + value,
+                                              std::memory_order_relaxed)) {
+  }
+}
+
+static const char *metric_type_name(metric_type type) {
+  switch (type) {
+  case METRIC_COUNTER:
+    return "counter";
+  case METRIC_GAUGE:
+    return "gauge";
+  case METRIC_HISTOGRAM:
+    return "histogram";
+  }
+  return "untyped";
+}
+
+// HELP text escapes backslash and newline, truncated to fit out
+static void escape_help(const char *help, char *out, size_t size) {
+  size_t n = 0;
+  for (; *help != '\0' && n + 2 < size; help++) {
+    if (*help == '\\' || *help == '\n') {
+      out[n++] = '\\';
+      out[n++] = *help == '\n' ? 'n' : '\\';
+    } else {
+      out[n++] = *help;
+    }
+  }
+  out[n] = '\0';
+}
+
+int metrics_format(char *buf, size_t size) {
+  size_t n = 0;
+  char help[256];
+
+#define APPEND(...)                                                            \
+  do {                                                                         \
+    if (n < size) {                                                            \
+      int len = snprintf(buf + n, size - n, __VA_ARGS__);                      \
+      n += len > 0 ? (size_t)len : 0;                                          \
+    }                                                                          \
+  } while (0)
+
+  for (int i = 0; i < n_metrics; i++) {
+    metric_t *m = &registry[i];
+    escape_help(m->help, help, sizeof(help));
+    APPEND("# HELP %s %s\n# TYPE %s %s\n", m->name, help, m->name,
+           metric_type_name(m->type));
+    switch (m->type) {
+    case METRIC_COUNTER:
+      APPEND("%s %llu\n", m->name,
+             (unsigned long long)m->count.load(std::memory_order_relaxed));
+      break;
+    case METRIC_GAUGE:
+      APPEND("%s %.10g\n", m->name, m->value.load(std::memory_order_relaxed));
+      break;
+    case METRIC_HISTOGRAM: {
+      // buckets are cumulative in the exposition format
+      uint64_t cumulative = 0;
+      for (int b = 0; b <= m->n_bounds; b++) {
+        cumulative += m->buckets[b].load(std::memory_order_relaxed);
+        if (b < m->n_bounds) {
+          APPEND("%s_bucket{le=\"%g\"} %llu\n", m->name, m->bounds[b],
+                 (unsigned long long)cumulative);
+        } else {
+          APPEND("%s_bucket{le=\"+Inf\"} %llu\n", m->name,
+                 (unsigned long long)cumulative);
+        }
+      }
+      APPEND("%s_sum %.10g\n%s_count %llu\n", m->name,
+             m->value.load(std::memory_order_relaxed), m->name,
+             (unsigned long long)cumulative);
+      break;
+    }
+    }
+  }
+#undef APPEND
+
+  if (n >= size) {
+    n = size - 1;
+  }
+  return (int)n;
+}
+
+static void write_all(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    // a scraper that hangs up early must not SIGPIPE the app
+    ssize_t ret = send(fd, data, len, MSG_NOSIGNAL);
+    if (ret <= 0) {
+      return;
+    }
+    data += ret;
+    len -= ret;
+  }
+}
+
+static void serve_client(int fd, char *page) {
+  char request[512];
+  struct pollfd pfd = {fd, POLLIN, 0};
+
+  // only the request line matters, and a stuck client must not hang us
+  if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) {
+    return;
+  }
+  ssize_t len = read(fd, request, sizeof(request) - 1);
+  if (len <= 0) {
+    return;
+  }
+  request[len] = '\0';
+
+  char header[160];
+  if (strncmp(request, "GET /metrics", 12) != 0 &&
+      strncmp(request, "GET / ", 6) != 0) {
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+    write_all(fd, header, n);
+    return;
+  }
+  int body = metrics_format(page, METRICS_PAGE_BYTES);
+  int n = snprintf(header, sizeof(header),
+                   "HTTP/1.0 200 OK\r\n"
+                   "Content-Type: text/plain; version=0.0.4\r\n"
+                   "Content-Length: %d\r\n\r\n",
+                   body);
+  write_all(fd, header, n);
+  write_all(fd, page, body);
+}
+
+static void *server_loop(void *arg) {
+  static char page[METRICS_PAGE_BYTES];
+  struct pollfd pfd = {listen_fd, POLLIN, 0};
+
+  while (server_running.load(std::memory_order_relaxed)) {
+    if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) {
+      continue;
+    }
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    serve_client(fd, page);
+    close(fd);
+  }
+  return NULL;
+}
+
+int metrics_server_start(int port) {
+  struct sockaddr_in addr;
+  int one = 1;
+
+  listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    printf("metrics socket fail!\n");
+    return -1;
+  }
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listen_fd, 4) < 0) {
+    printf("metrics bind 127.0.0.1:%d fail!\n", port);
+    close(listen_fd);
+    listen_fd = -1;
+    return -1;
+  }
+
+  server_running.store(true);
+  if (pthread_create(&server_thread, NULL, server_loop, NULL) != 0) {
+    server_running.store(false);
+    close(listen_fd);
+    listen_fd = -1;
+    return -1;
+  }
+  printf("metrics on http://127.0.0.1:%d/metrics\n", port);
+  return 0;
+}
+
+void metrics_server_stop() {
+  if (listen_fd < 0) {
+    return;
+  }
+  server_running.store(false);
+  pthread_join(server_thread, NULL);
+  close(listen_fd);
+  listen_fd = -1;
+}
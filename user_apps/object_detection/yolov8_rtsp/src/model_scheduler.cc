@@ -0,0 +1,288 @@
+#include "model_scheduler.h"
+#include "async_log.h"
+#include "pipeline_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#define SCHED_TRACK_IOU 0.3f
+#define SCHED_TRACK_MAX_MISSED 15
+#define SCHED_REFRESH_FRAMES 30
+
+static uint64_t get_now_us() {
+  struct timespec time = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000 + (uint64_t)time.tv_nsec / 1000;
+}
+
+static int clamp_int(int val, int min, int max) {
+  return val > min ? (val < max ? val : max) : min;
+}
+
+static object_attr_result decode_classifier(rknn_app_context_t *ctx) {
+  object_attr_result attr = {-1, 0.f};
+  rknn_tensor_attr *out = &ctx->output_attrs[0];
+  void *buf = ctx->output_mems[0]->virt_addr;
+
+  if (ctx->is_quant) {
+    int8_t *scores = (int8_t *)buf;
+    int8_t max_score = -128;
+    for (uint32_t c = 0; c < out->n_elems; c++) {
+      if (scores[c] > max_score) {
+        max_score = scores[c];
+        attr.cls_id = c;
+      }
+    }
+    attr.prop = ((float)max_score - (float)out->zp) * out->scale;
+  } else {
+    float *scores = (float *)buf;
+    float max_score = -1e30f;
+    for (uint32_t c = 0; c < out->n_elems; c++) {
+      if (scores[c] > max_score) {
+        max_score = scores[c];
+        attr.cls_id = c;
+      }
+    }
+    attr.prop = max_score;
+  }
+  return attr;
+}
+
+int init_model_scheduler(model_scheduler_t *sched, rknn_app_context_t *det_ctx,
+                         const char *cls_model_path,
+                         const char *cls_labels_path, int top_n,
+                         int budget_us) {
+  memset(sched, 0, sizeof(model_scheduler_t));
+  sched->det_ctx = det_ctx;
+  sched->top_n = clamp_int(top_n, 1, SCHED_MAX_CROPS);
+  sched->budget_us = budget_us;
+  sched->refresh_frames = SCHED_REFRESH_FRAMES;
+  box_tracker_init(&sched->tracker, SCHED_TRACK_IOU, SCHED_TRACK_MAX_MISSED);
+
+  // both models run one after the other, so the classifier follows the
+  // detector when it leaves its internal memory to a shared rknn_mem_pool
+  rknn_app_context_t *cls_ctx = &sched->cls_ctx;
+  cls_ctx->init_flags = det_ctx->init_flags & RKNN_FLAG_INTERNAL_ALLOC_OUTSIDE;
+  cls_ctx->verbose = det_ctx->verbose;
+  if (init_yolov8_model(cls_model_path, cls_ctx) != 0) {
+    printf("init classifier %s fail!\n", cls_model_path);
+    return -1;
+  }
+
+  // the crop batch replaces the input tensor created by the loader
+  rknn_tensor_attr *in_attr = &cls_ctx->input_attrs[0];
+  rknn_destroy_mem(cls_ctx->rknn_ctx, cls_ctx->input_mems[0]);
+  cls_ctx->input_mems[0] = NULL;
+
+  int slot_size = in_attr->size_with_stride;
+  sched->slot_wstride =
+      in_attr->w_stride ? in_attr->w_stride : cls_ctx->model_width;
+  sched->batch_mem =
+      rknn_create_mem(cls_ctx->rknn_ctx, slot_size * sched->top_n);
+  if (sched->batch_mem == NULL) {
+    printf("classifier batch alloc fail!\n");
+    return -1;
+  }
+  for (int k = 0; k < sched->top_n; k++) {
+    sched->slot_mems[k] = rknn_create_mem_from_fd(
+        cls_ctx->rknn_ctx, sched->batch_mem->fd, sched->batch_mem->virt_addr,
+        slot_size, k * slot_size);
+    if (sched->slot_mems[k] == NULL) {
+      printf("classifier batch slot %d alloc fail!\n", k);
+      return -1;
+    }
+  }
+  sched->batch_handle =
+      importbuffer_fd(sched->batch_mem->fd, slot_size * sched->top_n);
+  if (sched->batch_handle == 0) {
+    printf("classifier batch importbuffer_fd fail!\n");
+    return -1;
+  }
+
+  if (cls_labels_path != NULL &&
+      read_label_file(cls_labels_path, sched->cls_labels,
+                      SCHED_MAX_ATTR_CLASS) < 0) {
+    printf("Load %s failed!\n", cls_labels_path);
+  }
+
+  printf("classifier %dx%d, top %d crops, budget %d us\n",
+         cls_ctx->model_width, cls_ctx->model_height, sched->top_n,
+         sched->budget_us);
+  return 0;
+}
+
+int release_model_scheduler(model_scheduler_t *sched) {
+  rknn_app_context_t *cls_ctx = &sched->cls_ctx;
+
+  if (sched->batch_handle != 0) {
+    releasebuffer_handle(sched->batch_handle);
+    sched->batch_handle = 0;
+  }
+  for (int k = 0; k < SCHED_MAX_CROPS; k++) {
+    if (sched->slot_mems[k] != NULL) {
+      rknn_destroy_mem(cls_ctx->rknn_ctx, sched->slot_mems[k]);
+      sched->slot_mems[k] = NULL;
+    }
+  }
+  if (sched->batch_mem != NULL) {
+    rknn_destroy_mem(cls_ctx->rknn_ctx, sched->batch_mem);
+    sched->batch_mem = NULL;
+  }
+  for (int i = 0; i < SCHED_MAX_ATTR_CLASS; i++) {
+    if (sched->cls_labels[i] != NULL) {
+      free(sched->cls_labels[i]);
+      sched->cls_labels[i] = NULL;
+    }
+  }
+  return release_yolov8_model(cls_ctx);
+}
+
+// Crop the selected detections into consecutive batch slots with one RGA job
+static int crop_to_batch(model_scheduler_t *sched, frame_buffer_t *frame,
+                         object_detect_result_list *od_results,
+                         const int *selected, int count) {
+  rknn_app_context_t *cls_ctx = &sched->cls_ctx;
+  int model_w = cls_ctx->model_width;
+  int model_h = cls_ctx->model_height;
+
+  rga_buffer_t src = frame_buffer_rga(frame);
+  if (src.handle == 0) {
+    return -1;
+  }
+  rga_buffer_t dst = wrapbuffer_handle(
+      sched->batch_handle, model_w, model_h * sched->top_n, RK_FORMAT_RGB_888,
+      sched->slot_wstride, model_h * sched->top_n);
+  rga_buffer_t pat;
+  memset(&pat, 0, sizeof(pat));
+  im_rect prect = {0, 0, 0, 0};
+
+  im_job_handle_t job = imbeginJob();
+  if (job == 0) {
+    ALOGE("rga imbeginJob fail!\n");
+    return -1;
+  }
+  for (int k = 0; k < count; k++) {
+    image_rect_t *box = &od_results->results[selected[k]].box;
+    int left = clamp_int(box->left, 0, frame->width - 2);
+    int top = clamp_int(box->top, 0, frame->height - 2);
+    int right = clamp_int(box->right, left + 2, frame->width);
+    int bottom = clamp_int(box->bottom, top + 2, frame->height);
+    im_rect srect = {left, top, right - left, bottom - top};
+    im_rect drect = {0, k * model_h, model_w, model_h};
+    if (improcessTask(job, src, dst, pat, srect, drect, prect, NULL, 0) !=
+        IM_STATUS_SUCCESS) {
+      ALOGE("rga improcessTask fail!\n");
+      imcancelJob(job);
+      return -1;
+    }
+  }
+  if (imendJob(job) != IM_STATUS_SUCCESS) {
+    ALOGE("rga imendJob fail!\n");
+    return -1;
+  }
+  return 0;
+}
+
+int scheduler_classify(model_scheduler_t *sched, frame_buffer_t *src,
+                       object_detect_result_list *od_results,
+                       object_attr_result *attrs) {
+  rknn_app_context_t *cls_ctx = &sched->cls_ctx;
+  int track_slots[OBJ_NUMB_MAX_SIZE];
+  int candidates[OBJ_NUMB_MAX_SIZE];
+  int n_candidates = 0;
+  int ret;
+
+  sched->frame++;
+  box_tracker_update(&sched->tracker, od_results, track_slots);
+
+  // carry forward what is known, collect objects that need the classifier
+  for (int i = 0; i < od_results->count; i++) {
+    int slot = track_slots[i];
+    attrs[i].cls_id = -1;
+    attrs[i].prop = 0.f;
+    if (slot < 0) {
+      continue;
+    }
+    sched_attr_cache_t *cache = &sched->cache[slot];
+    if (cache->track_id != sched->tracker.tracks[slot].id) {
+      cache->track_id = sched->tracker.tracks[slot].id;
+      cache->attr.cls_id = -1;
+      cache->attr.prop = 0.f;
+    }
+    attrs[i] = cache->attr;
+    if (cache->attr.cls_id < 0 ||
+        sched->frame - cache->frame >= sched->refresh_frames) {
+      candidates[n_candidates++] = i;
+    }
+  }
+  if (n_candidates == 0) {
+    return 0;
+  }
+
+  // objects never classified first, then the most confident detections
+  std::sort(candidates, candidates + n_candidates, [&](int a, int b) {
+    bool new_a = attrs[a].cls_id < 0;
+    bool new_b = attrs[b].cls_id < 0;
+    if (new_a != new_b) {
+      return new_a;
+    }
+    return od_results->results[a].prop > od_results->results[b].prop;
+  });
+  int count = std::min(n_candidates, sched->top_n);
+
+  frame_buffer_sync_for_device(src);
+  PIPELINE_TRACE_BEGIN(TRACE_TRACK_RGA, "crop");
+  ret = crop_to_batch(sched, src, od_results, candidates, count);
+  PIPELINE_TRACE_END(TRACE_TRACK_RGA, "crop");
+  if (ret != 0) {
+    return -1;
+  }
+
+  uint64_t start_us = get_now_us();
+  int classified = 0;
+  for (int k = 0; k < count; k++) {
+    // the first crop always runs so every object makes progress
+    if (k > 0 && (int)(get_now_us() - start_us) + sched->avg_run_us >
+                     sched->budget_us) {
+      break;
+    }
+    ret = rknn_set_io_mem(cls_ctx->rknn_ctx, sched->slot_mems[k],
+                          &cls_ctx->input_attrs[0]);
+    if (ret < 0) {
+      ALOGE("classifier rknn_set_io_mem fail! ret=%d\n", ret);
+      return -1;
+    }
+    uint64_t run_start_us = get_now_us();
+    PIPELINE_TRACE_BEGIN(TRACE_TRACK_NPU, "classifier");
+    ret = rknn_run(cls_ctx->rknn_ctx, nullptr);
+    PIPELINE_TRACE_END(TRACE_TRACK_NPU, "classifier");
+    if (ret < 0) {
+      ALOGE("classifier rknn_run fail! ret=%d\n", ret);
+      return -1;
+    }
+    int run_us = (int)(get_now_us() - run_start_us);
+    sched->avg_run_us = sched->avg_run_us
+                            ? (sched->avg_run_us * 7 + run_us) / 8
+                            : run_us;
+
+    int i = candidates[k];
+    sched_attr_cache_t *cache = &sched->cache[track_slots[i]];
+    cache->attr = decode_classifier(cls_ctx);
+    cache->frame = sched->frame;
+    attrs[i] = cache->attr;
+    classified++;
+  }
+  return classified;
+}
+
+const char *scheduler_attr_name(model_scheduler_t *sched, int cls_id) {
+  if (cls_id < 0 || cls_id >= SCHED_MAX_ATTR_CLASS ||
+      sched->cls_labels[cls_id] == NULL) {
+    return "null";
+  }
+  return sched->cls_labels[cls_id];
+}
@@ -0,0 +1,68 @@
+#include "nal_parser.h"
+
+// Position of the next 00 00 01, or end
+static const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end) {
+  while (end - p >= 3) {
+    // the third byte decides how far the scan may jump
+    if (p[2] > 1) {
+      p += 3;
+    } else if (p[2] == 0) {
+      p++;
+    } else if (p[0] == 0 && p[1] == 0) {
+      return p;
+    } else {
+      p += 3;
+    }
+  }
+  return end;
+}
+
+int nal_split(nal_codec codec, const uint8_t *data, size_t len,
+              nal_unit_t *nals, int max_nals) {
+  const uint8_t *end = data + len;
+  const uint8_t *p = find_start_code(data, end);
+  int n = 0;
+
+  while (p < end && n < max_nals) {
+    const uint8_t *nal = p + 3;
+    const uint8_t *next = find_start_code(nal, end);
+    const uint8_t *nal_end = next;
+    // the leading zero of a 4 byte start code, and trailing_zero_8bits
+    while (nal_end > nal && nal_end[-1] == 0) {
+      nal_end--;
+    }
+    if (nal_end > nal) {
+      nals[n].offset = nal - data;
+      nals[n].len = nal_end - nal;
+      nals[n].type = nal_type(codec, nal);
+      n++;
+    }
+    p = next;
+  }
+  return n;
+}
+
+int nal_base64(const uint8_t *data, size_t len, char *out, size_t size) {
+  static const char table[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t n = 0;
+
+  if ((len + 2) / 3 * 4 + 1 > size) {
+    return -1;
+  }
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = data[i] << 16;
+    if (i + 1 < len) {
+      v |= data[i + 1] << 8;
+    }
+    if (i + 2 < len) {
+      v |= data[i + 2];
+    }
+    out[n++] = table[(v >> 18) & 0x3f];
+    out[n++] = table[(v >> 12) & 0x3f];
+    out[n++] = i + 1 < len ? table[(v >> 6) & 0x3f] : '=';
+    out[n++] = i + 2 < len ? table[v & 0x3f] : '=';
+  }
+  out[n] = '\0';
+  return (int)n;
+}
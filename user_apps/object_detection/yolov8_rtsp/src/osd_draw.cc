@@ -0,0 +1,291 @@
+#include "osd_draw.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define FONT_FIRST 32
+#define FONT_LAST 127
+
+// The 6x8 font of user_apps/ssd1306_driver, ASCII 32 to 127. One byte per
+// column, bit 0 is the top row.
+static const uint8_t font6x8[FONT_LAST - FONT_FIRST + 1][OSD_FONT_WIDTH] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // sp
+    {0x00, 0x00, 0x00, 0x2f, 0x00, 0x00}, // !
+    {0x00, 0x00, 0x07, 0x00, 0x07, 0x00}, // "
+    {0x00, 0x14, 0x7f, 0x14, 0x7f, 0x14}, // #
+    {0x00, 0x24, 0x2a, 0x7f, 0x2a, 0x12}, // $
+    {0x00, 0x23, 0x13, 0x08, 0x64, 0x62}, // %
+    {0x00, 0x36, 0x49, 0x55, 0x22, 0x50}, // &
+    {0x00, 0x00, 0x05, 0x03, 0x00, 0x00}, // '
+    {0x00, 0x00, 0x1c, 0x22, 0x41, 0x00}, // (
+    {0x00, 0x00, 0x41, 0x22, 0x1c, 0x00}, // )
+    {0x00, 0x14, 0x08, 0x3e, 0x08, 0x14}, // *
+    {0x00, 0x08, 0x08, 0x3e, 0x08, 0x08}, // +
+    {0x00, 0x00, 0x00, 0xa0, 0x60, 0x00}, // ,
+    {0x00, 0x08, 0x08, 0x08, 0x08, 0x08}, // -
+    {0x00, 0x00, 0x60, 0x60, 0x00, 0x00}, // .
+    {0x00, 0x20, 0x10, 0x08, 0x04, 0x02}, // /
+    {0x00, 0x3e, 0x51, 0x49, 0x45, 0x3e}, // 0
+    {0x00, 0x00, 0x42, 0x7f, 0x40, 0x00}, // 1
+    {0x00, 0x42, 0x61, 0x51, 0x49, 0x46}, // 2
+    {0x00, 0x21, 0x41, 0x45, 0x4b, 0x31}, // 3
+    {0x00, 0x18, 0x14, 0x12, 0x7f, 0x10}, // 4
+    {0x00, 0x27, 0x45, 0x45, 0x45, 0x39}, // 5
+    {0x00, 0x3c, 0x4a, 0x49, 0x49, 0x30}, // 6
+    {0x00, 0x01, 0x71, 0x09, 0x05, 0x03}, // 7
+    {0x00, 0x36, 0x49, 0x49, 0x49, 0x36}, // 8
+    {0x00, 0x06, 0x49, 0x49, 0x29, 0x1e}, // 9
+    {0x00, 0x00, 0x36, 0x36, 0x00, 0x00}, // :
+    {0x00, 0x00, 0x56, 0x36, 0x00, 0x00}, // ;
+    {0x00, 0x08, 0x14, 0x22, 0x41, 0x00}, // <
+    {0x00, 0x14, 0x14, 0x14, 0x14, 0x14}, // =
+    {0x00, 0x00, 0x41, 0x22, 0x14, 0x08}, // >
+    {0x00, 0x02, 0x01, 0x51, 0x09, 0x06}, // ?
+    {0x00, 0x32, 0x49, 0x59, 0x51, 0x3e}, // @
+    {0x00, 0x7c, 0x12, 0x11, 0x12, 0x7c}, // A
+    {0x00, 0x7f, 0x49, 0x49, 0x49, 0x36}, // B
+    {0x00, 0x3e, 0x41, 0x41, 0x41, 0x22}, // C
+    {0x00, 0x7f, 0x41, 0x41, 0x22, 0x1c}, // D
+    {0x00, 0x7f, 0x49, 0x49, 0x49, 0x41}, // E
+    {0x00, 0x7f, 0x09, 0x09, 0x09, 0x01}, // F
+    {0x00, 0x3e, 0x41, 0x49, 0x49, 0x7a}, // G
+    {0x00, 0x7f, 0x08, 0x08, 0x08, 0x7f}, // H
+    {0x00, 0x00, 0x41, 0x7f, 0x41, 0x00}, // I
+    {0x00, 0x20, 0x40, 0x41, 0x3f, 0x01}, // J
+    {0x00, 0x7f, 0x08, 0x14, 0x22, 0x41}, // K
+    {0x00, 0x7f, 0x40, 0x40, 0x40, 0x40}, // L
+    {0x00, 0x7f, 0x02, 0x0c, 0x02, 0x7f}, // M
+    {0x00, 0x7f, 0x04, 0x08, 0x10, 0x7f}, // N
+    {0x00, 0x3e, 0x41, 0x41, 0x41, 0x3e}, // O
+    {0x00, 0x7f, 0x09, 0x09, 0x09, 0x06}, // P
+    {0x00, 0x3e, 0x41, 0x51, 0x21, 0x5e}, // Q
+    {0x00, 0x7f, 0x09, 0x19, 0x29, 0x46}, // R
+    {0x00, 0x46, 0x49, 0x49, 0x49, 0x31}, // S
+    {0x00, 0x01, 0x01, 0x7f, 0x01, 0x01}, // T
+    {0x00, 0x3f, 0x40, 0x40, 0x40, 0x3f}, // U
+    {0x00, 0x1f, 0x20, 0x40, 0x20, 0x1f}, // V
+    {0x00, 0x3f, 0x40, 0x38, 0x40, 0x3f}, // W
+    {0x00, 0x63, 0x14, 0x08, 0x14, 0x63}, // X
+    {0x00, 0x07, 0x08, 0x70, 0x08, 0x07}, // Y
+    {0x00, 0x61, 0x51, 0x49, 0x45, 0x43}, // Z
+    {0x00, 0x00, 0x7f, 0x41, 0x41, 0x00}, // [
+    {0x00, 0x55, 0x2a, 0x55, 0x2a, 0x55}, // 55
+    {0x00, 0x00, 0x41, 0x41, 0x7f, 0x00}, // ]
+    {0x00, 0x04, 0x02, 0x01, 0x02, 0x04}, // ^
+    {0x00, 0x40, 0x40, 0x40, 0x40, 0x40}, // _
+    {0x00, 0x00, 0x01, 0x02, 0x04, 0x00}, // '
+    {0x00, 0x20, 0x54, 0x54, 0x54, 0x78}, // a
+    {0x00, 0x7f, 0x48, 0x44, 0x44, 0x38}, // b
+    {0x00, 0x38, 0x44, 0x44, 0x44, 0x20}, // c
+    {0x00, 0x38, 0x44, 0x44, 0x48, 0x7f}, // d
+    {0x00, 0x38, 0x54, 0x54, 0x54, 0x18}, // e
+    {0x00, 0x08, 0x7e, 0x09, 0x01, 0x02}, // f
+    {0x00, 0x18, 0xa4, 0xa4, 0xa4, 0x7c}, // g
+    {0x00, 0x7f, 0x08, 0x04, 0x04, 0x78}, // h
+    {0x00, 0x00, 0x44, 0x7d, 0x40, 0x00}, // i
+    {0x00, 0x40, 0x80, 0x84, 0x7d, 0x00}, // j
+    {0x00, 0x7f, 0x10, 0x28, 0x44, 0x00}, // k
+    {0x00, 0x00, 0x41, 0x7f, 0x40, 0x00}, // l
+    {0x00, 0x7c, 0x04, 0x18, 0x04, 0x78}, // m
+    {0x00, 0x7c, 0x08, 0x04, 0x04, 0x78}, // n
+    {0x00, 0x38, 0x44, 0x44, 0x44, 0x38}, // o
+    {0x00, 0xfc, 0x24, 0x24, 0x24, 0x18}, // p
+    {0x00, 0x18, 0x24, 0x24, 0x18, 0xfc}, // q
+    {0x00, 0x7c, 0x08, 0x04, 0x04, 0x08}, // r
+    {0x00, 0x48, 0x54, 0x54, 0x54, 0x20}, // s
+    {0x00, 0x04, 0x3f, 0x44, 0x40, 0x20}, // t
+    {0x00, 0x3c, 0x40, 0x40, 0x20, 0x7c}, // u
+    {0x00, 0x1c, 0x20, 0x40, 0x20, 0x1c}, // v
+    {0x00, 0x3c, 0x40, 0x30, 0x40, 0x3c}, // w
+    {0x00, 0x44, 0x28, 0x10, 0x28, 0x44}, // x
+    {0x00, 0x1c, 0xa0, 0xa0, 0xa0, 0x7c}, // y
+    {0x00, 0x44, 0x64, 0x54, 0x4c, 0x44}, // z
+    {0x00, 0x00, 0x08, 0x77, 0x00, 0x00}, // {
+    {0x00, 0x00, 0x00, 0x7f, 0x00, 0x00}, // |
+    {0x00, 0x00, 0x77, 0x08, 0x00, 0x00}, // }
+    {0x00, 0x10, 0x08, 0x10, 0x08, 0x00}, // ~
+    {0x14, 0x14, 0x14, 0x14, 0x14, 0x14}, // horiz lines
+};
+
+void osd_image_wrap_nv12(osd_image_t *img, uint8_t *data, int width,
+                         int height, int stride) {
+  img->format = OSD_FORMAT_NV12;
+  img->data = data;
+  img->uv = data + stride * height;
+  img->width = width;
+  img->height = height;
+  img->stride = stride;
+  img->uv_stride = stride;
+}
+
+void osd_image_wrap_bgr(osd_image_t *img, uint8_t *data, int width,
+                        int height, int stride) {
+  img->format = OSD_FORMAT_BGR888;
+  img->data = data;
+  img->uv = NULL;
+  img->width = width;
+  img->height = height;
+  img->stride = stride;
+  img->uv_stride = 0;
+}
+
+osd_color_t osd_color_rgb(uint8_t r, uint8_t g, uint8_t b) {
+  osd_color_t c;
+  c.y = (uint8_t)(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+  c.u = (uint8_t)(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+  c.v = (uint8_t)(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+  c.r = r;
+  c.g = g;
+  c.b = b;
+  return c;
+}
+
+static inline void fill_span_y(uint8_t *dst, uint8_t value, int n) {
+#if defined(__ARM_NEON)
+  uint8x16_t v = vdupq_n_u8(value);
+  for (; n >= 16; n -= 16, dst += 16) {
+    vst1q_u8(dst, v);
+  }
+#endif
+  memset(dst, value, n);
+}
+
+// n interleaved U, V pairs
+static inline void fill_span_uv(uint8_t *dst, uint8_t u, uint8_t v, int n) {
+#if defined(__ARM_NEON)
+  uint8x16_t uv = vreinterpretq_u8_u16(vdupq_n_u16((uint16_t)(v << 8 | u)));
+  for (; n >= 8; n -= 8, dst += 16) {
+    vst1q_u8(dst, uv);
+  }
+#endif
+  for (; n > 0; n--, dst += 2) {
+    dst[0] = u;
+    dst[1] = v;
+  }
+}
+
+// n pixels of B, G, R
+static inline void fill_span_bgr(uint8_t *dst, const osd_color_t *c, int n) {
+#if defined(__ARM_NEON)
+  uint8x16x3_t bgr;
+  bgr.val[0] = vdupq_n_u8(c->b);
+  bgr.val[1] = vdupq_n_u8(c->g);
+  bgr.val[2] = vdupq_n_u8(c->r);
+  for (; n >= 16; n -= 16, dst += 48) {
+    vst3q_u8(dst, bgr);
+  }
+#endif
+  for (; n > 0; n--, dst += 3) {
+    dst[0] = c->b;
+    dst[1] = c->g;
+    dst[2] = c->r;
+  }
+}
+
+void osd_fill_rect(const osd_image_t *img, int x, int y, int w, int h,
+                   osd_color_t color) {
+  int x1 = std::min(x + w, img->width);
+  int y1 = std::min(y + h, img->height);
+  x = std::max(x, 0);
+  y = std::max(y, 0);
+  if (x >= x1 || y >= y1) {
+    return;
+  }
+  if (img->format == OSD_FORMAT_BGR888) {
+    for (int row = y; row < y1; row++) {
+      fill_span_bgr(img->data + row * img->stride + 3 * x, &color, x1 - x);
+    }
+    return;
+  }
+  for (int row = y; row < y1; row++) {
+    fill_span_y(img->data + row * img->stride + x, color.y, x1 - x);
+  }
+  // every chroma block the rect touches
+  int cx0 = x / 2;
+  int cx1 = (x1 + 1) / 2;
+  for (int row = y / 2; row < (y1 + 1) / 2; row++) {
+    fill_span_uv(img->uv + row * img->uv_stride + 2 * cx0, color.u, color.v,
+                 cx1 - cx0);
+  }
+}
+
+void osd_draw_rect(const osd_image_t *img, int x0, int y0, int x1, int y1,
+                   int thickness, osd_color_t color) {
+  if (thickness < 0) {
+    osd_fill_rect(img, x0, y0, x1 - x0 + 1, y1 - y0 + 1, color);
+    return;
+  }
+  int t = std::max(thickness, 1);
+  int half = t / 2;
+  int left = x0 - half;
+  int top = y0 - half;
+  int outer_w = x1 - x0 + 1 + 2 * half;
+  int inner_h = y1 - y0 + 1 + 2 * half - 2 * t;
+  osd_fill_rect(img, left, top, outer_w, t, color);
+  osd_fill_rect(img, left, y1 - half, outer_w, t, color);
+  osd_fill_rect(img, left, top + t, t, inner_h, color);
+  osd_fill_rect(img, x1 - half, top + t, t, inner_h, color);
+}
+
+static inline const uint8_t *glyph(char c) {
+  unsigned char ch = (unsigned char)c;
+  if (ch < FONT_FIRST || ch >= FONT_LAST) {
+    ch = '?';
+  }
+  return font6x8[ch - FONT_FIRST];
+}
+
+int osd_text_width(const char *text, int scale) {
+  return (int)strlen(text) * OSD_FONT_WIDTH * std::max(scale, 1);
+}
+
+int osd_draw_text(const osd_image_t *img, int x, int y, const char *text,
+                  int scale, osd_color_t color) {
+  scale = std::max(scale, 1);
+  int len = (int)strlen(text);
+  int cols = len * OSD_FONT_WIDTH;
+  // one font row at a time, set pixels that touch merge into one span
+  // across the characters
+  for (int r = 0; r < OSD_FONT_HEIGHT; r++) {
+    int py = y + r * scale;
+    if (py >= img->height || py + scale <= 0) {
+      continue;
+    }
+    int run_start = -1;
+    for (int col = 0; col <= cols; col++) {
+      bool set = false;
+      if (col < cols) {
+        const uint8_t *g = glyph(text[col / OSD_FONT_WIDTH]);
+        set = g[col % OSD_FONT_WIDTH] >> r & 1;
+      }
+      if (set && run_start < 0) {
+        run_start = col;
+      } else if (!set && run_start >= 0) {
+        osd_fill_rect(img, x + run_start * scale, py,
+                       (col - run_start) * scale, scale, color);
+        run_start = -1;
+      }
+    }
+  }
+  return cols * scale;
+}
+
+int osd_draw_label(const osd_image_t *img, int x, int y, const char *text,
+                   int scale, osd_color_t fg, osd_color_t bg) {
+  scale = std::max(scale, 1);
+  int pad = scale;
+  int w = osd_text_width(text, scale) + 2 * pad;
+  int h = OSD_FONT_HEIGHT * scale + 2 * pad;
+  int top = y - h;
+  if (top < 0) {
+    top = y;
+  }
+  osd_fill_rect(img, x, top, w, h, bg);
+  osd_draw_text(img, x + pad, top + pad, text, scale, fg);
+  return h;
+}
@@ -0,0 +1,224 @@
+#include "pipeline_trace.h"
+
+#ifdef ENABLE_PIPELINE_TRACE
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <unordered_map>
+
+// seq is index + 1 once the slot holds event index, 0 while it is written
+typedef struct {
+  std::atomic<uint64_t> seq;
+  uint64_t ts_us;
+  const char *name;
+  uint32_t frame;
+  uint8_t track;
+  char phase; // 'B' or 'E'
+} trace_event_t;
+
+typedef struct {
+  uint64_t ts_us;
+  const char *name;
+  uint32_t frame;
+  uint8_t track;
+  char phase;
+} trace_event_copy_t;
+
+typedef struct {
+  uint64_t first;
+  uint64_t last;
+} frame_span_t;
+
+static trace_event_t *events;
+static uint32_t event_mask;
+static std::atomic<uint64_t> write_index;
+static std::atomic<uint32_t> current_frame;
+static volatile sig_atomic_t flush_requested;
+
+static const char *track_names[TRACE_TRACK_NUM] = {"CPU", "NPU", "RGA", "VENC",
+                                                   "RTSP"};
+
+static uint64_t get_now_us() {
+  struct timespec time = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000 + (uint64_t)time.tv_nsec / 1000;
+}
+
+static void flush_signal_handler(int signo) { flush_requested = 1; }
+
+int pipeline_trace_init(uint32_t capacity) {
+  uint32_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  events = (trace_event_t *)calloc(size, sizeof(trace_event_t));
+  if (events == NULL) {
+    printf("pipeline trace alloc fail! events=%u\n", size);
+    return -1;
+  }
+  event_mask = size - 1;
+  write_index.store(0);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = flush_signal_handler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGUSR2, &sa, NULL);
+  return 0;
+}
+
+void pipeline_trace_deinit() {
+  free(events);
+  events = NULL;
+}
+
+void pipeline_trace_frame(uint32_t frame_id) {
+  current_frame.store(frame_id, std::memory_order_relaxed);
+}
+
+static void record_event(trace_track track, const char *name, char phase) {
+  if (events == NULL) {
+    return;
+  }
+  uint64_t index = write_index.fetch_add(1, std::memory_order_relaxed);
+  trace_event_t *ev = &events[index & event_mask];
+  // seqlock writer: the fence keeps the field writes below from being seen
+  // before the slot is marked busy
+  ev->seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  ev->ts_us = get_now_us();
+  ev->name = name;
+  ev->frame = current_frame.load(std::memory_order_relaxed);
+  ev->track = track;
+  ev->phase = phase;
+  ev->seq.store(index + 1, std::memory_order_release);
+}
+
+void pipeline_trace_begin(trace_track track, const char *name) {
+  record_event(track, name, 'B');
+}
+
+void pipeline_trace_end(trace_track track, const char *name) {
+  record_event(track, name, 'E');
+}
+
+// Copy the buffer out, dropping slots being rewritten while we read them
+static int snapshot_events(trace_event_copy_t *out) {
+  uint64_t end = write_index.load(std::memory_order_acquire);
+  uint64_t size = (uint64_t)event_mask + 1;
+  uint64_t start = end > size ? end - size : 0;
+  int n = 0;
+
+  for (uint64_t i = start; i < end; i++) {
+    trace_event_t *ev = &events[i & event_mask];
+    if (ev->seq.load(std::memory_order_acquire) != i + 1) {
+      continue;
+    }
+    trace_event_copy_t copy = {ev->ts_us, ev->name, ev->frame, ev->track,
+                               ev->phase};
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (ev->seq.load(std::memory_order_relaxed) != i + 1) {
+      continue;
+    }
+    out[n++] = copy;
+  }
+  return n;
+}
+
+int pipeline_trace_flush(const char *path) {
+  if (events == NULL) {
+    return -1;
+  }
+  trace_event_copy_t *copy = (trace_event_copy_t *)malloc(
+      ((size_t)event_mask + 1) * sizeof(trace_event_copy_t));
+  if (copy == NULL) {
+    return -1;
+  }
+  int n = snapshot_events(copy);
+
+  // the first and last slice of every frame anchor its flow arrows
+  std::unordered_map<uint32_t, frame_span_t> frames;
+  for (int i = 0; i < n; i++) {
+    if (copy[i].phase != 'B' || copy[i].frame == 0) {
+      continue;
+    }
+    auto it = frames.find(copy[i].frame);
+    if (it == frames.end()) {
+      frames[copy[i].frame] = {(uint64_t)i, (uint64_t)i};
+    } else {
+      it->second.last = i;
+    }
+  }
+
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    printf("open %s fail!\n", path);
+    free(copy);
+    return -1;
+  }
+  fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+              "\"args\":{\"name\":\"yolov8_rtsp\"}}");
+  for (int t = 0; t < TRACE_TRACK_NUM; t++) {
+    fprintf(fp,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}",
+            t, track_names[t]);
+  }
+
+  // a wrapped buffer may have lost the begin of the oldest slices
+  int depth[TRACE_TRACK_NUM] = {0};
+  for (int i = 0; i < n; i++) {
+    trace_event_copy_t *ev = &copy[i];
+    if (ev->phase == 'E') {
+      if (depth[ev->track] == 0) {
+        continue;
+      }
+      depth[ev->track]--;
+    } else {
+      depth[ev->track]++;
+    }
+    fprintf(fp,
+            ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%llu,\"args\":{\"frame\":%u}}",
+            ev->name, ev->phase, ev->track, (unsigned long long)ev->ts_us,
+            ev->frame);
+
+    if (ev->phase != 'B' || ev->frame == 0) {
+      continue;
+    }
+    const frame_span_t &span = frames[ev->frame];
+    if (span.first == span.last) {
+      continue;
+    }
+    char flow = (uint64_t)i == span.first ? 's'
+                : (uint64_t)i == span.last ? 'f'
+                                           : 't';
+    fprintf(fp,
+            ",\n{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"%c\","
+            "\"id\":%u,\"pid\":1,\"tid\":%d,\"ts\":%llu%s}",
+            flow, ev->frame, ev->track, (unsigned long long)ev->ts_us,
+            flow == 'f' ? ",\"bp\":\"e\"" : "");
+  }
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+  free(copy);
+
+  printf("pipeline trace: %d events written to %s\n", n, path);
+  return 0;
+}
+
+void pipeline_trace_poll() {
+  if (flush_requested) {
+    flush_requested = 0;
+    pipeline_trace_flush(PIPELINE_TRACE_PATH);
+  }
+}
+
+#endif // ENABLE_PIPELINE_TRACE
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "async_log.h"
 #include "yolov8.h"
 
 #include <math.h>
@@ -84,6 +85,10 @@ static int readLines(const char *fileName, char *lines[], int max_line) {
   return i;
 }
 
+int read_label_file(const char *fileName, char *lines[], int max_line) {
+  return readLines(fileName, lines, max_line);
+}
+
 static int loadLabelName(const char *locationFilename, char *label[]) {
   printf("load lable %s\n", locationFilename);
   readLines(locationFilename, label, OBJ_CLASS_NUM);
@@ -479,8 +484,8 @@ static int process_i8_rv1106(int8_t *box_tensor, int32_t box_zp,
       }
     }
   }
-  printf("validCount=%d\n", validCount);
-  printf("grid h-%d, w-%d, stride %d\n", grid_h, grid_w, stride);
+  ALOGD("validCount=%d\n", validCount);
+  ALOGD("grid h-%d, w-%d, stride %d\n", grid_h, grid_w, stride);
   return validCount;
 }
 #endif
@@ -540,8 +545,7 @@ int post_process(rknn_app_context_t *app_ctx, void *outputs,
           score_sum_zp, score_sum_scale, grid_h, grid_w, stride, dfl_len,
           filterBoxes, objProbs, classId, conf_threshold);
     } else {
-      printf("RV1106/1103 only support quantization mode\n",
-             LABEL_NALE_TXT_PATH);
+      ALOGE("RV1106/1103 only support quantization mode\n");
       return -1;
     }
 
@@ -595,6 +599,16 @@ int post_process(rknn_app_context_t *app_ctx, void *outputs,
 #endif
   }
 
+  return filter_detect_results(validCount, filterBoxes, objProbs, classId,
+                               nms_threshold, model_in_w, model_in_h,
+                               od_results);
+}
+
+int filter_detect_results(int validCount, std::vector<float> &filterBoxes,
+                          std::vector<float> &objProbs,
+                          std::vector<int> &classId, float nms_threshold,
+                          int model_in_w, int model_in_h,
+                          object_detect_result_list *od_results) {
   // no object detect
   if (validCount <= 0) {
     return 0;
@@ -0,0 +1,79 @@
+#include "privacy_mask.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+void privacy_mask_init(privacy_mask_t *mask, int cls_id, int width,
+                       int height, int block) {
+  memset(mask, 0, sizeof(privacy_mask_t));
+  box_tracker_init(&mask->tracker, PRIVACY_MASK_TRACK_IOU,
+                   PRIVACY_MASK_HOLD_FRAMES);
+  mask->cls_id = cls_id;
+  mask->width = width;
+  mask->height = height;
+  mask->block = block;
+}
+
+// Dilated box on the block grid, inside the frame
+static image_rect_t snap_rect(const privacy_mask_t *mask,
+                              const image_rect_t *box) {
+  int b = mask->block;
+  int dx = (int)((box->right - box->left) * PRIVACY_MASK_DILATE);
+  int dy = (int)((box->bottom - box->top) * PRIVACY_MASK_DILATE);
+  image_rect_t r;
+  r.left = std::max(0, (box->left - dx) / b * b);
+  r.top = std::max(0, (box->top - dy) / b * b);
+  r.right = std::min(mask->width, (box->right + dx + b - 1) / b * b);
+  r.bottom = std::min(mask->height, (box->bottom + dy + b - 1) / b * b);
+  return r;
+}
+
+static void merge_rect(image_rect_t *dst, const image_rect_t *src) {
+  dst->left = std::min(dst->left, src->left);
+  dst->top = std::min(dst->top, src->top);
+  dst->right = std::max(dst->right, src->right);
+  dst->bottom = std::max(dst->bottom, src->bottom);
+}
+
+static void add_rect(privacy_mask_t *mask, const image_rect_t *box) {
+  image_rect_t r = snap_rect(mask, box);
+  if (r.right <= r.left || r.bottom <= r.top) {
+    return;
+  }
+  if (mask->n_rects < PRIVACY_MASK_MAX) {
+    mask->rects[mask->n_rects++] = r;
+  } else {
+    merge_rect(&mask->rects[PRIVACY_MASK_MAX - 1], &r);
+  }
+}
+
+int privacy_mask_update(privacy_mask_t *mask,
+                        const object_detect_result_list *od_results) {
+  object_detect_result_list masked;
+  int track_slots[OBJ_NUMB_MAX_SIZE];
+
+  // only the masked class reaches the tracker
+  masked.count = 0;
+  for (int i = 0; i < od_results->count; i++) {
+    if (od_results->results[i].cls_id == mask->cls_id) {
+      masked.results[masked.count++] = od_results->results[i];
+    }
+  }
+  box_tracker_update(&mask->tracker, &masked, track_slots);
+
+  // every live track, including the ones missed this frame, and any
+  // detection the tracker had no slot for
+  mask->n_rects = 0;
+  for (int slot = 0; slot < BOX_TRACK_MAX_NUM; slot++) {
+    if (mask->tracker.tracks[slot].id != 0) {
+      add_rect(mask, &mask->tracker.tracks[slot].box);
+    }
+  }
+  for (int i = 0; i < masked.count; i++) {
+    if (track_slots[i] < 0) {
+      add_rect(mask, &masked.results[i].box);
+    }
+  }
+  return mask->n_rects;
+}
@@ -0,0 +1,168 @@
+#include "rga_batch.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "async_log.h"
+
+void rga_batch_init(rga_batch_t *batch) {
+  memset(batch, 0, sizeof(rga_batch_t));
+  batch->fence_fd = -1;
+}
+
+void rga_batch_deinit(rga_batch_t *batch) {
+  rga_batch_wait(batch, -1);
+  if (batch->job != 0) {
+    imcancelJob(batch->job);
+    batch->job = 0;
+  }
+  for (int i = 0; i < batch->n_buffers; i++) {
+    releasebuffer_handle(batch->buffers[i].handle);
+  }
+  batch->n_buffers = 0;
+}
+
+rga_buffer_handle_t rga_batch_import(rga_batch_t *batch, int fd, size_t size) {
+  for (int i = 0; i < batch->n_buffers; i++) {
+    rga_batch_buffer_t *buf = &batch->buffers[i];
+    if (buf->fd == fd && buf->size == size) {
+      return buf->handle;
+    }
+  }
+  rga_buffer_handle_t handle = importbuffer_fd(fd, size);
+  if (handle == 0) {
+    ALOGE("rga importbuffer_fd %d fail!\n", fd);
+    return 0;
+  }
+  // no job is pending while a batch is built, so any entry may go
+  rga_batch_buffer_t *buf;
+  if (batch->n_buffers < RGA_BATCH_MAX_BUFFERS) {
+    buf = &batch->buffers[batch->n_buffers++];
+  } else {
+    buf = &batch->buffers[batch->next_evict];
+    batch->next_evict = (batch->next_evict + 1) % RGA_BATCH_MAX_BUFFERS;
+    releasebuffer_handle(buf->handle);
+  }
+  buf->fd = fd;
+  buf->size = size;
+  buf->handle = handle;
+  return handle;
+}
+
+int rga_batch_begin(rga_batch_t *batch) {
+  // the previous job must be done before its buffers are reused
+  rga_batch_wait(batch, -1);
+  if (batch->job != 0) {
+    imcancelJob(batch->job);
+  }
+  batch->n_tasks = 0;
+  batch->failed = false;
+  batch->job = imbeginJob();
+  if (batch->job == 0) {
+    ALOGE("rga imbeginJob fail!\n");
+    return -1;
+  }
+  return 0;
+}
+
+static void add_task(rga_batch_t *batch, IM_STATUS status, const char *name) {
+  if (status != IM_STATUS_SUCCESS) {
+    ALOGE("rga %s fail: %s\n", name, imStrError(status));
+    batch->failed = true;
+    return;
+  }
+  batch->n_tasks++;
+}
+
+void rga_batch_cvtcolor(rga_batch_t *batch, rga_buffer_t src, rga_buffer_t dst,
+                        int src_format, int dst_format) {
+  if (batch->job == 0 || batch->failed) {
+    return;
+  }
+  add_task(batch,
+           imcvtcolorTask(batch->job, src, dst, src_format, dst_format),
+           "imcvtcolorTask");
+}
+
+void rga_batch_process(rga_batch_t *batch, rga_buffer_t src, rga_buffer_t dst,
+                       im_rect srect, im_rect drect) {
+  if (batch->job == 0 || batch->failed) {
+    return;
+  }
+  rga_buffer_t pat;
+  memset(&pat, 0, sizeof(pat));
+  im_rect prect = {0, 0, 0, 0};
+  add_task(batch,
+           improcessTask(batch->job, src, dst, pat, srect, drect, prect, NULL,
+                         0),
+           "improcessTask");
+}
+
+void rga_batch_fill(rga_batch_t *batch, rga_buffer_t dst, im_rect rect,
+                    uint32_t color) {
+  if (batch->job == 0 || batch->failed) {
+    return;
+  }
+  add_task(batch, imfillTask(batch->job, dst, rect, color), "imfillTask");
+}
+
+void rga_batch_rectangles(rga_batch_t *batch, rga_buffer_t dst,
+                          im_rect *rects, int n_rects, uint32_t color,
+                          int thickness) {
+  if (batch->job == 0 || batch->failed || n_rects <= 0) {
+    return;
+  }
+  add_task(batch,
+           imrectangleTaskArray(batch->job, dst, rects, n_rects, color,
+                                thickness),
+           "imrectangleTaskArray");
+}
+
+int rga_batch_submit(rga_batch_t *batch) {
+  if (batch->job == 0) {
+    return -1;
+  }
+  im_job_handle_t job = batch->job;
+  batch->job = 0;
+  if (batch->failed || batch->n_tasks == 0) {
+    imcancelJob(job);
+    return batch->failed ? -1 : 0;
+  }
+  int fence_fd = -1;
+  IM_STATUS status = imendJob(job, batch->sync ? IM_SYNC : IM_ASYNC, 0,
+                              batch->sync ? NULL : &fence_fd);
+  if (status != IM_STATUS_SUCCESS) {
+    ALOGE("rga imendJob fail: %s\n", imStrError(status));
+    return -1;
+  }
+  if (!batch->sync && fence_fd <= 0) {
+    // no telling when this job is done; the caller redoes the frame on
+    // the CPU, which writes the same pixels, and later jobs run to
+    // completion in imendJob
+    ALOGW("rga job without a release fence, running jobs synchronously\n");
+    batch->sync = true;
+    return -1;
+  }
+  batch->fence_fd = batch->sync ? -1 : fence_fd;
+  return 0;
+}
+
+int rga_batch_wait(rga_batch_t *batch, int timeout_ms) {
+  if (batch->fence_fd < 0) {
+    return 0;
+  }
+  struct pollfd pfd = {batch->fence_fd, POLLIN, 0};
+  int ret;
+  do {
+    ret = poll(&pfd, 1, timeout_ms);
+  } while (ret < 0 && errno == EINTR);
+  if (ret == 0) {
+    // still running, the fence is kept for the next wait
+    return -1;
+  }
+  close(batch->fence_fd);
+  batch->fence_fd = -1;
+  return ret > 0 && !(pfd.revents & POLLERR) ? 0 : -1;
+}
@@ -0,0 +1,103 @@
+#include "rknn_mem_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void rknn_mem_pool_init(rknn_mem_pool_t *pool) {
+  memset(pool, 0, sizeof(rknn_mem_pool_t));
+}
+
+int rknn_mem_pool_add(rknn_mem_pool_t *pool, rknn_app_context_t *app_ctx) {
+  if (pool->n_ctx >= RKNN_MEM_POOL_MAX_CTX || pool->internal_mem != NULL) {
+    printf("rknn mem pool full or already committed\n");
+    return -1;
+  }
+  if (!(app_ctx->init_flags & RKNN_FLAG_INTERNAL_ALLOC_OUTSIDE)) {
+    printf("rknn mem pool needs contexts with internal memory outside\n");
+    return -1;
+  }
+  pool->ctxs[pool->n_ctx++] = app_ctx;
+  return 0;
+}
+
+int rknn_mem_pool_commit(rknn_mem_pool_t *pool) {
+  uint32_t max_internal = 0;
+  uint64_t private_internal = 0;
+  int ret;
+
+  if (pool->n_ctx == 0) {
+    return 0;
+  }
+
+  for (int i = 0; i < pool->n_ctx; i++) {
+    uint32_t size = pool->ctxs[i]->mem_size.total_internal_size;
+    private_internal += size;
+    if (size > max_internal) {
+      max_internal = size;
+    }
+  }
+
+  rknn_app_context_t *owner = pool->ctxs[0];
+  pool->internal_mem = rknn_create_mem(owner->rknn_ctx, max_internal);
+  if (pool->internal_mem == NULL) {
+    printf("rknn shared internal mem alloc fail! size=%u\n", max_internal);
+    return -1;
+  }
+
+  for (int i = 0; i < pool->n_ctx; i++) {
+    rknn_app_context_t *app_ctx = pool->ctxs[i];
+    app_ctx->internal_mem = rknn_create_mem_from_fd(
+        app_ctx->rknn_ctx, pool->internal_mem->fd,
+        pool->internal_mem->virt_addr,
+        app_ctx->mem_size.total_internal_size, 0);
+    if (app_ctx->internal_mem == NULL) {
+      printf("rknn_create_mem_from_fd for internal mem fail!\n");
+      return -1;
+    }
+    ret = rknn_set_internal_mem(app_ctx->rknn_ctx, app_ctx->internal_mem);
+    if (ret < 0) {
+      printf("rknn_set_internal_mem fail! ret=%d\n", ret);
+      return -1;
+    }
+  }
+
+  printf("rknn shared internal mem: %u bytes for %d contexts, saved %llu "
+         "bytes\n",
+         max_internal, pool->n_ctx,
+         (unsigned long long)(private_internal - max_internal));
+  return 0;
+}
+
+void rknn_mem_pool_release(rknn_mem_pool_t *pool) {
+  if (pool->internal_mem != NULL) {
+    rknn_destroy_mem(pool->ctxs[0]->rknn_ctx, pool->internal_mem);
+    pool->internal_mem = NULL;
+  }
+  pool->n_ctx = 0;
+}
+
+static long read_kb_field(const char *path, const char *field) {
+  char line[128];
+  long value = -1;
+  size_t len = strlen(field);
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (strncmp(line, field, len) == 0 && line[len] == ':') {
+      sscanf(line + len + 1, "%ld", &value);
+      break;
+    }
+  }
+  fclose(fp);
+  return value;
+}
+
+long get_cma_free_kb() { return read_kb_field("/proc/meminfo", "CmaFree"); }
+
+void print_mem_usage(const char *tag) {
+  printf("[mem] %s: VmRSS %ld kB, CmaFree %ld kB\n", tag,
+         read_kb_field("/proc/self/status", "VmRSS"),
+         read_kb_field("/proc/meminfo", "CmaFree"));
+}
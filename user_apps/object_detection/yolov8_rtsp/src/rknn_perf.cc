@@ -0,0 +1,311 @@
+#include "rknn_perf.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#define REPORT_FLUSH_FRAMES 30
+
+static rknn_perf_profiler_t *signal_profiler;
+
+static void split_tokens(const std::string &line,
+                         std::vector<std::string> &tokens) {
+  tokens.clear();
+  size_t pos = 0;
+  while (pos < line.size()) {
+    while (pos < line.size() && isspace((unsigned char)line[pos])) {
+      pos++;
+    }
+    size_t start = pos;
+    while (pos < line.size() && !isspace((unsigned char)line[pos])) {
+      pos++;
+    }
+    if (pos > start) {
+      tokens.push_back(line.substr(start, pos - start));
+    }
+  }
+}
+
+// Header names are separated by single spaces in places, and some names are
+// two words ("NPU Cycles", "Task Number"); glue those back together.
+static void split_header(const std::string &line,
+                         std::vector<std::string> &columns) {
+  std::vector<std::string> tokens;
+  split_tokens(line, tokens);
+  columns.clear();
+  for (size_t i = 0; i < tokens.size(); i++) {
+    if (!columns.empty() && (tokens[i] == "Cycles" || tokens[i] == "Number")) {
+      columns.back() += " " + tokens[i];
+    } else {
+      columns.push_back(tokens[i]);
+    }
+  }
+}
+
+static bool is_rule_line(const std::string &line) {
+  size_t n = 0;
+  for (size_t i = 0; i < line.size(); i++) {
+    if (line[i] == '-' || line[i] == '=') {
+      n++;
+    } else if (!isspace((unsigned char)line[i])) {
+      return false;
+    }
+  }
+  return n > 0;
+}
+
+static void copy_field(char *dst, size_t size, const std::string &src) {
+  snprintf(dst, size, "%s", src.c_str());
+}
+
+static bool starts_with(const std::string &str, const char *prefix) {
+  return str.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static int find_column(const std::vector<std::string> &columns,
+                       const char *name) {
+  for (size_t i = 0; i < columns.size(); i++) {
+    if (starts_with(columns[i], name)) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+int rknn_perf_parse_detail(const char *text,
+                           std::vector<rknn_layer_perf> &layers,
+                           rknn_perf_summary *summary) {
+  std::vector<std::string> columns;
+  std::vector<std::string> tokens;
+  bool in_table = false;
+  bool table_done = false;
+
+  layers.clear();
+  memset(summary, 0, sizeof(rknn_perf_summary));
+  if (text == NULL) {
+    return -1;
+  }
+
+  const char *p = text;
+  while (*p != '\0') {
+    const char *eol = strchr(p, '\n');
+    std::string line = eol ? std::string(p, eol - p) : std::string(p);
+    p = eol ? eol + 1 : p + line.size();
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+
+    size_t first = line.find_first_not_of(" \t");
+    std::string trimmed = first == std::string::npos ? "" : line.substr(first);
+    size_t colon = trimmed.find(':');
+    if (starts_with(trimmed, "Total Operator Elapsed") &&
+        colon != std::string::npos) {
+      summary->total_us = strtoull(trimmed.c_str() + colon + 1, NULL, 10);
+      continue;
+    }
+    if (starts_with(trimmed, "Total Memory Read/Write") &&
+        colon != std::string::npos) {
+      summary->total_rw_kb = strtof(trimmed.c_str() + colon + 1, NULL);
+      continue;
+    }
+    if (table_done) {
+      continue;
+    }
+
+    if (!in_table) {
+      if (starts_with(trimmed, "ID ") &&
+          trimmed.find("OpType") != std::string::npos) {
+        split_header(trimmed, columns);
+        in_table = true;
+      }
+      continue;
+    }
+    if (trimmed.empty() || is_rule_line(trimmed)) {
+      if (!layers.empty()) {
+        table_done = true;
+      }
+      continue;
+    }
+    if (!isdigit((unsigned char)trimmed[0])) {
+      table_done = true;
+      continue;
+    }
+
+    split_tokens(trimmed, tokens);
+    int ncols = (int)columns.size();
+    int ntok = (int)tokens.size();
+    if (ntok < ncols) {
+      continue;
+    }
+    // a free text column (WorkLoad on older runtimes) may hold spaces, the
+    // columns after it are taken from the end of the row
+    int free_col = find_column(columns, "WorkLoad");
+    std::vector<std::string> values(ncols);
+    for (int c = 0; c < ncols; c++) {
+      if (free_col >= 0 && c > free_col) {
+        values[c] = tokens[ntok - (ncols - c)];
+      } else if (c == free_col) {
+        int last = ntok - (ncols - c);
+        for (int t = c; t <= last; t++) {
+          values[c] += (t > c ? " " : "") + tokens[t];
+        }
+      } else {
+        values[c] = tokens[c];
+      }
+    }
+    if (free_col < 0) {
+      for (int t = ncols; t < ntok; t++) {
+        values[ncols - 1] += " " + tokens[t];
+      }
+    }
+
+    rknn_layer_perf layer;
+    memset(&layer, 0, sizeof(layer));
+    layer.mac_usage = -1.f;
+    int col;
+    layer.id = atoi(values[0].c_str());
+    if ((col = find_column(columns, "OpType")) >= 0)
+      copy_field(layer.op_type, sizeof(layer.op_type), values[col]);
+    if ((col = find_column(columns, "DataType")) >= 0)
+      copy_field(layer.data_type, sizeof(layer.data_type), values[col]);
+    if ((col = find_column(columns, "Target")) >= 0)
+      copy_field(layer.target, sizeof(layer.target), values[col]);
+    if ((col = find_column(columns, "OutputShape")) >= 0)
+      copy_field(layer.output_shape, sizeof(layer.output_shape), values[col]);
+    if ((col = find_column(columns, "NPU Cycles")) >= 0)
+      layer.npu_cycles = strtoull(values[col].c_str(), NULL, 10);
+    if ((col = find_column(columns, "Time(us)")) >= 0)
+      layer.time_us = strtoull(values[col].c_str(), NULL, 10);
+    if ((col = find_column(columns, "MacUsage")) >= 0 &&
+        isdigit((unsigned char)values[col][0]))
+      layer.mac_usage = strtof(values[col].c_str(), NULL);
+    if ((col = find_column(columns, "RW(KB)")) >= 0)
+      layer.rw_kb = strtof(values[col].c_str(), NULL);
+    if ((col = find_column(columns, "FullName")) >= 0)
+      copy_field(layer.name, sizeof(layer.name), values[col]);
+    layers.push_back(layer);
+  }
+
+  return in_table ? (int)layers.size() : -1;
+}
+
+static void write_json_string(FILE *fp, const char *str) {
+  fputc('"', fp);
+  for (; *str != '\0'; str++) {
+    if (*str == '"' || *str == '\\') {
+      fputc('\\', fp);
+      fputc(*str, fp);
+    } else if ((unsigned char)*str >= 0x20) {
+      fputc(*str, fp);
+    }
+  }
+  fputc('"', fp);
+}
+
+static void write_layers(FILE *fp, const std::vector<rknn_layer_perf> &layers,
+                         const rknn_perf_summary *summary) {
+  fprintf(fp, ",\"total_us\":%llu,\"total_rw_kb\":%.2f,\"layers\":[",
+          (unsigned long long)summary->total_us, summary->total_rw_kb);
+  for (size_t i = 0; i < layers.size(); i++) {
+    const rknn_layer_perf *l = &layers[i];
+    fprintf(fp, "%s{\"id\":%d,\"op\":", i ? "," : "", l->id);
+    write_json_string(fp, l->op_type);
+    fprintf(fp, ",\"dtype\":");
+    write_json_string(fp, l->data_type);
+    fprintf(fp, ",\"target\":");
+    write_json_string(fp, l->target);
+    fprintf(fp, ",\"output\":");
+    write_json_string(fp, l->output_shape);
+    fprintf(fp,
+            ",\"npu_cycles\":%llu,\"time_us\":%llu,\"mac_usage\":%.2f,"
+            "\"rw_kb\":%.2f,\"name\":",
+            (unsigned long long)l->npu_cycles,
+            (unsigned long long)l->time_us, l->mac_usage, l->rw_kb);
+    write_json_string(fp, l->name);
+    fputc('}', fp);
+  }
+  fputc(']', fp);
+}
+
+static void detail_signal_handler(int signo) {
+  if (signal_profiler != NULL) {
+    signal_profiler->detail_requested = 1;
+  }
+}
+
+int rknn_perf_open(rknn_perf_profiler_t *profiler, const char *report_path) {
+  memset(profiler, 0, sizeof(rknn_perf_profiler_t));
+  profiler->report = fopen(report_path, "w");
+  if (profiler->report == NULL) {
+    printf("open perf report %s fail!\n", report_path);
+    return -1;
+  }
+  profiler->detail_requested = 1;
+
+  signal_profiler = profiler;
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = detail_signal_handler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGHUP, &sa, NULL);
+  return 0;
+}
+
+void rknn_perf_close(rknn_perf_profiler_t *profiler) {
+  signal_profiler = NULL;
+  if (profiler->report != NULL) {
+    fclose(profiler->report);
+    profiler->report = NULL;
+  }
+}
+
+int rknn_perf_collect(rknn_perf_profiler_t *profiler, rknn_context ctx) {
+  rknn_perf_run perf_run;
+  int ret;
+
+  if (profiler == NULL || profiler->report == NULL) {
+    return -1;
+  }
+  profiler->frame++;
+  memset(&perf_run, 0, sizeof(perf_run));
+  ret = rknn_query(ctx, RKNN_QUERY_PERF_RUN, &perf_run, sizeof(perf_run));
+  if (ret != RKNN_SUCC) {
+    // the context was not loaded with RKNN_FLAG_COLLECT_PERF_MASK or the
+    // runtime can not profile, it will not get better on the next frame
+    printf("rknn_query PERF_RUN fail! ret=%d, profiling off\n", ret);
+    rknn_perf_close(profiler);
+    return -1;
+  }
+  fprintf(profiler->report, "{\"frame\":%u,\"run_us\":%lld", profiler->frame,
+          (long long)perf_run.run_duration);
+
+  bool detail = profiler->detail_requested;
+  if (detail) {
+    profiler->detail_requested = 0;
+    rknn_perf_detail perf_detail;
+    memset(&perf_detail, 0, sizeof(perf_detail));
+    ret = rknn_query(ctx, RKNN_QUERY_PERF_DETAIL, &perf_detail,
+                     sizeof(perf_detail));
+    if (ret == RKNN_SUCC && perf_detail.perf_data != NULL) {
+      std::vector<rknn_layer_perf> layers;
+      rknn_perf_summary summary;
+      if (rknn_perf_parse_detail(perf_detail.perf_data, layers, &summary) >=
+          0) {
+        write_layers(profiler->report, layers, &summary);
+      } else {
+        printf("perf detail has no layer table\n");
+      }
+    } else {
+      printf("rknn_query PERF_DETAIL fail! ret=%d\n", ret);
+    }
+  }
+  fprintf(profiler->report, "}\n");
+  // the app is usually killed rather than closed, keep the file readable
+  if (detail || profiler->frame % REPORT_FLUSH_FRAMES == 0) {
+    fflush(profiler->report);
+  }
+  return 0;
+}
@@ -0,0 +1,1162 @@
+#include "rtsp_server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <vector>
+
+#define RTSP_RTP_MTU 1400      // RTP header + payload of one packet
+#define RTSP_RTP_PORT_BASE 6970 // first server_port pair tried for UDP
+#define RTSP_AU_MAX_NALS 32
+#define RTSP_PENDING_AUS 8     // pushed, not yet taken by the server thread
+#define RTSP_SEND_BATCH 64     // packets per sendmmsg / sendmsg
+#define RTSP_REQUEST_BYTES 4096
+#define RTSP_REPLY_BYTES 2048
+#define RTSP_EPOLL_EVENTS 32
+#define RTSP_POLL_MS 500
+#define RTSP_PAYLOAD_TYPE 96
+
+// epoll tags of the non-client descriptors, clients use their slot index
+#define TAG_LISTEN -1
+#define TAG_WAKE -2
+#define TAG_RTCP -3
+
+// One encoded access unit, shared by all clients of its stream
+typedef struct {
+  std::atomic<int> refs;
+  int stream;
+  uint64_t pts_us;
+  bool keyframe;
+  bool has_params; // carries VPS/SPS/PPS in-band
+  int n_nals;
+  nal_unit_t nals[RTSP_AU_MAX_NALS];
+  uint32_t len;
+  uint8_t *data;
+} rtsp_au_t;
+
+// RTP packet as interleave prefix + RTP header + FU header, then a slice of
+// the access unit
+typedef struct {
+  uint8_t hdr[20];
+  uint8_t hdr_len;
+  const uint8_t *payload;
+  uint32_t payload_len;
+} rtp_packet_t;
+
+typedef enum {
+  CLIENT_FREE = 0,
+  CLIENT_INIT,
+  CLIENT_READY, // SETUP done
+  CLIENT_PLAYING,
+} client_state;
+
+typedef struct {
+  int fd;
+  client_state state;
+  int stream;
+  uint32_t session_id;
+
+  // transport from SETUP
+  bool tcp;
+  int channel;
+  struct sockaddr_in rtp_addr;
+
+  // RTP state
+  uint32_t ssrc;
+  uint16_t seq;
+  uint32_t ts_base;
+
+  char request[RTSP_REQUEST_BYTES];
+  int request_len;
+  char reply[RTSP_REPLY_BYTES]; // held back while an access unit is half sent
+  int reply_len;
+  int reply_sent;
+
+  rtsp_au_t *queue[RTSP_CLIENT_QUEUE];
+  int queue_head;
+  int queue_len;
+  int replay_len; // cached GOP at the head of the queue, queued by PLAY
+  bool waiting_key;
+  bool want_out;
+
+  // packets of queue[queue_head] and how far they are sent
+  std::vector<rtp_packet_t> packets;
+  rtsp_au_t *params_ref; // parameter sets sent ahead of the head, or NULL
+  bool params_sent;
+  bool packets_built;
+  size_t packet_index;
+  uint32_t packet_offset; // bytes of packets[packet_index] already sent
+} rtsp_client_t;
+
+typedef struct {
+  char path[64];
+  rtsp_codec codec;
+  std::atomic<int> n_playing;
+  std::atomic<int> queue_peak; // deepest client queue since last taken
+
+  // join cache, server thread only
+  rtsp_au_t *params;                 // latest unit with parameter sets
+  rtsp_au_t *gop[RTSP_GOP_CACHE_AUS]; // IDR first, empty when it overflowed
+  int gop_len;
+  uint32_t gop_bytes;
+} rtsp_stream_t;
+
+static_assert(RTSP_GOP_CACHE_AUS < RTSP_CLIENT_QUEUE,
+              "a joining client must fit the cached GOP in its queue");
+
+struct _rtsp_server {
+  int listen_fd;
+  int epoll_fd;
+  int wake_fd;
+  int rtp_fd;
+  int rtcp_fd;
+  int rtp_port;
+
+  rtsp_stream_t streams[RTSP_MAX_STREAMS];
+  int n_streams;
+  rtsp_client_t clients[RTSP_MAX_CLIENTS];
+  uint32_t next_session;
+
+  pthread_mutex_t lock; // guards pending
+  rtsp_au_t *pending[RTSP_PENDING_AUS];
+  int n_pending;
+
+  pthread_t thread;
+  std::atomic<bool> running;
+  bool started;
+};
+
+static void au_release(rtsp_au_t *au) {
+  if (au->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    free(au->data);
+    au->~rtsp_au_t();
+    free(au);
+  }
+}
+
+static void au_acquire(rtsp_au_t *au) {
+  au->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void put_be16(uint8_t *p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void add_packet(rtsp_client_t *client, uint32_t ts, bool marker,
+                       const uint8_t *fu, int fu_len, const uint8_t *payload,
+                       uint32_t payload_len) {
+  rtp_packet_t pkt;
+  uint8_t *rtp = pkt.hdr;
+
+  if (client->tcp) {
+    pkt.hdr[0] = '$';
+    pkt.hdr[1] = client->channel;
+    put_be16(pkt.hdr + 2, 12 + fu_len + payload_len);
+    rtp += 4;
+  }
+  rtp[0] = 0x80; // version 2
+  rtp[1] = (marker ? 0x80 : 0) | RTSP_PAYLOAD_TYPE;
+  put_be16(rtp + 2, client->seq++);
+  put_be32(rtp + 4, ts);
+  put_be32(rtp + 8, client->ssrc);
+  if (fu_len > 0) {
+    memcpy(rtp + 12, fu, fu_len);
+  }
+  pkt.hdr_len = (rtp - pkt.hdr) + 12 + fu_len;
+  pkt.payload = payload;
+  pkt.payload_len = payload_len;
+  client->packets.push_back(pkt);
+}
+
+// RFC 6184 (H.264) and RFC 7798 (H.265): single NAL unit packets, and
+// fragmentation units for NAL units larger than a packet
+static void build_packets(rtsp_server_t *server, rtsp_client_t *client,
+                          const rtsp_au_t *au) {
+  rtsp_codec codec = server->streams[au->stream].codec;
+  uint32_t ts = client->ts_base + (uint32_t)(au->pts_us * 9 / 100); // 90 kHz
+  const uint32_t max_payload = RTSP_RTP_MTU - 12;
+
+  client->packets.clear();
+  // a client that joined on this key frame gets the parameter sets first,
+  // in case the encoder does not repeat them in-band
+  rtsp_au_t *params = server->streams[au->stream].params;
+  if (au->keyframe && !client->params_sent && !au->has_params &&
+      params != NULL) {
+    au_acquire(params);
+    client->params_ref = params;
+    for (int i = 0; i < params->n_nals; i++) {
+      if (nal_is_parameter_set((nal_codec)codec, params->nals[i].type) &&
+          params->nals[i].len <= max_payload) {
+        add_packet(client, ts, false, NULL, 0,
+                   params->data + params->nals[i].offset,
+                   params->nals[i].len);
+      }
+    }
+  }
+  if (au->keyframe) {
+    client->params_sent = true;
+  }
+
+  for (int i = 0; i < au->n_nals; i++) {
+    const uint8_t *nal = au->data + au->nals[i].offset;
+    uint32_t len = au->nals[i].len;
+    bool last_nal = i == au->n_nals - 1;
+
+    if (len <= max_payload) {
+      add_packet(client, ts, last_nal, NULL, 0, nal, len);
+      continue;
+    }
+
+    uint8_t fu[3];
+    int fu_len, skip;
+    uint8_t type;
+    if (codec == RTSP_CODEC_H264) {
+      fu[0] = (nal[0] & 0xe0) | 28; // FU-A
+      type = nal[0] & 0x1f;
+      fu_len = 2;
+      skip = 1;
+    } else {
+      fu[0] = (nal[0] & 0x81) | (49 << 1);
+      fu[1] = nal[1];
+      type = (nal[0] >> 1) & 0x3f;
+      fu_len = 3;
+      skip = 2;
+    }
+    const uint8_t *p = nal + skip;
+    uint32_t remain = len - skip;
+    bool first = true;
+    while (remain > 0) {
+      uint32_t chunk = remain < max_payload - fu_len ? remain
+                                                     : max_payload - fu_len;
+      bool end = chunk == remain;
+      fu[fu_len - 1] = (first ? 0x80 : 0) | (end ? 0x40 : 0) | type;
+      add_packet(client, ts, last_nal && end, fu, fu_len, p, chunk);
+      p += chunk;
+      remain -= chunk;
+      first = false;
+    }
+  }
+  client->packets_built = true;
+  client->packet_index = 0;
+  client->packet_offset = 0;
+}
+
+// Interleaved data of the queue head is partly on the wire
+static bool mid_access_unit(const rtsp_client_t *client) {
+  return client->packets_built &&
+         (client->packet_index > 0 || client->packet_offset > 0);
+}
+
+static void set_want_out(rtsp_server_t *server, rtsp_client_t *client,
+                         bool want_out) {
+  if (client->want_out == want_out) {
+    return;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN | (want_out ? EPOLLOUT : 0);
+  ev.data.u64 = client - server->clients;
+  epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+  client->want_out = want_out;
+}
+
+static void release_params_ref(rtsp_client_t *client) {
+  if (client->params_ref != NULL) {
+    au_release(client->params_ref);
+    client->params_ref = NULL;
+  }
+}
+
+static void drop_queue(rtsp_client_t *client, bool keep_head) {
+  int keep = keep_head && client->queue_len > 0 ? 1 : 0;
+  for (int i = keep; i < client->queue_len; i++) {
+    au_release(client->queue[(client->queue_head + i) % RTSP_CLIENT_QUEUE]);
+  }
+  client->queue_len = keep;
+  client->replay_len = std::min(client->replay_len, keep);
+  if (!keep) {
+    client->packets_built = false;
+    release_params_ref(client);
+  }
+}
+
+static void enqueue(rtsp_client_t *client, rtsp_au_t *au) {
+  au_acquire(au);
+  client->queue[(client->queue_head + client->queue_len) %
+                RTSP_CLIENT_QUEUE] = au;
+  client->queue_len++;
+}
+
+static void close_client(rtsp_server_t *server, rtsp_client_t *client) {
+  if (client->state == CLIENT_PLAYING) {
+    server->streams[client->stream].n_playing.fetch_sub(1);
+  }
+  drop_queue(client, false);
+  epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+  close(client->fd);
+  client->fd = -1;
+  client->state = CLIENT_FREE;
+}
+
+// 1 when the access unit is out, 0 when the socket is full, -1 on error
+static int send_tcp(rtsp_client_t *client) {
+  while (client->packet_index < client->packets.size()) {
+    struct iovec iov[2 * RTSP_SEND_BATCH];
+    int n_iov = 0;
+    uint32_t skip = client->packet_offset;
+    for (size_t i = client->packet_index;
+         i < client->packets.size() && n_iov < 2 * RTSP_SEND_BATCH; i++) {
+      rtp_packet_t *pkt = &client->packets[i];
+      if (skip < pkt->hdr_len) {
+        iov[n_iov].iov_base = pkt->hdr + skip;
+        iov[n_iov].iov_len = pkt->hdr_len - skip;
+        n_iov++;
+        skip = 0;
+      } else {
+        skip -= pkt->hdr_len;
+      }
+      iov[n_iov].iov_base = (void *)(pkt->payload + skip);
+      iov[n_iov].iov_len = pkt->payload_len - skip;
+      n_iov++;
+      skip = 0;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n_iov;
+    ssize_t sent = sendmsg(client->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    // advance over what went out, possibly ending inside a packet
+    size_t total = sent + client->packet_offset;
+    while (client->packet_index < client->packets.size()) {
+      rtp_packet_t *pkt = &client->packets[client->packet_index];
+      size_t pkt_len = pkt->hdr_len + pkt->payload_len;
+      if (total < pkt_len) {
+        break;
+      }
+      total -= pkt_len;
+      client->packet_index++;
+    }
+    client->packet_offset = total;
+    if (client->packet_offset != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// UDP may lose packets anyway, so a full socket buffer drops the rest of
+// the access unit instead of holding it
+static int send_udp(rtsp_server_t *server, rtsp_client_t *client) {
+  while (client->packet_index < client->packets.size()) {
+    struct mmsghdr msgs[RTSP_SEND_BATCH];
+    struct iovec iov[RTSP_SEND_BATCH][2];
+    int n = 0;
+    for (size_t i = client->packet_index;
+         i < client->packets.size() && n < RTSP_SEND_BATCH; i++, n++) {
+      rtp_packet_t *pkt = &client->packets[i];
+      iov[n][0].iov_base = pkt->hdr;
+      iov[n][0].iov_len = pkt->hdr_len;
+      iov[n][1].iov_base = (void *)pkt->payload;
+      iov[n][1].iov_len = pkt->payload_len;
+      memset(&msgs[n], 0, sizeof(struct mmsghdr));
+      msgs[n].msg_hdr.msg_name = &client->rtp_addr;
+      msgs[n].msg_hdr.msg_namelen = sizeof(client->rtp_addr);
+      msgs[n].msg_hdr.msg_iov = iov[n];
+      msgs[n].msg_hdr.msg_iovlen = 2;
+    }
+    int sent = sendmmsg(server->rtp_fd, msgs, n, MSG_DONTWAIT);
+    if (sent <= 0) {
+      break;
+    }
+    client->packet_index += sent;
+  }
+  return 1;
+}
+
+static int send_reply(rtsp_client_t *client) {
+  while (client->reply_sent < client->reply_len) {
+    ssize_t ret = send(client->fd, client->reply + client->reply_sent,
+                       client->reply_len - client->reply_sent,
+                       MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (ret < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    client->reply_sent += ret;
+  }
+  client->reply_len = 0;
+  client->reply_sent = 0;
+  return 1;
+}
+
+static void flush_client(rtsp_server_t *server, rtsp_client_t *client) {
+  while (1) {
+    // replies go out between access units, never inside interleaved data
+    if (client->reply_len > 0 && !mid_access_unit(client)) {
+      int ret = send_reply(client);
+      if (ret < 0) {
+        close_client(server, client);
+        return;
+      }
+      if (ret == 0) {
+        set_want_out(server, client, true);
+        return;
+      }
+    }
+    if (client->queue_len == 0) {
+      break;
+    }
+
+    rtsp_au_t *au = client->queue[client->queue_head];
+    if (!client->packets_built) {
+      build_packets(server, client, au);
+    }
+    int ret = client->tcp ? send_tcp(client) : send_udp(server, client);
+    if (ret < 0) {
+      close_client(server, client);
+      return;
+    }
+    if (ret == 0) {
+      set_want_out(server, client, true);
+      return;
+    }
+    au_release(au);
+    release_params_ref(client);
+    client->queue_head = (client->queue_head + 1) % RTSP_CLIENT_QUEUE;
+    client->queue_len--;
+    if (client->replay_len > 0) {
+      client->replay_len--;
+    }
+    client->packets_built = false;
+  }
+  set_want_out(server, client, false);
+}
+
+static void release_gop(rtsp_stream_t *stream) {
+  for (int i = 0; i < stream->gop_len; i++) {
+    au_release(stream->gop[i]);
+  }
+  stream->gop_len = 0;
+  stream->gop_bytes = 0;
+}
+
+// Keep the parameter sets and everything since the last key frame
+static void cache_access_unit(rtsp_stream_t *stream, rtsp_au_t *au) {
+  if (au->has_params) {
+    if (stream->params != NULL) {
+      au_release(stream->params);
+    }
+    au_acquire(au);
+    stream->params = au;
+  }
+  if (au->keyframe) {
+    release_gop(stream);
+  } else if (stream->gop_len == 0) {
+    return;
+  }
+  if (stream->gop_len == RTSP_GOP_CACHE_AUS ||
+      stream->gop_bytes + au->len > RTSP_GOP_CACHE_BYTES) {
+    // GOP too long to replay, joins wait for the next IDR instead
+    release_gop(stream);
+    return;
+  }
+  au_acquire(au);
+  stream->gop[stream->gop_len++] = au;
+  stream->gop_bytes += au->len;
+}
+
+static void dispatch(rtsp_server_t *server, rtsp_au_t *au) {
+  rtsp_stream_t *stream = &server->streams[au->stream];
+  int deepest = 0;
+
+  cache_access_unit(stream, au);
+  for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+    rtsp_client_t *client = &server->clients[i];
+    if (client->state != CLIENT_PLAYING || client->stream != au->stream) {
+      continue;
+    }
+    if (client->queue_len == RTSP_CLIENT_QUEUE) {
+      // too slow: keep only what is half sent and restart at an IDR
+      drop_queue(client, mid_access_unit(client));
+      client->waiting_key = true;
+      deepest = RTSP_CLIENT_QUEUE;
+    }
+    if (client->waiting_key && !au->keyframe) {
+      continue;
+    }
+    client->waiting_key = false;
+    enqueue(client, au);
+    // the GOP replayed at PLAY is a burst of our own making, not a sign
+    // that the client falls behind
+    deepest = std::max(deepest, client->queue_len - client->replay_len);
+  }
+
+  int peak = stream->queue_peak.load(std::memory_order_relaxed);
+  while (deepest > peak &&
+         !stream->queue_peak.compare_exchange_weak(peak, deepest)) {
+  }
+}
+
+static void reply(rtsp_client_t *client, int cseq, const char *status,
+                  const char *headers, const char *body) {
+  int n = snprintf(client->reply + client->reply_len,
+                   RTSP_REPLY_BYTES - client->reply_len,
+                   "RTSP/1.0 %s\r\nCSeq: %d\r\n%s", status, cseq, headers);
+  if (n < 0 || client->reply_len + n >= RTSP_REPLY_BYTES) {
+    return;
+  }
+  client->reply_len += n;
+  n = snprintf(client->reply + client->reply_len,
+               RTSP_REPLY_BYTES - client->reply_len,
+               body != NULL ? "Content-Length: %d\r\n\r\n%s" : "\r\n",
+               body != NULL ? (int)strlen(body) : 0, body);
+  if (n > 0 && client->reply_len + n < RTSP_REPLY_BYTES) {
+    client->reply_len += n;
+  }
+}
+
+// Value of a header line, copied into out; false when absent
+static bool get_header(const char *request, const char *name, char *out,
+                       size_t size) {
+  size_t name_len = strlen(name);
+  const char *line = strstr(request, "\r\n");
+  while (line != NULL && line[2] != '\r') {
+    line += 2;
+    if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+      const char *value = line + name_len + 1;
+      while (*value == ' ') {
+        value++;
+      }
+      size_t len = strcspn(value, "\r\n");
+      if (len >= size) {
+        len = size - 1;
+      }
+      memcpy(out, value, len);
+      out[len] = '\0';
+      return true;
+    }
+    line = strstr(line, "\r\n");
+  }
+  return false;
+}
+
+// Stream whose path the URL starts with, ignoring a trailing track control
+static int find_stream(rtsp_server_t *server, const char *url) {
+  const char *path = url;
+  if (strncmp(url, "rtsp://", 7) == 0) {
+    path = strchr(url + 7, '/');
+    if (path == NULL) {
+      return -1;
+    }
+  }
+  for (int i = 0; i < server->n_streams; i++) {
+    size_t len = strlen(server->streams[i].path);
+    if (strncmp(path, server->streams[i].path, len) == 0 &&
+        (path[len] == '\0' || path[len] == '/')) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// a=fmtp line with the cached parameter sets, RFC 6184 / RFC 7798
+static void format_fmtp(const rtsp_stream_t *stream, char *out, size_t size) {
+  char sps[256] = "", pps[256] = "", vps[256] = "";
+  const char *profile = NULL;
+  char profile_hex[8];
+  const rtsp_au_t *params = stream->params;
+
+  for (int i = 0; params != NULL && i < params->n_nals; i++) {
+    const uint8_t *nal = params->data + params->nals[i].offset;
+    uint32_t len = params->nals[i].len;
+    uint8_t type = params->nals[i].type;
+    char *b64 = NULL;
+    if (stream->codec == RTSP_CODEC_H264) {
+      b64 = type == NAL_H264_SPS ? sps : (type == NAL_H264_PPS ? pps : NULL);
+      if (type == NAL_H264_SPS && len >= 4) {
+        snprintf(profile_hex, sizeof(profile_hex), "%02X%02X%02X", nal[1],
+                 nal[2], nal[3]);
+        profile = profile_hex;
+      }
+    } else {
+      b64 = type == NAL_H265_VPS   ? vps
+            : type == NAL_H265_SPS ? sps
+            : type == NAL_H265_PPS ? pps
+                                   : NULL;
+    }
+    // the first of each kind is enough
+    if (b64 != NULL && b64[0] == '\0') {
+      nal_base64(nal, len, b64, sizeof(sps));
+    }
+  }
+
+  if (stream->codec == RTSP_CODEC_H264) {
+    int n = snprintf(out, size, "a=fmtp:%d packetization-mode=1",
+                     RTSP_PAYLOAD_TYPE);
+    if (profile != NULL && sps[0] != '\0' && pps[0] != '\0') {
+      snprintf(out + n, size - n,
+               ";profile-level-id=%s;sprop-parameter-sets=%s,%s", profile, sps,
+               pps);
+    }
+  } else if (vps[0] != '\0' && sps[0] != '\0' && pps[0] != '\0') {
+    snprintf(out, size, "a=fmtp:%d sprop-vps=%s;sprop-sps=%s;sprop-pps=%s",
+             RTSP_PAYLOAD_TYPE, vps, sps, pps);
+  } else {
+    out[0] = '\0';
+    return;
+  }
+  strncat(out, "\r\n", size - strlen(out) - 1);
+}
+
+static void describe(rtsp_server_t *server, rtsp_client_t *client, int cseq,
+                     const char *url, int stream) {
+  char ip[INET_ADDRSTRLEN] = "0.0.0.0";
+  struct sockaddr_in local;
+  socklen_t local_len = sizeof(local);
+  if (getsockname(client->fd, (struct sockaddr *)&local, &local_len) == 0) {
+    inet_ntop(AF_INET, &local.sin_addr, ip, sizeof(ip));
+  }
+
+  char sdp[1024];
+  char fmtp[512];
+  bool h264 = server->streams[stream].codec == RTSP_CODEC_H264;
+  format_fmtp(&server->streams[stream], fmtp, sizeof(fmtp));
+  snprintf(sdp, sizeof(sdp),
+           "v=0\r\n"
+           "o=- %u 1 IN IP4 %s\r\n"
+           "s=%s\r\n"
+           "c=IN IP4 0.0.0.0\r\n"
+           "t=0 0\r\n"
+           "a=control:*\r\n"
+           "m=video 0 RTP/AVP %d\r\n"
+           "a=rtpmap:%d %s/90000\r\n"
+           "%s"
+           "a=control:track0\r\n",
+           client->session_id, ip, server->streams[stream].path,
+           RTSP_PAYLOAD_TYPE, RTSP_PAYLOAD_TYPE, h264 ? "H264" : "H265", fmtp);
+
+  char headers[512];
+  snprintf(headers, sizeof(headers),
+           "Content-Type: application/sdp\r\nContent-Base: %s/\r\n", url);
+  reply(client, cseq, "200 OK", headers, sdp);
+}
+
+static void setup(rtsp_server_t *server, rtsp_client_t *client, int cseq,
+                  int stream, const char *transport) {
+  char headers[256];
+  int rtp_port;
+
+  if (client->state == CLIENT_PLAYING) {
+    reply(client, cseq, "455 Method Not Valid in This State", "", NULL);
+    return;
+  }
+  if (strstr(transport, "RTP/AVP/TCP") != NULL) {
+    const char *interleaved = strstr(transport, "interleaved=");
+    client->tcp = true;
+    client->channel = interleaved != NULL ? atoi(interleaved + 12) : 0;
+    snprintf(headers, sizeof(headers),
+             "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d\r\n"
+             "Session: %08X;timeout=60\r\n",
+             client->channel, client->channel + 1, client->session_id);
+  } else {
+    const char *client_port = strstr(transport, "client_port=");
+    socklen_t len = sizeof(client->rtp_addr);
+    if (client_port == NULL || server->rtp_fd < 0 ||
+        getpeername(client->fd, (struct sockaddr *)&client->rtp_addr, &len) <
+            0) {
+      reply(client, cseq, "461 Unsupported Transport", "", NULL);
+      return;
+    }
+    rtp_port = atoi(client_port + 12);
+    client->tcp = false;
+    client->rtp_addr.sin_port = htons(rtp_port);
+    snprintf(headers, sizeof(headers),
+             "Transport: RTP/AVP;unicast;client_port=%d-%d;"
+             "server_port=%d-%d\r\n"
+             "Session: %08X;timeout=60\r\n",
+             rtp_port, rtp_port + 1, server->rtp_port, server->rtp_port + 1,
+             client->session_id);
+  }
+  client->stream = stream;
+  client->state = CLIENT_READY;
+  reply(client, cseq, "200 OK", headers, NULL);
+}
+
+static void handle_request(rtsp_server_t *server, rtsp_client_t *client,
+                           char *request) {
+  char method[32], url[256], value[256], headers[256];
+  int cseq = 0;
+
+  if (sscanf(request, "%31s %255s", method, url) != 2) {
+    reply(client, 0, "400 Bad Request", "", NULL);
+    return;
+  }
+  if (get_header(request, "CSeq", value, sizeof(value))) {
+    cseq = atoi(value);
+  }
+  int stream = find_stream(server, url);
+  snprintf(headers, sizeof(headers), "Session: %08X\r\n", client->session_id);
+
+  if (strcmp(method, "OPTIONS") == 0) {
+    reply(client, cseq, "200 OK",
+          "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, "
+          "GET_PARAMETER\r\n",
+          NULL);
+  } else if (strcmp(method, "DESCRIBE") == 0) {
+    if (stream < 0) {
+      reply(client, cseq, "404 Not Found", "", NULL);
+      return;
+    }
+    describe(server, client, cseq, url, stream);
+  } else if (strcmp(method, "SETUP") == 0) {
+    if (stream < 0) {
+      reply(client, cseq, "404 Not Found", "", NULL);
+      return;
+    }
+    if (!get_header(request, "Transport", value, sizeof(value))) {
+      reply(client, cseq, "461 Unsupported Transport", "", NULL);
+      return;
+    }
+    setup(server, client, cseq, stream, value);
+  } else if (strcmp(method, "PLAY") == 0) {
+    if (client->state == CLIENT_INIT) {
+      reply(client, cseq, "455 Method Not Valid in This State", "", NULL);
+      return;
+    }
+    if (client->state == CLIENT_READY) {
+      rtsp_stream_t *st = &server->streams[client->stream];
+      client->state = CLIENT_PLAYING;
+      client->params_sent = false;
+      // start from the cached GOP, or wait for the next IDR without one
+      client->waiting_key = st->gop_len == 0;
+      for (int i = 0; i < st->gop_len; i++) {
+        enqueue(client, st->gop[i]);
+      }
+      client->replay_len = client->queue_len;
+      st->n_playing.fetch_add(1);
+    }
+    strcat(headers, "Range: npt=0.000-\r\n");
+    reply(client, cseq, "200 OK", headers, NULL);
+  } else if (strcmp(method, "TEARDOWN") == 0) {
+    if (client->state == CLIENT_PLAYING) {
+      server->streams[client->stream].n_playing.fetch_sub(1);
+    }
+    drop_queue(client, mid_access_unit(client));
+    client->state = CLIENT_INIT;
+    reply(client, cseq, "200 OK", headers, NULL);
+  } else if (strcmp(method, "GET_PARAMETER") == 0 ||
+             strcmp(method, "SET_PARAMETER") == 0) {
+    reply(client, cseq, "200 OK", headers, NULL);
+  } else {
+    reply(client, cseq, "501 Not Implemented", "", NULL);
+  }
+}
+
+static void read_client(rtsp_server_t *server, rtsp_client_t *client) {
+  ssize_t n = recv(client->fd, client->request + client->request_len,
+                   RTSP_REQUEST_BYTES - 1 - client->request_len, MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    close_client(server, client);
+    return;
+  }
+  if (n < 0) {
+    return;
+  }
+  client->request_len += n;
+  client->request[client->request_len] = '\0';
+
+  while (client->request_len > 0) {
+    char *buf = client->request;
+    int used;
+    if (buf[0] == '$') {
+      // RTCP from an interleaved client, not needed
+      if (client->request_len < 4) {
+        break;
+      }
+      used = 4 + ((uint8_t)buf[2] << 8 | (uint8_t)buf[3]);
+      if (used > client->request_len) {
+        break;
+      }
+    } else {
+      char *end = strstr(buf, "\r\n\r\n");
+      if (end == NULL) {
+        if (client->request_len >= RTSP_REQUEST_BYTES - 1) {
+          close_client(server, client);
+          return;
+        }
+        break;
+      }
+      used = end + 4 - buf;
+      char value[32];
+      end[2] = '\0';
+      if (get_header(buf, "Content-Length", value, sizeof(value))) {
+        // the body has to fit the request buffer after the headers
+        char *value_end;
+        unsigned long body = strtoul(value, &value_end, 10);
+        while (*value_end == ' ' || *value_end == '\t') {
+          value_end++;
+        }
+        if (value[0] < '0' || value[0] > '9' || *value_end != '\0' ||
+            body > (unsigned long)(RTSP_REQUEST_BYTES - 1 - used)) {
+          printf("rtsp: bad Content-Length %s\n", value);
+          close_client(server, client);
+          return;
+        }
+        used += (int)body;
+      }
+      if (used > client->request_len) {
+        end[2] = '\r';
+        break;
+      }
+      handle_request(server, client, buf);
+    }
+    memmove(buf, buf + used, client->request_len - used);
+    client->request_len -= used;
+    client->request[client->request_len] = '\0';
+  }
+  flush_client(server, client);
+}
+
+static void accept_client(rtsp_server_t *server) {
+  int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  int slot = -1;
+  for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+    if (server->clients[i].state == CLIENT_FREE) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    printf("rtsp: too many clients\n");
+    close(fd);
+    return;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  rtsp_client_t *client = &server->clients[slot];
+  client->fd = fd;
+  client->state = CLIENT_INIT;
+  client->stream = -1;
+  client->session_id = ++server->next_session ^ (uint32_t)rand();
+  client->ssrc = (uint32_t)rand();
+  client->seq = (uint16_t)rand();
+  client->ts_base = (uint32_t)rand();
+  client->request_len = 0;
+  client->reply_len = 0;
+  client->reply_sent = 0;
+  client->queue_head = 0;
+  client->queue_len = 0;
+  client->replay_len = 0;
+  client->packets_built = false;
+  client->params_ref = NULL;
+  client->want_out = false;
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u64 = slot;
+  epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void take_pending(rtsp_server_t *server) {
+  rtsp_au_t *aus[RTSP_PENDING_AUS];
+  uint64_t count;
+
+  if (read(server->wake_fd, &count, sizeof(count)) < 0) {
+    // spurious wakeup, the pending list says what is there
+  }
+  pthread_mutex_lock(&server->lock);
+  int n = server->n_pending;
+  memcpy(aus, server->pending, n * sizeof(rtsp_au_t *));
+  server->n_pending = 0;
+  pthread_mutex_unlock(&server->lock);
+
+  for (int i = 0; i < n; i++) {
+    dispatch(server, aus[i]);
+    au_release(aus[i]);
+  }
+  for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+    rtsp_client_t *client = &server->clients[i];
+    if (client->state == CLIENT_PLAYING && client->queue_len > 0 &&
+        !client->want_out) {
+      flush_client(server, client);
+    }
+  }
+}
+
+static void *server_loop(void *arg) {
+  rtsp_server_t *server = (rtsp_server_t *)arg;
+  struct epoll_event events[RTSP_EPOLL_EVENTS];
+
+  while (server->running.load(std::memory_order_relaxed)) {
+    int n = epoll_wait(server->epoll_fd, events, RTSP_EPOLL_EVENTS,
+                       RTSP_POLL_MS);
+    for (int i = 0; i < n; i++) {
+      int tag = (int)(int64_t)events[i].data.u64;
+      if (tag == TAG_LISTEN) {
+        accept_client(server);
+      } else if (tag == TAG_WAKE) {
+        take_pending(server);
+      } else if (tag == TAG_RTCP) {
+        char rtcp[512];
+        // receiver reports, drained and ignored
+        while (recv(server->rtcp_fd, rtcp, sizeof(rtcp), MSG_DONTWAIT) > 0) {
+        }
+      } else {
+        rtsp_client_t *client = &server->clients[tag];
+        if (client->state == CLIENT_FREE) {
+          continue;
+        }
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+          close_client(server, client);
+          continue;
+        }
+        if (events[i].events & EPOLLOUT) {
+          flush_client(server, client);
+        }
+        if (client->state != CLIENT_FREE && (events[i].events & EPOLLIN)) {
+          read_client(server, client);
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+static int epoll_add(rtsp_server_t *server, int fd, int tag) {
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u64 = (uint64_t)(int64_t)tag;
+  return epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int udp_socket(int port) {
+  struct sockaddr_in addr;
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// RTP and RTCP on the first free even/odd port pair
+static void open_rtp_ports(rtsp_server_t *server) {
+  for (int port = RTSP_RTP_PORT_BASE; port < RTSP_RTP_PORT_BASE + 100;
+       port += 2) {
+    server->rtp_fd = udp_socket(port);
+    if (server->rtp_fd < 0) {
+      continue;
+    }
+    server->rtcp_fd = udp_socket(port + 1);
+    if (server->rtcp_fd >= 0) {
+      server->rtp_port = port;
+      return;
+    }
+    close(server->rtp_fd);
+    server->rtp_fd = -1;
+  }
+  printf("rtsp: no UDP port pair, only TCP interleaved transport\n");
+}
+
+rtsp_server_t *rtsp_server_create(int port) {
+  rtsp_server_t *server = new rtsp_server_t();
+  struct sockaddr_in addr;
+  int one = 1;
+
+  server->listen_fd = -1;
+  server->epoll_fd = -1;
+  server->wake_fd = -1;
+  server->rtp_fd = -1;
+  server->rtcp_fd = -1;
+  for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+    server->clients[i].fd = -1;
+  }
+  pthread_mutex_init(&server->lock, NULL);
+  srand(time(NULL) ^ getpid());
+
+  server->listen_fd =
+      socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server->listen_fd < 0) {
+    printf("rtsp socket fail!\n");
+    rtsp_server_destroy(server);
+    return NULL;
+  }
+  setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(server->listen_fd, 8) < 0) {
+    printf("rtsp bind port %d fail!\n", port);
+    rtsp_server_destroy(server);
+    return NULL;
+  }
+  open_rtp_ports(server);
+
+  server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (server->epoll_fd < 0 || server->wake_fd < 0) {
+    printf("rtsp epoll fail!\n");
+    rtsp_server_destroy(server);
+    return NULL;
+  }
+  epoll_add(server, server->listen_fd, TAG_LISTEN);
+  epoll_add(server, server->wake_fd, TAG_WAKE);
+  if (server->rtcp_fd >= 0) {
+    epoll_add(server, server->rtcp_fd, TAG_RTCP);
+  }
+  return server;
+}
+
+int rtsp_server_add_stream(rtsp_server_t *server, const char *path,
+                           rtsp_codec codec) {
+  if (server->started || server->n_streams >= RTSP_MAX_STREAMS) {
+    return -1;
+  }
+  rtsp_stream_t *stream = &server->streams[server->n_streams];
+  snprintf(stream->path, sizeof(stream->path), "%s", path);
+  stream->codec = codec;
+  return server->n_streams++;
+}
+
+int rtsp_server_start(rtsp_server_t *server) {
+  server->running.store(true);
+  if (pthread_create(&server->thread, NULL, server_loop, server) != 0) {
+    server->running.store(false);
+    printf("rtsp thread create fail!\n");
+    return -1;
+  }
+  server->started = true;
+  return 0;
+}
+
+int rtsp_server_push(rtsp_server_t *server, int stream, const uint8_t *data,
+                     size_t len, uint64_t pts_us) {
+  if (stream < 0 || stream >= server->n_streams) {
+    return -1;
+  }
+  void *mem = malloc(sizeof(rtsp_au_t));
+  uint8_t *copy = (uint8_t *)malloc(len);
+  if (mem == NULL || copy == NULL) {
+    free(mem);
+    free(copy);
+    return -1;
+  }
+  rtsp_au_t *au = new (mem) rtsp_au_t;
+  au->refs.store(1, std::memory_order_relaxed);
+  au->stream = stream;
+  au->pts_us = pts_us;
+  memcpy(copy, data, len);
+  au->data = copy;
+  au->len = len;
+  nal_codec codec = (nal_codec)server->streams[stream].codec;
+  au->n_nals = nal_split(codec, copy, len, au->nals, RTSP_AU_MAX_NALS);
+  au->keyframe = false;
+  au->has_params = false;
+  for (int i = 0; i < au->n_nals; i++) {
+    au->keyframe |= nal_is_keyframe(codec, au->nals[i].type);
+    au->has_params |= nal_is_parameter_set(codec, au->nals[i].type);
+  }
+
+  pthread_mutex_lock(&server->lock);
+  bool queued = server->n_pending < RTSP_PENDING_AUS;
+  if (queued) {
+    server->pending[server->n_pending++] = au;
+  }
+  pthread_mutex_unlock(&server->lock);
+  if (!queued) {
+    // the server thread is stuck, clients resync at an IDR
+    au_release(au);
+    return -1;
+  }
+  uint64_t one = 1;
+  if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+    // the counter is already non-zero, the thread wakes up anyway
+  }
+  return 0;
+}
+
+int rtsp_server_client_count(rtsp_server_t *server, int stream) {
+  if (stream < 0 || stream >= server->n_streams) {
+    return 0;
+  }
+  return server->streams[stream].n_playing.load(std::memory_order_relaxed);
+}
+
+int rtsp_server_take_queue_peak(rtsp_server_t *server, int stream) {
+  if (stream < 0 || stream >= server->n_streams) {
+    return 0;
+  }
+  return server->streams[stream].queue_peak.exchange(0);
+}
+
+void rtsp_server_destroy(rtsp_server_t *server) {
+  if (server == NULL) {
+    return;
+  }
+  if (server->started) {
+    server->running.store(false);
+    pthread_join(server->thread, NULL);
+  }
+  for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+    if (server->clients[i].state != CLIENT_FREE) {
+      close_client(server, &server->clients[i]);
+    }
+  }
+  for (int i = 0; i < server->n_pending; i++) {
+    au_release(server->pending[i]);
+  }
+  for (int i = 0; i < server->n_streams; i++) {
+    release_gop(&server->streams[i]);
+    if (server->streams[i].params != NULL) {
+      au_release(server->streams[i].params);
+    }
+  }
+  int fds[] = {server->listen_fd, server->epoll_fd, server->wake_fd,
+               server->rtp_fd, server->rtcp_fd};
+  for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+    if (fds[i] >= 0) {
+      close(fds[i]);
+    }
+  }
+  pthread_mutex_destroy(&server->lock);
+  delete server;
+}
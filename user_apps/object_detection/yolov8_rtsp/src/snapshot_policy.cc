@@ -0,0 +1,113 @@
+#include "snapshot_policy.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+void snapshot_policy_init(snapshot_policy_t *policy, uint64_t repeat_us) {
+  memset(policy, 0, sizeof(snapshot_policy_t));
+  box_tracker_init(&policy->tracker, SNAPSHOT_TRACK_IOU,
+                   SNAPSHOT_TRACK_MAX_MISSED);
+  policy->repeat_us = repeat_us;
+}
+
+int snapshot_policy_select(snapshot_policy_t *policy,
+                           const object_detect_result_list *od_results,
+                           uint64_t pts_us, snapshot_pick_t *picks,
+                           int max_picks) {
+  int track_slots[OBJ_NUMB_MAX_SIZE];
+  int due[OBJ_NUMB_MAX_SIZE];
+  int n_due = 0;
+
+  box_tracker_update(&policy->tracker, od_results, track_slots);
+  for (int i = 0; i < od_results->count; i++) {
+    int slot = track_slots[i];
+    if (slot < 0) {
+      continue;
+    }
+    const box_track_t *track = &policy->tracker.tracks[slot];
+    snapshot_mark_t *mark = &policy->marks[slot];
+    if (mark->track_id != track->id) {
+      // slot reused by another object
+      mark->track_id = 0;
+    }
+    if (track->hits < SNAPSHOT_MIN_HITS) {
+      continue;
+    }
+    if (mark->track_id == 0 ||
+        (pts_us - mark->pts_us >= policy->repeat_us &&
+         box_iou(&mark->box, &track->box) < SNAPSHOT_MOVE_IOU)) {
+      due[n_due++] = i;
+    }
+  }
+
+  // objects never snapped first, then the most confident detections
+  std::sort(due, due + n_due, [&](int a, int b) {
+    bool new_a = policy->marks[track_slots[a]].track_id == 0;
+    bool new_b = policy->marks[track_slots[b]].track_id == 0;
+    if (new_a != new_b) {
+      return new_a;
+    }
+    return od_results->results[a].prop > od_results->results[b].prop;
+  });
+
+  int count = std::min(n_due, max_picks);
+  for (int k = 0; k < count; k++) {
+    int i = due[k];
+    const box_track_t *track = &policy->tracker.tracks[track_slots[i]];
+    snapshot_mark_t *mark = &policy->marks[track_slots[i]];
+    picks[k].index = i;
+    picks[k].track_id = track->id;
+    picks[k].slot = track_slots[i];
+    picks[k].prev = *mark;
+    mark->track_id = track->id;
+    mark->box = track->box;
+    mark->pts_us = pts_us;
+  }
+  return count;
+}
+
+void snapshot_policy_undo(snapshot_policy_t *policy,
+                          const snapshot_pick_t *pick) {
+  snapshot_mark_t *mark = &policy->marks[pick->slot];
+  if (policy->tracker.tracks[pick->slot].id != pick->track_id ||
+      mark->track_id != pick->track_id) {
+    return;
+  }
+  *mark = pick->prev;
+}
+
+void snapshot_crop_rect(const image_rect_t *box, int src_width,
+                        int src_height, int out_width, int out_height,
+                        image_rect_t *crop) {
+  float w = (box->right - box->left) * (1.f + 2 * SNAPSHOT_MARGIN);
+  float h = (box->bottom - box->top) * (1.f + 2 * SNAPSHOT_MARGIN);
+  float cx = (box->left + box->right) / 2.f;
+  float cy = (box->top + box->bottom) / 2.f;
+
+  // widen the short side to the thumbnail aspect, then fit the frame
+  if (w * out_height < h * out_width) {
+    w = h * out_width / out_height;
+  } else {
+    h = w * out_height / out_width;
+  }
+  if (w > src_width) {
+    h = h * src_width / w;
+    w = src_width;
+  }
+  if (h > src_height) {
+    w = w * src_height / h;
+    h = src_height;
+  }
+
+  int width = std::max(2, (int)w & ~1);
+  int height = std::max(2, (int)h & ~1);
+  int left = std::min(std::max(0, (int)(cx - width / 2.f)),
+                      src_width - width);
+  int top = std::min(std::max(0, (int)(cy - height / 2.f)),
+                     src_height - height);
+  crop->left = left & ~1;
+  crop->top = top & ~1;
+  crop->right = crop->left + width;
+  crop->bottom = crop->top + height;
+}
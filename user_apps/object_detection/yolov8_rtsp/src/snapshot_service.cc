@@ -0,0 +1,292 @@
+#include "snapshot_service.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "async_log.h"
+#include "im2d.hpp"
+#include "luckfox_mpi.h"
+#include "pipeline_trace.h"
+#include "snapshot_policy.h"
+
+typedef struct {
+  MB_BLK blk;
+  rga_buffer_handle_t handle;
+  VIDEO_FRAME_INFO_S frame;
+  snapshot_info_t info;
+  snapshot_pick_t pick;
+} snapshot_slot_t;
+
+struct _snapshot_service {
+  int chn;
+  snapshot_callback callback;
+  void *user;
+  snapshot_policy_t policy; // frame loop only
+
+  MB_POOL pool;
+  snapshot_slot_t slots[SNAPSHOT_SLOTS];
+
+  pthread_mutex_t lock; // guards the slot lists and running
+  pthread_cond_t cond;
+  int free_slots[SNAPSHOT_SLOTS];
+  int n_free;
+  int queue[SNAPSHOT_SLOTS]; // FIFO of slots waiting for the encoder
+  int queue_head;
+  int n_queued;
+  snapshot_pick_t failed[SNAPSHOT_SLOTS]; // for the frame loop to undo
+  int n_failed;
+  bool running;
+
+  bool venc_created;
+  pthread_t thread;
+  bool started;
+};
+
+static void *encode_loop(void *arg) {
+  snapshot_service_t *svc = (snapshot_service_t *)arg;
+  VENC_STREAM_S stream;
+  VENC_PACK_S pack;
+  memset(&stream, 0, sizeof(stream));
+  stream.pstPack = &pack;
+
+  pthread_mutex_lock(&svc->lock);
+  while (1) {
+    while (svc->running && svc->n_queued == 0) {
+      pthread_cond_wait(&svc->cond, &svc->lock);
+    }
+    if (svc->n_queued == 0) {
+      break;
+    }
+    int k = svc->queue[svc->queue_head];
+    svc->queue_head = (svc->queue_head + 1) % SNAPSHOT_SLOTS;
+    svc->n_queued--;
+    pthread_mutex_unlock(&svc->lock);
+
+    // one picture at a time, the channel only ever holds this one
+    snapshot_slot_t *slot = &svc->slots[k];
+    bool encoded = false;
+    if (RK_MPI_VENC_SendFrame(svc->chn, &slot->frame, -1) != RK_SUCCESS) {
+      ALOGW("snapshot encode fail\n");
+    } else if (RK_MPI_VENC_GetStream(svc->chn, &stream, -1) != RK_SUCCESS) {
+      ALOGW("snapshot get stream fail\n");
+    } else {
+      svc->callback(&slot->info,
+                    (const uint8_t *)RK_MPI_MB_Handle2VirAddr(pack.pMbBlk),
+                    pack.u32Len, svc->user);
+      RK_MPI_VENC_ReleaseStream(svc->chn, &stream);
+      encoded = true;
+    }
+
+    pthread_mutex_lock(&svc->lock);
+    if (!encoded) {
+      svc->failed[svc->n_failed++] = slot->pick;
+    }
+    svc->free_slots[svc->n_free++] = k;
+  }
+  pthread_mutex_unlock(&svc->lock);
+  return NULL;
+}
+
+snapshot_service_t *snapshot_service_create(int chn,
+                                            snapshot_callback callback,
+                                            void *user) {
+  snapshot_service_t *svc = new snapshot_service_t();
+  svc->chn = chn;
+  svc->callback = callback;
+  svc->user = user;
+  svc->pool = MB_INVALID_POOLID;
+  snapshot_policy_init(&svc->policy, SNAPSHOT_REPEAT_US);
+  pthread_mutex_init(&svc->lock, NULL);
+  pthread_cond_init(&svc->cond, NULL);
+  for (int k = 0; k < SNAPSHOT_SLOTS; k++) {
+    svc->slots[k].blk = MB_INVALID_HANDLE;
+  }
+
+  uint32_t size = SNAPSHOT_WIDTH * SNAPSHOT_HEIGHT * 3;
+  MB_POOL_CONFIG_S PoolCfg;
+  memset(&PoolCfg, 0, sizeof(MB_POOL_CONFIG_S));
+  PoolCfg.u64MBSize = size;
+  PoolCfg.u32MBCnt = SNAPSHOT_SLOTS;
+  PoolCfg.enAllocType = MB_ALLOC_TYPE_DMA;
+  svc->pool = RK_MPI_MB_CreatePool(&PoolCfg);
+  if (svc->pool == MB_INVALID_POOLID) {
+    printf("create snapshot pool fail!\n");
+    snapshot_service_destroy(svc);
+    return NULL;
+  }
+  for (int k = 0; k < SNAPSHOT_SLOTS; k++) {
+    snapshot_slot_t *slot = &svc->slots[k];
+    slot->blk = RK_MPI_MB_GetMB(svc->pool, size, RK_TRUE);
+    if (slot->blk == MB_INVALID_HANDLE) {
+      printf("get snapshot MB fail!\n");
+      snapshot_service_destroy(svc);
+      return NULL;
+    }
+    slot->handle = importbuffer_fd(RK_MPI_MB_Handle2Fd(slot->blk), size);
+    if (slot->handle == 0) {
+      printf("snapshot importbuffer_fd fail!\n");
+      snapshot_service_destroy(svc);
+      return NULL;
+    }
+    VIDEO_FRAME_S *vframe = &slot->frame.stVFrame;
+    vframe->u32Width = SNAPSHOT_WIDTH;
+    vframe->u32Height = SNAPSHOT_HEIGHT;
+    vframe->u32VirWidth = SNAPSHOT_WIDTH;
+    vframe->u32VirHeight = SNAPSHOT_HEIGHT;
+    vframe->enPixelFormat = RK_FMT_RGB888;
+    vframe->pMbBlk = slot->blk;
+    svc->free_slots[svc->n_free++] = k;
+  }
+
+  if (jpeg_venc_init(chn, SNAPSHOT_WIDTH, SNAPSHOT_HEIGHT,
+                     SNAPSHOT_QUALITY) != 0) {
+    snapshot_service_destroy(svc);
+    return NULL;
+  }
+  svc->venc_created = true;
+
+  svc->running = true;
+  if (pthread_create(&svc->thread, NULL, encode_loop, svc) != 0) {
+    printf("snapshot thread create fail!\n");
+    snapshot_service_destroy(svc);
+    return NULL;
+  }
+  svc->started = true;
+  return svc;
+}
+
+int snapshot_service_capture(snapshot_service_t *svc, frame_buffer_t *src,
+                             const object_detect_result_list *od_results,
+                             uint64_t pts_us) {
+  snapshot_pick_t picks[SNAPSHOT_SLOTS];
+  int slots[SNAPSHOT_SLOTS];
+
+  // objects whose encode failed are due again; a slot is only freed after
+  // its failure is listed, so there are never more than SNAPSHOT_SLOTS
+  pthread_mutex_lock(&svc->lock);
+  int n_failed = svc->n_failed;
+  memcpy(picks, svc->failed, n_failed * sizeof(snapshot_pick_t));
+  svc->n_failed = 0;
+  int n_free = svc->n_free;
+  pthread_mutex_unlock(&svc->lock);
+  for (int k = 0; k < n_failed; k++) {
+    snapshot_policy_undo(&svc->policy, &picks[k]);
+  }
+
+  // the tracker sees every frame, even when all buffers are in flight
+  int count = snapshot_policy_select(&svc->policy, od_results, pts_us, picks,
+                                     n_free);
+  if (count == 0) {
+    return 0;
+  }
+
+  rga_buffer_t src_buf = frame_buffer_rga(src);
+  if (src_buf.handle == 0) {
+    for (int k = 0; k < count; k++) {
+      snapshot_policy_undo(&svc->policy, &picks[k]);
+    }
+    return -1;
+  }
+  frame_buffer_sync_for_device(src);
+
+  // only the frame loop takes slots, so the count seen above still holds
+  pthread_mutex_lock(&svc->lock);
+  for (int k = 0; k < count; k++) {
+    slots[k] = svc->free_slots[--svc->n_free];
+  }
+  pthread_mutex_unlock(&svc->lock);
+
+  rga_buffer_t pat;
+  memset(&pat, 0, sizeof(pat));
+  im_rect prect = {0, 0, 0, 0};
+  im_rect drect = {0, 0, SNAPSHOT_WIDTH, SNAPSHOT_HEIGHT};
+  int ret = 0;
+
+  PIPELINE_TRACE_BEGIN(TRACE_TRACK_RGA, "snapshot");
+  im_job_handle_t job = imbeginJob();
+  if (job == 0) {
+    ALOGE("rga imbeginJob fail!\n");
+    ret = -1;
+  }
+  for (int k = 0; k < count && ret == 0; k++) {
+    const object_detect_result *det = &od_results->results[picks[k].index];
+    snapshot_slot_t *slot = &svc->slots[slots[k]];
+    image_rect_t crop;
+    snapshot_crop_rect(&det->box, src->width, src->height, SNAPSHOT_WIDTH,
+                       SNAPSHOT_HEIGHT, &crop);
+    im_rect srect = {crop.left, crop.top, crop.right - crop.left,
+                     crop.bottom - crop.top};
+    rga_buffer_t dst = wrapbuffer_handle(slot->handle, SNAPSHOT_WIDTH,
+                                         SNAPSHOT_HEIGHT, src->format);
+    if (improcessTask(job, src_buf, dst, pat, srect, drect, prect, NULL, 0) !=
+        IM_STATUS_SUCCESS) {
+      ALOGE("rga improcessTask fail!\n");
+      imcancelJob(job);
+      ret = -1;
+      break;
+    }
+    slot->info.track_id = picks[k].track_id;
+    slot->info.cls_id = det->cls_id;
+    slot->info.prop = det->prop;
+    slot->info.box = det->box;
+    slot->info.pts_us = pts_us;
+    slot->pick = picks[k];
+  }
+  if (ret == 0 && imendJob(job) != IM_STATUS_SUCCESS) {
+    ALOGE("rga imendJob fail!\n");
+    ret = -1;
+  }
+  PIPELINE_TRACE_END(TRACE_TRACK_RGA, "snapshot");
+
+  pthread_mutex_lock(&svc->lock);
+  for (int k = 0; k < count; k++) {
+    if (ret == 0) {
+      svc->queue[(svc->queue_head + svc->n_queued++) % SNAPSHOT_SLOTS] =
+          slots[k];
+    } else {
+      svc->free_slots[svc->n_free++] = slots[k];
+    }
+  }
+  pthread_mutex_unlock(&svc->lock);
+  if (ret != 0) {
+    // nothing was queued, the objects are tried again next frame
+    for (int k = 0; k < count; k++) {
+      snapshot_policy_undo(&svc->policy, &picks[k]);
+    }
+    return -1;
+  }
+  pthread_cond_signal(&svc->cond);
+  return count;
+}
+
+void snapshot_service_destroy(snapshot_service_t *svc) {
+  if (svc == NULL) {
+    return;
+  }
+  if (svc->started) {
+    pthread_mutex_lock(&svc->lock);
+    svc->running = false;
+    pthread_mutex_unlock(&svc->lock);
+    pthread_cond_signal(&svc->cond);
+    pthread_join(svc->thread, NULL);
+  }
+  if (svc->venc_created) {
+    RK_MPI_VENC_StopRecvFrame(svc->chn);
+    RK_MPI_VENC_DestroyChn(svc->chn);
+  }
+  for (int k = 0; k < SNAPSHOT_SLOTS; k++) {
+    if (svc->slots[k].handle != 0) {
+      releasebuffer_handle(svc->slots[k].handle);
+    }
+    if (svc->slots[k].blk != MB_INVALID_HANDLE) {
+      RK_MPI_MB_ReleaseMB(svc->slots[k].blk);
+    }
+  }
+  if (svc->pool != MB_INVALID_POOLID) {
+    RK_MPI_MB_DestroyPool(svc->pool);
+  }
+  pthread_cond_destroy(&svc->cond);
+  pthread_mutex_destroy(&svc->lock);
+  delete svc;
+}
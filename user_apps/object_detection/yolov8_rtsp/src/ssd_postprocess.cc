@@ -0,0 +1,429 @@
+#include "ssd_postprocess.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "async_log.h"
+#include "rknn_box_priors.h"
+
+// Priors in SoA form, with the center variance already folded into the
+// size terms so the regression below is a single multiply-add per lane.
+typedef struct {
+  float cx[SSD_NUM_PRIORS];
+  float cy[SSD_NUM_PRIORS];
+  float w[SSD_NUM_PRIORS];
+  float h[SSD_NUM_PRIORS];
+  float wv[SSD_NUM_PRIORS];
+  float hv[SSD_NUM_PRIORS];
+} ssd_priors_t;
+
+// Gathered per-candidate inputs of the box regression, also SoA. Sized for
+// the worst case so decoding never allocates.
+typedef struct {
+  int idx[SSD_NUM_PRIORS];
+  float lx[SSD_NUM_PRIORS];
+  float ly[SSD_NUM_PRIORS];
+  float lw[SSD_NUM_PRIORS];
+  float lh[SSD_NUM_PRIORS];
+  float cx[SSD_NUM_PRIORS];
+  float cy[SSD_NUM_PRIORS];
+  float pw[SSD_NUM_PRIORS];
+  float ph[SSD_NUM_PRIORS];
+  float pwv[SSD_NUM_PRIORS];
+  float phv[SSD_NUM_PRIORS];
+} ssd_candidates_t;
+
+static ssd_priors_t *priors = nullptr;
+static ssd_candidates_t *cands = nullptr;
+
+// Score column to label index of the 80 class COCO list, -1 for background
+// and for ids the model never predicts
+static int class_map[SSD_MAX_CLASSES];
+static int num_mapped_classes = 0;
+
+// Category ids the 91 class COCO export skips
+static const int coco91_unused_ids[] = {12, 26, 29, 30, 45, 66, 68, 69, 71, 83};
+
+static float unsigmoid(float y) { return -1.0 * logf((1.0 / y) - 1.0); }
+
+static float sigmoid(float x) { return 1.0 / (1.0 + expf(-x)); }
+
+static int8_t qnt_f32_to_affine(float f32, int32_t zp, float scale) {
+  float dst_val = (f32 / scale) + zp;
+  if (dst_val <= -128)
+    return -128;
+  if (dst_val >= 127)
+    return 127;
+  return (int8_t)dst_val;
+}
+
+static float deqnt_affine_to_f32(int8_t qnt, int32_t zp, float scale) {
+  return ((float)qnt - (float)zp) * scale;
+}
+
+#if defined(__ARM_NEON)
+// Cephes-style expf on four lanes, accurate to a few ulp over the range the
+// size regression produces.
+static inline float32x4_t exp_f32x4(float32x4_t x) {
+  x = vminq_f32(x, vdupq_n_f32(88.3762626647949f));
+  x = vmaxq_f32(x, vdupq_n_f32(-88.3762626647949f));
+
+  // n = floor(x / ln2 + 0.5)
+  float32x4_t fx =
+      vmlaq_f32(vdupq_n_f32(0.5f), x, vdupq_n_f32(1.44269504088896341f));
+  float32x4_t tmp = vcvtq_f32_s32(vcvtq_s32_f32(fx));
+  uint32x4_t mask = vcgtq_f32(tmp, fx);
+  tmp = vsubq_f32(tmp, vreinterpretq_f32_u32(vandq_u32(
+                           mask, vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+  int32x4_t n = vcvtq_s32_f32(tmp);
+
+  // r = x - n * ln2, split in two constants for precision
+  x = vmlsq_f32(x, tmp, vdupq_n_f32(0.693359375f));
+  x = vmlsq_f32(x, tmp, vdupq_n_f32(-2.12194440e-4f));
+
+  float32x4_t y = vdupq_n_f32(1.9875691500E-4f);
+  y = vmlaq_f32(vdupq_n_f32(1.3981999507E-3f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(8.3334519073E-3f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(4.1665795894E-2f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(1.6666665459E-1f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(5.0000001201E-1f), y, x);
+  y = vmlaq_f32(x, y, vmulq_f32(x, x));
+  y = vaddq_f32(y, vdupq_n_f32(1.0f));
+
+  // scale by 2^n
+  int32x4_t pow2n = vshlq_n_s32(vaddq_s32(n, vdupq_n_s32(127)), 23);
+  return vmulq_f32(y, vreinterpretq_f32_s32(pow2n));
+}
+
+// Max of row[1..num_classes), i.e. the best non-background score.
+static inline int8_t max_foreground_i8(const int8_t *row, int num_classes) {
+  int c = 1;
+  int8_t max_score = -128;
+  if (num_classes - c >= 16) {
+    int8x16_t acc = vld1q_s8(row + c);
+    for (c += 16; c + 16 <= num_classes; c += 16) {
+      acc = vmaxq_s8(acc, vld1q_s8(row + c));
+    }
+    int8x8_t m8 = vmax_s8(vget_low_s8(acc), vget_high_s8(acc));
+    m8 = vpmax_s8(m8, m8);
+    m8 = vpmax_s8(m8, m8);
+    m8 = vpmax_s8(m8, m8);
+    max_score = vget_lane_s8(m8, 0);
+  }
+  for (; c < num_classes; c++) {
+    if (row[c] > max_score) {
+      max_score = row[c];
+    }
+  }
+  return max_score;
+}
+#else
+static inline int8_t max_foreground_i8(const int8_t *row, int num_classes) {
+  int8_t max_score = -128;
+  for (int c = 1; c < num_classes; c++) {
+    if (row[c] > max_score) {
+      max_score = row[c];
+    }
+  }
+  return max_score;
+}
+#endif
+
+static void gather_prior(int k, int p) {
+  cands->idx[k] = p;
+  cands->cx[k] = priors->cx[p];
+  cands->cy[k] = priors->cy[p];
+  cands->pw[k] = priors->w[p];
+  cands->ph[k] = priors->h[p];
+  cands->pwv[k] = priors->wv[p];
+  cands->phv[k] = priors->hv[p];
+}
+
+// Decode `count` gathered candidates into (x, y, w, h) boxes in model input
+// pixels, interleaved the way filter_detect_results() expects.
+static void decode_boxes(int count, int model_in_w, int model_in_h,
+                         float *boxes) {
+  int k = 0;
+#if defined(__ARM_NEON)
+  const float32x4_t size_var = vdupq_n_f32(SSD_SIZE_VARIANCE);
+  const float32x4_t half = vdupq_n_f32(0.5f);
+  const float32x4_t mw = vdupq_n_f32((float)model_in_w);
+  const float32x4_t mh = vdupq_n_f32((float)model_in_h);
+  for (; k + 4 <= count; k += 4) {
+    float32x4_t cx = vmlaq_f32(vld1q_f32(cands->cx + k),
+                               vld1q_f32(cands->lx + k),
+                               vld1q_f32(cands->pwv + k));
+    float32x4_t cy = vmlaq_f32(vld1q_f32(cands->cy + k),
+                               vld1q_f32(cands->ly + k),
+                               vld1q_f32(cands->phv + k));
+    float32x4_t w = vmulq_f32(
+        vld1q_f32(cands->pw + k),
+        exp_f32x4(vmulq_f32(vld1q_f32(cands->lw + k), size_var)));
+    float32x4_t h = vmulq_f32(
+        vld1q_f32(cands->ph + k),
+        exp_f32x4(vmulq_f32(vld1q_f32(cands->lh + k), size_var)));
+
+    float32x4x4_t out;
+    out.val[0] = vmulq_f32(vmlsq_f32(cx, w, half), mw);
+    out.val[1] = vmulq_f32(vmlsq_f32(cy, h, half), mh);
+    out.val[2] = vmulq_f32(w, mw);
+    out.val[3] = vmulq_f32(h, mh);
+    vst4q_f32(boxes + k * 4, out);
+  }
+#endif
+  for (; k < count; k++) {
+    float cx = cands->cx[k] + cands->lx[k] * cands->pwv[k];
+    float cy = cands->cy[k] + cands->ly[k] * cands->phv[k];
+    float w = cands->pw[k] * expf(cands->lw[k] * SSD_SIZE_VARIANCE);
+    float h = cands->ph[k] * expf(cands->lh[k] * SSD_SIZE_VARIANCE);
+    boxes[k * 4 + 0] = (cx - 0.5f * w) * model_in_w;
+    boxes[k * 4 + 1] = (cy - 0.5f * h) * model_in_h;
+    boxes[k * 4 + 2] = w * model_in_w;
+    boxes[k * 4 + 3] = h * model_in_h;
+  }
+}
+
+static int process_ssd_i8(int8_t *loc, int32_t loc_zp, float loc_scale,
+                          int loc_stride, int8_t *conf, int32_t conf_zp,
+                          float conf_scale, int conf_stride, int num_classes,
+                          std::vector<float> &objProbs,
+                          std::vector<int> &classId, float threshold) {
+  int count = 0;
+  // scores are logits, compare against the threshold before the sigmoid
+  int8_t score_thres_i8 =
+      qnt_f32_to_affine(unsigmoid(threshold), conf_zp, conf_scale);
+
+  for (int p = 0; p < SSD_NUM_PRIORS; p++) {
+    const int8_t *row = conf + p * conf_stride;
+    if (max_foreground_i8(row, num_classes) <= score_thres_i8) {
+      continue;
+    }
+    int8_t max_score = row[1];
+    int max_class_id = 1;
+    for (int c = 2; c < num_classes; c++) {
+      if (row[c] > max_score) {
+        max_score = row[c];
+        max_class_id = c;
+      }
+    }
+    if (class_map[max_class_id] < 0) {
+      continue;
+    }
+
+    const int8_t *l = loc + p * loc_stride;
+    gather_prior(count, p);
+    cands->lx[count] = deqnt_affine_to_f32(l[0], loc_zp, loc_scale);
+    cands->ly[count] = deqnt_affine_to_f32(l[1], loc_zp, loc_scale);
+    cands->lw[count] = deqnt_affine_to_f32(l[2], loc_zp, loc_scale);
+    cands->lh[count] = deqnt_affine_to_f32(l[3], loc_zp, loc_scale);
+    objProbs.push_back(
+        sigmoid(deqnt_affine_to_f32(max_score, conf_zp, conf_scale)));
+    classId.push_back(class_map[max_class_id]);
+    count++;
+  }
+  return count;
+}
+
+static int process_ssd_fp32(float *loc, int loc_stride, float *conf,
+                            int conf_stride, int num_classes,
+                            std::vector<float> &objProbs,
+                            std::vector<int> &classId, float threshold) {
+  int count = 0;
+  float logit_thres = unsigmoid(threshold);
+
+  for (int p = 0; p < SSD_NUM_PRIORS; p++) {
+    const float *row = conf + p * conf_stride;
+    float max_score = row[1];
+    int max_class_id = 1;
+    for (int c = 2; c < num_classes; c++) {
+      if (row[c] > max_score) {
+        max_score = row[c];
+        max_class_id = c;
+      }
+    }
+    if (max_score <= logit_thres || class_map[max_class_id] < 0) {
+      continue;
+    }
+
+    const float *l = loc + p * loc_stride;
+    gather_prior(count, p);
+    cands->lx[count] = l[0];
+    cands->ly[count] = l[1];
+    cands->lw[count] = l[2];
+    cands->lh[count] = l[3];
+    objProbs.push_back(sigmoid(max_score));
+    classId.push_back(class_map[max_class_id]);
+    count++;
+  }
+  return count;
+}
+
+// Elements between consecutive priors of an output, honouring the padding
+// the NPU adds to the innermost dimension of native layout tensors.
+static int prior_stride(rknn_tensor_attr *attr, int elems_per_prior,
+                        int elem_size) {
+  int stride = elems_per_prior;
+  if (attr->size_with_stride > attr->size) {
+    stride = attr->size_with_stride / (SSD_NUM_PRIORS * elem_size);
+  }
+  return stride;
+}
+
+// Fill class_map for a score tensor of num_classes columns
+static int build_class_map(int num_classes) {
+  if (num_classes == OBJ_CLASS_NUM + 1) {
+    for (int c = 0; c < num_classes; c++) {
+      class_map[c] = c - 1;
+    }
+  } else if (num_classes == SSD_MAX_CLASSES) {
+    int label = 0;
+    int gap = 0;
+    int n_gaps = sizeof(coco91_unused_ids) / sizeof(coco91_unused_ids[0]);
+    class_map[0] = -1;
+    for (int c = 1; c < num_classes; c++) {
+      if (gap < n_gaps && c == coco91_unused_ids[gap]) {
+        class_map[c] = -1;
+        gap++;
+      } else {
+        class_map[c] = label++;
+      }
+    }
+  } else {
+    return -1;
+  }
+  num_mapped_classes = num_classes;
+  return 0;
+}
+
+// Indices of the (loc, conf) outputs, number of score columns or -1
+static int find_outputs(rknn_app_context_t *app_ctx, int *loc_idx,
+                        int *conf_idx) {
+  if (app_ctx->io_num.n_output != 2) {
+    return -1;
+  }
+  // the location tensor is the one with 4 values per prior
+  *loc_idx = 0;
+  *conf_idx = 1;
+  if (app_ctx->output_attrs[0].n_elems != SSD_NUM_PRIORS * 4) {
+    *loc_idx = 1;
+    *conf_idx = 0;
+  }
+  rknn_tensor_attr *loc_attr = &app_ctx->output_attrs[*loc_idx];
+  rknn_tensor_attr *conf_attr = &app_ctx->output_attrs[*conf_idx];
+  if (loc_attr->n_elems != SSD_NUM_PRIORS * 4 ||
+      conf_attr->n_elems % SSD_NUM_PRIORS != 0) {
+    return -1;
+  }
+  return conf_attr->n_elems / SSD_NUM_PRIORS;
+}
+
+int ssd_post_process_check(rknn_app_context_t *app_ctx) {
+  int loc_idx, conf_idx;
+  int num_classes = find_outputs(app_ctx, &loc_idx, &conf_idx);
+  if (num_classes < 0) {
+    printf("ssd model needs a (loc, conf) output pair over %d priors\n",
+           SSD_NUM_PRIORS);
+    return -1;
+  }
+  if (build_class_map(num_classes) != 0) {
+    printf("ssd model has %d classes, only %d or %d are supported\n",
+           num_classes, OBJ_CLASS_NUM + 1, SSD_MAX_CLASSES);
+    return -1;
+  }
+  return 0;
+}
+
+int ssd_post_process(rknn_app_context_t *app_ctx, void *outputs,
+                     float conf_threshold, float nms_threshold,
+                     object_detect_result_list *od_results) {
+#if defined(RV1106_1103)
+  rknn_tensor_mem **_outputs = (rknn_tensor_mem **)outputs;
+#define SSD_OUTPUT_BUF(i) (_outputs[i]->virt_addr)
+#else
+  rknn_output *_outputs = (rknn_output *)outputs;
+#define SSD_OUTPUT_BUF(i) (_outputs[i].buf)
+#endif
+  std::vector<float> filterBoxes;
+  std::vector<float> objProbs;
+  std::vector<int> classId;
+  int model_in_w = app_ctx->model_width;
+  int model_in_h = app_ctx->model_height;
+
+  memset(od_results, 0, sizeof(object_detect_result_list));
+
+  int loc_idx, conf_idx;
+  int num_classes = find_outputs(app_ctx, &loc_idx, &conf_idx);
+  if (priors == nullptr || num_classes != num_mapped_classes) {
+    ALOGE("ssd post process needs init and a checked model\n");
+    return -1;
+  }
+  rknn_tensor_attr *loc_attr = &app_ctx->output_attrs[loc_idx];
+  rknn_tensor_attr *conf_attr = &app_ctx->output_attrs[conf_idx];
+
+  int validCount = 0;
+  if (app_ctx->is_quant) {
+    validCount = process_ssd_i8(
+        (int8_t *)SSD_OUTPUT_BUF(loc_idx), loc_attr->zp, loc_attr->scale,
+        prior_stride(loc_attr, 4, 1), (int8_t *)SSD_OUTPUT_BUF(conf_idx),
+        conf_attr->zp, conf_attr->scale,
+        prior_stride(conf_attr, num_classes, 1), num_classes, objProbs,
+        classId, conf_threshold);
+  } else {
+    validCount = process_ssd_fp32(
+        (float *)SSD_OUTPUT_BUF(loc_idx), prior_stride(loc_attr, 4, 4),
+        (float *)SSD_OUTPUT_BUF(conf_idx),
+        prior_stride(conf_attr, num_classes, 4), num_classes, objProbs,
+        classId, conf_threshold);
+  }
+#undef SSD_OUTPUT_BUF
+
+  filterBoxes.resize(validCount * 4);
+  decode_boxes(validCount, model_in_w, model_in_h, filterBoxes.data());
+
+  return filter_detect_results(validCount, filterBoxes, objProbs, classId,
+                               nms_threshold, model_in_w, model_in_h,
+                               od_results);
+}
+
+int init_ssd_post_process() {
+  if (priors != nullptr) {
+    return 0;
+  }
+  priors = (ssd_priors_t *)malloc(sizeof(ssd_priors_t));
+  cands = (ssd_candidates_t *)malloc(sizeof(ssd_candidates_t));
+  if (priors == nullptr || cands == nullptr) {
+    printf("ssd priors alloc fail!\n");
+    deinit_ssd_post_process();
+    return -1;
+  }
+  memset(cands, 0, sizeof(ssd_candidates_t));
+  for (int i = 0; i < SSD_NUM_PRIORS; i++) {
+    priors->cx[i] = BOX_PRIORS_320[i][0];
+    priors->cy[i] = BOX_PRIORS_320[i][1];
+    priors->w[i] = BOX_PRIORS_320[i][2];
+    priors->h[i] = BOX_PRIORS_320[i][3];
+    priors->wv[i] = BOX_PRIORS_320[i][2] * SSD_CENTER_VARIANCE;
+    priors->hv[i] = BOX_PRIORS_320[i][3] * SSD_CENTER_VARIANCE;
+  }
+  return 0;
+}
+
+void deinit_ssd_post_process() {
+  if (priors != nullptr) {
+    free(priors);
+    priors = nullptr;
+  }
+  if (cands != nullptr) {
+    free(cands);
+    cands = nullptr;
+  }
+}
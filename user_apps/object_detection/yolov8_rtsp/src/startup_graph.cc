@@ -0,0 +1,270 @@
+#include "startup_graph.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t get_now_us() {
+  struct timespec time = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000 + (uint64_t)time.tv_nsec / 1000;
+}
+
+static const char *stage_state_name(startup_stage_state state) {
+  switch (state) {
+  case STARTUP_STAGE_PENDING:
+    return "pending";
+  case STARTUP_STAGE_RUNNING:
+    return "running";
+  case STARTUP_STAGE_DONE:
+    return "done";
+  case STARTUP_STAGE_FAILED:
+    return "failed";
+  case STARTUP_STAGE_SKIPPED:
+    return "skipped";
+  }
+  return "unknown";
+}
+
+void startup_graph_init(startup_graph_t *graph) {
+  memset(graph, 0, sizeof(startup_graph_t));
+  pthread_mutex_init(&graph->lock, NULL);
+  pthread_cond_init(&graph->cond, NULL);
+}
+
+int startup_graph_add(startup_graph_t *graph, const char *name,
+                      startup_stage_fn fn, void *arg) {
+  if (graph->n_stages >= STARTUP_MAX_STAGES) {
+    printf("startup graph full, can not add %s\n", name);
+    return -1;
+  }
+  int id = graph->n_stages++;
+  startup_stage_t *stage = &graph->stages[id];
+  memset(stage, 0, sizeof(startup_stage_t));
+  stage->name = name;
+  stage->fn = fn;
+  stage->arg = arg;
+  return id;
+}
+
+int startup_graph_depend(startup_graph_t *graph, int stage, int dep) {
+  // deps must come first, which keeps the graph acyclic
+  if (stage < 0 || stage >= graph->n_stages || dep < 0 || dep >= stage) {
+    printf("startup graph: bad dependency %d -> %d\n", stage, dep);
+    return -1;
+  }
+  startup_stage_t *s = &graph->stages[stage];
+  if (s->n_deps >= STARTUP_MAX_DEPS) {
+    printf("startup graph: too many dependencies for %s\n", s->name);
+    return -1;
+  }
+  s->deps[s->n_deps++] = dep;
+  return 0;
+}
+
+int startup_graph_set_undo(startup_graph_t *graph, int stage,
+                           startup_undo_fn undo) {
+  if (stage < 0 || stage >= graph->n_stages) {
+    printf("startup graph: bad stage %d\n", stage);
+    return -1;
+  }
+  graph->stages[stage].undo = undo;
+  return 0;
+}
+
+int startup_graph_undo_before(startup_graph_t *graph, int stage, int other) {
+  if (stage < 0 || stage >= graph->n_stages || other < 0 ||
+      other >= graph->n_stages || stage == other) {
+    printf("startup graph: bad undo order %d -> %d\n", stage, other);
+    return -1;
+  }
+  startup_stage_t *s = &graph->stages[stage];
+  for (int k = 0; k < s->n_undo_after; k++) {
+    if (s->undo_after[k] == other) {
+      printf("startup graph: undo order of %s and %s loops\n", s->name,
+             graph->stages[other].name);
+      return -1;
+    }
+  }
+  startup_stage_t *o = &graph->stages[other];
+  if (o->n_undo_after >= STARTUP_MAX_DEPS) {
+    printf("startup graph: too many undo orderings for %s\n", o->name);
+    return -1;
+  }
+  o->undo_after[o->n_undo_after++] = stage;
+  return 0;
+}
+
+// Find a pending stage that can start. Stages behind a failed dependency are
+// marked skipped on the way. Called with the lock held.
+static int next_ready_stage(startup_graph_t *graph, int *pending) {
+  *pending = 0;
+  for (int i = 0; i < graph->n_stages; i++) {
+    startup_stage_t *stage = &graph->stages[i];
+    if (stage->state != STARTUP_STAGE_PENDING) {
+      continue;
+    }
+    bool ready = true;
+    bool blocked = false;
+    for (int d = 0; d < stage->n_deps; d++) {
+      startup_stage_state dep_state = graph->stages[stage->deps[d]].state;
+      if (dep_state == STARTUP_STAGE_FAILED ||
+          dep_state == STARTUP_STAGE_SKIPPED) {
+        blocked = true;
+        break;
+      }
+      if (dep_state != STARTUP_STAGE_DONE) {
+        ready = false;
+      }
+    }
+    if (blocked) {
+      // deps are always earlier, so later dependents see this in the same scan
+      stage->state = STARTUP_STAGE_SKIPPED;
+      continue;
+    }
+    if (ready) {
+      return i;
+    }
+    (*pending)++;
+  }
+  return -1;
+}
+
+static void *startup_worker(void *arg) {
+  startup_graph_t *graph = (startup_graph_t *)arg;
+
+  pthread_mutex_lock(&graph->lock);
+  while (1) {
+    int pending;
+    int id = next_ready_stage(graph, &pending);
+    if (id < 0) {
+      if (pending == 0 || graph->n_running == 0) {
+        // nothing left, or nothing running that could unblock the rest
+        break;
+      }
+      pthread_cond_wait(&graph->cond, &graph->lock);
+      continue;
+    }
+
+    startup_stage_t *stage = &graph->stages[id];
+    stage->state = STARTUP_STAGE_RUNNING;
+    stage->start_us = get_now_us() - graph->base_us;
+    graph->n_running++;
+    pthread_mutex_unlock(&graph->lock);
+
+    int ret = stage->fn(stage->arg);
+
+    pthread_mutex_lock(&graph->lock);
+    stage->ret = ret;
+    stage->end_us = get_now_us() - graph->base_us;
+    stage->state = ret == 0 ? STARTUP_STAGE_DONE : STARTUP_STAGE_FAILED;
+    graph->n_running--;
+    pthread_cond_broadcast(&graph->cond);
+  }
+  pthread_cond_broadcast(&graph->cond);
+  pthread_mutex_unlock(&graph->lock);
+  return NULL;
+}
+
+int startup_graph_run(startup_graph_t *graph, int max_threads) {
+  pthread_t threads[STARTUP_MAX_STAGES];
+  int n_threads = 0;
+
+  if (max_threads < 1) {
+    max_threads = 1;
+  }
+  if (max_threads > graph->n_stages) {
+    max_threads = graph->n_stages;
+  }
+
+  graph->base_us = get_now_us();
+  graph->n_running = 0;
+  for (int i = 1; i < max_threads; i++) {
+    if (pthread_create(&threads[n_threads], NULL, startup_worker, graph) != 0) {
+      printf("startup graph: pthread_create fail, running with %d threads\n",
+             n_threads + 1);
+      break;
+    }
+    n_threads++;
+  }
+  startup_worker(graph);
+  for (int i = 0; i < n_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  graph->total_us = get_now_us() - graph->base_us;
+
+  for (int i = 0; i < graph->n_stages; i++) {
+    if (graph->stages[i].state != STARTUP_STAGE_DONE) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void startup_graph_undo(startup_graph_t *graph) {
+  // stages that never ran have nothing to undo
+  bool undone[STARTUP_MAX_STAGES];
+  for (int i = 0; i < graph->n_stages; i++) {
+    startup_stage_state state = graph->stages[i].state;
+    undone[i] = state != STARTUP_STAGE_DONE && state != STARTUP_STAGE_FAILED;
+  }
+  while (1) {
+    int next = -1;
+    int last = -1;
+    for (int i = graph->n_stages - 1; i >= 0 && next < 0; i--) {
+      if (undone[i]) {
+        continue;
+      }
+      if (last < 0) {
+        last = i;
+      }
+      const startup_stage_t *stage = &graph->stages[i];
+      bool ready = true;
+      for (int k = 0; k < stage->n_undo_after; k++) {
+        ready = ready && undone[stage->undo_after[k]];
+      }
+      if (ready) {
+        next = i;
+      }
+    }
+    if (last < 0) {
+      break;
+    }
+    // only a loop of orderings leaves nothing ready, break it by add order
+    if (next < 0) {
+      next = last;
+    }
+    undone[next] = true;
+    startup_stage_t *stage = &graph->stages[next];
+    if (stage->undo != NULL) {
+      stage->undo(stage->arg);
+    }
+  }
+}
+
+void startup_graph_print(const startup_graph_t *graph) {
+  uint64_t serial_us = 0;
+  printf("startup stages:\n");
+  for (int i = 0; i < graph->n_stages; i++) {
+    const startup_stage_t *stage = &graph->stages[i];
+    if (stage->state == STARTUP_STAGE_DONE ||
+        stage->state == STARTUP_STAGE_FAILED) {
+      uint64_t dur_us = stage->end_us - stage->start_us;
+      serial_us += dur_us;
+      printf("  %-12s %-7s start %6llu ms  took %6llu ms\n", stage->name,
+             stage_state_name(stage->state),
+             (unsigned long long)stage->start_us / 1000,
+             (unsigned long long)dur_us / 1000);
+    } else {
+      printf("  %-12s %-7s\n", stage->name, stage_state_name(stage->state));
+    }
+  }
+  printf("startup took %llu ms, %llu ms if run in sequence\n",
+         (unsigned long long)graph->total_us / 1000,
+         (unsigned long long)serial_us / 1000);
+}
+
+void startup_graph_deinit(startup_graph_t *graph) {
+  pthread_mutex_destroy(&graph->lock);
+  pthread_cond_destroy(&graph->cond);
+}
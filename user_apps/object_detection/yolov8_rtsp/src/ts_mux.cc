@@ -0,0 +1,175 @@
+#include "ts_mux.h"
+
+#include <string.h>
+
+#define TS_PAYLOAD_SIZE 184
+#define TS_PCR_FIELD_SIZE 8 // adaptation field length, flags and PCR
+#define TS_STREAM_TYPE_H264 0x1b
+#define TS_STREAM_TYPE_H265 0x24
+#define TS_PES_HEADER_SIZE 14
+#define TS_PTS_DELAY 9000 // PTS runs 100 ms ahead of the PCR
+
+void ts_mux_init(ts_mux_t *mux, nal_codec codec) {
+  memset(mux, 0, sizeof(ts_mux_t));
+  mux->codec = codec;
+}
+
+size_t ts_mux_max_size(size_t len) {
+  // PAT + PMT, plus the PES with its header, an AUD and a PCR
+  size_t pes = TS_PES_HEADER_SIZE + 7 + len + TS_PCR_FIELD_SIZE;
+  return (2 + (pes + TS_PAYLOAD_SIZE - 1) / TS_PAYLOAD_SIZE) * TS_PACKET_SIZE;
+}
+
+static uint32_t crc32_mpeg(const uint8_t *data, size_t len) {
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint32_t)data[i] << 24;
+    for (int k = 0; k < 8; k++) {
+      crc = crc & 0x80000000 ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// One 188 byte packet; payloads shorter than the room left are padded with
+// adaptation field stuffing
+static uint8_t *put_packet(uint8_t *p, uint16_t pid, bool unit_start,
+                           uint8_t *cc, const uint64_t *pcr,
+                           const uint8_t *payload, size_t len) {
+  size_t af_len = pcr != NULL ? TS_PCR_FIELD_SIZE : 0;
+  if (af_len + len < TS_PAYLOAD_SIZE) {
+    af_len = TS_PAYLOAD_SIZE - len;
+  }
+  p[0] = 0x47;
+  p[1] = (unit_start ? 0x40 : 0) | ((pid >> 8) & 0x1f);
+  p[2] = pid & 0xff;
+  p[3] = (af_len > 0 ? 0x30 : 0x10) | *cc;
+  *cc = (*cc + 1) & 0x0f;
+
+  uint8_t *q = p + 4;
+  if (af_len > 0) {
+    q[0] = af_len - 1;
+    if (af_len > 1) {
+      size_t used = 2;
+      q[1] = pcr != NULL ? 0x10 : 0x00;
+      if (pcr != NULL) {
+        // 33 bit base, 6 reserved bits, 9 bit extension left at 0
+        q[2] = *pcr >> 25;
+        q[3] = *pcr >> 17;
+        q[4] = *pcr >> 9;
+        q[5] = *pcr >> 1;
+        q[6] = ((*pcr & 1) << 7) | 0x7e;
+        q[7] = 0;
+        used = TS_PCR_FIELD_SIZE;
+      }
+      memset(q + used, 0xff, af_len - used);
+    }
+    q += af_len;
+  }
+  memcpy(q, payload, len);
+  return p + TS_PACKET_SIZE;
+}
+
+// A PSI section in a packet of its own, padded with 0xff
+static uint8_t *put_section(uint8_t *p, uint16_t pid, uint8_t *cc,
+                            uint8_t *section, size_t len) {
+  uint8_t payload[TS_PAYLOAD_SIZE];
+  uint32_t crc = crc32_mpeg(section, len - 4);
+  section[len - 4] = crc >> 24;
+  section[len - 3] = crc >> 16;
+  section[len - 2] = crc >> 8;
+  section[len - 1] = crc;
+  memset(payload, 0xff, sizeof(payload));
+  payload[0] = 0; // pointer_field
+  memcpy(payload + 1, section, len);
+  return put_packet(p, pid, true, cc, NULL, payload, sizeof(payload));
+}
+
+static uint8_t *put_psi(ts_mux_t *mux, uint8_t *p) {
+  uint8_t pat[] = {
+      0x00, 0xb0, 13,   0x00, 0x01, 0xc1, 0x00, 0x00, // transport stream 1
+      0x00, 0x01, 0xe0 | (TS_PID_PMT >> 8), TS_PID_PMT & 0xff,
+      0,    0,    0,    0, // CRC
+  };
+  uint8_t stream_type = mux->codec == NAL_CODEC_H264 ? TS_STREAM_TYPE_H264
+                                                     : TS_STREAM_TYPE_H265;
+  uint8_t pmt[] = {
+      0x02, 0xb0, 18,   0x00, 0x01, 0xc1, 0x00, 0x00, // program 1
+      0xe0 | (TS_PID_VIDEO >> 8), TS_PID_VIDEO & 0xff, // PCR PID
+      0xf0, 0x00, stream_type, 0xe0 | (TS_PID_VIDEO >> 8),
+      TS_PID_VIDEO & 0xff, 0xf0, 0x00,
+      0,    0,    0,    0, // CRC
+  };
+  p = put_section(p, 0, &mux->cc_pat, pat, sizeof(pat));
+  return put_section(p, TS_PID_PMT, &mux->cc_pmt, pmt, sizeof(pmt));
+}
+
+static void put_pts(uint8_t *p, uint64_t pts) {
+  p[0] = 0x21 | ((pts >> 29) & 0x0e);
+  p[1] = pts >> 22;
+  p[2] = ((pts >> 14) & 0xfe) | 1;
+  p[3] = pts >> 7;
+  p[4] = ((pts << 1) & 0xfe) | 1;
+}
+
+// Players expect every access unit of a TS to open with an AUD
+static bool starts_with_aud(nal_codec codec, const uint8_t *au, size_t len) {
+  size_t i = 0;
+  while (i < len && au[i] == 0) {
+    i++;
+  }
+  if (i < 2 || i + 1 >= len || au[i] != 1) {
+    return false;
+  }
+  uint8_t type = nal_type(codec, au + i + 1);
+  return type == (codec == NAL_CODEC_H264 ? NAL_H264_AUD : NAL_H265_AUD);
+}
+
+size_t ts_mux_write(ts_mux_t *mux, const uint8_t *au, size_t len,
+                    uint64_t pts_us, bool keyframe, uint8_t *out,
+                    size_t size) {
+  static const uint8_t aud_h264[] = {0, 0, 0, 1, 0x09, 0xf0};
+  static const uint8_t aud_h265[] = {0, 0, 0, 1, 0x46, 0x01, 0x50};
+  uint8_t first[TS_PAYLOAD_SIZE];
+  uint8_t *p = out;
+
+  if (ts_mux_max_size(len) > size) {
+    return 0;
+  }
+  if (!mux->started) {
+    mux->base_us = pts_us;
+  }
+  if (keyframe || !mux->started) {
+    p = put_psi(mux, p);
+  }
+  mux->started = true;
+
+  uint64_t pcr = pts_us > mux->base_us ? (pts_us - mux->base_us) * 9 / 100 : 0;
+  uint64_t pts = pcr + TS_PTS_DELAY;
+
+  // PES header, unbounded length as allowed for video
+  size_t n = 0;
+  const uint8_t header[] = {0, 0, 1, 0xe0, 0, 0, 0x80, 0x80, 5};
+  memcpy(first, header, sizeof(header));
+  n = sizeof(header);
+  put_pts(first + n, pts);
+  n += 5;
+  if (!starts_with_aud(mux->codec, au, len)) {
+    bool h264 = mux->codec == NAL_CODEC_H264;
+    size_t aud_len = h264 ? sizeof(aud_h264) : sizeof(aud_h265);
+    memcpy(first + n, h264 ? aud_h264 : aud_h265, aud_len);
+    n += aud_len;
+  }
+
+  size_t room = TS_PAYLOAD_SIZE - TS_PCR_FIELD_SIZE - n;
+  size_t chunk = len < room ? len : room;
+  memcpy(first + n, au, chunk);
+  p = put_packet(p, TS_PID_VIDEO, true, &mux->cc_video, &pcr, first,
+                 n + chunk);
+  for (size_t pos = chunk; pos < len; pos += chunk) {
+    chunk = len - pos < TS_PAYLOAD_SIZE ? len - pos : TS_PAYLOAD_SIZE;
+    p = put_packet(p, TS_PID_VIDEO, false, &mux->cc_video, NULL, au + pos,
+                   chunk);
+  }
+  return p - out;
+}
@@ -0,0 +1,193 @@
+#include "venc_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// kbps range accepted by RK_MPI_VENC for H.264 and H.265
+#define VENC_MIN_KBPS 2
+#define VENC_MAX_KBPS 200000
+
+static const char *rc_names[] = {"cbr", "vbr", "avbr"};
+
+void venc_config_default(venc_config_t *config) {
+  memset(config, 0, sizeof(venc_config_t));
+  config->h265 = false;
+  config->rc_mode = VENC_RC_CBR;
+  config->kbps = 4096;
+  config->min_kbps = 1024;
+  config->max_kbps = 8192;
+  config->gop = 60;
+  config->smartp_vir_idr = 0;
+  config->adaptive = true;
+  config->roi_qp = -6;
+}
+
+static bool parse_int(const char *value, int min, int max, int *out) {
+  char *end;
+  long v = strtol(value, &end, 10);
+  if (end == value || *end != '\0' || v < min || v > max) {
+    return false;
+  }
+  *out = (int)v;
+  return true;
+}
+
+// "min-max", both within [0, 51]
+static bool parse_qp_range(const char *value, int *min_qp, int *max_qp) {
+  char *end;
+  long lo = strtol(value, &end, 10);
+  if (end == value || *end != '-') {
+    return false;
+  }
+  const char *hi_str = end + 1;
+  long hi = strtol(hi_str, &end, 10);
+  if (end == hi_str || *end != '\0' || lo < 0 || hi > 51 || lo > hi) {
+    return false;
+  }
+  *min_qp = (int)lo;
+  *max_qp = (int)hi;
+  return true;
+}
+
+// "WxH", multiples of the macroblock so RGA and VENC take them as they are
+static bool parse_size(const char *value, int *width, int *height) {
+  char *end;
+  long w = strtol(value, &end, 10);
+  if (end == value || *end != 'x') {
+    return false;
+  }
+  const char *h_str = end + 1;
+  long h = strtol(h_str, &end, 10);
+  if (end == h_str || *end != '\0' || w < 64 || h < 64 || w > 4096 ||
+      h > 4096 || w % 16 != 0 || h % 16 != 0) {
+    return false;
+  }
+  *width = (int)w;
+  *height = (int)h;
+  return true;
+}
+
+static bool parse_pair(venc_config_t *config, const char *key,
+                       const char *value) {
+  int v;
+  if (strcmp(key, "codec") == 0) {
+    if (strcmp(value, "h264") != 0 && strcmp(value, "h265") != 0) {
+      return false;
+    }
+    config->h265 = strcmp(value, "h265") == 0;
+    return true;
+  }
+  if (strcmp(key, "size") == 0) {
+    return parse_size(value, &config->width, &config->height);
+  }
+  if (strcmp(key, "rc") == 0) {
+    for (int i = 0; i < (int)(sizeof(rc_names) / sizeof(rc_names[0])); i++) {
+      if (strcmp(value, rc_names[i]) == 0) {
+        config->rc_mode = (venc_rc_mode)i;
+        return true;
+      }
+    }
+    return false;
+  }
+  if (strcmp(key, "kbps") == 0) {
+    return parse_int(value, VENC_MIN_KBPS, VENC_MAX_KBPS, &config->kbps);
+  }
+  if (strcmp(key, "min_kbps") == 0) {
+    return parse_int(value, VENC_MIN_KBPS, VENC_MAX_KBPS, &config->min_kbps);
+  }
+  if (strcmp(key, "max_kbps") == 0) {
+    return parse_int(value, VENC_MIN_KBPS, VENC_MAX_KBPS, &config->max_kbps);
+  }
+  if (strcmp(key, "gop") == 0) {
+    return parse_int(value, 1, 65536, &config->gop);
+  }
+  if (strcmp(key, "smartp") == 0) {
+    return parse_int(value, 0, 65536, &config->smartp_vir_idr);
+  }
+  if (strcmp(key, "qp") == 0) {
+    return parse_qp_range(value, &config->min_qp, &config->max_qp);
+  }
+  if (strcmp(key, "iqp") == 0) {
+    return parse_qp_range(value, &config->min_i_qp, &config->max_i_qp);
+  }
+  if (strcmp(key, "roi") == 0) {
+    return parse_int(value, -51, 51, &config->roi_qp);
+  }
+  if (strcmp(key, "adaptive") == 0 && parse_int(value, 0, 1, &v)) {
+    config->adaptive = v != 0;
+    return true;
+  }
+  return false;
+}
+
+int venc_config_parse(venc_config_t *config, const char *spec) {
+  char buf[256];
+  char *save = NULL;
+  bool has_min = false, has_max = false;
+
+  if (strlen(spec) >= sizeof(buf)) {
+    printf("encoder config too long\n");
+    return -1;
+  }
+  strcpy(buf, spec);
+  for (char *item = strtok_r(buf, ",", &save); item != NULL;
+       item = strtok_r(NULL, ",", &save)) {
+    char *eq = strchr(item, '=');
+    if (eq == NULL) {
+      printf("encoder config %s is not key=value\n", item);
+      return -1;
+    }
+    *eq = '\0';
+    if (!parse_pair(config, item, eq + 1)) {
+      printf("bad encoder config %s=%s\n", item, eq + 1);
+      return -1;
+    }
+    has_min |= strcmp(item, "min_kbps") == 0;
+    has_max |= strcmp(item, "max_kbps") == 0;
+  }
+
+  // a lone kbps moves the range with it, explicit bounds must contain it
+  if (config->max_kbps < config->kbps) {
+    if (has_max) {
+      printf("encoder config max_kbps below kbps\n");
+      return -1;
+    }
+    config->max_kbps = config->kbps;
+  }
+  if (config->min_kbps > config->kbps) {
+    if (has_min) {
+      printf("encoder config min_kbps above kbps\n");
+      return -1;
+    }
+    config->min_kbps = config->kbps;
+  }
+  if (config->smartp_vir_idr >= config->gop) {
+    printf("encoder config smartp must be shorter than gop\n");
+    return -1;
+  }
+  return 0;
+}
+
+void venc_config_print(const venc_config_t *config) {
+  printf("venc ");
+  if (config->width > 0) {
+    printf("%dx%d ", config->width, config->height);
+  }
+  printf("%s %s %d kbps (%d-%d%s), gop %d", config->h265 ? "h265" : "h264",
+         rc_names[config->rc_mode], config->kbps, config->min_kbps,
+         config->max_kbps, config->adaptive ? " adaptive" : "", config->gop);
+  if (config->smartp_vir_idr > 0) {
+    printf(", smart-P %d", config->smartp_vir_idr);
+  }
+  if (config->max_qp > 0) {
+    printf(", qp %d-%d", config->min_qp, config->max_qp);
+  }
+  if (config->max_i_qp > 0) {
+    printf(", iqp %d-%d", config->min_i_qp, config->max_i_qp);
+  }
+  if (config->roi_qp != 0) {
+    printf(", roi qp %+d", config->roi_qp);
+  }
+  printf("\n");
+}
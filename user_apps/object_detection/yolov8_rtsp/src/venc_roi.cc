@@ -0,0 +1,140 @@
+#include "venc_roi.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "box_tracker.h"
+
+typedef struct {
+  float iou;
+  int region;
+  int det;
+} roi_match_t;
+
+void venc_roi_init(venc_roi_t *roi, int width, int height, int qp,
+                   int n_regions) {
+  memset(roi, 0, sizeof(venc_roi_t));
+  roi->width = width;
+  roi->height = height;
+  roi->qp = qp;
+  roi->n_regions = std::min(std::max(n_regions, 0), VENC_ROI_MAX);
+}
+
+static int align_down(int v) { return v / VENC_ROI_ALIGN * VENC_ROI_ALIGN; }
+
+static int align_up(int v) {
+  return (v + VENC_ROI_ALIGN - 1) / VENC_ROI_ALIGN * VENC_ROI_ALIGN;
+}
+
+// Box plus margin, grown to the macroblock grid and clipped to the frame
+static bool region_for(const venc_roi_t *roi, const image_rect_t *box,
+                       image_rect_t *rect) {
+  int mx = (int)((box->right - box->left) * VENC_ROI_MARGIN);
+  int my = (int)((box->bottom - box->top) * VENC_ROI_MARGIN);
+  rect->left = std::max(align_down(box->left - mx), 0);
+  rect->top = std::max(align_down(box->top - my), 0);
+  rect->right = std::min(align_up(box->right + mx), align_down(roi->width));
+  rect->bottom = std::min(align_up(box->bottom + my), align_down(roi->height));
+  return rect->right > rect->left && rect->bottom > rect->top;
+}
+
+static bool contains(const image_rect_t *outer, const image_rect_t *inner) {
+  return inner->left >= outer->left && inner->top >= outer->top &&
+         inner->right <= outer->right && inner->bottom <= outer->bottom;
+}
+
+int venc_roi_update(venc_roi_t *roi, const object_detect_result_list *results) {
+  image_rect_t rects[OBJ_NUMB_MAX_SIZE];
+  bool valid[OBJ_NUMB_MAX_SIZE];
+  bool det_used[OBJ_NUMB_MAX_SIZE] = {false};
+  bool region_used[VENC_ROI_MAX] = {false};
+  std::vector<roi_match_t> matches;
+  int n_dirty = 0;
+
+  for (int i = 0; i < results->count; i++) {
+    valid[i] = region_for(roi, &results->results[i].box, &rects[i]);
+  }
+
+  // keep regions on the objects they already cover
+  for (int r = 0; r < roi->n_regions; r++) {
+    if (!roi->regions[r].enabled) {
+      continue;
+    }
+    for (int i = 0; i < results->count; i++) {
+      float iou = valid[i] ? box_iou(&roi->regions[r].rect, &rects[i]) : 0.f;
+      if (iou >= VENC_ROI_MATCH_IOU) {
+        roi_match_t m = {iou, r, i};
+        matches.push_back(m);
+      }
+    }
+  }
+  std::sort(matches.begin(), matches.end(),
+            [](const roi_match_t &a, const roi_match_t &b) {
+              return a.iou > b.iou;
+            });
+  for (const roi_match_t &m : matches) {
+    if (region_used[m.region] || det_used[m.det]) {
+      continue;
+    }
+    region_used[m.region] = true;
+    det_used[m.det] = true;
+    venc_roi_region_t *region = &roi->regions[m.region];
+    region->idle = 0;
+    // move only when the object left the region or shrank well inside it
+    if (!contains(&region->rect, &results->results[m.det].box) ||
+        m.iou < VENC_ROI_MOVE_IOU) {
+      region->rect = rects[m.det];
+      roi->dirty[m.region] = true;
+    }
+  }
+
+  for (int r = 0; r < roi->n_regions; r++) {
+    venc_roi_region_t *region = &roi->regions[r];
+    if (region->enabled && !region_used[r] &&
+        ++region->idle > VENC_ROI_HOLD_FRAMES) {
+      region->enabled = false;
+      roi->dirty[r] = true;
+    }
+  }
+
+  // new objects, most confident first, into the free regions
+  std::vector<int> order;
+  for (int i = 0; i < results->count; i++) {
+    if (valid[i] && !det_used[i]) {
+      order.push_back(i);
+    }
+  }
+  std::sort(order.begin(), order.end(), [results](int a, int b) {
+    return results->results[a].prop > results->results[b].prop;
+  });
+  int free_region = 0;
+  for (int i : order) {
+    bool covered = false;
+    for (int r = 0; r < roi->n_regions && !covered; r++) {
+      covered = roi->regions[r].enabled &&
+                contains(&roi->regions[r].rect, &results->results[i].box);
+    }
+    if (covered) {
+      continue;
+    }
+    while (free_region < roi->n_regions &&
+           roi->regions[free_region].enabled) {
+      free_region++;
+    }
+    if (free_region == roi->n_regions) {
+      break;
+    }
+    venc_roi_region_t *region = &roi->regions[free_region];
+    region->enabled = true;
+    region->rect = rects[i];
+    region->idle = 0;
+    roi->dirty[free_region] = true;
+  }
+
+  for (int r = 0; r < roi->n_regions; r++) {
+    n_dirty += roi->dirty[r] ? 1 : 0;
+  }
+  return n_dirty;
+}
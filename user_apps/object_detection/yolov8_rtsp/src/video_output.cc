@@ -0,0 +1,99 @@
+#include "video_output.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int video_output_init(video_output_t *out, int chn, const char *path,
+                      const venc_config_t *config, frame_buffer_t *src) {
+  memset(out, 0, sizeof(video_output_t));
+  out->chn = chn;
+  out->config = *config;
+  out->width = config->width > 0 ? config->width : src->width;
+  out->height = config->height > 0 ? config->height : src->height;
+  out->scaled = out->width != src->width || out->height != src->height;
+  out->pool = MB_INVALID_POOLID;
+  out->src = frame_buffer_ref(src);
+  out->blk = out->scaled ? MB_INVALID_HANDLE : frame_buffer_mb(src);
+  out->path = path;
+  out->stream.pstPack = &out->pack;
+  bitrate_ctrl_init(&out->bitrate, config->min_kbps, config->max_kbps,
+                    config->kbps);
+
+  if (out->scaled) {
+    MB_POOL_CONFIG_S PoolCfg;
+    memset(&PoolCfg, 0, sizeof(MB_POOL_CONFIG_S));
+    PoolCfg.u64MBSize = out->width * out->height * 3;
+    PoolCfg.u32MBCnt = 1;
+    PoolCfg.enAllocType = MB_ALLOC_TYPE_DMA;
+    out->pool = RK_MPI_MB_CreatePool(&PoolCfg);
+    if (out->pool == MB_INVALID_POOLID) {
+      printf("create %s pool fail!\n", path);
+      return -1;
+    }
+    MB_BLK blk =
+        RK_MPI_MB_GetMB(out->pool, out->width * out->height * 3, RK_TRUE);
+    if (blk == MB_INVALID_HANDLE) {
+      printf("get %s MB fail!\n", path);
+      return -1;
+    }
+    out->dst = frame_buffer_from_mb(blk, out->width, out->height,
+                                    out->width * 3, RK_FORMAT_BGR_888);
+    if (out->dst == NULL) {
+      printf("%s frame buffer fail!\n", path);
+      return -1;
+    }
+    out->blk = blk;
+  }
+
+  VIDEO_FRAME_S *vframe = &out->frame.stVFrame;
+  vframe->u32Width = out->width;
+  vframe->u32Height = out->height;
+  vframe->u32VirWidth = out->width;
+  vframe->u32VirHeight = out->height;
+  vframe->enPixelFormat = RK_FMT_RGB888;
+  vframe->u32FrameFlag = 160;
+  vframe->pMbBlk = out->blk;
+
+  return venc_init(chn, out->width, out->height, config);
+}
+
+int video_output_send(video_output_t *out, uint32_t time_ref,
+                      uint64_t pts_us) {
+  // VENC, or RGA for a sub-stream, reads what the CPU drew into the frame;
+  // only the first output of a frame flushes
+  frame_buffer_sync_for_device(out->src);
+  if (out->scaled) {
+    rga_buffer_t src = frame_buffer_rga(out->src);
+    rga_buffer_t dst = frame_buffer_rga(out->dst);
+    if (src.handle == 0 || dst.handle == 0 ||
+        imresize(src, dst) != IM_STATUS_SUCCESS) {
+      return -1;
+    }
+  }
+  out->frame.stVFrame.u32TimeRef = time_ref;
+  out->frame.stVFrame.u64PTS = pts_us;
+  return RK_MPI_VENC_SendFrame(out->chn, &out->frame, -1) == RK_SUCCESS ? 0
+                                                                        : -1;
+}
+
+int video_output_get(video_output_t *out) {
+  return RK_MPI_VENC_GetStream(out->chn, &out->stream, -1) == RK_SUCCESS ? 0
+                                                                         : -1;
+}
+
+void video_output_release(video_output_t *out) {
+  RK_S32 s32Ret = RK_MPI_VENC_ReleaseStream(out->chn, &out->stream);
+  if (s32Ret != RK_SUCCESS) {
+    RK_LOGE("RK_MPI_VENC_ReleaseStream fail %x", s32Ret);
+  }
+}
+
+void video_output_deinit(video_output_t *out) {
+  RK_MPI_VENC_StopRecvFrame(out->chn);
+  RK_MPI_VENC_DestroyChn(out->chn);
+  frame_buffer_unref(out->src);
+  frame_buffer_unref(out->dst);
+  if (out->pool != MB_INVALID_POOLID) {
+    RK_MPI_MB_DestroyPool(out->pool);
+  }
+}
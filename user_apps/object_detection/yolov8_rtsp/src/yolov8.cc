@@ -12,13 +12,53 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <fcntl.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "async_log.h"
+#include "rknn_perf.h"
 #include "yolov8.h"
 
+static uint64_t get_now_us() {
+  struct timespec time = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000 + (uint64_t)time.tv_nsec / 1000;
+}
+
+// Map the .rknn file instead of reading it into a heap buffer first. The
+// runtime of this SDK has no zero-copy model flag, so rknn_init still copies
+// what it needs; the mapping only lives until then and its pages stay
+// reclaimable page cache.
+static void *map_model_file(const char *model_path, size_t *size) {
+  int fd = open(model_path, O_RDONLY);
+  if (fd < 0) {
+    printf("open %s fail!\n", model_path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    printf("stat %s fail!\n", model_path);
+    close(fd);
+    return NULL;
+  }
+  void *model = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (model == MAP_FAILED) {
+    printf("mmap %s fail!\n", model_path);
+    return NULL;
+  }
+  madvise(model, st.st_size, MADV_SEQUENTIAL);
+  *size = st.st_size;
+  return model;
+}
+
 static void dump_tensor_attr(rknn_tensor_attr *attr) {
   printf("  index=%d, name=%s, n_dims=%d, dims=[%d, %d, %d, %d], n_elems=%d, "
          "size=%d, fmt=%s, type=%s, qnt_type=%s, "
@@ -29,17 +69,22 @@ static void dump_tensor_attr(rknn_tensor_attr *attr) {
          get_qnt_type_string(attr->qnt_type), attr->zp, attr->scale);
 }
 
-int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
-  int ret;
-  int model_len = 0;
-  char *model;
-  rknn_context ctx = 0;
-
-  ret = rknn_init(&ctx, (char *)model_path, 0, 0, NULL);
-  if (ret < 0) {
-    printf("rknn_init fail! ret=%d\n", ret);
+static int query_mem_size(rknn_context ctx, rknn_app_context_t *app_ctx) {
+  int ret = rknn_query(ctx, RKNN_QUERY_MEM_SIZE, &app_ctx->mem_size,
+                       sizeof(app_ctx->mem_size));
+  if (ret != RKNN_SUCC) {
+    printf("rknn_query mem size fail! ret=%d\n", ret);
     return -1;
   }
+  printf("model weight size: %u, internal size: %u\n",
+         app_ctx->mem_size.total_weight_size,
+         app_ctx->mem_size.total_internal_size);
+  return 0;
+}
+
+// Query the io tensors and bind their memory
+static int setup_yolov8_model(rknn_context ctx, rknn_app_context_t *app_ctx) {
+  int ret;
 
   // Get Model Input Output Number
   rknn_input_output_num io_num;
@@ -52,7 +97,8 @@ int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
          io_num.n_output);
 
   // Get Model Input Info
-  printf("input tensors:\n");
+  if (app_ctx->verbose)
+    printf("input tensors:\n");
   rknn_tensor_attr input_attrs[io_num.n_input];
   memset(input_attrs, 0, sizeof(input_attrs));
   for (int i = 0; i < io_num.n_input; i++) {
@@ -63,11 +109,13 @@ int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
       printf("rknn_query fail! ret=%d\n", ret);
       return -1;
     }
-    dump_tensor_attr(&(input_attrs[i]));
+    if (app_ctx->verbose)
+      dump_tensor_attr(&(input_attrs[i]));
   }
 
   // Get Model Output Info
-  printf("output tensors:\n");
+  if (app_ctx->verbose)
+    printf("output tensors:\n");
   rknn_tensor_attr output_attrs[io_num.n_output];
   memset(output_attrs, 0, sizeof(output_attrs));
   for (int i = 0; i < io_num.n_output; i++) {
@@ -80,7 +128,8 @@ int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
       printf("rknn_query fail! ret=%d\n", ret);
       return -1;
     }
-    dump_tensor_attr(&(output_attrs[i]));
+    if (app_ctx->verbose)
+      dump_tensor_attr(&(output_attrs[i]));
   }
 
   // default input type is int8 (normalize and quantize need compute in outside)
@@ -88,8 +137,9 @@ int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
   input_attrs[0].type = RKNN_TENSOR_UINT8;
   // default fmt is NHWC,1106 npu only support NHWC in zero copy mode
   input_attrs[0].fmt = RKNN_TENSOR_NHWC;
-  printf("input_attrs[0].size_with_stride=%d\n",
-         input_attrs[0].size_with_stride);
+  if (app_ctx->verbose)
+    printf("input_attrs[0].size_with_stride=%d\n",
+           input_attrs[0].size_with_stride);
   app_ctx->input_mems[0] =
       rknn_create_mem(ctx, input_attrs[0].size_with_stride);
 
@@ -111,9 +161,6 @@ int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
     }
   }
 
-  // Set to context
-  app_ctx->rknn_ctx = ctx;
-
   // TODO
   if (output_attrs[0].qnt_type == RKNN_TENSOR_QNT_AFFINE_ASYMMETRIC) {
     app_ctx->is_quant = true;
@@ -132,12 +179,14 @@ int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
          io_num.n_output * sizeof(rknn_tensor_attr));
 
   if (input_attrs[0].fmt == RKNN_TENSOR_NCHW) {
-    printf("model is NCHW input fmt\n");
+    if (app_ctx->verbose)
+      printf("model is NCHW input fmt\n");
     app_ctx->model_channel = input_attrs[0].dims[1];
     app_ctx->model_height = input_attrs[0].dims[2];
     app_ctx->model_width = input_attrs[0].dims[3];
   } else {
-    printf("model is NHWC input fmt\n");
+    if (app_ctx->verbose)
+      printf("model is NHWC input fmt\n");
     app_ctx->model_height = input_attrs[0].dims[1];
     app_ctx->model_width = input_attrs[0].dims[2];
     app_ctx->model_channel = input_attrs[0].dims[3];
@@ -149,6 +198,44 @@ int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
   return 0;
 }
 
+int init_yolov8_model_from_buffer(const void *model, uint32_t model_len,
+                                  rknn_app_context_t *app_ctx) {
+  int ret;
+  rknn_context ctx = 0;
+  uint64_t start_us = get_now_us();
+
+  // per-layer timing slows every run down, so only when profiling
+  if (app_ctx->perf != NULL) {
+    app_ctx->init_flags |= RKNN_FLAG_COLLECT_PERF_MASK;
+  }
+  ret = rknn_init(&ctx, (void *)model, model_len, app_ctx->init_flags, NULL);
+  if (ret < 0) {
+    printf("rknn_init fail! ret=%d\n", ret);
+    return -1;
+  }
+  app_ctx->rknn_ctx = ctx;
+  if (query_mem_size(ctx, app_ctx) != 0) {
+    return -1;
+  }
+
+  ret = setup_yolov8_model(ctx, app_ctx);
+  printf("model init %llu us\n",
+         (unsigned long long)(get_now_us() - start_us));
+  return ret;
+}
+
+int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
+  size_t model_len = 0;
+  void *model = map_model_file(model_path, &model_len);
+  if (model == NULL) {
+    return -1;
+  }
+  // rknn_init copied the model, the mapping is not needed any more
+  int ret = init_yolov8_model_from_buffer(model, model_len, app_ctx);
+  munmap(model, model_len);
+  return ret;
+}
+
 int release_yolov8_model(rknn_app_context_t *app_ctx) {
   if (app_ctx->input_attrs != NULL) {
     free(app_ctx->input_attrs);
@@ -168,6 +255,10 @@ int release_yolov8_model(rknn_app_context_t *app_ctx) {
       rknn_destroy_mem(app_ctx->rknn_ctx, app_ctx->output_mems[i]);
     }
   }
+  if (app_ctx->internal_mem != NULL) {
+    rknn_destroy_mem(app_ctx->rknn_ctx, app_ctx->internal_mem);
+    app_ctx->internal_mem = NULL;
+  }
   if (app_ctx->rknn_ctx != 0) {
     rknn_destroy(app_ctx->rknn_ctx);
     app_ctx->rknn_ctx = 0;
@@ -186,12 +277,14 @@ int inference_yolov8_model(rknn_app_context_t *app_ctx,
     return -1;
   }
 
-  printf("rknn_run\n");
   ret = rknn_run(app_ctx->rknn_ctx, nullptr);
   if (ret < 0) {
-    printf("rknn_run fail! ret=%d\n", ret);
+    ALOGE("rknn_run fail! ret=%d\n", ret);
     return -1;
   }
+  if (app_ctx->perf != NULL) {
+    rknn_perf_collect(app_ctx->perf, app_ctx->rknn_ctx);
+  }
 
   // Post Process
   post_process(app_ctx, app_ctx->output_mems, box_conf_threshold, nms_threshold,
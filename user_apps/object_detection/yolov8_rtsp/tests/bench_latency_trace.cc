@@ -0,0 +1,27 @@
+// Cost of the latency trace in the frame loop: every point of a frame is
+// marked as main does, and the time is set against a 30 fps frame. Not a
+// test, run it by hand on the machine of interest.
+#include "latency_trace.h"
+
+#include <stdio.h>
+
+#include <chrono>
+
+#define FRAMES 200000
+#define FRAME_US (1000000.0 / 30)
+
+int main() {
+  latency_trace_init(0);
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < FRAMES; n++) {
+    for (int p = 0; p < TRACE_POINT_NUM; p++) {
+      latency_trace_mark((trace_point)p);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  double frame_us =
+      std::chrono::duration<double, std::micro>(end - start).count() / FRAMES;
+  printf("%d marks %7.3f us/frame, %5.3f%% of a 30 fps frame (budget 1%%)\n",
+         TRACE_POINT_NUM, frame_us, frame_us * 100 / FRAME_US);
+  return 0;
+}
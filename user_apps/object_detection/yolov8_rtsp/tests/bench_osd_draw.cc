@@ -0,0 +1,73 @@
+// The OSD renderer against cv::rectangle and cv::putText, as the frame loop
+// draws: 10 boxes with labels on a 640x480 frame. Not a test, run it by
+// hand on the machine of interest.
+#include "osd_draw.h"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+#ifdef ENABLE_OPENCV
+#include "opencv2/imgproc.hpp"
+#endif
+
+#define W 640
+#define H 480
+#define FRAMES 2000
+#define BOXES 10
+
+static const char *labels[BOXES] = {
+    "person 91.2%", "car 87.0%",     "dog 66.6%", "bus 55.1%",  "truck 71.3%",
+    "person 45.0%", "bicycle 52.9%", "cat 80.1%", "bird 33.3%", "chair 40.4%"};
+
+typedef void (*draw_fn)(void *arg, int x, int y, const char *label);
+
+static void report(const char *name, draw_fn draw, void *arg) {
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < FRAMES; n++) {
+    for (int i = 0; i < BOXES; i++) {
+      draw(arg, 20 + i * 55, 60 + i * 30, labels[i]);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  printf("%-28s %7.1f us/frame\n", name,
+         std::chrono::duration<double, std::micro>(end - start).count() /
+             FRAMES);
+}
+
+static void draw_osd(void *arg, int x, int y, const char *label) {
+  const osd_image_t *img = (const osd_image_t *)arg;
+  osd_draw_rect(img, x, y, x + 120, y + 180, 3, osd_color_rgb(0, 255, 0));
+  osd_draw_label(img, x - 1, y - 1, label, 2, osd_color_rgb(0, 0, 0),
+                 osd_color_rgb(0, 255, 0));
+}
+
+#ifdef ENABLE_OPENCV
+static void draw_opencv(void *arg, int x, int y, const char *label) {
+  cv::Mat *frame = (cv::Mat *)arg;
+  cv::rectangle(*frame, cv::Point(x, y), cv::Point(x + 120, y + 180),
+                cv::Scalar(0, 255, 0), 3);
+  cv::putText(*frame, label, cv::Point(x, y - 8), cv::FONT_HERSHEY_SIMPLEX, 1,
+              cv::Scalar(0, 255, 0), 2);
+}
+#endif
+
+int main() {
+  std::vector<uint8_t> bgr(W * H * 3);
+  std::vector<uint8_t> nv12(W * H * 3 / 2);
+  osd_image_t img;
+
+  osd_image_wrap_bgr(&img, bgr.data(), W, H, W * 3);
+  report("osd_draw BGR888", draw_osd, &img);
+  osd_image_wrap_nv12(&img, nv12.data(), W, H, W);
+  report("osd_draw NV12", draw_osd, &img);
+#ifdef ENABLE_OPENCV
+  cv::setNumThreads(1);
+  cv::Mat frame(H, W, CV_8UC3, bgr.data());
+  report("cv::rectangle + cv::putText", draw_opencv, &frame);
+#else
+  printf("built without OpenCV, no reference\n");
+#endif
+  return 0;
+}
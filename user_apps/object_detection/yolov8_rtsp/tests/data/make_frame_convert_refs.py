@@ -0,0 +1,25 @@
+#!/usr/bin/env python3
+# Regenerate the OpenCV references of test_frame_convert: a random 64x48
+# NV21 frame, its COLOR_YUV420sp2BGR conversion and two letterboxes of it
+# with INTER_LINEAR, pad 114. Needs opencv-python and numpy.
+import cv2
+import numpy as np
+
+W, H, PAD = 64, 48, 114
+
+rng = np.random.default_rng(1)
+yuv = rng.integers(0, 256, (H * 3 // 2, W), dtype=np.uint8)
+bgr = cv2.cvtColor(yuv, cv2.COLOR_YUV420sp2BGR)
+yuv.tofile('nv21_64x48.yuv')
+bgr.tofile('nv21_64x48.bgr')
+
+
+def letterbox(size, w, h, x, y, path):
+    out = np.full((size, size, 3), PAD, np.uint8)
+    out[y:y + h, x:x + w] = cv2.resize(bgr, (w, h),
+                                       interpolation=cv2.INTER_LINEAR)
+    out.tofile(path)
+
+
+letterbox(32, 32, 24, 0, 4, 'letterbox_32.bgr')
+letterbox(28, 28, 21, 0, 3, 'letterbox_28.bgr')
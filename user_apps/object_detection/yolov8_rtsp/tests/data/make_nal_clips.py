@@ -0,0 +1,34 @@
+#!/usr/bin/env python3
+# Regenerate clip.h264 and clip.h265 for test_nal_parser: ten 64x64 frames,
+# a key frame every 5, access unit delimiters and the parameter sets
+# repeated at every key frame. Needs PyAV built with libx264 and libx265
+# (pip install av).
+import av
+import numpy as np
+
+
+def encode(codec, fmt, path, options):
+    out = av.open(path, 'w', format=fmt)
+    stream = out.add_stream(codec, rate=30)
+    stream.width, stream.height, stream.pix_fmt = 64, 64, 'yuv420p'
+    stream.options = options
+    for i in range(10):
+        img = np.zeros((64, 64, 3), np.uint8)
+        img[:, :, 0] = (np.arange(64) * 4 + i * 9) % 256
+        img[16 + i:32 + i, 8 + 2 * i:24 + 2 * i] = (250, 40, 90)
+        frame = av.VideoFrame.from_ndarray(img, format='rgb24')
+        for packet in stream.encode(frame):
+            out.mux(packet)
+    for packet in stream.encode():
+        out.mux(packet)
+    out.close()
+
+
+encode('libx264', 'h264', 'clip.h264',
+       {'preset': 'ultrafast', 'profile': 'baseline', 'g': '5',
+        'keyint_min': '5', 'bf': '0', 'crf': '30',
+        'x264-params': 'repeat-headers=1:aud=1:slices=2'})
+encode('libx265', 'hevc', 'clip.h265',
+       {'preset': 'ultrafast', 'g': '5', 'bf': '0', 'crf': '30',
+        'x265-params': 'keyint=5:min-keyint=5:repeat-headers=1:aud=1:'
+                       'log-level=error'})
@@ -0,0 +1,143 @@
+#include "bitrate_ctrl.h"
+
+#include "test_util.h"
+
+#define QUEUE 64
+
+static uint64_t now_us = 1;
+
+// One interval at 10 fps, the queue peak is seen on one frame of it.
+// Returns the bitrate change the interval ended with, 0 for none.
+static int run_interval(bitrate_ctrl_t *ctrl, int queue_peak, int objects) {
+  int kbps = 0;
+  for (int f = 0; f < 10; f++) {
+    bitrate_ctrl_frame(ctrl, objects);
+    now_us += BITRATE_CTRL_INTERVAL_US / 10;
+    int ret = bitrate_ctrl_update(ctrl, now_us, f == 5 ? queue_peak : 0, QUEUE);
+    if (ret != 0) {
+      CHECK(kbps == 0);
+      kbps = ret;
+    }
+  }
+  return kbps;
+}
+
+static void init(bitrate_ctrl_t *ctrl, int start_kbps) {
+  bitrate_ctrl_init(ctrl, 1000, 8000, start_kbps);
+  // the first call only starts the interval
+  CHECK(bitrate_ctrl_update(ctrl, now_us, 0, QUEUE) == 0);
+}
+
+// A busy scene with calm viewers climbs by a tenth of the range after
+// every BITRATE_CTRL_CALM_INTERVALS, up to the maximum
+static void test_climb() {
+  bitrate_ctrl_t ctrl;
+  init(&ctrl, 4000);
+  for (int i = 1; i < BITRATE_CTRL_CALM_INTERVALS; i++) {
+    CHECK(run_interval(&ctrl, 0, 2) == 0);
+  }
+  CHECK(run_interval(&ctrl, 0, 2) == 4700);
+  CHECK(run_interval(&ctrl, 0, 2) == 5400);
+  for (int i = 0; i < 10; i++) {
+    run_interval(&ctrl, 0, 2);
+  }
+  CHECK(ctrl.kbps == 8000);
+  CHECK(run_interval(&ctrl, 0, 2) == 0);
+}
+
+static void test_pressure() {
+  bitrate_ctrl_t ctrl;
+  init(&ctrl, 8000);
+
+  // a quarter of the queue cuts at once, and again the next interval
+  int high = (int)(QUEUE * BITRATE_CTRL_HIGH_PRESSURE);
+  CHECK(run_interval(&ctrl, high, 2) == 5600);
+  CHECK(run_interval(&ctrl, high, 2) == 3920);
+
+  // between the thresholds the bitrate holds and the calm count restarts
+  int medium = (int)(QUEUE * BITRATE_CTRL_LOW_PRESSURE) + 1;
+  CHECK(run_interval(&ctrl, medium, 2) == 0);
+  for (int i = 1; i < BITRATE_CTRL_CALM_INTERVALS; i++) {
+    CHECK(run_interval(&ctrl, 0, 2) == 0);
+  }
+  CHECK(run_interval(&ctrl, medium, 2) == 0);
+  for (int i = 1; i < BITRATE_CTRL_CALM_INTERVALS; i++) {
+    CHECK(run_interval(&ctrl, 0, 2) == 0);
+  }
+  CHECK(run_interval(&ctrl, 0, 2) == 4620);
+
+  // just below the cut threshold is not a cut
+  CHECK(run_interval(&ctrl, high - 1, 2) == 0);
+  CHECK(ctrl.kbps == 4620);
+
+  // sustained pressure stops at the minimum
+  for (int i = 0; i < 20; i++) {
+    run_interval(&ctrl, QUEUE, 2);
+  }
+  CHECK(ctrl.kbps >= 1000 && ctrl.kbps < 1000 * (1 + BITRATE_CTRL_MIN_CHANGE));
+  CHECK(ctrl.target == 1000.f);
+}
+
+// Only the deepest queue of the interval counts, and only that interval
+static void test_peak_is_per_interval() {
+  bitrate_ctrl_t ctrl;
+  init(&ctrl, 8000);
+  bitrate_ctrl_frame(&ctrl, 1);
+  now_us += 1000;
+  CHECK(bitrate_ctrl_update(&ctrl, now_us, QUEUE / 2, QUEUE) == 0);
+  CHECK(run_interval(&ctrl, 0, 1) == 5600);
+  CHECK(run_interval(&ctrl, 0, 1) == 0);
+}
+
+// Without objects the ceiling sinks to the idle share of the range and the
+// bitrate follows it down a step at a time
+static void test_idle_scene() {
+  bitrate_ctrl_t ctrl;
+  init(&ctrl, 8000);
+  int last = 8000;
+  for (int i = 0; i < 40; i++) {
+    int kbps = run_interval(&ctrl, 0, 0);
+    if (kbps != 0) {
+      CHECK(kbps < last && last - kbps <= 700);
+      last = kbps;
+    }
+  }
+  int idle_ceiling = 1000 + (int)(7000 * BITRATE_CTRL_IDLE_SHARE);
+  CHECK(ctrl.activity < 0.01f);
+  CHECK(ctrl.target > idle_ceiling - 1 && ctrl.target < idle_ceiling + 1);
+  // the last step is left out when it is too small to apply
+  CHECK(ctrl.kbps >= idle_ceiling &&
+        ctrl.kbps < idle_ceiling * (1 + BITRATE_CTRL_MIN_CHANGE));
+
+  // objects come back: the ceiling rises and the bitrate climbs again
+  for (int i = 0; i < 40; i++) {
+    run_interval(&ctrl, 0, 3);
+  }
+  CHECK(ctrl.target > 7999.f);
+  CHECK(ctrl.kbps > 8000 * (1 - BITRATE_CTRL_MIN_CHANGE));
+}
+
+// Changes below BITRATE_CTRL_MIN_CHANGE are not worth reconfiguring VENC,
+// the target moves on and the bitrate follows once the gap is large enough
+static void test_small_changes() {
+  bitrate_ctrl_t ctrl;
+  bitrate_ctrl_init(&ctrl, 1000, 1100, 1000);
+  CHECK(bitrate_ctrl_update(&ctrl, now_us, 0, QUEUE) == 0);
+  // steps of 10 kbps from the third calm interval on
+  for (int i = 0; i < BITRATE_CTRL_CALM_INTERVALS + 3; i++) {
+    CHECK(run_interval(&ctrl, 0, 1) == 0);
+  }
+  CHECK(ctrl.kbps == 1000);
+  CHECK(run_interval(&ctrl, 0, 1) == 1050);
+}
+
+int main() {
+  test_climb();
+  test_pressure();
+  test_peak_is_per_interval();
+  test_idle_scene();
+  test_small_changes();
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "box_overlay.h"
+
+#include "test_util.h"
+
+static void check_rect(const image_rect_t *r, int left, int top, int right,
+                       int bottom) {
+  CHECK(r->left == left && r->top == top);
+  CHECK(r->right == right && r->bottom == bottom);
+}
+
+// Widened by half a line, edges made exclusive, clipped to the frame
+static void test_add() {
+  box_overlay_t overlay;
+  box_overlay_init(&overlay, 640, 480, 3, 1);
+  image_rect_t box = {10, 20, 100, 200};
+  CHECK(box_overlay_add(&overlay, &box) == 0);
+  check_rect(&overlay.rects[0], 9, 19, 102, 202);
+
+  image_rect_t edge = {-50, -50, 630, 479};
+  CHECK(box_overlay_add(&overlay, &edge) == 1);
+  check_rect(&overlay.rects[1], 0, 0, 632, 480);
+
+  image_rect_t outside = {700, 10, 800, 50};
+  CHECK(box_overlay_add(&overlay, &outside) == -1);
+  image_rect_t above = {10, -80, 100, -2};
+  CHECK(box_overlay_add(&overlay, &above) == -1);
+  CHECK(overlay.n_rects == 2);
+
+  for (int i = 0; i < 2 * BOX_OVERLAY_MAX; i++) {
+    box_overlay_add(&overlay, &box);
+  }
+  CHECK(overlay.n_rects == BOX_OVERLAY_MAX);
+  CHECK(box_overlay_add(&overlay, &box) == -1);
+  box_overlay_reset(&overlay);
+  CHECK(overlay.n_rects == 0);
+}
+
+// On YUV 4:2:0 the rects grow outwards to even pixels
+static void test_align() {
+  box_overlay_t overlay;
+  box_overlay_init(&overlay, 640, 480, 3, 2);
+  image_rect_t box = {10, 21, 100, 200};
+  CHECK(box_overlay_add(&overlay, &box) == 0);
+  check_rect(&overlay.rects[0], 8, 20, 102, 202);
+  image_rect_t edge = {11, 11, 638, 478};
+  CHECK(box_overlay_add(&overlay, &edge) == 1);
+  check_rect(&overlay.rects[1], 10, 10, 640, 480);
+}
+
+// Boxes no larger than two lines, small objects or what is left of a box at
+// the frame edge, are left to the caller instead of being dropped
+static void test_too_small() {
+  box_overlay_t overlay;
+  box_overlay_init(&overlay, 640, 480, 3, 1);
+  image_rect_t tiny = {100, 100, 102, 103};
+  CHECK(box_overlay_add(&overlay, &tiny) == BOX_OVERLAY_TOO_SMALL);
+  // 6 x 40 after widening
+  image_rect_t narrow = {100, 100, 103, 137};
+  CHECK(box_overlay_add(&overlay, &narrow) == BOX_OVERLAY_TOO_SMALL);
+  image_rect_t wider = {100, 100, 104, 137};
+  CHECK(box_overlay_add(&overlay, &wider) == 0);
+  check_rect(&overlay.rects[0], 99, 99, 106, 139);
+  image_rect_t sliver = {636, 10, 700, 50};
+  CHECK(box_overlay_add(&overlay, &sliver) == BOX_OVERLAY_TOO_SMALL);
+  CHECK(overlay.n_rects == 1);
+}
+
+static void test_map() {
+  box_overlay_map_t map = {0.5f, 0.5f, 0, 80};
+  image_rect_t box = {10, 80, 20, 90};
+  box_overlay_map_box(&map, &box);
+  check_rect(&box, 20, 0, 40, 20);
+}
+
+int main() {
+  test_add();
+  test_align();
+  test_too_small();
+  test_map();
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,189 @@
+#include "detect_bus.h"
+
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test_util.h"
+
+#define BUS_NAME "yolov8_rtsp.test_detect_bus"
+
+static object_detect_result_list results;
+
+static void publish(detect_bus_t *bus, int count) {
+  uint32_t n = bus->shm->published.load();
+  results.count = count;
+  for (int i = 0; i < count; i++) {
+    results.results[i].cls_id = (int)(n & 0xffff);
+    results.results[i].box.left = i;
+  }
+  detect_bus_publish(bus, (uint64_t)n * 10, 640, 480, &results);
+}
+
+static void check_record(const detect_bus_record_t *rec, uint32_t n) {
+  CHECK((uint32_t)rec->frame_id == n);
+  CHECK(rec->timestamp_us == (uint64_t)n * 10);
+  CHECK(rec->width == 640 && rec->height == 480);
+  for (int i = 0; i < rec->count; i++) {
+    CHECK(rec->results[i].cls_id == (int)(n & 0xffff));
+    CHECK(rec->results[i].box.left == i);
+  }
+}
+
+static void test_empty(detect_bus_reader_t *reader) {
+  detect_bus_record_t rec;
+  uint32_t missed = 0;
+  CHECK(detect_bus_read_latest(reader, &rec) == -1);
+  CHECK(detect_bus_read_next(reader, &rec, &missed) == 0);
+  CHECK(missed == 0);
+}
+
+static void test_in_order(detect_bus_t *bus, detect_bus_reader_t *reader) {
+  detect_bus_record_t rec;
+  uint32_t missed = 0;
+  uint32_t first = bus->shm->published.load();
+  for (int i = 0; i < 3; i++) {
+    publish(bus, i + 1);
+  }
+  for (uint32_t i = 0; i < 3; i++) {
+    CHECK(detect_bus_read_next(reader, &rec, &missed) == 1);
+    check_record(&rec, first + i);
+    CHECK(rec.count == (int)i + 1);
+  }
+  CHECK(detect_bus_read_next(reader, &rec, &missed) == 0);
+  CHECK(missed == 0);
+
+  // one record at a time, the slot index wraps many times
+  for (int i = 0; i < 5 * DETECT_BUS_SLOTS; i++) {
+    publish(bus, i % OBJ_NUMB_MAX_SIZE);
+    CHECK(detect_bus_read_next(reader, &rec, &missed) == 1);
+    check_record(&rec, bus->shm->published.load() - 1);
+  }
+  CHECK(missed == 0);
+}
+
+// A reader that falls behind by more than the ring skips to what is left
+static void test_overrun(detect_bus_t *bus, detect_bus_reader_t *reader) {
+  detect_bus_record_t rec;
+  uint32_t missed = 0;
+  uint32_t first = bus->shm->published.load();
+  for (int i = 0; i < 20; i++) {
+    publish(bus, 2);
+  }
+  // the oldest slot may be rewritten next, only SLOTS - 1 are read
+  int got = 0;
+  while (detect_bus_read_next(reader, &rec, &missed) == 1) {
+    check_record(&rec, first + 20 - (DETECT_BUS_SLOTS - 1) + got);
+    got++;
+  }
+  CHECK(got == DETECT_BUS_SLOTS - 1);
+  CHECK(missed == 20 - (DETECT_BUS_SLOTS - 1));
+
+  CHECK(detect_bus_read_latest(reader, &rec) == 0);
+  check_record(&rec, first + 19);
+}
+
+// A slot caught mid-write is counted as missed, the next one is returned
+static void test_torn_slot(detect_bus_t *bus, detect_bus_reader_t *reader) {
+  detect_bus_record_t rec;
+  uint32_t missed = 0;
+  uint32_t first = bus->shm->published.load();
+  publish(bus, 1);
+  publish(bus, 1);
+  detect_bus_slot_t *slot = &bus->shm->slots[first & (DETECT_BUS_SLOTS - 1)];
+  slot->seq.fetch_add(1);
+  CHECK(detect_bus_read_next(reader, &rec, &missed) == 1);
+  check_record(&rec, first + 1);
+  CHECK(missed == 1);
+  slot->seq.fetch_add(1);
+}
+
+// The 32 bit sequence wraps after about 4.5 years at 30 fps
+static void test_sequence_wrap(detect_bus_t *bus) {
+  detect_bus_reader_t reader;
+  detect_bus_record_t rec;
+  uint32_t missed = 0;
+  uint32_t first = 0xfffffffc;
+  bus->shm->published.store(first);
+  CHECK(detect_bus_reader_open(&reader, BUS_NAME) == 0);
+  for (int i = 0; i < 6; i++) {
+    publish(bus, 1);
+  }
+  CHECK(bus->shm->published.load() == 2);
+  for (uint32_t i = 0; i < 6; i++) {
+    CHECK(detect_bus_read_next(&reader, &rec, &missed) == 1);
+    check_record(&rec, first + i);
+  }
+  CHECK(detect_bus_read_next(&reader, &rec, &missed) == 0);
+  CHECK(missed == 0);
+  detect_bus_reader_close(&reader);
+}
+
+// Readers in other processes see whole records in order while the
+// publisher runs flat out
+static void test_concurrent(detect_bus_t *bus) {
+  const uint32_t frames = 50000;
+  uint32_t first = bus->shm->published.load();
+  pid_t kids[2];
+  for (int k = 0; k < 2; k++) {
+    kids[k] = fork();
+    CHECK(kids[k] >= 0);
+    if (kids[k] == 0) {
+      detect_bus_reader_t reader;
+      detect_bus_record_t rec;
+      uint32_t missed = 0, got = 0;
+      uint32_t last = first - 1;
+      CHECK(detect_bus_reader_open(&reader, BUS_NAME) == 0);
+      reader.next = first;
+      while (1) {
+        if (detect_bus_read_next(&reader, &rec, &missed) == 0) {
+          if (reader.next - first >= frames) {
+            break;
+          }
+          continue;
+        }
+        check_record(&rec, (uint32_t)rec.frame_id);
+        CHECK(rec.count == (int)(rec.frame_id % OBJ_NUMB_MAX_SIZE));
+        CHECK((uint32_t)rec.frame_id - last >= 1);
+        last = (uint32_t)rec.frame_id;
+        got++;
+      }
+      CHECK(got + missed == frames);
+      detect_bus_reader_close(&reader);
+      _exit(0);
+    }
+  }
+  for (uint32_t f = 0; f < frames; f++) {
+    uint32_t n = bus->shm->published.load();
+    publish(bus, n % OBJ_NUMB_MAX_SIZE);
+    if (f % 64 == 0) {
+      usleep(50);
+    }
+  }
+  for (int k = 0; k < 2; k++) {
+    int status;
+    CHECK(waitpid(kids[k], &status, 0) == kids[k]);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+}
+
+int main() {
+  static detect_bus_t bus;
+  detect_bus_reader_t reader;
+
+  CHECK(detect_bus_open(&bus, BUS_NAME) == 0);
+  CHECK(detect_bus_reader_open(&reader, BUS_NAME) == 0);
+  test_empty(&reader);
+  test_in_order(&bus, &reader);
+  test_overrun(&bus, &reader);
+  test_torn_slot(&bus, &reader);
+  detect_bus_reader_close(&reader);
+  test_sequence_wrap(&bus);
+  test_concurrent(&bus);
+  detect_bus_close(&bus);
+  // the socket is gone with the publisher
+  CHECK(detect_bus_reader_open(&reader, BUS_NAME) == -1);
+
+  printf("OK\n");
+  return 0;
+}
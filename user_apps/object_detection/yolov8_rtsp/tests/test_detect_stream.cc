@@ -0,0 +1,179 @@
+#include "detect_stream.h"
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "test_util.h"
+
+#define FRAMES 300
+#define FAST_FRAMES 150 // 30 fps, the rest come at 4 fps
+#define BIG_FRAME 77    // more objects than fit a datagram
+
+static object_detect_result_list sent[FRAMES];
+static uint32_t sent_ids[FRAMES][OBJ_NUMB_MAX_SIZE];
+
+// Loopback receiver on a free port, dest gets its "ip:port"
+static int open_receiver(char *dest, size_t size) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  CHECK(fd >= 0);
+  int rcvbuf = 1 << 20;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  CHECK(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+  socklen_t len = sizeof(addr);
+  CHECK(getsockname(fd, (struct sockaddr *)&addr, &len) == 0);
+  snprintf(dest, size, "127.0.0.1:%d", ntohs(addr.sin_port));
+  return fd;
+}
+
+static void make_frames() {
+  srand(1);
+  for (int f = 0; f < FRAMES; f++) {
+    object_detect_result_list *list = &sent[f];
+    list->count = f == BIG_FRAME ? OBJ_NUMB_MAX_SIZE : rand() % 12;
+    for (int i = 0; i < list->count; i++) {
+      int left = rand() % 640, top = rand() % 480;
+      list->results[i].box.left = left;
+      list->results[i].box.top = top;
+      list->results[i].box.right = left + rand() % 200;
+      list->results[i].box.bottom = top + rand() % 200;
+      list->results[i].cls_id = rand() % 80;
+      list->results[i].prop = (rand() % 1000) / 1000.0f;
+      // far apart ids make the big frame too large for one datagram
+      sent_ids[f][i] =
+          f == BIG_FRAME ? (i % 2) * 3000000 : 1000 + rand() % 5000;
+    }
+  }
+}
+
+static void check_frame(const detect_stream_frame_t *frame, int f) {
+  const object_detect_result_list *src = &sent[f];
+  CHECK(frame->frame_id == (uint32_t)f + 5);
+  CHECK(frame->width == 640 && frame->height == 480);
+  // odd frames carry object ids
+  CHECK(!!(frame->flags & DETECT_STREAM_FLAG_IDS) == (f % 2 == 1));
+  if (frame->flags & DETECT_STREAM_FLAG_TRUNCATED) {
+    CHECK(f == BIG_FRAME);
+    CHECK(frame->count > 0 && frame->count < src->count);
+  } else {
+    CHECK(frame->count == src->count);
+  }
+  for (int i = 0; i < frame->count; i++) {
+    const object_detect_result *det = &frame->results[i];
+    CHECK(memcmp(&det->box, &src->results[i].box, sizeof(image_rect_t)) == 0);
+    CHECK(det->cls_id == src->results[i].cls_id);
+    CHECK(fabsf(det->prop - src->results[i].prop) <= 0.5f / 255 + 1e-6f);
+    CHECK(frame->object_ids[i] == (f % 2 ? sent_ids[f][i] : 0));
+  }
+}
+
+static void test_round_trip() {
+  char dest[32];
+  int rx = open_receiver(dest, sizeof(dest));
+  detect_stream_t stream;
+  CHECK(detect_stream_open(&stream, dest) == 0);
+
+  make_frames();
+  uint64_t pts_us = 1000000000000ull;
+  std::vector<uint64_t> sent_pts;
+  for (int f = 0; f < FRAMES; f++) {
+    pts_us += f < FAST_FRAMES ? 33333 : 250000;
+    sent_pts.push_back(pts_us);
+    CHECK(detect_stream_send(&stream, f + 5, pts_us, 640, 480, &sent[f],
+                             f % 2 ? sent_ids[f] : NULL) == 0);
+  }
+  detect_stream_close(&stream);
+
+  std::vector<detect_stream_frame_t> frames;
+  std::vector<int> batch;
+  uint8_t buf[2048];
+  uint32_t seq = 0, last_seq = 0;
+  struct pollfd pfd = {rx, POLLIN, 0};
+  while (poll(&pfd, 1, 100) > 0) {
+    ssize_t len = recv(rx, buf, sizeof(buf), 0);
+    CHECK(len > 0 && len <= DETECT_STREAM_MTU);
+    size_t first = frames.size();
+    int n = detect_stream_decode(buf, len, &seq, frames);
+    CHECK(n > 0 && n <= DETECT_STREAM_MAX_BATCH);
+    CHECK(batch.empty() || seq == last_seq + 1);
+    last_seq = seq;
+    batch.push_back(n);
+
+    // the packet goes out with the first frame past the batching window
+    if (n > 1) {
+      CHECK(frames[frames.size() - 2].pts_us - frames[first].pts_us <
+            DETECT_STREAM_BATCH_US);
+    }
+
+    // a datagram cut short is refused as a whole
+    std::vector<detect_stream_frame_t> junk;
+    CHECK(detect_stream_decode(buf, len - 1, &seq, junk) == -1);
+    CHECK(junk.empty());
+  }
+  close(rx);
+
+  CHECK(frames.size() == FRAMES);
+  for (int f = 0; f < FRAMES; f++) {
+    check_frame(&frames[f], f);
+    CHECK(frames[f].pts_us == sent_pts[f]);
+  }
+  CHECK(frames[BIG_FRAME].flags & DETECT_STREAM_FLAG_TRUNCATED);
+
+  // 30 fps is batched, 4 fps goes out a frame at a time
+  int fast_packets = 0, slow_packets = 0, counted = 0;
+  for (size_t p = 0; p < batch.size(); p++) {
+    if (counted < FAST_FRAMES) {
+      fast_packets++;
+    } else {
+      CHECK(batch[p] == 1);
+      slow_packets++;
+    }
+    counted += batch[p];
+  }
+  CHECK(fast_packets < FAST_FRAMES / 2);
+  CHECK(slow_packets >= FRAMES - FAST_FRAMES - 1);
+}
+
+static void test_malformed() {
+  std::vector<detect_stream_frame_t> frames;
+  uint32_t seq;
+  const uint8_t foreign[] = {'R', 'T', 1, 0, 0, 0, 0};
+  const uint8_t version[] = {'D', 'S', DETECT_STREAM_VERSION + 1, 0, 0, 0, 0};
+  // one frame announced, none present
+  const uint8_t short_frame[] = {'D', 'S', DETECT_STREAM_VERSION, 1, 0, 1, 1};
+  // more objects than a frame can hold
+  const uint8_t too_many[] = {'D', 'S', DETECT_STREAM_VERSION, 1, 0, 1, 1,
+                              0, 0, 0, 0xff, 0x7f};
+  // varint that never ends
+  const uint8_t endless[] = {'D', 'S', DETECT_STREAM_VERSION, 0, 0xff,
+                             0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                             0xff, 0xff, 0xff};
+
+  CHECK(detect_stream_decode(foreign, sizeof(foreign), &seq, frames) == -1);
+  CHECK(detect_stream_decode(version, sizeof(version), &seq, frames) == -1);
+  CHECK(detect_stream_decode(short_frame, sizeof(short_frame), &seq,
+                             frames) == -1);
+  CHECK(detect_stream_decode(too_many, sizeof(too_many), &seq, frames) == -1);
+  CHECK(detect_stream_decode(endless, sizeof(endless), &seq, frames) == -1);
+  CHECK(detect_stream_decode(foreign, 0, &seq, frames) == -1);
+  CHECK(frames.empty());
+}
+
+int main() {
+  detect_stream_t stream;
+  CHECK(detect_stream_open(&stream, "bogus") == -1);
+  CHECK(detect_stream_open(&stream, "not.an.ip:5004") == -1);
+
+  test_round_trip();
+  test_malformed();
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include "detector.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "rknn_perf.h"
+#include "test_util.h"
+
+// librga and RKNN stubs. rknn_run checks what the NPU would read.
+static frame_buffer_t *npu_input;
+static int flushes;
+static int runs;
+static int run_ret;
+static bool input_zero_and_clean;
+
+IM_API rga_buffer_handle_t importbuffer_fd(int fd, int size) { return 100; }
+
+IM_EXPORT_API IM_STATUS releasebuffer_handle(rga_buffer_handle_t handle) {
+  return IM_STATUS_SUCCESS;
+}
+
+IM_API rga_buffer_t wrapbuffer_handle(rga_buffer_handle_t handle, int width,
+                                      int height, int format, int wstride,
+                                      int hstride) {
+  rga_buffer_t buf;
+  memset(&buf, 0, sizeof(buf));
+  return buf;
+}
+
+rknn_tensor_mem *rknn_create_mem_from_fd(rknn_context ctx, int32_t fd,
+                                         void *virt_addr, uint32_t size,
+                                         int32_t offset) {
+  return NULL;
+}
+
+int rknn_destroy_mem(rknn_context ctx, rknn_tensor_mem *mem) { return 0; }
+
+int rknn_run(rknn_context ctx, rknn_run_extend *extend) {
+  runs++;
+  input_zero_and_clean = npu_input->cache == FRAME_BUFFER_CLEAN &&
+                         flushes == 1;
+  const uint8_t *data = (const uint8_t *)npu_input->vaddr;
+  for (size_t i = 0; i < npu_input->size; i++) {
+    input_zero_and_clean = input_zero_and_clean && data[i] == 0;
+  }
+  return run_ret;
+}
+
+int rknn_perf_collect(rknn_perf_profiler_t *profiler, rknn_context ctx) {
+  return 0;
+}
+
+// Model loading and decoding are covered elsewhere
+int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
+  return 0;
+}
+int release_yolov8_model(rknn_app_context_t *app_ctx) { return 0; }
+int init_post_process() { return 0; }
+void deinit_post_process() {}
+int post_process(rknn_app_context_t *app_ctx, void *outputs,
+                 float conf_threshold, float nms_threshold,
+                 object_detect_result_list *od_results) {
+  od_results->count = 1;
+  return 0;
+}
+int init_ssd_post_process() { return 0; }
+void deinit_ssd_post_process() {}
+int ssd_post_process_check(rknn_app_context_t *app_ctx) { return 0; }
+int ssd_post_process(rknn_app_context_t *app_ctx, void *outputs,
+                     float conf_threshold, float nms_threshold,
+                     object_detect_result_list *od_results) {
+  return 0;
+}
+
+static int memfd_flush(frame_buffer_t *buf) {
+  flushes++;
+  return 0;
+}
+
+static int memfd_invalidate(frame_buffer_t *buf) { return 0; }
+
+static void memfd_release(frame_buffer_t *buf) {
+  munmap(buf->vaddr, buf->size);
+  close(buf->fd);
+}
+
+static const frame_buffer_ops_t memfd_ops = {memfd_flush, memfd_invalidate,
+                                             memfd_release};
+
+// The model input as main wraps it, still holding an old frame
+static frame_buffer_t *make_input() {
+  size_t size = 64 * 64 * 3;
+  int fd = memfd_create("input", MFD_CLOEXEC);
+  CHECK(fd >= 0 && ftruncate(fd, size) == 0);
+  void *vaddr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  CHECK(vaddr != MAP_FAILED);
+  memset(vaddr, 0x5a, size);
+  return frame_buffer_wrap(fd, vaddr, size, 64, 64, 64 * 3,
+                           RK_FORMAT_BGR_888, &memfd_ops, NULL);
+}
+
+// The zeroed input is flushed before the NPU runs on it, for any backend
+static void test_warmup() {
+  const char *names[] = {"yolov8", "ssd"};
+  for (int i = 0; i < 2; i++) {
+    const detector_backend_t *backend = get_detector_backend(names[i]);
+    CHECK(backend != NULL);
+    rknn_app_context_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    CHECK(backend->init("model.rknn", &ctx) == 0);
+
+    npu_input = make_input();
+    flushes = 0;
+    runs = 0;
+    run_ret = 0;
+    input_zero_and_clean = false;
+    CHECK(detector_warmup(&ctx, npu_input) == 0);
+    CHECK(runs == 1);
+    CHECK(input_zero_and_clean);
+
+    run_ret = -1;
+    CHECK(detector_warmup(&ctx, npu_input) == -1);
+    frame_buffer_unref(npu_input);
+    backend->release(&ctx);
+  }
+  CHECK(get_detector_backend("yolov5") == NULL);
+}
+
+// A failed run reports failure and leaves the results alone
+static void test_inference_fail() {
+  const detector_backend_t *backend = get_detector_backend("yolov8");
+  rknn_app_context_t ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  npu_input = make_input();
+  object_detect_result_list od;
+  memset(&od, 0, sizeof(od));
+
+  run_ret = 0;
+  CHECK(detector_inference(backend, &ctx, &od) == 0);
+  CHECK(od.count == 1);
+  od.count = 0;
+  run_ret = -1;
+  CHECK(detector_inference(backend, &ctx, &od) == -1);
+  CHECK(od.count == 0);
+  frame_buffer_unref(npu_input);
+}
+
+int main() {
+  test_warmup();
+  test_inference_fail();
+  printf("OK\n");
+  return 0;
+}
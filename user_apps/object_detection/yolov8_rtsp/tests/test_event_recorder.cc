@@ -0,0 +1,211 @@
+#include "event_recorder.h"
+#include "ts_mux.h"
+
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+#define MAX_NALS 64
+#define FRAME_US 33333
+#define LOOPS 3 // the ten frame clips pushed three times over
+
+typedef std::vector<uint8_t> bytes_t;
+
+typedef struct {
+  uint64_t pts; // 90 kHz
+  uint64_t pcr;
+  bool psi;     // PAT and PMT right before it
+  bytes_t data; // PES payload
+} pes_t;
+
+static uint32_t crc32_mpeg(const uint8_t *data, size_t len) {
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint32_t)data[i] << 24;
+    for (int k = 0; k < 8; k++) {
+      crc = crc & 0x80000000 ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// Access units of an Annex-B clip, cut at its AUDs
+static std::vector<bytes_t> split_aus(nal_codec codec, const std::string &clip) {
+  const uint8_t *data = (const uint8_t *)clip.data();
+  uint8_t aud = codec == NAL_CODEC_H264 ? NAL_H264_AUD : NAL_H265_AUD;
+  nal_unit_t nals[MAX_NALS];
+  int n = nal_split(codec, data, clip.size(), nals, MAX_NALS);
+  std::vector<bytes_t> aus;
+  size_t start = 0;
+  for (int i = 1; i <= n; i++) {
+    if (i < n && nals[i].type != aud) {
+      continue;
+    }
+    // from the start code of one AUD to that of the next
+    size_t end = i < n ? nals[i].offset - 4 : clip.size();
+    aus.push_back(bytes_t(data + start, data + end));
+    start = end;
+  }
+  return aus;
+}
+
+// Demux a clip, checking the packet layer on the way
+static std::vector<pes_t> demux(const std::string &ts, nal_codec codec) {
+  std::vector<pes_t> pes;
+  int cc[0x2000];
+  bool psi = false;
+  memset(cc, -1, sizeof(cc));
+  CHECK(!ts.empty() && ts.size() % TS_PACKET_SIZE == 0);
+  for (size_t off = 0; off < ts.size(); off += TS_PACKET_SIZE) {
+    const uint8_t *p = (const uint8_t *)ts.data() + off;
+    CHECK(p[0] == 0x47);
+    bool unit_start = p[1] & 0x40;
+    int pid = ((p[1] & 0x1f) << 8) | p[2];
+    CHECK(cc[pid] < 0 || (p[3] & 0x0f) == ((cc[pid] + 1) & 0x0f));
+    cc[pid] = p[3] & 0x0f;
+
+    const uint8_t *q = p + 4;
+    bool has_pcr = false;
+    uint64_t pcr = 0;
+    if (p[3] & 0x20) {
+      if (q[0] > 0 && (q[1] & 0x10)) {
+        has_pcr = true;
+        pcr = ((uint64_t)q[2] << 25) | (q[3] << 17) | (q[4] << 9) |
+              (q[5] << 1) | (q[6] >> 7);
+      }
+      q += 1 + q[0];
+    }
+    CHECK(q <= p + TS_PACKET_SIZE);
+    size_t len = p + TS_PACKET_SIZE - q;
+
+    if (pid == 0 || pid == TS_PID_PMT) {
+      // one section per packet, behind a zero pointer field
+      CHECK(unit_start && q[0] == 0);
+      const uint8_t *section = q + 1;
+      size_t section_len = 3 + (((section[1] & 0x0f) << 8) | section[2]);
+      CHECK(section_len < len);
+      CHECK(crc32_mpeg(section, section_len) == 0);
+      if (pid == 0) {
+        CHECK(section[0] == 0x00 && !psi);
+        CHECK((((section[10] & 0x1f) << 8) | section[11]) == TS_PID_PMT);
+      } else {
+        CHECK(section[0] == 0x02);
+        CHECK(section[12] == (codec == NAL_CODEC_H264 ? 0x1b : 0x24));
+        CHECK((((section[13] & 0x1f) << 8) | section[14]) == TS_PID_VIDEO);
+        psi = true;
+      }
+      continue;
+    }
+
+    CHECK(pid == TS_PID_VIDEO);
+    if (unit_start) {
+      CHECK(has_pcr);
+      CHECK(memcmp(q, "\0\0\1\xe0", 4) == 0 && q[8] == 5);
+      const uint8_t *b = q + 9;
+      pes_t next;
+      next.pts = ((uint64_t)(b[0] & 0x0e) << 29) | (b[1] << 22) |
+                 ((b[2] >> 1) << 15) | (b[3] << 7) | (b[4] >> 1);
+      next.pcr = pcr;
+      next.psi = psi;
+      psi = false;
+      q += 14;
+      pes.push_back(next);
+    } else {
+      CHECK(!has_pcr && !pes.empty());
+    }
+    pes.back().data.insert(pes.back().data.end(), q, p + TS_PACKET_SIZE);
+  }
+  return pes;
+}
+
+static std::string only_clip(const char *dir) {
+  std::string path;
+  DIR *d = opendir(dir);
+  CHECK(d != NULL);
+  struct dirent *ent;
+  while ((ent = readdir(d)) != NULL) {
+    if (strncmp(ent->d_name, "event_", 6) == 0) {
+      CHECK(path.empty());
+      path = std::string(dir) + "/" + ent->d_name;
+    }
+  }
+  closedir(d);
+  CHECK(!path.empty());
+  return path;
+}
+
+// The encoded clip goes through the ring and the writer thread into a TS
+// file, and comes out of it unchanged
+static void test_recorded_clip(const char *file, nal_codec codec) {
+  std::vector<bytes_t> aus = split_aus(codec, read_test_data(file));
+  CHECK(aus.size() == 10);
+
+  char dir[] = "/tmp/event_recorder_testXXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  event_recorder_t *rec = event_recorder_create(dir, codec);
+  CHECK(rec != NULL);
+  uint64_t base_us = 1000000000;
+  int frames = aus.size() * LOOPS;
+  for (int i = 0; i < frames; i++) {
+    const bytes_t &au = aus[i % aus.size()];
+    CHECK(event_recorder_push(rec, au.data(), au.size(),
+                              base_us + i * FRAME_US) == 0);
+    if (i == frames - 5) {
+      event_recorder_trigger(rec, base_us + i * FRAME_US);
+    }
+  }
+  // the post-roll is not over, destroy keeps what was recorded
+  event_recorder_destroy(rec);
+
+  std::string path = only_clip(dir);
+  std::string ts = read_test_file(path.c_str());
+  unlink(path.c_str());
+  rmdir(dir);
+
+  // all of it was pre-roll
+  std::vector<pes_t> pes = demux(ts, codec);
+  CHECK((int)pes.size() == frames);
+  for (int i = 0; i < frames; i++) {
+    // the clips have AUDs, none added
+    CHECK(pes[i].data == aus[i % aus.size()]);
+    CHECK(pes[i].pts == 9000 + (uint64_t)i * FRAME_US * 9 / 100);
+    CHECK(pes[i].pts - pes[i].pcr == 9000);
+    CHECK(pes[i].psi == (i % 5 == 0));
+  }
+}
+
+// An access unit without an AUD gets one, and a buffer too small for the
+// worst case is refused untouched
+static void test_mux_aud() {
+  static const uint8_t au[] = {0, 0, 0, 1, 0x65, 0x88, 0x84, 0x00, 0x33};
+  ts_mux_t mux;
+  uint8_t out[4 * TS_PACKET_SIZE];
+  ts_mux_init(&mux, NAL_CODEC_H264);
+  CHECK(ts_mux_max_size(sizeof(au)) == 3 * TS_PACKET_SIZE);
+  CHECK(ts_mux_write(&mux, au, sizeof(au), 5000, true, out,
+                     3 * TS_PACKET_SIZE - 1) == 0);
+  CHECK(!mux.started);
+  size_t n = ts_mux_write(&mux, au, sizeof(au), 5000, true, out, sizeof(out));
+  CHECK(n == 3 * TS_PACKET_SIZE);
+
+  std::vector<pes_t> pes =
+      demux(std::string((const char *)out, n), NAL_CODEC_H264);
+  CHECK(pes.size() == 1 && pes[0].psi && pes[0].pts == 9000);
+  bytes_t expect = {0, 0, 0, 1, 0x09, 0xf0};
+  expect.insert(expect.end(), au, au + sizeof(au));
+  CHECK(pes[0].data == expect);
+}
+
+int main() {
+  test_mux_aud();
+  test_recorded_clip("clip.h264", NAL_CODEC_H264);
+  test_recorded_clip("clip.h265", NAL_CODEC_H265);
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,265 @@
+#include "frame_buffer.h"
+#include "video_output.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "test_util.h"
+
+// librga and RKNN stubs
+static int imports;
+static int handle_releases;
+static int mem_creates;
+static int mem_destroys;
+static rknn_tensor_mem tensor_mem;
+
+IM_API rga_buffer_handle_t importbuffer_fd(int fd, int size) {
+  imports++;
+  return fd >= 0 ? 100 + fd : 0;
+}
+
+IM_EXPORT_API IM_STATUS releasebuffer_handle(rga_buffer_handle_t handle) {
+  handle_releases++;
+  return IM_STATUS_SUCCESS;
+}
+
+IM_API rga_buffer_t wrapbuffer_handle(rga_buffer_handle_t handle, int width,
+                                      int height, int format, int wstride,
+                                      int hstride) {
+  rga_buffer_t buf;
+  memset(&buf, 0, sizeof(buf));
+  buf.handle = handle;
+  buf.width = width;
+  buf.height = height;
+  buf.wstride = wstride;
+  buf.hstride = hstride;
+  buf.format = format;
+  return buf;
+}
+
+rknn_tensor_mem *rknn_create_mem_from_fd(rknn_context ctx, int32_t fd,
+                                         void *virt_addr, uint32_t size,
+                                         int32_t offset) {
+  mem_creates++;
+  tensor_mem.fd = fd;
+  tensor_mem.virt_addr = virt_addr;
+  tensor_mem.size = size;
+  return &tensor_mem;
+}
+
+int rknn_destroy_mem(rknn_context ctx, rknn_tensor_mem *mem) {
+  mem_destroys++;
+  return 0;
+}
+
+// Buffers over memfds, with counted cache maintenance
+static int flushes;
+static int invalidates;
+static int frees;
+static bool handles_released_first;
+
+static int memfd_flush(frame_buffer_t *buf) {
+  flushes++;
+  return 0;
+}
+
+static int memfd_invalidate(frame_buffer_t *buf) {
+  invalidates++;
+  return 0;
+}
+
+static void memfd_release(frame_buffer_t *buf) {
+  frees++;
+  handles_released_first = buf->rga_handle == 0 || handle_releases > 0;
+  munmap(buf->vaddr, buf->size);
+  close(buf->fd);
+}
+
+static const frame_buffer_ops_t memfd_ops = {memfd_flush, memfd_invalidate,
+                                             memfd_release};
+
+static frame_buffer_t *memfd_alloc(int width, int height, int stride,
+                                   int format) {
+  size_t size = (size_t)stride * height;
+  int fd = memfd_create("frame_buffer", MFD_CLOEXEC);
+  CHECK(fd >= 0 && ftruncate(fd, size) == 0);
+  void *vaddr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  CHECK(vaddr != MAP_FAILED);
+  return frame_buffer_wrap(fd, vaddr, size, width, height, stride, format,
+                           &memfd_ops, NULL);
+}
+
+// MPI stubs for video_output; VENC checks the cache of what it is given
+static frame_buffer_t *mb_frame;
+static int frames_sent;
+static int dirty_frames_sent;
+
+MB_BLK frame_buffer_mb(const frame_buffer_t *buf) { return (MB_BLK)buf; }
+
+int venc_init(int chnId, int width, int height, const venc_config_t *config) {
+  return 0;
+}
+
+RK_S32 RK_MPI_VENC_SendFrame(VENC_CHN VeChn, const VIDEO_FRAME_INFO_S *pstFrame,
+                             RK_S32 s32MilliSec) {
+  frame_buffer_t *buf = (frame_buffer_t *)pstFrame->stVFrame.pMbBlk;
+  frames_sent++;
+  dirty_frames_sent += buf->cache == FRAME_BUFFER_CPU_DIRTY;
+  return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VENC_GetStream(VENC_CHN, VENC_STREAM_S *, RK_S32) { return -1; }
+RK_S32 RK_MPI_VENC_ReleaseStream(VENC_CHN, VENC_STREAM_S *) { return -1; }
+RK_S32 RK_MPI_VENC_StopRecvFrame(VENC_CHN) { return RK_SUCCESS; }
+RK_S32 RK_MPI_VENC_DestroyChn(VENC_CHN) { return RK_SUCCESS; }
+MB_POOL RK_MPI_MB_CreatePool(MB_POOL_CONFIG_S *) { return MB_INVALID_POOLID; }
+RK_S32 RK_MPI_MB_DestroyPool(MB_POOL) { return RK_SUCCESS; }
+MB_BLK RK_MPI_MB_GetMB(MB_POOL, RK_U64, RK_BOOL) { return MB_INVALID_HANDLE; }
+frame_buffer_t *frame_buffer_from_mb(MB_BLK blk, int width, int height,
+                                     int stride, int format) {
+  return NULL;
+}
+IM_API IM_STATUS imresize(const rga_buffer_t src, rga_buffer_t dst, double fx,
+                          double fy, int interpolation, int sync,
+                          int *release_fence_fd) {
+  return IM_STATUS_FAILED;
+}
+void RK_LOG(RK_S32 level, RK_S32 modId, const char *fmt, const char *fname,
+            const RK_U32 row, ...) {}
+
+// The mapping and the fd are the same memory, handles are made once
+static void test_handles() {
+  frame_buffer_t *buf = memfd_alloc(640, 480, 640 * 3, RK_FORMAT_BGR_888);
+  CHECK(buf != NULL && buf->refs == 1 && buf->cache == FRAME_BUFFER_CLEAN);
+  memset(buf->vaddr, 7, buf->size);
+  uint8_t byte = 0;
+  CHECK(pread(buf->fd, &byte, 1, 1000) == 1 && byte == 7);
+
+  CHECK(imports == 0);
+  rga_buffer_t rga = frame_buffer_rga(buf);
+  CHECK(imports == 1 && rga.handle == (rga_buffer_handle_t)(100 + buf->fd));
+  CHECK(rga.wstride == 640 && rga.hstride == 480);
+  CHECK(rga.format == RK_FORMAT_BGR_888);
+  frame_buffer_rga(buf);
+  CHECK(frame_buffer_rga_handle(buf) == rga.handle && imports == 1);
+
+  // bound to the first context that asks
+  rknn_tensor_mem *mem = frame_buffer_rknn_mem(buf, (rknn_context)1);
+  CHECK(mem != NULL && mem->fd == buf->fd && mem_creates == 1);
+  CHECK(frame_buffer_rknn_mem(buf, (rknn_context)1) == mem);
+  CHECK(frame_buffer_rknn_mem(buf, (rknn_context)2) == NULL);
+  CHECK(mem_creates == 1);
+
+  frame_buffer_unref(buf);
+  CHECK(frees == 1 && handle_releases == 1 && mem_destroys == 1);
+  CHECK(handles_released_first);
+  frame_buffer_unref(NULL);
+
+  // a borrowed tensor mem stays with its context
+  frame_buffer_t *input = memfd_alloc(640, 640, 640 * 3, RK_FORMAT_RGB_888);
+  input->rknn_mem = &tensor_mem;
+  input->rknn_ctx = (rknn_context)5;
+  input->owns_rknn_mem = false;
+  frame_buffer_unref(input);
+  CHECK(frees == 2 && mem_destroys == 1 && handle_releases == 1);
+
+  // on NV12 the byte stride is the pixel stride
+  frame_buffer_t *nv12 =
+      memfd_alloc(640, 480, 704, RK_FORMAT_YCbCr_420_SP);
+  CHECK(frame_buffer_rga(nv12).wstride == 704);
+  frame_buffer_unref(nv12);
+}
+
+// Flush and invalidate only when the other side wrote last
+static void test_cache() {
+  frame_buffer_t *buf = memfd_alloc(64, 64, 64 * 3, RK_FORMAT_BGR_888);
+  flushes = invalidates = 0;
+  frame_buffer_sync_for_device(buf);
+  frame_buffer_sync_for_cpu(buf);
+  CHECK(flushes == 0 && invalidates == 0);
+
+  frame_buffer_cpu_wrote(buf);
+  frame_buffer_sync_for_device(buf);
+  frame_buffer_sync_for_device(buf);
+  CHECK(flushes == 1 && buf->cache == FRAME_BUFFER_CLEAN);
+
+  frame_buffer_device_wrote(buf);
+  frame_buffer_sync_for_device(buf);
+  CHECK(flushes == 1 && invalidates == 0);
+  frame_buffer_sync_for_cpu(buf);
+  frame_buffer_sync_for_cpu(buf);
+  CHECK(invalidates == 1 && buf->cache == FRAME_BUFFER_CLEAN);
+  frame_buffer_unref(buf);
+}
+
+static void *ref_worker(void *arg) {
+  frame_buffer_t *buf = (frame_buffer_t *)arg;
+  for (int i = 0; i < 100000; i++) {
+    frame_buffer_unref(frame_buffer_ref(buf));
+  }
+  frame_buffer_rga_handle(buf);
+  frame_buffer_unref(buf);
+  return NULL;
+}
+
+// Stages on other threads hand references on, the last one frees
+static void test_refs() {
+  frame_buffer_t *buf = memfd_alloc(64, 64, 64 * 3, RK_FORMAT_BGR_888);
+  int frees_before = frees;
+  int imports_before = imports;
+  CHECK(frame_buffer_ref(buf) == buf && buf->refs == 2);
+  frame_buffer_unref(buf);
+
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    frame_buffer_ref(buf);
+    CHECK(pthread_create(&threads[i], NULL, ref_worker, buf) == 0);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  CHECK(frees == frees_before && buf->refs == 1);
+  CHECK(imports == imports_before + 1);
+  frame_buffer_unref(buf);
+  CHECK(frees == frees_before + 1);
+}
+
+// VENC reads the main block straight from memory: the CPU overlay must be
+// flushed before it is sent, once for all outputs of the frame
+static void test_output_flush() {
+  mb_frame = memfd_alloc(320, 240, 320 * 3, RK_FORMAT_BGR_888);
+  venc_config_t config;
+  memset(&config, 0, sizeof(config));
+  config.kbps = config.min_kbps = config.max_kbps = 1000;
+  video_output_t outputs[2];
+  CHECK(video_output_init(&outputs[0], 0, "/live/0", &config, mb_frame) == 0);
+  CHECK(video_output_init(&outputs[1], 1, "/live/1", &config, mb_frame) == 0);
+  CHECK(!outputs[0].scaled && !outputs[1].scaled);
+
+  flushes = 0;
+  for (int frame = 0; frame < 3; frame++) {
+    memset(mb_frame->vaddr, frame, mb_frame->size);
+    frame_buffer_cpu_wrote(mb_frame);
+    for (int i = 0; i < 2; i++) {
+      CHECK(video_output_send(&outputs[i], frame, frame * 33333) == 0);
+    }
+  }
+  CHECK(frames_sent == 6 && dirty_frames_sent == 0 && flushes == 3);
+
+  for (int i = 0; i < 2; i++) {
+    video_output_deinit(&outputs[i]);
+  }
+  frame_buffer_unref(mb_frame);
+}
+
+int main() {
+  test_handles();
+  test_cache();
+  test_refs();
+  test_output_flush();
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include "frame_convert.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+#define W 64
+#define H 48
+#define PAD 114
+
+// The references are OpenCV's results on the same frame,
+// data/make_frame_convert_refs.py regenerates them
+
+static std::string bgr_frame() {
+  std::string yuv = read_test_data("nv21_64x48.yuv");
+  CHECK(yuv.size() == W * H * 3 / 2);
+  std::string bgr(W * H * 3, 0);
+  yuv420sp_to_bgr((const uint8_t *)yuv.data(), W, H, W, (uint8_t *)&bgr[0]);
+  return bgr;
+}
+
+// Same fixed-point coefficients as COLOR_YUV420sp2BGR, bit exact
+static void test_yuv_to_bgr() {
+  CHECK(bgr_frame() == read_test_data("nv21_64x48.bgr"));
+}
+
+// Largest difference to the reference, the pad must match exactly
+static int letterbox_diff(int size, int w, int h, int x, int y,
+                          const char *ref_name) {
+  std::string bgr = bgr_frame();
+  std::string ref = read_test_data(ref_name);
+  std::vector<uint8_t> out(size * size * 3, 0);
+  CHECK((int)ref.size() == size * size * 3);
+  bgr_letterbox((const uint8_t *)bgr.data(), W, H, out.data(), size, size, x,
+                y, w, h, PAD);
+  int max_diff = 0;
+  for (int row = 0; row < size; row++) {
+    for (int col = 0; col < size * 3; col++) {
+      int i = row * size * 3 + col;
+      int diff = abs(out[i] - (uint8_t)ref[i]);
+      if (row < y || row >= y + h) {
+        CHECK(out[i] == PAD);
+      }
+      max_diff = diff > max_diff ? diff : max_diff;
+    }
+  }
+  return max_diff;
+}
+
+static void test_letterbox() {
+  // 2:1 as INTER_LINEAR, exact
+  CHECK(letterbox_diff(32, 32, 24, 0, 4, "letterbox_32.bgr") == 0);
+  // other ratios round their weights differently, off by one at most
+  CHECK(letterbox_diff(28, 28, 21, 0, 3, "letterbox_28.bgr") <= 1);
+
+  // the same size is a copy into the rect
+  std::string bgr = bgr_frame();
+  std::vector<uint8_t> out((W + 2) * (H + 2) * 3);
+  bgr_letterbox((const uint8_t *)bgr.data(), W, H, out.data(), W + 2, H + 2,
+                1, 1, W, H, PAD);
+  CHECK(out[0] == PAD && out[out.size() - 1] == PAD);
+  for (int row = 0; row < H; row++) {
+    CHECK(memcmp(&out[((row + 1) * (W + 2) + 1) * 3], &bgr[row * W * 3],
+                 W * 3) == 0);
+  }
+}
+
+int main() {
+  test_yuv_to_bgr();
+  test_letterbox();
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,153 @@
+#include "frame_ring.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "test_util.h"
+
+#define FRAME_US 33333
+
+// Frame seq filled with a pattern of its own, so a frame overwritten by a
+// later one shows
+static std::vector<uint8_t> make_frame(uint64_t seq, uint32_t len) {
+  std::vector<uint8_t> frame(len);
+  for (uint32_t i = 0; i < len; i++) {
+    frame[i] = (uint8_t)(seq * 31 + i);
+  }
+  return frame;
+}
+
+static int push(frame_ring_t *ring, uint64_t seq, uint32_t len, bool key) {
+  std::vector<uint8_t> frame = make_frame(seq, len);
+  return frame_ring_push(ring, frame.data(), len, seq * FRAME_US, key);
+}
+
+// Every live frame holds its own bytes and the ring starts at a key frame
+static void check_ring(const frame_ring_t *ring) {
+  CHECK(ring->tail - ring->head <= ring->max_entries);
+  if (ring->head == ring->tail) {
+    return;
+  }
+  CHECK(frame_ring_get(ring, ring->head)->keyframe);
+  CHECK(frame_ring_get(ring, ring->head - 1) == NULL);
+  CHECK(frame_ring_get(ring, ring->tail) == NULL);
+  // refused frames leave no seq behind, the PTS tells which frame it is
+  uint64_t last = 0;
+  for (uint64_t seq = ring->head; seq < ring->tail; seq++) {
+    const frame_ring_entry_t *e = frame_ring_get(ring, seq);
+    CHECK(e != NULL && e->offset + e->len <= ring->size);
+    uint64_t frame_seq = e->pts_us / FRAME_US;
+    CHECK(seq == ring->head || frame_seq > last);
+    last = frame_seq;
+    std::vector<uint8_t> frame = make_frame(frame_seq, e->len);
+    CHECK(memcmp(frame_ring_data(ring, e), frame.data(), e->len) == 0);
+  }
+}
+
+static void test_refused() {
+  frame_ring_t ring;
+  CHECK(frame_ring_init(&ring, 1000, 16, UINT64_MAX) == 0);
+  CHECK(push(&ring, 0, 100, false) == -1);
+  CHECK(push(&ring, 0, 0, true) == -1);
+  CHECK(push(&ring, 0, 1001, true) == -1);
+  CHECK(ring.head == 0 && ring.tail == 0);
+  CHECK(push(&ring, 0, 1000, true) == 0);
+  // the key frame has to go, and the frame after it can not start a ring
+  CHECK(push(&ring, 1, 100, false) == -1);
+  CHECK(ring.head == 1 && ring.tail == 1);
+  frame_ring_deinit(&ring);
+}
+
+// Out of bytes or entries, whole GOPs go from the front
+static void test_evict_gop() {
+  frame_ring_t ring;
+  CHECK(frame_ring_init(&ring, 1000, 64, UINT64_MAX) == 0);
+  for (uint64_t seq = 0; seq < 10; seq++) {
+    CHECK(push(&ring, seq, 100, seq % 4 == 0) == 0);
+  }
+  CHECK(ring.head == 0 && ring.tail == 10 && ring.write_offset == 1000);
+  CHECK(push(&ring, 10, 100, false) == 0);
+  CHECK(ring.head == 4);
+  CHECK(frame_ring_get(&ring, 10)->offset == 0);
+  check_ring(&ring);
+  // the wrapped frame is followed by one that needs the next GOP's room
+  CHECK(push(&ring, 11, 350, false) == 0);
+  CHECK(ring.head == 8 && frame_ring_get(&ring, 11)->offset == 100);
+  check_ring(&ring);
+  // 350 bytes left between the write offset and frame 8, one short
+  CHECK(push(&ring, 12, 351, true) == 0);
+  CHECK(ring.head == 12 && frame_ring_get(&ring, 12)->offset == 0);
+  check_ring(&ring);
+  frame_ring_deinit(&ring);
+
+  CHECK(frame_ring_init(&ring, 100000, 8, UINT64_MAX) == 0);
+  for (uint64_t seq = 0; seq < 8; seq++) {
+    CHECK(push(&ring, seq, 100, seq % 4 == 0) == 0);
+  }
+  CHECK(ring.head == 0);
+  CHECK(push(&ring, 8, 100, true) == 0);
+  CHECK(ring.head == 4 && ring.tail == 9);
+  check_ring(&ring);
+  frame_ring_deinit(&ring);
+}
+
+// A GOP goes once the one after it alone covers keep_us, unless it is
+// pinned
+static void test_keep_and_pin() {
+  frame_ring_t ring;
+  CHECK(frame_ring_init(&ring, 100000, 256, 10 * FRAME_US) == 0);
+  for (uint64_t seq = 0; seq < 60; seq++) {
+    CHECK(push(&ring, seq, 100, seq % 5 == 0) == 0);
+    check_ring(&ring);
+    const frame_ring_entry_t *head = frame_ring_get(&ring, ring.head);
+    CHECK(seq * FRAME_US - head->pts_us < 15 * FRAME_US);
+    CHECK(seq < 10 || seq * FRAME_US - head->pts_us >= 10 * FRAME_US);
+  }
+  CHECK(ring.head == 45);
+
+  ring.pin = 55;
+  for (uint64_t seq = 60; seq < 100; seq++) {
+    CHECK(push(&ring, seq, 100, seq % 5 == 0) == 0);
+  }
+  // the GOP before the pin is not needed, the pinned one is
+  CHECK(ring.head == 55);
+  check_ring(&ring);
+
+  // the pin does not hold once there is no room left
+  for (uint64_t seq = 100; ring.head == 55; seq++) {
+    CHECK(seq < 2000);
+    CHECK(push(&ring, seq, 1000, seq % 5 == 0) == 0);
+  }
+  CHECK(ring.head > 55);
+  check_ring(&ring);
+  ring.pin = FRAME_RING_NO_PIN;
+  frame_ring_deinit(&ring);
+}
+
+// Frames of random size, some larger than half the ring
+static void test_random() {
+  frame_ring_t ring;
+  CHECK(frame_ring_init(&ring, 64 * 1024, 64, 60 * FRAME_US) == 0);
+  srand(1);
+  for (uint64_t seq = 0; seq < 5000; seq++) {
+    bool key = seq % 30 == 0;
+    uint32_t len = key ? 8000 + rand() % 30000 : 1 + rand() % 4000;
+    if (seq % 997 == 0) {
+      len = 40000;
+    }
+    CHECK(push(&ring, seq, len, key) == 0 || !key);
+    check_ring(&ring);
+  }
+  frame_ring_deinit(&ring);
+}
+
+int main() {
+  test_refused();
+  test_evict_gop();
+  test_keep_and_pin();
+  test_random();
+
+  printf("OK\n");
+  return 0;
+}
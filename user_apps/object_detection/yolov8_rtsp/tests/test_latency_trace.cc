@@ -0,0 +1,79 @@
+#include "latency_trace.h"
+
+#include <string.h>
+
+#include "test_util.h"
+
+// Every value lands in a bucket whose upper bound is at most 1/16 above it,
+// and the buckets are in value order
+static void test_buckets() {
+  for (uint32_t v = 0; v < 16; v++) {
+    CHECK(latency_hist_bucket(v) == (int)v);
+    CHECK(latency_hist_bucket_value(v) == v);
+  }
+  // 16..31 are still exact, then the buckets double in width
+  CHECK(latency_hist_bucket(31) == 31);
+  CHECK(latency_hist_bucket(32) == 32);
+  CHECK(latency_hist_bucket(33) == 32);
+  CHECK(latency_hist_bucket_value(32) == 33);
+  // 1000 = 0b1111101000: shift 5, sub (1000 >> 5) & 15 = 15
+  CHECK(latency_hist_bucket(1000) == 6 * 16 + 15);
+  CHECK(latency_hist_bucket_value(6 * 16 + 15) == 1023);
+
+  int prev = -1;
+  for (uint64_t v = 0; v <= UINT32_MAX; v += v / 7 + 1) {
+    int b = latency_hist_bucket((uint32_t)v);
+    CHECK(b >= prev && b < TRACE_HIST_BUCKETS);
+    uint32_t high = latency_hist_bucket_value(b);
+    CHECK(high >= v && high - v <= v / 16);
+    CHECK(b == 0 || latency_hist_bucket_value(b - 1) < v);
+    prev = b;
+  }
+  int last = latency_hist_bucket(UINT32_MAX);
+  CHECK(last == TRACE_HIST_BUCKETS - 1);
+  CHECK(latency_hist_bucket_value(last) == UINT32_MAX);
+}
+
+static void record(uint32_t *counts, uint32_t value, int n) {
+  counts[latency_hist_bucket(value)] += n;
+}
+
+static void test_percentiles() {
+  uint32_t counts[TRACE_HIST_BUCKETS];
+
+  // 1..100 once each: p50 is the 50th value, reported as the top of its
+  // bucket (50 and 51 share one); p99 is 99, whose bucket ends at 99
+  memset(counts, 0, sizeof(counts));
+  for (uint32_t v = 1; v <= 100; v++) {
+    record(counts, v, 1);
+  }
+  CHECK(latency_hist_percentile(counts, 100, 50, 100) == 51);
+  CHECK(latency_hist_percentile(counts, 100, 99, 100) == 99);
+  // 100 shares a bucket with 101..103, the exact max caps it
+  CHECK(latency_hist_percentile(counts, 100, 100, 100) == 100);
+  CHECK(latency_hist_percentile(counts, 100, 1, 100) == 1);
+
+  // one slow frame in a hundred does not move p99, two do; 2000 is in the
+  // bucket 1984..2047
+  memset(counts, 0, sizeof(counts));
+  record(counts, 2000, 99);
+  record(counts, 40000, 1);
+  CHECK(latency_hist_percentile(counts, 100, 50, 40000) == 2047);
+  CHECK(latency_hist_percentile(counts, 100, 99, 40000) == 2047);
+  record(counts, 2000, -1);
+  record(counts, 40000, 1);
+  CHECK(latency_hist_percentile(counts, 100, 99, 40000) == 40000);
+
+  // a single value is every percentile, capped at the max
+  memset(counts, 0, sizeof(counts));
+  record(counts, 33333, 1);
+  CHECK(latency_hist_percentile(counts, 1, 50, 33333) == 33333);
+  CHECK(latency_hist_percentile(counts, 1, 99, 33333) == 33333);
+}
+
+int main() {
+  test_buckets();
+  test_percentiles();
+  printf("OK\n");
+  return 0;
+}
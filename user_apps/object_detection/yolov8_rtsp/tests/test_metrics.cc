@@ -0,0 +1,145 @@
+#include "metrics.h"
+
+#include <string.h>
+
+#include <string>
+
+#include "test_util.h"
+
+static std::string format_all() {
+  static char page[8192];
+  int len = metrics_format(page, sizeof(page));
+  CHECK(len >= 0 && len < (int)sizeof(page));
+  CHECK(page[len] == '\0' && (int)strlen(page) == len);
+  return page;
+}
+
+static bool has_line(const std::string &page, const std::string &line) {
+  return ("\n" + page).find("\n" + line + "\n") != std::string::npos;
+}
+
+// The registry lives for the whole process, so every metric is registered
+// once here and the cases below only update it
+static metric_t *frames;
+static metric_t *fps;
+static metric_t *infer_ms;
+static metric_t *odd_help;
+
+static void register_all() {
+  const double bounds[] = {5, 10, 20.5};
+  frames = metrics_counter("frames_total", "Frames captured");
+  fps = metrics_gauge("capture_fps", "Capture rate");
+  infer_ms = metrics_histogram("inference_ms", "Inference time", bounds, 3);
+  odd_help = metrics_gauge("odd_help", "A\\B\nC \"quoted\"");
+  CHECK(frames != NULL && fps != NULL && infer_ms != NULL &&
+        odd_help != NULL);
+}
+
+static void test_counter_and_gauge() {
+  std::string page = format_all();
+  CHECK(has_line(page, "# HELP frames_total Frames captured"));
+  CHECK(has_line(page, "# TYPE frames_total counter"));
+  CHECK(has_line(page, "frames_total 0"));
+  CHECK(has_line(page, "# TYPE capture_fps gauge"));
+  CHECK(has_line(page, "capture_fps 0"));
+
+  metric_inc(frames);
+  metric_add(frames, 41);
+  metric_set(fps, 29.97);
+  page = format_all();
+  CHECK(has_line(page, "frames_total 42"));
+  CHECK(has_line(page, "capture_fps 29.97"));
+
+  // a counter past 2^53 keeps every digit
+  metric_add(frames, 9007199254740993ULL - 42);
+  page = format_all();
+  CHECK(has_line(page, "frames_total 9007199254740993"));
+
+  // updates to an unregistered metric are dropped
+  metric_inc(NULL);
+  metric_set(NULL, 1);
+  metric_observe(NULL, 1);
+}
+
+// Buckets are cumulative, a value on a bound counts in that bucket, and
+// +Inf, _count and _sum cover every observation
+static void test_histogram() {
+  std::string page = format_all();
+  CHECK(has_line(page, "# TYPE inference_ms histogram"));
+  CHECK(has_line(page, "inference_ms_bucket{le=\"5\"} 0"));
+  CHECK(has_line(page, "inference_ms_bucket{le=\"+Inf\"} 0"));
+  CHECK(has_line(page, "inference_ms_sum 0"));
+  CHECK(has_line(page, "inference_ms_count 0"));
+
+  const double values[] = {1, 5, 7, 20.5, 21, 300};
+  for (double v : values) {
+    metric_observe(infer_ms, v);
+  }
+  page = format_all();
+  CHECK(has_line(page, "inference_ms_bucket{le=\"5\"} 2"));
+  CHECK(has_line(page, "inference_ms_bucket{le=\"10\"} 3"));
+  CHECK(has_line(page, "inference_ms_bucket{le=\"20.5\"} 4"));
+  CHECK(has_line(page, "inference_ms_bucket{le=\"+Inf\"} 6"));
+  CHECK(has_line(page, "inference_ms_sum 354.5"));
+  CHECK(has_line(page, "inference_ms_count 6"));
+
+  // the buckets come in bound order, ahead of the sum and count
+  size_t b5 = page.find("inference_ms_bucket{le=\"5\"}");
+  size_t b10 = page.find("inference_ms_bucket{le=\"10\"}");
+  size_t inf = page.find("inference_ms_bucket{le=\"+Inf\"}");
+  size_t sum = page.find("inference_ms_sum");
+  CHECK(b5 < b10 && b10 < inf && inf < sum);
+}
+
+// HELP escapes backslash and newline; quotes only need escaping in label
+// values, so they stay as they are
+static void test_escaping() {
+  std::string page = format_all();
+  CHECK(has_line(page, "# HELP odd_help A\\\\B\\nC \"quoted\""));
+  // every line is a comment or a sample of a known metric
+  size_t pos = 0;
+  while (pos < page.size()) {
+    size_t end = page.find('\n', pos);
+    CHECK(end != std::string::npos);
+    std::string line = page.substr(pos, end - pos);
+    CHECK(line.compare(0, 2, "# ") == 0 || line.compare(0, 6, "frames") == 0 ||
+          line.compare(0, 7, "capture") == 0 ||
+          line.compare(0, 9, "inference") == 0 ||
+          line.compare(0, 8, "odd_help") == 0);
+    pos = end + 1;
+  }
+}
+
+// A short buffer is filled and terminated, never overrun
+static void test_truncation() {
+  std::string full = format_all();
+  char small[64 + 8];
+  memset(small, 'x', sizeof(small));
+  int len = metrics_format(small, 64);
+  CHECK(len == 63);
+  CHECK(small[63] == '\0');
+  CHECK(small[64] == 'x');
+  CHECK(full.compare(0, 63, small) == 0);
+}
+
+static void test_registry_full() {
+  static char names[METRICS_MAX][16];
+  int registered = 4;
+  for (int i = registered; i < METRICS_MAX; i++) {
+    snprintf(names[i], sizeof(names[i]), "filler_%d", i);
+    CHECK(metrics_counter(names[i], "Filler") != NULL);
+  }
+  CHECK(metrics_counter("one_too_many", "Dropped") == NULL);
+  CHECK(format_all().find("one_too_many") == std::string::npos);
+}
+
+int main() {
+  register_all();
+  test_counter_and_gauge();
+  test_histogram();
+  test_escaping();
+  test_truncation();
+  test_registry_full();
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,296 @@
+#include "model_scheduler.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "test_util.h"
+
+// RKNN stubs. The classifier answers with the number of the run as its
+// class, so a test can tell which frame classified an object. Each run
+// takes run_sleep_us of wall time against the scheduler's budget.
+#define TEST_CLS_CLASSES 64
+#define TEST_CLS_SIZE 32
+
+static int live_mems;
+static int fail_slot_mem = -1; // rknn_create_mem_from_fd call that fails
+static int from_fd_calls;
+static int runs;
+static int run_sleep_us;
+static rknn_tensor_mem *bound_input;
+static float cls_scores[TEST_CLS_CLASSES];
+
+static rknn_tensor_mem *new_mem(void *virt_addr, uint32_t size) {
+  rknn_tensor_mem *mem = new rknn_tensor_mem();
+  mem->virt_addr = virt_addr;
+  mem->fd = 7;
+  mem->size = size;
+  live_mems++;
+  return mem;
+}
+
+rknn_tensor_mem *rknn_create_mem(rknn_context ctx, uint32_t size) {
+  return new_mem(calloc(1, size), size);
+}
+
+rknn_tensor_mem *rknn_create_mem_from_fd(rknn_context ctx, int32_t fd,
+                                         void *virt_addr, uint32_t size,
+                                         int32_t offset) {
+  if (from_fd_calls++ == fail_slot_mem) {
+    return NULL;
+  }
+  return new_mem(NULL, size);
+}
+
+int rknn_destroy_mem(rknn_context ctx, rknn_tensor_mem *mem) {
+  if (mem->fd == 7 && mem->virt_addr != NULL &&
+      mem->virt_addr != (void *)cls_scores) {
+    free(mem->virt_addr);
+  }
+  delete mem;
+  live_mems--;
+  return 0;
+}
+
+int rknn_set_io_mem(rknn_context ctx, rknn_tensor_mem *mem,
+                    rknn_tensor_attr *attr) {
+  bound_input = mem;
+  return 0;
+}
+
+int rknn_run(rknn_context ctx, rknn_run_extend *extend) {
+  CHECK(bound_input != NULL);
+  runs++;
+  for (int c = 0; c < TEST_CLS_CLASSES; c++) {
+    cls_scores[c] = c == runs % TEST_CLS_CLASSES ? 1.f : 0.f;
+  }
+  if (run_sleep_us > 0) {
+    usleep(run_sleep_us);
+  }
+  return 0;
+}
+
+static rknn_tensor_attr in_attr;
+static rknn_tensor_attr out_attr;
+
+int init_yolov8_model(const char *model_path, rknn_app_context_t *app_ctx) {
+  memset(&in_attr, 0, sizeof(in_attr));
+  memset(&out_attr, 0, sizeof(out_attr));
+  in_attr.size_with_stride = TEST_CLS_SIZE * TEST_CLS_SIZE * 3;
+  out_attr.n_elems = TEST_CLS_CLASSES;
+  app_ctx->rknn_ctx = 1;
+  app_ctx->model_width = TEST_CLS_SIZE;
+  app_ctx->model_height = TEST_CLS_SIZE;
+  app_ctx->input_attrs = &in_attr;
+  app_ctx->output_attrs = &out_attr;
+  app_ctx->input_mems[0] = rknn_create_mem(1, in_attr.size_with_stride);
+  app_ctx->output_mems[0] = new_mem(cls_scores, sizeof(cls_scores));
+  return 0;
+}
+
+int release_yolov8_model(rknn_app_context_t *app_ctx) {
+  if (app_ctx->output_mems[0] != NULL) {
+    rknn_destroy_mem(app_ctx->rknn_ctx, app_ctx->output_mems[0]);
+    app_ctx->output_mems[0] = NULL;
+  }
+  return 0;
+}
+
+int read_label_file(const char *fileName, char *lines[], int max_line) {
+  return 0;
+}
+
+// librga stubs, the crops are only counted
+static int crops;
+
+IM_API rga_buffer_handle_t importbuffer_fd(int fd, int size) { return 100; }
+
+IM_EXPORT_API IM_STATUS releasebuffer_handle(rga_buffer_handle_t handle) {
+  return IM_STATUS_SUCCESS;
+}
+
+IM_API rga_buffer_t wrapbuffer_handle(rga_buffer_handle_t handle, int width,
+                                      int height, int format, int wstride,
+                                      int hstride) {
+  rga_buffer_t buf;
+  memset(&buf, 0, sizeof(buf));
+  buf.handle = handle;
+  return buf;
+}
+
+IM_API im_job_handle_t imbeginJob(uint64_t flags) { return 42; }
+
+IM_API IM_STATUS imendJob(im_job_handle_t job_handle, int sync_mode,
+                          int acquire_fence_fd, int *release_fence_fd) {
+  return IM_STATUS_SUCCESS;
+}
+
+IM_API IM_STATUS imcancelJob(im_job_handle_t job_handle) {
+  return IM_STATUS_SUCCESS;
+}
+
+IM_API IM_STATUS improcessTask(im_job_handle_t job_handle, rga_buffer_t src,
+                               rga_buffer_t dst, rga_buffer_t pat,
+                               im_rect srect, im_rect drect, im_rect prect,
+                               im_opt_t *opt_ptr, int usage) {
+  crops++;
+  return IM_STATUS_SUCCESS;
+}
+
+// frame_buffer stubs, the source frame is never touched
+rga_buffer_t frame_buffer_rga(frame_buffer_t *buf) {
+  rga_buffer_t rga;
+  memset(&rga, 0, sizeof(rga));
+  rga.handle = 200;
+  return rga;
+}
+
+int frame_buffer_sync_for_device(frame_buffer_t *buf) { return 0; }
+
+static void reset_stubs() {
+  live_mems = 0;
+  fail_slot_mem = -1;
+  from_fd_calls = 0;
+  runs = 0;
+  run_sleep_us = 0;
+  bound_input = NULL;
+  crops = 0;
+}
+
+// n people in a row, the first one the least confident
+static void make_people(object_detect_result_list *od, int n, int shift) {
+  memset(od, 0, sizeof(*od));
+  od->count = n;
+  for (int i = 0; i < n; i++) {
+    od->results[i].box.left = i * 100 + shift;
+    od->results[i].box.top = 50;
+    od->results[i].box.right = i * 100 + 80 + shift;
+    od->results[i].box.bottom = 250;
+    od->results[i].prop = 0.5f + 0.05f * i;
+    od->results[i].cls_id = 0;
+  }
+}
+
+static void test_slot_alloc_fail() {
+  reset_stubs();
+  rknn_app_context_t det_ctx;
+  memset(&det_ctx, 0, sizeof(det_ctx));
+  model_scheduler_t sched;
+  fail_slot_mem = 2;
+  CHECK(init_model_scheduler(&sched, &det_ctx, "cls.rknn", NULL, 4, 1000) ==
+        -1);
+  CHECK(sched.slot_mems[2] == NULL);
+  release_model_scheduler(&sched);
+  CHECK(live_mems == 0);
+}
+
+// Objects are classified at most top_n per frame and only while the
+// average run still fits the budget; the rest carry over, new ones first,
+// and results stay attached to their object until the refresh interval.
+static void test_budget_and_carry_forward() {
+  reset_stubs();
+  rknn_app_context_t det_ctx;
+  memset(&det_ctx, 0, sizeof(det_ctx));
+  model_scheduler_t sched;
+  CHECK(init_model_scheduler(&sched, &det_ctx, "cls.rknn", NULL, 4, 25000) ==
+        0);
+  // the loader's input tensor is replaced by the batch and its slots
+  CHECK(live_mems == 1 + 1 + 4);
+
+  frame_buffer_t frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.width = 640;
+  frame.height = 480;
+  object_detect_result_list od;
+  object_attr_result attrs[OBJ_NUMB_MAX_SIZE];
+
+  // 10 ms per run in a 25 ms budget: the first run always goes, the
+  // second fits (10 + 10), the third would not (20 + 10)
+  run_sleep_us = 10000;
+  make_people(&od, 5, 0);
+  CHECK(scheduler_classify(&sched, &frame, &od, attrs) == 2);
+  CHECK(crops == 4);
+  // the most confident first
+  CHECK(attrs[4].cls_id == 1);
+  CHECK(attrs[3].cls_id == 2);
+  CHECK(attrs[2].cls_id == -1);
+  CHECK(attrs[1].cls_id == -1);
+  CHECK(attrs[0].cls_id == -1);
+
+  // the objects moved a little: the two classified keep their result and
+  // the unclassified ones go first
+  make_people(&od, 5, 4);
+  CHECK(scheduler_classify(&sched, &frame, &od, attrs) == 2);
+  CHECK(attrs[4].cls_id == 1);
+  CHECK(attrs[3].cls_id == 2);
+  CHECK(attrs[2].cls_id == 3);
+  CHECK(attrs[1].cls_id == 4);
+  CHECK(attrs[0].cls_id == -1);
+
+  make_people(&od, 5, 8);
+  CHECK(scheduler_classify(&sched, &frame, &od, attrs) == 1);
+  CHECK(attrs[0].cls_id == 5);
+  CHECK(runs == 5);
+
+  // a zero budget still runs one crop per frame
+  run_sleep_us = 0;
+  sched.budget_us = 0;
+  make_people(&od, 6, 8);
+  CHECK(scheduler_classify(&sched, &frame, &od, attrs) == 1);
+  CHECK(attrs[5].cls_id == 6);
+  CHECK(attrs[0].cls_id == 5);
+
+  // nothing runs until the first results are refresh_frames old
+  int frames = 4;
+  while (sched.frame < sched.refresh_frames) {
+    CHECK(scheduler_classify(&sched, &frame, &od, attrs) == 0);
+    frames++;
+  }
+  CHECK(frames == (int)sched.refresh_frames);
+  CHECK(attrs[4].cls_id == 1);
+  CHECK(runs == 6);
+  CHECK(scheduler_classify(&sched, &frame, &od, attrs) == 1);
+  CHECK(runs == 7);
+
+  release_model_scheduler(&sched);
+  CHECK(live_mems == 0);
+}
+
+// A new object in a reused tracker slot does not inherit the old result
+static void test_slot_reuse() {
+  reset_stubs();
+  rknn_app_context_t det_ctx;
+  memset(&det_ctx, 0, sizeof(det_ctx));
+  model_scheduler_t sched;
+  CHECK(init_model_scheduler(&sched, &det_ctx, "cls.rknn", NULL, 1, 25000) ==
+        0);
+  frame_buffer_t frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.width = 640;
+  frame.height = 480;
+  object_detect_result_list od;
+  object_attr_result attrs[OBJ_NUMB_MAX_SIZE];
+
+  make_people(&od, 1, 0);
+  CHECK(scheduler_classify(&sched, &frame, &od, attrs) == 1);
+  CHECK(attrs[0].cls_id == 1);
+
+  // the object leaves, the tracker drops it and frees the slot
+  od.count = 0;
+  for (int i = 0; i < 20; i++) {
+    CHECK(scheduler_classify(&sched, &frame, &od, attrs) == 0);
+  }
+  make_people(&od, 1, 300);
+  CHECK(scheduler_classify(&sched, &frame, &od, attrs) == 1);
+  CHECK(attrs[0].cls_id == 2);
+
+  release_model_scheduler(&sched);
+  CHECK(live_mems == 0);
+}
+
+int main() {
+  test_slot_alloc_fail();
+  test_budget_and_carry_forward();
+  test_slot_reuse();
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include "nal_parser.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+#define MAX_NALS 64
+
+// clip.h264 and clip.h265 are ten 64x64 frames from libx264 and libx265, a
+// key frame every 5 with access unit delimiters and repeated parameter sets;
+// data/make_nal_clips.py regenerates them. x264 cuts every frame in two
+// slices.
+static const uint8_t h264_types[] = {9, 7, 8, 6, 5, 5, 9, 1, 1, 9, 1, 1,
+                                     9, 1, 1, 9, 1, 1, 9, 7, 8, 5, 5, 9,
+                                     1, 1, 9, 1, 1, 9, 1, 1, 9, 1, 1};
+static const uint8_t h265_types[] = {35, 32, 33, 34, 39, 20, 35, 1,  35, 1,
+                                     35, 1,  35, 1,  35, 32, 33, 34, 39, 21,
+                                     35, 1,  35, 1,  35, 1,  35, 1};
+
+typedef struct {
+  const char *file;
+  nal_codec codec;
+  const uint8_t *types;
+  int n_types;
+  int four_byte_start_codes; // AUDs and parameter sets
+  int keyframes;
+} clip_t;
+
+static const clip_t clips[] = {
+    {"clip.h264", NAL_CODEC_H264, h264_types, sizeof(h264_types), 14, 4},
+    {"clip.h265", NAL_CODEC_H265, h265_types, sizeof(h265_types), 16, 2},
+};
+
+static const uint8_t *bytes(const std::string &data) {
+  return (const uint8_t *)data.data();
+}
+
+static void test_clip(const clip_t *clip) {
+  std::string data = read_test_data(clip->file);
+  nal_unit_t nals[MAX_NALS];
+  CHECK(!data.empty());
+
+  int n = nal_split(clip->codec, bytes(data), data.size(), nals, MAX_NALS);
+  CHECK(n == clip->n_types);
+  int four_byte = 0, keyframes = 0;
+  for (int i = 0; i < n; i++) {
+    const nal_unit_t *nal = &nals[i];
+    const uint8_t *p = bytes(data) + nal->offset;
+    CHECK(nal->type == clip->types[i]);
+    CHECK(nal->type == nal_type(clip->codec, p));
+    CHECK(nal->offset >= 3 && memcmp(p - 3, "\0\0\1", 3) == 0);
+    four_byte += nal->offset >= 4 && p[-4] == 0;
+    keyframes += nal_is_keyframe(clip->codec, nal->type);
+    // the NAL runs up to the next start code, emulation prevention keeps
+    // 00 00 01 out of its payload
+    size_t end = i + 1 < n ? nals[i + 1].offset - 3 : data.size();
+    CHECK(end - nal->offset - nal->len <= 1);
+    std::string payload((const char *)p, nal->len);
+    CHECK(payload.find(std::string("\0\0\1", 3)) == std::string::npos);
+  }
+  CHECK(four_byte == clip->four_byte_start_codes);
+  CHECK(n - four_byte > 0);
+  CHECK(keyframes == clip->keyframes);
+  CHECK(nal_is_parameter_set(clip->codec, nals[1].type));
+}
+
+// Every start code made 4 bytes long and trailing_zero_8bits after each NAL:
+// the same NAL units come out
+static void test_clip_rewritten(const clip_t *clip) {
+  std::string data = read_test_data(clip->file);
+  nal_unit_t nals[MAX_NALS], rewritten_nals[MAX_NALS];
+  int n = nal_split(clip->codec, bytes(data), data.size(), nals, MAX_NALS);
+
+  // a few bytes of an earlier unit before the first start code
+  std::string rewritten("\x80\x12\x34", 3);
+  for (int i = 0; i < n; i++) {
+    rewritten += std::string("\0\0\0\1", 4);
+    rewritten += data.substr(nals[i].offset, nals[i].len);
+    rewritten += std::string("\0\0", i % 3);
+  }
+  int m = nal_split(clip->codec, bytes(rewritten), rewritten.size(),
+                    rewritten_nals, MAX_NALS);
+  CHECK(m == n);
+  for (int i = 0; i < n; i++) {
+    CHECK(rewritten_nals[i].type == nals[i].type);
+    CHECK(rewritten_nals[i].len == nals[i].len);
+    CHECK(memcmp(bytes(rewritten) + rewritten_nals[i].offset,
+                 bytes(data) + nals[i].offset, nals[i].len) == 0);
+  }
+
+  // at most max_nals come back
+  CHECK(nal_split(clip->codec, bytes(data), data.size(), nals, 3) == 3);
+  CHECK(nals[2].type == clip->types[2]);
+}
+
+static void test_edge_cases() {
+  nal_unit_t nals[4];
+  const uint8_t none[] = {0x12, 0, 0, 2, 0, 0};
+  const uint8_t only_start_codes[] = {0, 0, 1, 0, 0, 0, 1, 0, 0};
+  const uint8_t short_nal[] = {0, 0, 1, 0x65};
+
+  CHECK(nal_split(NAL_CODEC_H264, none, 0, nals, 4) == 0);
+  CHECK(nal_split(NAL_CODEC_H264, none, sizeof(none), nals, 4) == 0);
+  CHECK(nal_split(NAL_CODEC_H264, only_start_codes, sizeof(only_start_codes),
+                  nals, 4) == 0);
+  CHECK(nal_split(NAL_CODEC_H264, short_nal, sizeof(short_nal), nals, 4) == 1);
+  CHECK(nals[0].offset == 3 && nals[0].len == 1 && nals[0].type == 5);
+}
+
+static std::string base64(const void *data, size_t len) {
+  char out[128];
+  int n = nal_base64((const uint8_t *)data, len, out, sizeof(out));
+  CHECK(n == (int)strlen(out));
+  return out;
+}
+
+static void test_base64() {
+  // RFC 4648 test vectors
+  CHECK(base64("", 0) == "");
+  CHECK(base64("f", 1) == "Zg==");
+  CHECK(base64("fo", 2) == "Zm8=");
+  CHECK(base64("foo", 3) == "Zm9v");
+  CHECK(base64("foob", 4) == "Zm9vYg==");
+  CHECK(base64("fooba", 5) == "Zm9vYmE=");
+  CHECK(base64("foobar", 6) == "Zm9vYmFy");
+  const uint8_t high[] = {0xfb, 0xff, 0xbf};
+  CHECK(base64(high, sizeof(high)) == "+/+/");
+
+  // room for the terminator is needed
+  char out[9];
+  CHECK(nal_base64((const uint8_t *)"foobar", 6, out, 9) == 8);
+  CHECK(nal_base64((const uint8_t *)"foobar", 6, out, 8) == -1);
+  CHECK(nal_base64((const uint8_t *)"fooba", 5, out, 8) == -1);
+
+  // sprop-parameter-sets of the clips, as Python's base64 writes them
+  static const char *h264_sets[] = {"Z0LACtoQmhAAAAMAEAAAAwPA8SJq",
+                                    "aM4Ecg=="};
+  static const char *h265_sets[] = {
+      "QAEMAf//AWAAAAMAkAAAAwAAAwAeugJA",
+      "QgEBAWAAAAMAkAAAAwAAAwAeoCCBBZbpKTC5oCAAAAMAIAAAAwPB", "RAHAc8CJ"};
+  const char **sets[] = {h264_sets, h265_sets};
+  for (int c = 0; c < 2; c++) {
+    std::string data = read_test_data(clips[c].file);
+    nal_unit_t nals[MAX_NALS];
+    int n =
+        nal_split(clips[c].codec, bytes(data), data.size(), nals, MAX_NALS);
+    // the access unit delimiter comes first
+    int k = 0;
+    for (int i = 1;
+         i < n && nal_is_parameter_set(clips[c].codec, nals[i].type); i++) {
+      CHECK(base64(bytes(data) + nals[i].offset, nals[i].len) == sets[c][k++]);
+    }
+    CHECK(k == (c == 0 ? 2 : 3));
+  }
+}
+
+int main() {
+  for (size_t c = 0; c < sizeof(clips) / sizeof(clips[0]); c++) {
+    test_clip(&clips[c]);
+    test_clip_rewritten(&clips[c]);
+  }
+  test_edge_cases();
+  test_base64();
+
+  printf("OK\n");
+  return 0;
+}
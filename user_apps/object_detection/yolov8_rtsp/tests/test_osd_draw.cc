@@ -0,0 +1,186 @@
+#include "osd_draw.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "test_util.h"
+
+#define W 640
+#define H 480
+
+static std::vector<uint8_t> nv12(W *H * 3 / 2);
+static osd_image_t img;
+
+static void clear() {
+  memset(nv12.data(), 0, W * H);
+  memset(nv12.data() + W * H, 128, W * H / 2);
+}
+
+static uint8_t luma(int x, int y) { return nv12[y * W + x]; }
+static uint8_t chroma_u(int x, int y) {
+  return nv12[W * H + (y / 2) * W + (x / 2) * 2];
+}
+static uint8_t chroma_v(int x, int y) {
+  return nv12[W * H + (y / 2) * W + (x / 2) * 2 + 1];
+}
+
+static int luma_pixels() {
+  int n = 0;
+  for (int i = 0; i < W * H; i++) {
+    n += nv12[i] != 0;
+  }
+  return n;
+}
+
+// What cv::rectangle sets for corners (10, 20), (100, 200), thickness 3
+static bool on_outline(int x, int y) {
+  bool outer = x >= 9 && x <= 101 && y >= 19 && y <= 201;
+  bool inner = x >= 12 && x <= 98 && y >= 22 && y <= 198;
+  return outer && !inner;
+}
+
+static void test_color() {
+  osd_color_t white = osd_color_rgb(255, 255, 255);
+  osd_color_t black = osd_color_rgb(0, 0, 0);
+  osd_color_t green = osd_color_rgb(0, 255, 0);
+  CHECK(white.y == 235 && white.u == 128 && white.v == 128);
+  CHECK(black.y == 16 && black.u == 128 && black.v == 128);
+  CHECK(green.y == 144 && green.u == 54 && green.v == 34);
+  CHECK(green.r == 0 && green.g == 255 && green.b == 0);
+}
+
+// Luma exactly, chroma for every 2x2 block touched, clipped to the image
+static void test_fill() {
+  osd_color_t green = osd_color_rgb(0, 255, 0);
+  clear();
+  osd_fill_rect(&img, 3, 5, 37, 9, green);
+  CHECK(luma_pixels() == 37 * 9);
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < W; x++) {
+      CHECK((luma(x, y) != 0) == (x >= 3 && x < 40 && y >= 5 && y < 14));
+    }
+  }
+  int blocks = 0;
+  for (int y = 0; y < H; y += 2) {
+    for (int x = 0; x < W; x += 2) {
+      if (chroma_u(x, y) != 128) {
+        CHECK(chroma_u(x, y) == 54 && chroma_v(x, y) == 34);
+        blocks++;
+      }
+    }
+  }
+  // block columns 1..19, rows 2..6
+  CHECK(blocks == 19 * 5);
+
+  clear();
+  osd_fill_rect(&img, -10, -10, 20, 20, green);
+  osd_fill_rect(&img, 630, 470, 50, 50, green);
+  osd_fill_rect(&img, 700, 10, 5, 5, green);
+  osd_fill_rect(&img, 10, 10, 0, 5, green);
+  CHECK(luma_pixels() == 100 + 100);
+}
+
+static void test_rect() {
+  osd_color_t green = osd_color_rgb(0, 255, 0);
+  clear();
+  osd_draw_rect(&img, 10, 20, 100, 200, 3, green);
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < W; x++) {
+      CHECK((luma(x, y) != 0) == on_outline(x, y));
+    }
+  }
+
+  // negative thickness fills, corners inclusive
+  clear();
+  osd_draw_rect(&img, 10, 20, 11, 21, -1, green);
+  CHECK(luma_pixels() == 4);
+}
+
+static void test_text() {
+  osd_color_t white = osd_color_rgb(255, 255, 255);
+  // '-' is bit 3 of font columns 1..5
+  clear();
+  CHECK(osd_draw_text(&img, 0, 0, "-", 2, white) == 12);
+  CHECK(osd_text_width("-", 2) == 12);
+  for (int y = 0; y < 16; y++) {
+    for (int x = 0; x < 12; x++) {
+      CHECK((luma(x, y) == 235) == (x >= 2 && x < 12 && y >= 6 && y < 8));
+    }
+  }
+  // one span across characters, only the blank first columns stay unset
+  clear();
+  osd_draw_text(&img, 0, 0, "--", 1, white);
+  for (int x = 0; x < 12; x++) {
+    CHECK((luma(x, 3) == 235) == (x != 0 && x != 6));
+  }
+
+  clear();
+  osd_draw_text(&img, 0, 0, "\x01", 1, white);
+  std::vector<uint8_t> unknown(nv12);
+  clear();
+  osd_draw_text(&img, 0, 0, "?", 1, white);
+  CHECK(unknown == nv12);
+
+  // clipped at every edge, nothing outside the planes is touched
+  std::vector<uint8_t> guarded(W * H * 3 / 2 + 2 * W, 0x5a);
+  osd_image_t inner;
+  osd_image_wrap_nv12(&inner, guarded.data() + W, W, H, W);
+  osd_draw_text(&inner, 630, 476, "person 99.9%", 3, white);
+  osd_draw_text(&inner, -20, -5, "car", 2, white);
+  osd_draw_label(&inner, W - 4, H + 3, "bus", 2, white, white);
+  for (int x = 0; x < W; x++) {
+    CHECK(guarded[x] == 0x5a && guarded[guarded.size() - 1 - x] == 0x5a);
+  }
+}
+
+// Above (x, y) like cv::putText, below it at the top of the image
+static void test_label() {
+  osd_color_t black = osd_color_rgb(0, 0, 0);
+  osd_color_t green = osd_color_rgb(0, 255, 0);
+  clear();
+  CHECK(osd_draw_label(&img, 10, 100, "ab", 2, black, green) == 20);
+  CHECK(luma(10, 80) == 144 && luma(10, 79) == 0);
+  CHECK(luma(10, 99) == 144 && luma(10, 100) == 0);
+  CHECK(luma(10 + 24 + 4 - 1, 90) == 144 && luma(10 + 24 + 4, 90) == 0);
+
+  clear();
+  osd_draw_label(&img, 10, 5, "ab", 2, black, green);
+  CHECK(luma(10, 5) == 144 && luma(10, 24) == 144 && luma(10, 4) == 0);
+}
+
+static void test_bgr() {
+  std::vector<uint8_t> bgr(W * H * 3, 0);
+  osd_image_t image;
+  osd_image_wrap_bgr(&image, bgr.data(), W, H, W * 3);
+  osd_color_t color = osd_color_rgb(10, 20, 30);
+  osd_draw_rect(&image, 10, 20, 100, 200, 3, color);
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < W; x++) {
+      const uint8_t *p = &bgr[(y * W + x) * 3];
+      if (on_outline(x, y)) {
+        CHECK(p[0] == 30 && p[1] == 20 && p[2] == 10);
+      } else {
+        CHECK(p[0] == 0 && p[1] == 0 && p[2] == 0);
+      }
+    }
+  }
+  osd_fill_rect(&image, 600, 0, 100, 1, color);
+  for (int x = 600; x < W; x++) {
+    CHECK(bgr[x * 3] == 30);
+  }
+  CHECK(bgr[W * 3] == 0);
+}
+
+int main() {
+  osd_image_wrap_nv12(&img, nv12.data(), W, H, W);
+  test_color();
+  test_fill();
+  test_rect();
+  test_text();
+  test_label();
+  test_bgr();
+
+  printf("OK\n");
+  return 0;
+}
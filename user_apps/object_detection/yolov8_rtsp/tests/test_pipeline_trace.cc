@@ -0,0 +1,290 @@
+#include "pipeline_trace.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+// Just enough of a JSON parser to load a trace; any syntax error fails the
+// test, so a file that parses here is valid JSON.
+struct json_t {
+  char type; // 'o' object, 'a' array, 's' string, 'n' number, 'l' literal
+  std::string str;
+  double num = 0;
+  std::vector<std::unique_ptr<json_t>> items;
+  std::map<std::string, std::unique_ptr<json_t>> fields;
+
+  const json_t *get(const char *key) const {
+    auto it = fields.find(key);
+    return it == fields.end() ? NULL : it->second.get();
+  }
+};
+
+static void skip_space(const char **p) {
+  while (isspace((unsigned char)**p)) {
+    (*p)++;
+  }
+}
+
+static std::string parse_string(const char **p) {
+  std::string out;
+  CHECK(**p == '"');
+  (*p)++;
+  while (**p != '"') {
+    CHECK(**p != '\0' && (unsigned char)**p >= 0x20);
+    if (**p == '\\') {
+      (*p)++;
+      CHECK(strchr("\"\\/bfnrtu", **p) != NULL && **p != '\0');
+      if (**p == 'u') {
+        for (int i = 1; i <= 4; i++) {
+          CHECK(isxdigit((unsigned char)(*p)[i]));
+        }
+        *p += 4;
+      }
+    }
+    out += *(*p)++;
+  }
+  (*p)++;
+  return out;
+}
+
+static std::unique_ptr<json_t> parse_value(const char **p) {
+  std::unique_ptr<json_t> v(new json_t());
+  skip_space(p);
+  if (**p == '{') {
+    v->type = 'o';
+    (*p)++;
+    skip_space(p);
+    if (**p == '}') {
+      (*p)++;
+      return v;
+    }
+    while (1) {
+      skip_space(p);
+      std::string key = parse_string(p);
+      skip_space(p);
+      CHECK(**p == ':');
+      (*p)++;
+      CHECK(v->fields.count(key) == 0);
+      v->fields[key] = parse_value(p);
+      skip_space(p);
+      if (**p == ',') {
+        (*p)++;
+        continue;
+      }
+      CHECK(**p == '}');
+      (*p)++;
+      return v;
+    }
+  }
+  if (**p == '[') {
+    v->type = 'a';
+    (*p)++;
+    skip_space(p);
+    if (**p == ']') {
+      (*p)++;
+      return v;
+    }
+    while (1) {
+      v->items.push_back(parse_value(p));
+      skip_space(p);
+      if (**p == ',') {
+        (*p)++;
+        continue;
+      }
+      CHECK(**p == ']');
+      (*p)++;
+      return v;
+    }
+  }
+  if (**p == '"') {
+    v->type = 's';
+    v->str = parse_string(p);
+    return v;
+  }
+  const char *literals[] = {"true", "false", "null"};
+  for (const char *lit : literals) {
+    if (strncmp(*p, lit, strlen(lit)) == 0) {
+      v->type = 'l';
+      v->str = lit;
+      *p += strlen(lit);
+      return v;
+    }
+  }
+  CHECK(**p == '-' || isdigit((unsigned char)**p));
+  char *end;
+  v->type = 'n';
+  v->num = strtod(*p, &end);
+  CHECK(end != *p);
+  *p = end;
+  return v;
+}
+
+static std::unique_ptr<json_t> parse_json(const std::string &text) {
+  const char *p = text.c_str();
+  std::unique_ptr<json_t> root = parse_value(&p);
+  skip_space(&p);
+  CHECK(*p == '\0');
+  return root;
+}
+
+static std::string trace_path;
+
+static std::unique_ptr<json_t> flush_and_parse() {
+  CHECK(pipeline_trace_flush(trace_path.c_str()) == 0);
+  std::string text = read_test_file(trace_path.c_str());
+  CHECK(!text.empty());
+  std::unique_ptr<json_t> root = parse_json(text);
+  CHECK(root->type == 'o');
+  const json_t *events = root->get("traceEvents");
+  CHECK(events != NULL && events->type == 'a');
+  return root;
+}
+
+// One frame as the pipeline records it: the NPU slice starts before the CPU
+// one ends, then the encoder runs
+static void record_frame(uint32_t frame) {
+  pipeline_trace_frame(frame);
+  pipeline_trace_begin(TRACE_TRACK_CPU, "preprocess");
+  pipeline_trace_begin(TRACE_TRACK_NPU, "detector");
+  pipeline_trace_end(TRACE_TRACK_CPU, "preprocess");
+  pipeline_trace_end(TRACE_TRACK_NPU, "detector");
+  pipeline_trace_begin(TRACE_TRACK_VENC, "encode");
+  pipeline_trace_end(TRACE_TRACK_VENC, "encode");
+}
+
+typedef struct {
+  int slices; // B and E events
+  int metadata;
+  std::map<uint32_t, std::string> flows; // phases of each frame's flow
+} trace_summary_t;
+
+// Check the events are well formed and sum them up. Every E closes a B on
+// its track, and every flow event sits on the begin of a slice of its frame.
+static trace_summary_t check_events(const json_t *root) {
+  trace_summary_t sum;
+  sum.slices = 0;
+  sum.metadata = 0;
+  int depth[TRACE_TRACK_NUM] = {0};
+  double last_ts = 0;
+  std::map<uint32_t, double> flow_ts;
+  const json_t *last_begin = NULL;
+
+  for (auto &item : root->get("traceEvents")->items) {
+    const json_t *ev = item.get();
+    CHECK(ev->type == 'o');
+    const json_t *ph = ev->get("ph");
+    CHECK(ph != NULL && ph->type == 's' && ph->str.size() == 1);
+    CHECK(ev->get("pid") != NULL && ev->get("name") != NULL);
+    char phase = ph->str[0];
+    if (phase == 'M') {
+      sum.metadata++;
+      continue;
+    }
+    const json_t *tid = ev->get("tid");
+    const json_t *ts = ev->get("ts");
+    CHECK(tid != NULL && ts != NULL && ts->type == 'n');
+    int track = (int)tid->num;
+    CHECK(track >= 0 && track < TRACE_TRACK_NUM);
+    CHECK(ts->num >= last_ts);
+    last_ts = ts->num;
+
+    if (phase == 'B' || phase == 'E') {
+      sum.slices++;
+      depth[track] += phase == 'B' ? 1 : -1;
+      CHECK(depth[track] >= 0);
+      last_begin = phase == 'B' ? ev : NULL;
+      continue;
+    }
+    CHECK(phase == 's' || phase == 't' || phase == 'f');
+    // a flow step follows the begin it is bound to
+    CHECK(last_begin != NULL);
+    CHECK(last_begin->get("tid")->num == tid->num);
+    CHECK(last_begin->get("ts")->num == ts->num);
+    uint32_t id = (uint32_t)ev->get("id")->num;
+    CHECK(last_begin->get("args")->get("frame")->num == id);
+    CHECK(ev->get("cat")->str == "frame");
+    CHECK((ev->get("bp") != NULL) == (phase == 'f'));
+    sum.flows[id] += phase;
+  }
+  for (int t = 0; t < TRACE_TRACK_NUM; t++) {
+    CHECK(depth[t] == 0);
+  }
+  return sum;
+}
+
+static void test_flush() {
+  CHECK(pipeline_trace_flush(trace_path.c_str()) == -1);
+  CHECK(pipeline_trace_init(64) == 0);
+
+  // nothing recorded yet is still a valid trace, with the track names
+  std::unique_ptr<json_t> root = flush_and_parse();
+  trace_summary_t sum = check_events(root.get());
+  CHECK(sum.metadata == 1 + TRACE_TRACK_NUM);
+  CHECK(sum.slices == 0);
+
+  for (uint32_t f = 1; f <= 3; f++) {
+    record_frame(f);
+  }
+  // a slice outside any frame gets no flow
+  pipeline_trace_frame(0);
+  pipeline_trace_begin(TRACE_TRACK_RTSP, "send");
+  pipeline_trace_end(TRACE_TRACK_RTSP, "send");
+  root = flush_and_parse();
+  sum = check_events(root.get());
+  CHECK(sum.slices == 3 * 6 + 2);
+  CHECK(sum.flows.size() == 3);
+  for (uint32_t f = 1; f <= 3; f++) {
+    CHECK(sum.flows[f] == "stf");
+  }
+  pipeline_trace_deinit();
+}
+
+// Once the ring wraps only the newest events are left. The oldest frame has
+// lost the begins of its CPU and NPU slices; their ends are dropped and its
+// lone encode slice gets no flow.
+static void test_wrap() {
+  CHECK(pipeline_trace_init(16) == 0);
+  for (uint32_t f = 1; f <= 6; f++) {
+    record_frame(f);
+  }
+  std::unique_ptr<json_t> root = flush_and_parse();
+  trace_summary_t sum = check_events(root.get());
+  CHECK(sum.slices == 2 + 6 + 6);
+  CHECK(sum.flows.size() == 2);
+  CHECK(sum.flows[5] == "stf");
+  CHECK(sum.flows[6] == "stf");
+
+  // the oldest event left is the begin of frame 4's encode
+  const json_t *first = NULL;
+  for (auto &item : root->get("traceEvents")->items) {
+    if (item->get("ph")->str == "B") {
+      first = item.get();
+      break;
+    }
+  }
+  CHECK(first != NULL && first->get("name")->str == "encode");
+  CHECK(first->get("args")->get("frame")->num == 4);
+  pipeline_trace_deinit();
+}
+
+int main() {
+  char dir[] = "/tmp/test_pipeline_trace_XXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  trace_path = std::string(dir) + "/trace.json";
+
+  test_flush();
+  test_wrap();
+
+  unlink(trace_path.c_str());
+  rmdir(dir);
+  printf("OK\n");
+  return 0;
+}
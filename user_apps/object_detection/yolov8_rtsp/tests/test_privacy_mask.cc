@@ -0,0 +1,113 @@
+#include "privacy_mask.h"
+
+#include <string.h>
+
+#include "test_util.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+#define BLOCK 16
+
+static object_detect_result_list results;
+
+static void add(int cls_id, int left, int top, int right, int bottom) {
+  object_detect_result *det = &results.results[results.count++];
+  memset(det, 0, sizeof(object_detect_result));
+  det->cls_id = cls_id;
+  det->prop = 0.9f;
+  det->box.left = left;
+  det->box.top = top;
+  det->box.right = right;
+  det->box.bottom = bottom;
+}
+
+static bool covers(const image_rect_t *mask, const image_rect_t *box) {
+  return mask->left <= box->left && mask->top <= box->top &&
+         mask->right >= box->right && mask->bottom >= box->bottom;
+}
+
+static bool covered(const privacy_mask_t *mask, const image_rect_t *box) {
+  for (int k = 0; k < mask->n_rects; k++) {
+    if (covers(&mask->rects[k], box)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Only the masked class, dilated and on the block grid
+static void test_snap() {
+  privacy_mask_t mask;
+  privacy_mask_init(&mask, 0, WIDTH, HEIGHT, BLOCK);
+  results.count = 0;
+  add(0, 101, 50, 161, 250);
+  add(2, 300, 300, 400, 400);
+  CHECK(privacy_mask_update(&mask, &results) == 1);
+  const image_rect_t *r = &mask.rects[0];
+  CHECK(r->left % BLOCK == 0 && r->top % BLOCK == 0);
+  CHECK(r->right % BLOCK == 0 && r->bottom % BLOCK == 0);
+  // 10% of 60 x 200 on every side
+  CHECK(r->left == 80 && r->top == 16 && r->right == 176 && r->bottom == 272);
+
+  // clamped to the frame, which need not be a whole number of blocks
+  privacy_mask_init(&mask, 0, 630, 470, BLOCK);
+  results.count = 0;
+  add(0, -10, -10, 625, 469);
+  CHECK(privacy_mask_update(&mask, &results) == 1);
+  CHECK(r->left == 0 && r->top == 0 && r->right == 630 && r->bottom == 470);
+}
+
+// A lost person stays masked for the hold, a moving one is followed
+static void test_hold() {
+  privacy_mask_t mask;
+  privacy_mask_init(&mask, 0, WIDTH, HEIGHT, BLOCK);
+  results.count = 0;
+  add(0, 100, 100, 200, 300);
+  CHECK(privacy_mask_update(&mask, &results) == 1);
+
+  results.count = 0;
+  for (int k = 0; k < PRIVACY_MASK_HOLD_FRAMES; k++) {
+    CHECK(privacy_mask_update(&mask, &results) == 1);
+  }
+  CHECK(privacy_mask_update(&mask, &results) == 0);
+
+  privacy_mask_init(&mask, 0, WIDTH, HEIGHT, BLOCK);
+  for (int k = 0; k < 20; k++) {
+    results.count = 0;
+    add(0, 100 + 10 * k, 100, 200 + 10 * k, 300);
+    CHECK(privacy_mask_update(&mask, &results) == 1);
+    CHECK(covered(&mask, &results.results[0].box));
+  }
+}
+
+// More people than masks: the last mask takes all the rest
+static void test_crowd() {
+  privacy_mask_t mask;
+  privacy_mask_init(&mask, 0, WIDTH, HEIGHT, BLOCK);
+  results.count = 0;
+  for (int i = 0; i < 30; i++) {
+    add(0, (i % 10) * 60 + 2, (i / 10) * 150 + 2, (i % 10) * 60 + 40,
+        (i / 10) * 150 + 100);
+  }
+  CHECK(privacy_mask_update(&mask, &results) == PRIVACY_MASK_MAX);
+  for (int i = 0; i < results.count; i++) {
+    CHECK(covered(&mask, &results.results[i].box));
+  }
+  // and keeps them masked while they are lost
+  results.count = 0;
+  privacy_mask_update(&mask, &results);
+  for (int i = 0; i < 30; i++) {
+    image_rect_t box = {(i % 10) * 60 + 2, (i / 10) * 150 + 2,
+                        (i % 10) * 60 + 40, (i / 10) * 150 + 100};
+    CHECK(covered(&mask, &box));
+  }
+}
+
+int main() {
+  test_snap();
+  test_hold();
+  test_crowd();
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,153 @@
+#include "rga_batch.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "test_util.h"
+
+// librga stubs. A job's release fence is an eventfd, readable once the
+// test "completes" the job; fence_mode -1 hands out no fence at all.
+static int fence_mode = 0;
+static int last_fence = -1;
+static int end_calls;
+static int last_sync_mode;
+static int cancel_calls;
+static int imports;
+static int releases;
+
+IM_API rga_buffer_handle_t importbuffer_fd(int fd, int size) {
+  imports++;
+  return fd + 1000;
+}
+
+IM_EXPORT_API IM_STATUS releasebuffer_handle(rga_buffer_handle_t handle) {
+  releases++;
+  return IM_STATUS_SUCCESS;
+}
+
+IM_API im_job_handle_t imbeginJob(uint64_t flags) { return 42; }
+
+IM_API IM_STATUS imendJob(im_job_handle_t job_handle, int sync_mode,
+                          int acquire_fence_fd, int *release_fence_fd) {
+  end_calls++;
+  last_sync_mode = sync_mode;
+  if (sync_mode == IM_ASYNC) {
+    CHECK(release_fence_fd != NULL);
+    *release_fence_fd = fence_mode < 0 ? -1 : eventfd(0, EFD_CLOEXEC);
+    last_fence = *release_fence_fd;
+  }
+  return IM_STATUS_SUCCESS;
+}
+
+IM_API IM_STATUS imcancelJob(im_job_handle_t job_handle) {
+  cancel_calls++;
+  return IM_STATUS_SUCCESS;
+}
+
+IM_API IM_STATUS imfillTask(im_job_handle_t job_handle, rga_buffer_t dst,
+                            im_rect rect, uint32_t color) {
+  return rect.width > 0 ? IM_STATUS_SUCCESS : IM_STATUS_INVALID_PARAM;
+}
+
+IM_API IM_STATUS imcvtcolorTask(im_job_handle_t job_handle, rga_buffer_t src,
+                                rga_buffer_t dst, int sfmt, int dfmt,
+                                int mode) {
+  return IM_STATUS_SUCCESS;
+}
+
+IM_API IM_STATUS improcessTask(im_job_handle_t job_handle, rga_buffer_t src,
+                               rga_buffer_t dst, rga_buffer_t pat,
+                               im_rect srect, im_rect drect, im_rect prect,
+                               im_opt_t *opt_ptr, int usage) {
+  return IM_STATUS_SUCCESS;
+}
+
+IM_API IM_STATUS imrectangleTaskArray(im_job_handle_t job_handle,
+                                      rga_buffer_t dst, im_rect *rect_array,
+                                      int array_size, uint32_t color,
+                                      int thickness) {
+  return IM_STATUS_SUCCESS;
+}
+
+IM_C_API const char *imStrError_t(IM_STATUS status) { return "stub"; }
+
+static void complete_job() {
+  uint64_t one = 1;
+  CHECK(write(last_fence, &one, sizeof(one)) == sizeof(one));
+}
+
+static bool fd_open(int fd) { return fcntl(fd, F_GETFD) >= 0; }
+
+static int fill_batch(rga_batch_t *batch, int width) {
+  rga_buffer_t dst;
+  memset(&dst, 0, sizeof(dst));
+  CHECK(rga_batch_begin(batch) == 0);
+  rga_batch_fill(batch, dst, {0, 0, width, 16}, 0xff00ff00);
+  return rga_batch_submit(batch);
+}
+
+// The fence is kept until the job is done, then closed
+static void test_async() {
+  rga_batch_t batch;
+  rga_batch_init(&batch);
+  CHECK(rga_batch_wait(&batch, 0) == 0);
+  CHECK(fill_batch(&batch, 16) == 0);
+  CHECK(last_sync_mode == IM_ASYNC && batch.fence_fd == last_fence);
+  CHECK(rga_batch_wait(&batch, 0) == -1);
+  CHECK(batch.fence_fd == last_fence);
+  int fence = last_fence;
+  complete_job();
+  CHECK(rga_batch_wait(&batch, 0) == 0);
+  CHECK(batch.fence_fd == -1 && !fd_open(fence));
+
+  // a failed task cancels the job, nothing is submitted
+  int ends = end_calls;
+  CHECK(fill_batch(&batch, 0) == -1);
+  CHECK(end_calls == ends && cancel_calls == 1 && batch.fence_fd == -1);
+  rga_batch_deinit(&batch);
+}
+
+// No fence: the frame fails, and later jobs run synchronously
+static void test_no_fence() {
+  rga_batch_t batch;
+  rga_batch_init(&batch);
+  fence_mode = -1;
+  CHECK(fill_batch(&batch, 16) == -1);
+  CHECK(last_sync_mode == IM_ASYNC && batch.fence_fd == -1 && batch.sync);
+
+  fence_mode = 0;
+  int ends = end_calls;
+  CHECK(fill_batch(&batch, 16) == 0);
+  CHECK(end_calls == ends + 1 && last_sync_mode == IM_SYNC);
+  CHECK(batch.fence_fd == -1);
+  CHECK(rga_batch_wait(&batch, 0) == 0);
+  rga_batch_deinit(&batch);
+}
+
+// Imported fds are kept, the oldest goes when the table is full
+static void test_import() {
+  rga_batch_t batch;
+  rga_batch_init(&batch);
+  imports = releases = 0;
+  for (int fd = 0; fd < RGA_BATCH_MAX_BUFFERS; fd++) {
+    CHECK(rga_batch_import(&batch, fd, 4096) == (rga_buffer_handle_t)fd + 1000);
+  }
+  CHECK(rga_batch_import(&batch, 3, 4096) == 1003 && imports == 8);
+  // the same fd at another size is another buffer
+  CHECK(rga_batch_import(&batch, 3, 8192) == 1003 && imports == 9);
+  CHECK(releases == 1 && batch.buffers[0].size == 8192);
+  CHECK(rga_batch_import(&batch, 0, 4096) == 1000 && imports == 10);
+  rga_batch_deinit(&batch);
+  CHECK(releases == 2 + RGA_BATCH_MAX_BUFFERS);
+}
+
+int main() {
+  test_async();
+  test_no_fence();
+  test_import();
+
+  printf("OK\n");
+  return 0;
+}
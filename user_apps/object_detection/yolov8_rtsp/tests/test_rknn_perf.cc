@@ -0,0 +1,87 @@
+#include "rknn_perf.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "test_util.h"
+
+static int query_ret = RKNN_SUCC;
+static int query_calls = 0;
+
+int rknn_query(rknn_context ctx, rknn_query_cmd cmd, void *info,
+               uint32_t size) {
+  query_calls++;
+  return query_ret;
+}
+
+static void test_parse_detail() {
+  std::vector<rknn_layer_perf> layers;
+  rknn_perf_summary summary;
+  std::string text = read_test_data("perf_detail.txt");
+
+  CHECK(rknn_perf_parse_detail(text.c_str(), layers, &summary) == 3);
+  const rknn_layer_perf *conv = &layers[1];
+  CHECK(conv->id == 2);
+  CHECK(strcmp(conv->op_type, "ConvSigmoid") == 0);
+  CHECK(strcmp(conv->data_type, "INT8") == 0);
+  CHECK(strcmp(conv->target, "NPU") == 0);
+  CHECK(strcmp(conv->output_shape, "(1,16,320,320)") == 0);
+  CHECK(conv->npu_cycles == 691200);
+  CHECK(conv->time_us == 2167);
+  CHECK(conv->mac_usage > 3.18f && conv->mac_usage < 3.20f);
+  CHECK(strcmp(conv->name, "Conv:/model.0/conv/Conv") == 0);
+  // "\" in MacUsage
+  CHECK(layers[0].mac_usage < 0);
+  // the ranking table after the layer table is not taken for layers
+  CHECK(summary.total_us == 2780);
+  CHECK(summary.total_rw_kb > 4600.5f && summary.total_rw_kb < 4600.6f);
+}
+
+static void test_parse_detail_old_runtime() {
+  std::vector<rknn_layer_perf> layers;
+  rknn_perf_summary summary;
+  std::string text = read_test_data("perf_detail_old.txt");
+
+  // WorkLoad holds spaces, RW(KB) and FullName come after it
+  CHECK(rknn_perf_parse_detail(text.c_str(), layers, &summary) == 2);
+  CHECK(layers[1].time_us == 150);
+  CHECK(layers[1].rw_kb == 547.f);
+  CHECK(strcmp(layers[1].name, "Conv:conv1") == 0);
+  CHECK(summary.total_us == 155);
+}
+
+static void test_parse_no_table() {
+  std::vector<rknn_layer_perf> layers;
+  rknn_perf_summary summary;
+
+  CHECK(rknn_perf_parse_detail("nothing here", layers, &summary) == -1);
+  CHECK(rknn_perf_parse_detail(NULL, layers, &summary) == -1);
+  CHECK(layers.empty());
+}
+
+static void test_collect_off_after_failure() {
+  rknn_perf_profiler_t profiler;
+  char path[] = "/tmp/rknn_perf_testXXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0);
+  close(fd);
+
+  CHECK(rknn_perf_open(&profiler, path) == 0);
+  query_ret = -1;
+  query_calls = 0;
+  CHECK(rknn_perf_collect(&profiler, 0) == -1);
+  CHECK(profiler.report == NULL);
+  // later frames do not query or print again
+  CHECK(rknn_perf_collect(&profiler, 0) == -1);
+  CHECK(query_calls == 1);
+  unlink(path);
+}
+
+int main() {
+  test_parse_detail();
+  test_parse_detail_old_runtime();
+  test_parse_no_table();
+  test_collect_off_after_failure();
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,233 @@
+#include "rtsp_server.h"
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "test_util.h"
+
+static int port;
+
+static int connect_client() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  CHECK(fd >= 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  CHECK(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+  return fd;
+}
+
+static void send_all(int fd, const std::string &data) {
+  CHECK(send(fd, data.data(), data.size(), MSG_NOSIGNAL) ==
+        (ssize_t)data.size());
+}
+
+// Bytes until the server stops sending for timeout_ms, or closes. *closed
+// tells which.
+static std::string receive(int fd, int timeout_ms, bool *closed) {
+  std::string data;
+  struct pollfd pfd = {fd, POLLIN, 0};
+  *closed = false;
+  while (poll(&pfd, 1, timeout_ms) > 0) {
+    char buf[4096];
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      *closed = true;
+      break;
+    }
+    data.append(buf, n);
+  }
+  return data;
+}
+
+static std::string options(int cseq, const char *extra_headers,
+                           const char *body) {
+  char request[512];
+  snprintf(request, sizeof(request),
+           "OPTIONS rtsp://127.0.0.1/live/0 RTSP/1.0\r\nCSeq: %d\r\n%s\r\n%s",
+           cseq, extra_headers, body);
+  return request;
+}
+
+static void test_content_length() {
+  bool closed;
+
+  // a body is skipped, the next request is answered
+  int fd = connect_client();
+  send_all(fd, options(1, "Content-Length: 5\r\n", "hello") +
+                   options(2, "", ""));
+  std::string reply = receive(fd, 200, &closed);
+  CHECK(!closed);
+  CHECK(reply.find("CSeq: 1") != std::string::npos);
+  CHECK(reply.find("CSeq: 2") != std::string::npos);
+  close(fd);
+
+  // a body split over two reads
+  fd = connect_client();
+  send_all(fd, options(1, "Content-Length: 10 \r\n", "hello"));
+  reply = receive(fd, 100, &closed);
+  CHECK(!closed && reply.empty());
+  send_all(fd, "world");
+  reply = receive(fd, 200, &closed);
+  CHECK(!closed && reply.find("CSeq: 1") != std::string::npos);
+  close(fd);
+
+  // values that would move the parser outside its buffer close the client
+  const char *bad[] = {"-1",  "-4000", "4096",  "99999999999999999999",
+                       "abc", "12abc", "+5",    ""};
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    char header[64];
+    snprintf(header, sizeof(header), "Content-Length: %s\r\n", bad[i]);
+    fd = connect_client();
+    send_all(fd, options(1, header, ""));
+    reply = receive(fd, 1000, &closed);
+    if (!closed || !reply.empty()) {
+      printf("Content-Length \"%s\" accepted\n", bad[i]);
+    }
+    CHECK(closed && reply.empty());
+    close(fd);
+  }
+
+  // the server is still serving
+  fd = connect_client();
+  send_all(fd, options(3, "", ""));
+  reply = receive(fd, 200, &closed);
+  CHECK(reply.find("CSeq: 3") != std::string::npos);
+  close(fd);
+}
+
+// Access unit i of a stream with an IDR every 30, AU_BYTES long
+#define AU_BYTES 30000
+static void push_au(rtsp_server_t *server, int i, size_t len) {
+  std::string au;
+  if (i % 30 == 0) {
+    au += std::string("\0\0\0\1\x67\x42\xc0\x0a", 8);
+    au += std::string("\0\0\0\1\x68\xce\x04\x72", 8);
+    au += std::string("\0\0\0\1\x65", 5);
+  } else {
+    au += std::string("\0\0\0\1\x41", 5);
+  }
+  au.resize(len, (char)(0x80 | i));
+  CHECK(rtsp_server_push(server, 0, (const uint8_t *)au.data(), au.size(),
+                         1000000 + i * 33333) == 0);
+  // let the server thread take it
+  usleep(2000);
+}
+
+// Send a request and wait for its reply
+static void request(int fd, const char *method, int cseq,
+                    const char *headers) {
+  char text[512];
+  snprintf(text, sizeof(text),
+           "%s rtsp://127.0.0.1/live/0 RTSP/1.0\r\nCSeq: %d\r\n%s\r\n", method,
+           cseq, headers);
+  send_all(fd, text);
+  char expect[32];
+  snprintf(expect, sizeof(expect), "CSeq: %d", cseq);
+  std::string reply;
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (reply.find(expect) == std::string::npos) {
+    CHECK(poll(&pfd, 1, 1000) > 0);
+    char buf[512];
+    // byte by byte so nothing after the reply is read
+    ssize_t n = recv(fd, buf, 1, 0);
+    CHECK(n == 1);
+    reply.append(buf, n);
+  }
+  // rest of the reply headers
+  while (reply.find("\r\n\r\n", reply.find(expect)) == std::string::npos) {
+    char c;
+    CHECK(recv(fd, &c, 1, 0) == 1);
+    reply += c;
+  }
+  CHECK(reply.find("200 OK") != std::string::npos);
+}
+
+// Clients accepted from now on get a send buffer of a slow link instead of
+// the megabytes of loopback, so what they do not read stays queued on the
+// server. Accepted sockets take it from the listening one.
+static void shrink_send_buffers() {
+  for (int fd = 3; fd < 1024; fd++) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int listening = 0;
+    socklen_t opt_len = sizeof(listening);
+    if (getsockname(fd, (struct sockaddr *)&addr, &len) != 0 ||
+        addr.sin_family != AF_INET || ntohs(addr.sin_port) != port ||
+        getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &opt_len) != 0 ||
+        !listening) {
+      continue;
+    }
+    int sndbuf = 4096;
+    CHECK(setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) ==
+          0);
+    return;
+  }
+  CHECK(!"listening socket not found");
+}
+
+// A client that joins gets the cached GOP queued at once. That burst must
+// not look like a client falling behind, or every join would cut the
+// bitrate; a client that really stops reading still must.
+static void test_queue_peak(rtsp_server_t *server) {
+  for (int i = 0; i < 25; i++) {
+    push_au(server, i, AU_BYTES);
+  }
+  CHECK(rtsp_server_take_queue_peak(server, 0) == 0);
+
+  // a client that reads nothing after PLAY, over a link too slow for the
+  // replayed GOP to leave the server's queue
+  shrink_send_buffers();
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int rcvbuf = 4096;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  CHECK(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+  request(fd, "SETUP", 1,
+          "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n");
+  request(fd, "PLAY", 2, "");
+  CHECK(rtsp_server_client_count(server, 0) == 1);
+
+  for (int i = 25; i < 28; i++) {
+    push_au(server, i, AU_BYTES);
+  }
+  int peak = rtsp_server_take_queue_peak(server, 0);
+  CHECK(peak >= 1 && peak <= 3);
+
+  // now it falls behind for real
+  for (int i = 28; i < 28 + RTSP_CLIENT_QUEUE; i++) {
+    push_au(server, i, AU_BYTES);
+  }
+  CHECK(rtsp_server_take_queue_peak(server, 0) == RTSP_CLIENT_QUEUE);
+  close(fd);
+}
+
+int main() {
+  rtsp_server_t *server = NULL;
+  // a port of our own, ctest may run other servers
+  for (int i = 0; i < 50 && server == NULL; i++) {
+    port = 20000 + (getpid() * 7 + i * 131) % 20000;
+    server = rtsp_server_create(port);
+  }
+  CHECK(server != NULL);
+  CHECK(rtsp_server_add_stream(server, "/live/0", RTSP_CODEC_H264) == 0);
+  CHECK(rtsp_server_start(server) == 0);
+
+  test_content_length();
+  test_queue_peak(server);
+
+  rtsp_server_destroy(server);
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,269 @@
+#include "snapshot_policy.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+
+#define SEC 1000000ULL
+#define REPEAT (30 * SEC)
+
+typedef struct {
+  int left, top, right, bottom;
+  float prop;
+} test_box_t;
+
+static void make_frame(object_detect_result_list *od, const test_box_t *boxes,
+                       int n) {
+  memset(od, 0, sizeof(*od));
+  od->count = n;
+  for (int i = 0; i < n; i++) {
+    od->results[i].box.left = boxes[i].left;
+    od->results[i].box.top = boxes[i].top;
+    od->results[i].box.right = boxes[i].right;
+    od->results[i].box.bottom = boxes[i].bottom;
+    od->results[i].prop = boxes[i].prop;
+    od->results[i].cls_id = 2;
+  }
+}
+
+// One object per frame, returns the number of picks
+static int select_one(snapshot_policy_t *policy, test_box_t box,
+                      uint64_t pts_us, snapshot_pick_t *pick) {
+  object_detect_result_list od;
+  make_frame(&od, &box, 1);
+  snapshot_pick_t picks[4];
+  int count = snapshot_policy_select(policy, &od, pts_us, picks, 4);
+  CHECK(count <= 1);
+  if (count == 1 && pick != NULL) {
+    *pick = picks[0];
+  }
+  return count;
+}
+
+static void select_empty(snapshot_policy_t *policy, uint64_t pts_us) {
+  object_detect_result_list od;
+  make_frame(&od, NULL, 0);
+  snapshot_pick_t picks[4];
+  CHECK(snapshot_policy_select(policy, &od, pts_us, picks, 4) == 0);
+}
+
+// A new object is trusted after SNAPSHOT_MIN_HITS frames and snapped once
+static void test_min_hits() {
+  snapshot_policy_t policy;
+  snapshot_policy_init(&policy, REPEAT);
+  test_box_t car = {100, 100, 200, 180, 0.9f};
+  snapshot_pick_t pick;
+  CHECK(select_one(&policy, car, 0, NULL) == 0);
+  CHECK(select_one(&policy, car, 33000, NULL) == 0);
+  CHECK(select_one(&policy, car, 66000, &pick) == 1);
+  CHECK(pick.index == 0 && pick.track_id != 0);
+  CHECK(select_one(&policy, car, 99000, NULL) == 0);
+}
+
+// Another snapshot needs both repeat_us and a move away from the last one
+static void test_repeat_and_move() {
+  snapshot_policy_t policy;
+  snapshot_policy_init(&policy, REPEAT);
+  test_box_t car = {100, 100, 200, 180, 0.9f};
+  snapshot_pick_t pick;
+  for (int f = 0; f < 3; f++) {
+    select_one(&policy, car, f * SEC, &pick);
+  }
+  uint64_t snapped = 2 * SEC;
+
+  // drive off in steps the tracker follows: the IoU with the last snapshot
+  // falls below 0.5 well before the 30 s are up
+  test_box_t moved = car;
+  for (int step = 0; step < 6; step++) {
+    moved.left += 10;
+    moved.right += 10;
+    CHECK(select_one(&policy, moved, snapped + SEC, NULL) == 0);
+  }
+  CHECK(box_iou(&policy.marks[0].box, &policy.tracker.tracks[0].box) < 0.5f);
+  CHECK(select_one(&policy, moved, snapped + REPEAT - 1, NULL) == 0);
+  CHECK(select_one(&policy, moved, snapped + REPEAT, &pick) == 1);
+  CHECK(pick.track_id == 1);
+  CHECK(policy.marks[0].box.left == moved.left);
+
+  // parked there: never again, however long
+  CHECK(select_one(&policy, moved, snapped + 2 * REPEAT, NULL) == 0);
+  CHECK(select_one(&policy, moved, snapped + 10 * REPEAT, NULL) == 0);
+  // a nudge is not a move
+  moved.left += 10;
+  moved.right += 10;
+  CHECK(select_one(&policy, moved, snapped + 11 * REPEAT, NULL) == 0);
+}
+
+// A new object in the slot of a dropped one is snapped as new
+static void test_slot_reuse() {
+  snapshot_policy_t policy;
+  snapshot_policy_init(&policy, REPEAT);
+  test_box_t car = {100, 100, 200, 180, 0.9f};
+  snapshot_pick_t first;
+  snapshot_pick_t second;
+  for (int f = 0; f < 3; f++) {
+    select_one(&policy, car, f * 33000, &first);
+  }
+  CHECK(first.track_id == 1 && first.slot == 0);
+  for (int f = 0; f <= SNAPSHOT_TRACK_MAX_MISSED; f++) {
+    select_empty(&policy, SEC + f * 33000);
+  }
+  CHECK(policy.tracker.tracks[0].id == 0);
+
+  // same place, same class, seconds later: still a new object
+  CHECK(select_one(&policy, car, 3 * SEC, NULL) == 0);
+  CHECK(select_one(&policy, car, 3 * SEC + 33000, NULL) == 0);
+  CHECK(select_one(&policy, car, 3 * SEC + 66000, &second) == 1);
+  CHECK(second.slot == 0 && second.track_id == 2);
+}
+
+// With one pick left a new object wins over a more confident one that is
+// due again
+static void test_new_first() {
+  snapshot_policy_t policy;
+  snapshot_policy_init(&policy, REPEAT);
+  test_box_t boxes[2] = {{100, 100, 200, 180, 0.95f},
+                         {400, 100, 500, 180, 0.5f}};
+  for (int f = 0; f < 3; f++) {
+    select_one(&policy, boxes[0], f * 33000, NULL);
+  }
+  for (int step = 0; step < 6; step++) {
+    boxes[0].left += 10;
+    boxes[0].right += 10;
+    select_one(&policy, boxes[0], SEC, NULL);
+  }
+
+  // both are due once the new one was seen three times
+  object_detect_result_list od;
+  make_frame(&od, boxes, 2);
+  snapshot_pick_t picks[2];
+  uint64_t pts = REPEAT + SEC;
+  CHECK(snapshot_policy_select(&policy, &od, pts, picks, 0) == 0);
+  CHECK(snapshot_policy_select(&policy, &od, pts + 1, picks, 0) == 0);
+  CHECK(snapshot_policy_select(&policy, &od, pts + 2, picks, 1) == 1);
+  CHECK(picks[0].index == 1);
+  // the old object is next
+  CHECK(snapshot_policy_select(&policy, &od, pts + 3, picks, 1) == 1);
+  CHECK(picks[0].index == 0);
+
+  // by confidence among new objects
+  snapshot_policy_init(&policy, REPEAT);
+  boxes[0].prop = 0.4f;
+  make_frame(&od, boxes, 2);
+  snapshot_policy_select(&policy, &od, 0, picks, 2);
+  snapshot_policy_select(&policy, &od, 1, picks, 2);
+  CHECK(snapshot_policy_select(&policy, &od, 2, picks, 2) == 2);
+  CHECK(picks[0].index == 1 && picks[1].index == 0);
+}
+
+// A failed snapshot is taken back: the object is due on the next frame, a
+// parked one too, and a repeat keeps the time of the last one that worked
+static void test_undo() {
+  snapshot_policy_t policy;
+  snapshot_policy_init(&policy, REPEAT);
+  test_box_t car = {100, 100, 200, 180, 0.9f};
+  snapshot_pick_t pick;
+  select_one(&policy, car, 0, NULL);
+  select_one(&policy, car, 33000, NULL);
+  CHECK(select_one(&policy, car, 66000, &pick) == 1);
+  // in flight, not picked again
+  CHECK(select_one(&policy, car, 99000, NULL) == 0);
+  snapshot_policy_undo(&policy, &pick);
+  CHECK(policy.marks[0].track_id == 0);
+  CHECK(select_one(&policy, car, 132000, &pick) == 1);
+  CHECK(select_one(&policy, car, 165000, NULL) == 0);
+
+  // a failed repeat leaves the earlier snapshot in place
+  uint64_t snapped = 132000;
+  test_box_t moved = car;
+  for (int step = 0; step < 6; step++) {
+    moved.left += 10;
+    moved.right += 10;
+    select_one(&policy, moved, snapped + SEC, NULL);
+  }
+  CHECK(select_one(&policy, moved, snapped + REPEAT, &pick) == 1);
+  snapshot_policy_undo(&policy, &pick);
+  CHECK(policy.marks[0].pts_us == snapped);
+  CHECK(policy.marks[0].box.left == car.left);
+  CHECK(select_one(&policy, moved, snapped + REPEAT + 33000, &pick) == 1);
+
+  // once the slot went to another object the undo is dropped
+  for (int f = 0; f <= SNAPSHOT_TRACK_MAX_MISSED; f++) {
+    select_empty(&policy, 2 * REPEAT);
+  }
+  snapshot_pick_t other;
+  for (int f = 0; f < 3; f++) {
+    select_one(&policy, car, 2 * REPEAT + f, &other);
+  }
+  CHECK(other.slot == pick.slot && other.track_id != pick.track_id);
+  snapshot_policy_undo(&policy, &pick);
+  CHECK(policy.marks[0].track_id == other.track_id);
+  CHECK(policy.marks[0].pts_us == 2 * REPEAT + 2);
+}
+
+static void check_crop(const image_rect_t *box, int src_w, int src_h,
+                       int out_w, int out_h, image_rect_t *crop) {
+  snapshot_crop_rect(box, src_w, src_h, out_w, out_h, crop);
+  int w = crop->right - crop->left;
+  int h = crop->bottom - crop->top;
+  CHECK(crop->left % 2 == 0 && crop->top % 2 == 0);
+  CHECK(w % 2 == 0 && h % 2 == 0 && w >= 2 && h >= 2);
+  CHECK(crop->left >= 0 && crop->top >= 0);
+  CHECK(crop->right <= src_w && crop->bottom <= src_h);
+  // the thumbnail aspect, to within the even rounding
+  CHECK(abs(w * out_h - h * out_w) <= 2 * (out_w + out_h));
+}
+
+static void test_crop_rect() {
+  image_rect_t crop;
+
+  // 100x50 plus 15% a side is 130x65, widened to 130x130 around the centre
+  image_rect_t box = {200, 200, 300, 250};
+  check_crop(&box, 640, 480, 192, 192, &crop);
+  CHECK(crop.right - crop.left == 130 && crop.bottom - crop.top == 130);
+  CHECK(crop.left == 184 && crop.top == 160);
+
+  // a tall box is widened, for a wide thumbnail too
+  box = {301, 101, 341, 201};
+  check_crop(&box, 640, 480, 320, 180, &crop);
+  CHECK(crop.bottom - crop.top == 130);
+  CHECK(crop.right - crop.left == 230);
+  CHECK(crop.left <= box.left && crop.right >= box.right);
+
+  // at the frame edges the crop is moved inside, not cut
+  box = {0, 0, 40, 40};
+  check_crop(&box, 640, 480, 192, 192, &crop);
+  CHECK(crop.left == 0 && crop.top == 0);
+  CHECK(crop.right - crop.left == 52 && crop.bottom - crop.top == 52);
+  box = {599, 439, 640, 480};
+  check_crop(&box, 640, 480, 192, 192, &crop);
+  CHECK(crop.right <= 640 && crop.right >= 638);
+  CHECK(crop.bottom <= 480 && crop.bottom >= 478);
+  CHECK(crop.right - crop.left == 52);
+
+  // larger than the frame: the largest square that fits, centred
+  box = {0, 0, 640, 480};
+  check_crop(&box, 640, 480, 192, 192, &crop);
+  CHECK(crop.right - crop.left == 480 && crop.bottom - crop.top == 480);
+  CHECK(crop.left == 80 && crop.top == 0);
+
+  // odd frame width, the crop still ends inside it
+  box = {1000, 10, 1279, 300};
+  check_crop(&box, 1279, 719, 192, 192, &crop);
+
+  // a degenerate box still gives a crop
+  box = {10, 10, 10, 10};
+  check_crop(&box, 640, 480, 192, 192, &crop);
+}
+
+int main() {
+  test_min_hits();
+  test_repeat_and_move();
+  test_slot_reuse();
+  test_new_first();
+  test_undo();
+  test_crop_rect();
+  printf("OK\n");
+  return 0;
+}
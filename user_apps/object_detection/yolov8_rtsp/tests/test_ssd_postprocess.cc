@@ -0,0 +1,217 @@
+#include "ssd_postprocess.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include "rknn_box_priors.h"
+#include "test_util.h"
+
+// Two output tensors as the NPU leaves them: loc is (priors, 4), conf is
+// (priors, classes), both without row padding. The priors are the 320x320
+// table the decoder loads, expected boxes are worked out by hand below.
+typedef struct {
+  rknn_app_context_t ctx;
+  rknn_tensor_attr attrs[2];
+  rknn_tensor_mem mems[2];
+  std::vector<float> loc;
+  std::vector<float> conf;
+  std::vector<int8_t> loc_i8;
+  std::vector<int8_t> conf_i8;
+  int num_classes;
+} ssd_fixture_t;
+
+static const float kNoScore = -10.0f;
+
+static void fixture_init(ssd_fixture_t *f, int num_classes, bool quant) {
+  memset(&f->ctx, 0, sizeof(f->ctx));
+  memset(f->attrs, 0, sizeof(f->attrs));
+  memset(f->mems, 0, sizeof(f->mems));
+  f->num_classes = num_classes;
+  f->ctx.io_num.n_output = 2;
+  f->ctx.output_attrs = f->attrs;
+  f->ctx.model_width = 320;
+  f->ctx.model_height = 320;
+  f->ctx.is_quant = quant;
+  f->attrs[0].n_elems = SSD_NUM_PRIORS * 4;
+  f->attrs[1].n_elems = SSD_NUM_PRIORS * num_classes;
+  int elem_size = quant ? 1 : 4;
+  for (int i = 0; i < 2; i++) {
+    f->attrs[i].size = f->attrs[i].n_elems * elem_size;
+    f->attrs[i].size_with_stride = f->attrs[i].size;
+    f->ctx.output_mems[i] = &f->mems[i];
+  }
+  if (quant) {
+    f->attrs[0].zp = 0;
+    f->attrs[0].scale = 0.05f;
+    f->attrs[1].zp = -10;
+    f->attrs[1].scale = 0.1f;
+    f->loc_i8.assign(SSD_NUM_PRIORS * 4, 0);
+    f->conf_i8.assign(SSD_NUM_PRIORS * num_classes, -128);
+    f->mems[0].virt_addr = f->loc_i8.data();
+    f->mems[1].virt_addr = f->conf_i8.data();
+  } else {
+    f->loc.assign(SSD_NUM_PRIORS * 4, 0.0f);
+    f->conf.assign(SSD_NUM_PRIORS * num_classes, kNoScore);
+    f->mems[0].virt_addr = f->loc.data();
+    f->mems[1].virt_addr = f->conf.data();
+  }
+}
+
+// One prior firing on one score column with the given regression offsets
+static void fixture_set(ssd_fixture_t *f, int prior, int column, float logit,
+                        float lx, float ly, float lw, float lh) {
+  float l[4] = {lx, ly, lw, lh};
+  if (f->ctx.is_quant) {
+    for (int i = 0; i < 4; i++) {
+      f->loc_i8[prior * 4 + i] = (int8_t)lroundf(l[i] / f->attrs[0].scale);
+    }
+    f->conf_i8[prior * f->num_classes + column] =
+        (int8_t)lroundf(logit / f->attrs[1].scale + f->attrs[1].zp);
+  } else {
+    memcpy(&f->loc[prior * 4], l, sizeof(l));
+    f->conf[prior * f->num_classes + column] = logit;
+  }
+}
+
+static int fixture_run(ssd_fixture_t *f, object_detect_result_list *out) {
+  CHECK(ssd_post_process_check(&f->ctx) == 0);
+  memset(out, 0xff, sizeof(*out));
+  return ssd_post_process(&f->ctx, f->ctx.output_mems, 0.5f, 0.45f, out);
+}
+
+static bool near(float a, float b) { return fabsf(a - b) < 1e-4f; }
+
+// prior 1561 is (0.5125, 0.4875, 0.1, 0.1); with offsets (1, -2, 2.5, 0):
+//   cx = 0.5125 + 1 * 0.1 * 0.1  = 0.5225
+//   cy = 0.4875 - 2 * 0.1 * 0.1  = 0.4675
+//   w  = 0.1 * exp(2.5 * 0.2)    = 0.164872
+//   h  = 0.1 * exp(0)            = 0.1
+// in 320 pixels: left 140.82, top 133.6, right 193.58, bottom 165.6
+static const int kPrior = 1561;
+
+static void check_prior_box(const object_detect_result *r) {
+  CHECK(r->box.left == 140);
+  CHECK(r->box.top == 133);
+  CHECK(r->box.right == 193);
+  CHECK(r->box.bottom == 165);
+}
+
+static void test_box_regression() {
+  ssd_fixture_t f;
+  fixture_init(&f, OBJ_CLASS_NUM + 1, false);
+  CHECK(near(BOX_PRIORS_320[kPrior][0], 0.5125f));
+  CHECK(near(BOX_PRIORS_320[kPrior][1], 0.4875f));
+  CHECK(near(BOX_PRIORS_320[kPrior][2], 0.1f));
+  fixture_set(&f, kPrior, 5, 1.5f, 1.0f, -2.0f, 2.5f, 0.0f);
+
+  object_detect_result_list out;
+  CHECK(fixture_run(&f, &out) == 0);
+  CHECK(out.count == 1);
+  check_prior_box(&out.results[0]);
+  // the score is the sigmoid of the logit, column c is label c - 1
+  CHECK(near(out.results[0].prop, 1.0f / (1.0f + expf(-1.5f))));
+  CHECK(out.results[0].cls_id == 4);
+}
+
+// The last prior of the table, (0.95, 0.95, 1.6, 1.6) with no offsets,
+// reaches past the frame and is clamped to it
+static void test_edge_prior() {
+  ssd_fixture_t f;
+  fixture_init(&f, OBJ_CLASS_NUM + 1, false);
+  CHECK(near(BOX_PRIORS_320[SSD_NUM_PRIORS - 1][2], 1.6f));
+  fixture_set(&f, SSD_NUM_PRIORS - 1, 1, 3.0f, 0, 0, 0, 0);
+
+  object_detect_result_list out;
+  CHECK(fixture_run(&f, &out) == 0);
+  CHECK(out.count == 1);
+  // cx - w/2 = 0.15 -> 48, truncated, so 47 in float; cx + w/2 = 1.75 -> 320
+  CHECK(out.results[0].box.left == 47 || out.results[0].box.left == 48);
+  CHECK(out.results[0].box.top == 47 || out.results[0].box.top == 48);
+  CHECK(out.results[0].box.right == 320);
+  CHECK(out.results[0].box.bottom == 320);
+  CHECK(out.results[0].cls_id == 0);
+}
+
+// Background and scores under the threshold never make a box
+static void test_threshold_and_background() {
+  ssd_fixture_t f;
+  fixture_init(&f, OBJ_CLASS_NUM + 1, false);
+  fixture_set(&f, 10, 0, 8.0f, 0, 0, 0, 0);
+  // sigmoid(-0.1) is just under the 0.5 threshold
+  fixture_set(&f, 20, 3, -0.1f, 0, 0, 0, 0);
+
+  object_detect_result_list out;
+  CHECK(fixture_run(&f, &out) == 0);
+  CHECK(out.count == 0);
+
+  // a strong background does not hide a foreground class of the same prior
+  fixture_set(&f, 10, 7, 0.5f, 0, 0, 0, 0);
+  CHECK(fixture_run(&f, &out) == 0);
+  CHECK(out.count == 1);
+  CHECK(out.results[0].cls_id == 6);
+}
+
+// The 91 column COCO export: the skipped category ids never yield a label,
+// the others shift down past them onto the 80 class list.
+static void test_coco91_class_map() {
+  ssd_fixture_t f;
+  fixture_init(&f, SSD_MAX_CLASSES, false);
+  object_detect_result_list out;
+
+  // 12 is one of the removed ids, even as the best column
+  fixture_set(&f, kPrior, 12, 4.0f, 1.0f, -2.0f, 2.5f, 0.0f);
+  CHECK(fixture_run(&f, &out) == 0);
+  CHECK(out.count == 0);
+
+  // 13 (stop sign) is label 11, 1..11 are labels 0..10
+  fixture_set(&f, kPrior, 13, 2.0f, 1.0f, -2.0f, 2.5f, 0.0f);
+  fixture_set(&f, kPrior, 12, kNoScore, 1.0f, -2.0f, 2.5f, 0.0f);
+  fixture_set(&f, 100, 1, 3.0f, 0, 0, 0, 0);
+  // 90 (toothbrush) is the last label, past all ten removed ids
+  fixture_set(&f, 3000, 90, 1.0f, 0, 0, 0, 0);
+  CHECK(fixture_run(&f, &out) == 0);
+  CHECK(out.count == 3);
+  // sorted by score
+  CHECK(out.results[0].cls_id == 0);
+  CHECK(out.results[1].cls_id == 11);
+  check_prior_box(&out.results[1]);
+  CHECK(out.results[2].cls_id == 79);
+}
+
+// The int8 path dequantizes the same offsets and logit to the same box
+static void test_quantized() {
+  ssd_fixture_t f;
+  fixture_init(&f, OBJ_CLASS_NUM + 1, true);
+  fixture_set(&f, kPrior, 5, 1.5f, 1.0f, -2.0f, 2.5f, 0.0f);
+
+  object_detect_result_list out;
+  CHECK(fixture_run(&f, &out) == 0);
+  CHECK(out.count == 1);
+  check_prior_box(&out.results[0]);
+  CHECK(near(out.results[0].prop, 1.0f / (1.0f + expf(-1.5f))));
+  CHECK(out.results[0].cls_id == 4);
+}
+
+static void test_check_rejects() {
+  ssd_fixture_t f;
+  fixture_init(&f, 85, false);
+  CHECK(ssd_post_process_check(&f.ctx) == -1);
+  fixture_init(&f, OBJ_CLASS_NUM + 1, false);
+  f.attrs[0].n_elems = SSD_NUM_PRIORS * 5;
+  CHECK(ssd_post_process_check(&f.ctx) == -1);
+}
+
+int main() {
+  CHECK(init_ssd_post_process() == 0);
+  test_box_regression();
+  test_edge_prior();
+  test_threshold_and_background();
+  test_coco91_class_map();
+  test_quantized();
+  test_check_rejects();
+  deinit_ssd_post_process();
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,204 @@
+#include "startup_graph.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test_util.h"
+
+// Stub stages: each sleeps, fails when told to, and logs its undo
+typedef struct {
+  const char *name;
+  int sleep_ms;
+  int ret;
+} stub_stage_t;
+
+static int stub_run(void *arg) {
+  stub_stage_t *stage = (stub_stage_t *)arg;
+  usleep(stage->sleep_ms * 1000);
+  return stage->ret;
+}
+
+static char undo_log[256];
+
+static void stub_undo(void *arg) {
+  stub_stage_t *stage = (stub_stage_t *)arg;
+  if (undo_log[0] != '\0') {
+    strcat(undo_log, " ");
+  }
+  strcat(undo_log, stage->name);
+}
+
+// Two stages that only finish once both are inside, so they must overlap
+static pthread_mutex_t meet_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t meet_cond = PTHREAD_COND_INITIALIZER;
+static int meet_inside;
+
+static int meet_run(void *arg) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += 2;
+  int ret = 0;
+  pthread_mutex_lock(&meet_lock);
+  meet_inside++;
+  pthread_cond_broadcast(&meet_cond);
+  while (meet_inside < 2 && ret == 0) {
+    if (pthread_cond_timedwait(&meet_cond, &meet_lock, &deadline) ==
+        ETIMEDOUT) {
+      ret = -1;
+    }
+  }
+  pthread_mutex_unlock(&meet_lock);
+  return ret;
+}
+
+static void test_concurrent() {
+  startup_graph_t graph;
+  startup_graph_init(&graph);
+  int a = startup_graph_add(&graph, "a", meet_run, NULL);
+  int b = startup_graph_add(&graph, "b", meet_run, NULL);
+  meet_inside = 0;
+  CHECK(startup_graph_run(&graph, 2) == 0);
+  CHECK(graph.stages[a].state == STARTUP_STAGE_DONE);
+  CHECK(graph.stages[b].state == STARTUP_STAGE_DONE);
+  startup_graph_deinit(&graph);
+}
+
+// Start and end times are recorded, dependents start after their deps end
+static void test_timings() {
+  stub_stage_t slow = {"slow", 30, 0};
+  stub_stage_t fast = {"fast", 10, 0};
+  stub_stage_t after = {"after", 10, 0};
+  startup_graph_t graph;
+  startup_graph_init(&graph);
+  int s = startup_graph_add(&graph, "slow", stub_run, &slow);
+  int f = startup_graph_add(&graph, "fast", stub_run, &fast);
+  int x = startup_graph_add(&graph, "after", stub_run, &after);
+  CHECK(startup_graph_depend(&graph, x, s) == 0);
+  CHECK(startup_graph_run(&graph, 3) == 0);
+
+  const startup_stage_t *st = graph.stages;
+  CHECK(st[s].end_us - st[s].start_us >= 30000);
+  CHECK(st[f].end_us - st[f].start_us >= 10000);
+  CHECK(st[x].end_us - st[x].start_us >= 10000);
+  CHECK(st[x].start_us >= st[s].end_us);
+  // fast ran beside slow, not after it
+  CHECK(st[f].start_us < st[s].end_us);
+  CHECK(graph.total_us >= st[x].end_us);
+  startup_graph_print(&graph);
+  startup_graph_deinit(&graph);
+}
+
+// Everything behind a failed stage is skipped, independent stages still run
+static void test_skip_on_failure() {
+  stub_stage_t a = {"a", 1, -1};
+  stub_stage_t b = {"b", 1, 0};
+  stub_stage_t c = {"c", 1, 0};
+  stub_stage_t d = {"d", 1, 0};
+  startup_graph_t graph;
+  startup_graph_init(&graph);
+  int ia = startup_graph_add(&graph, "a", stub_run, &a);
+  int ib = startup_graph_add(&graph, "b", stub_run, &b);
+  int ic = startup_graph_add(&graph, "c", stub_run, &c);
+  int id = startup_graph_add(&graph, "d", stub_run, &d);
+  CHECK(startup_graph_depend(&graph, ib, ia) == 0);
+  CHECK(startup_graph_depend(&graph, ic, ib) == 0);
+  CHECK(startup_graph_run(&graph, 2) == -1);
+  CHECK(graph.stages[ia].state == STARTUP_STAGE_FAILED);
+  CHECK(graph.stages[ia].ret == -1);
+  CHECK(graph.stages[ib].state == STARTUP_STAGE_SKIPPED);
+  CHECK(graph.stages[ic].state == STARTUP_STAGE_SKIPPED);
+  CHECK(graph.stages[id].state == STARTUP_STAGE_DONE);
+  // deps must be added first
+  CHECK(startup_graph_depend(&graph, ia, id) == -1);
+  startup_graph_deinit(&graph);
+}
+
+// The graph main builds, see main.cc
+typedef struct {
+  stub_stage_t model, rtsp, isp, mpi, vi, mb_pool, venc;
+} app_stages_t;
+
+static void app_graph(startup_graph_t *graph, app_stages_t *app) {
+  stub_stage_t defaults[] = {{"model", 20, 0}, {"rtsp", 1, 0},
+                             {"isp", 5, 0},    {"mpi", 1, 0},
+                             {"vi", 1, 0},     {"mb_pool", 10, 0},
+                             {"venc", 1, 0}};
+  memcpy(app, defaults, sizeof(defaults));
+  startup_graph_init(graph);
+  int model = startup_graph_add(graph, "model", stub_run, &app->model);
+  startup_graph_add(graph, "rtsp", stub_run, &app->rtsp);
+  int isp = startup_graph_add(graph, "isp", stub_run, &app->isp);
+  int mpi = startup_graph_add(graph, "mpi", stub_run, &app->mpi);
+  CHECK(startup_graph_depend(graph, mpi, isp) == 0);
+  CHECK(startup_graph_undo_before(graph, isp, mpi) == 0);
+  int vi = startup_graph_add(graph, "vi", stub_run, &app->vi);
+  CHECK(startup_graph_depend(graph, vi, isp) == 0);
+  CHECK(startup_graph_depend(graph, vi, mpi) == 0);
+  int pool = startup_graph_add(graph, "mb_pool", stub_run, &app->mb_pool);
+  CHECK(startup_graph_depend(graph, pool, mpi) == 0);
+  int venc = startup_graph_add(graph, "venc", stub_run, &app->venc);
+  CHECK(startup_graph_depend(graph, venc, mpi) == 0);
+  CHECK(startup_graph_depend(graph, venc, pool) == 0);
+  for (int i = model; i <= venc; i++) {
+    CHECK(startup_graph_set_undo(graph, i, stub_undo) == 0);
+  }
+}
+
+// One teardown order whatever finished last: dependents first, except the
+// ISP, which stops before MPI exits
+static void test_undo_order() {
+  startup_graph_t graph;
+  app_stages_t app;
+
+  // at exit
+  app_graph(&graph, &app);
+  CHECK(startup_graph_run(&graph, 4) == 0);
+  undo_log[0] = '\0';
+  startup_graph_undo(&graph);
+  CHECK(strcmp(undo_log, "venc mb_pool vi isp mpi rtsp model") == 0);
+  startup_graph_deinit(&graph);
+
+  // the model finishing last does not move it
+  app_graph(&graph, &app);
+  app.model.sleep_ms = 60;
+  CHECK(startup_graph_run(&graph, 4) == 0);
+  CHECK(graph.stages[0].end_us > graph.stages[6].end_us);
+  undo_log[0] = '\0';
+  startup_graph_undo(&graph);
+  CHECK(strcmp(undo_log, "venc mb_pool vi isp mpi rtsp model") == 0);
+  startup_graph_deinit(&graph);
+
+  // a failed stage is undone too, skipped ones are not
+  app_graph(&graph, &app);
+  app.mpi.ret = -1;
+  CHECK(startup_graph_run(&graph, 4) == -1);
+  undo_log[0] = '\0';
+  startup_graph_undo(&graph);
+  CHECK(strcmp(undo_log, "isp mpi rtsp model") == 0);
+  startup_graph_deinit(&graph);
+
+  app_graph(&graph, &app);
+  app.venc.ret = -1;
+  CHECK(startup_graph_run(&graph, 1) == -1);
+  undo_log[0] = '\0';
+  startup_graph_undo(&graph);
+  CHECK(strcmp(undo_log, "venc mb_pool vi isp mpi rtsp model") == 0);
+  startup_graph_deinit(&graph);
+
+  // an ordering loop is refused
+  app_graph(&graph, &app);
+  CHECK(startup_graph_undo_before(&graph, 3, 2) == -1);
+  CHECK(startup_graph_undo_before(&graph, 2, 2) == -1);
+  startup_graph_deinit(&graph);
+}
+
+int main() {
+  test_concurrent();
+  test_timings();
+  test_skip_on_failure();
+  test_undo_order();
+  printf("OK\n");
+  return 0;
+}
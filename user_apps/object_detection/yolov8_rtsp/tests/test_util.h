@@ -0,0 +1,40 @@
+#ifndef _RKNN_DEMO_TEST_UTIL_H_
+#define _RKNN_DEMO_TEST_UTIL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+// Unlike assert, stays on in release builds
+#define CHECK(cond)                                                           \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);         \
+      exit(1);                                                                \
+    }                                                                         \
+  } while (0)
+
+// Whole file, empty when it can not be read
+static inline std::string read_test_file(const char *path) {
+  std::string data;
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    printf("open %s fail!\n", path);
+    return data;
+  }
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    data.append(buf, n);
+  }
+  fclose(fp);
+  return data;
+}
+
+// A file from tests/data
+static inline std::string read_test_data(const char *name) {
+  return read_test_file((std::string(TEST_DATA_DIR) + "/" + name).c_str());
+}
+
+#endif //_RKNN_DEMO_TEST_UTIL_H_
@@ -0,0 +1,199 @@
+#include "luckfox_mpi.h"
+#include "venc_roi.h"
+
+#include "test_util.h"
+
+// venc_apply_roi is linked from luckfox_mpi.cc, the MPI calls it and its
+// neighbours make are stubbed here
+static int set_roi_calls;
+static RK_S32 set_roi_ret = RK_SUCCESS;
+static VENC_ROI_ATTR_S last_roi;
+
+RK_S32 RK_MPI_VENC_SetRoiAttr(VENC_CHN VeChn,
+                              const VENC_ROI_ATTR_S *pstRoiAttr) {
+  set_roi_calls++;
+  last_roi = *pstRoiAttr;
+  return set_roi_ret;
+}
+
+RK_S32 RK_MPI_VENC_CreateChn(VENC_CHN, const VENC_CHN_ATTR_S *) { return -1; }
+RK_S32 RK_MPI_VENC_GetChnAttr(VENC_CHN, VENC_CHN_ATTR_S *) { return -1; }
+RK_S32 RK_MPI_VENC_SetChnAttr(VENC_CHN, const VENC_CHN_ATTR_S *) { return -1; }
+RK_S32 RK_MPI_VENC_GetRcParam(VENC_CHN, VENC_RC_PARAM_S *) { return -1; }
+RK_S32 RK_MPI_VENC_SetRcParam(VENC_CHN, const VENC_RC_PARAM_S *) { return -1; }
+RK_S32 RK_MPI_VENC_StartRecvFrame(VENC_CHN, const VENC_RECV_PIC_PARAM_S *) {
+  return -1;
+}
+RK_S32 RK_MPI_VI_GetDevAttr(VI_DEV, VI_DEV_ATTR_S *) { return -1; }
+RK_S32 RK_MPI_VI_SetDevAttr(VI_DEV, const VI_DEV_ATTR_S *) { return -1; }
+RK_S32 RK_MPI_VI_GetDevIsEnable(VI_DEV) { return -1; }
+RK_S32 RK_MPI_VI_EnableDev(VI_DEV) { return -1; }
+RK_S32 RK_MPI_VI_SetDevBindPipe(VI_DEV, const VI_DEV_BIND_PIPE_S *) {
+  return -1;
+}
+RK_S32 RK_MPI_VI_SetChnAttr(VI_PIPE, VI_CHN, const VI_CHN_ATTR_S *) {
+  return -1;
+}
+RK_S32 RK_MPI_VI_EnableChn(VI_PIPE, VI_CHN) { return -1; }
+
+static object_detect_result_list results;
+
+static void add(int left, int top, int right, int bottom, float prop) {
+  object_detect_result *det = &results.results[results.count++];
+  det->box.left = left;
+  det->box.top = top;
+  det->box.right = right;
+  det->box.bottom = bottom;
+  det->prop = prop;
+  det->cls_id = 0;
+}
+
+static int enabled(const venc_roi_t *roi) {
+  int n = 0;
+  for (int i = 0; i < roi->n_regions; i++) {
+    n += roi->regions[i].enabled;
+  }
+  return n;
+}
+
+static void clear_dirty(venc_roi_t *roi) {
+  for (int i = 0; i < VENC_ROI_MAX; i++) {
+    roi->dirty[i] = false;
+  }
+}
+
+// A region is the box with its margin, on the macroblock grid
+static void test_region_fit() {
+  venc_roi_t roi;
+  venc_roi_init(&roi, 640, 480, -6, 2);
+  results.count = 0;
+  add(100, 100, 200, 300, 0.9f);
+  CHECK(venc_roi_update(&roi, &results) == 1);
+  CHECK(enabled(&roi) == 1 && roi.dirty[0]);
+  image_rect_t rect = roi.regions[0].rect;
+  CHECK(rect.left % VENC_ROI_ALIGN == 0 && rect.top % VENC_ROI_ALIGN == 0);
+  CHECK(rect.right % VENC_ROI_ALIGN == 0 && rect.bottom % VENC_ROI_ALIGN == 0);
+  CHECK(rect.left <= 90 && rect.top <= 80);
+  CHECK(rect.right >= 210 && rect.bottom >= 320);
+
+  // clipped to the frame at its edge
+  venc_roi_t edge;
+  venc_roi_init(&edge, 640, 480, -6, 1);
+  results.count = 0;
+  add(600, 440, 640, 480, 0.9f);
+  CHECK(venc_roi_update(&edge, &results) == 1);
+  CHECK(edge.regions[0].rect.right == 640);
+  CHECK(edge.regions[0].rect.bottom == 480);
+}
+
+// Jitter and short dropouts leave the region alone, a real move does not
+static void test_sticky() {
+  venc_roi_t roi;
+  venc_roi_init(&roi, 640, 480, -6, 2);
+  results.count = 0;
+  add(100, 100, 200, 300, 0.9f);
+  CHECK(venc_roi_update(&roi, &results) == 1);
+  clear_dirty(&roi);
+
+  for (int k = 0; k < 5; k++) {
+    results.count = 0;
+    add(100 + k, 102 - k, 201 + k, 299, 0.9f);
+    CHECK(venc_roi_update(&roi, &results) == 0);
+  }
+
+  results.count = 0;
+  add(150, 100, 250, 300, 0.9f);
+  CHECK(venc_roi_update(&roi, &results) == 1);
+  CHECK(roi.regions[0].rect.right >= 260);
+  clear_dirty(&roi);
+
+  results.count = 0;
+  for (int k = 0; k < VENC_ROI_HOLD_FRAMES; k++) {
+    CHECK(venc_roi_update(&roi, &results) == 0);
+  }
+  add(150, 100, 250, 300, 0.9f);
+  CHECK(venc_roi_update(&roi, &results) == 0);
+  CHECK(enabled(&roi) == 1);
+
+  // gone for longer than the hold
+  results.count = 0;
+  int changed = 0;
+  for (int k = 0; k <= VENC_ROI_HOLD_FRAMES; k++) {
+    changed += venc_roi_update(&roi, &results);
+  }
+  CHECK(changed == 1 && enabled(&roi) == 0);
+}
+
+// More objects than regions: the most confident get them, and an object
+// inside another one's region needs none of its own
+static void test_more_objects_than_regions() {
+  venc_roi_t roi;
+  venc_roi_init(&roi, 640, 480, -6, 2);
+  results.count = 0;
+  add(100, 100, 200, 300, 0.9f);
+  add(400, 50, 450, 100, 0.4f);
+  add(500, 300, 600, 400, 0.8f);
+  CHECK(venc_roi_update(&roi, &results) == 2);
+  CHECK(enabled(&roi) == 2);
+  for (int i = 0; i < 2; i++) {
+    CHECK(roi.regions[i].rect.left > 450 || roi.regions[i].rect.right < 400);
+  }
+
+  venc_roi_t nested;
+  venc_roi_init(&nested, 640, 480, -6, 4);
+  results.count = 0;
+  add(100, 100, 300, 400, 0.9f);
+  add(150, 150, 180, 180, 0.7f);
+  venc_roi_update(&nested, &results);
+  CHECK(enabled(&nested) == 1);
+}
+
+// The dirty regions go to the encoder once; a channel refusing them turns
+// encoder ROI off instead of being retried every frame
+static void test_apply() {
+  venc_roi_t roi;
+  venc_roi_init(&roi, 640, 480, -6, 2);
+  results.count = 0;
+  add(100, 100, 200, 300, 0.9f);
+  venc_roi_update(&roi, &results);
+
+  set_roi_calls = 0;
+  CHECK(venc_apply_roi(0, &roi) == 0);
+  CHECK(set_roi_calls == 1);
+  CHECK(last_roi.u32Index == 0 && last_roi.bEnable == RK_TRUE);
+  CHECK(last_roi.bAbsQp == RK_FALSE && last_roi.s32Qp == -6);
+  CHECK((int)last_roi.stRect.u32Width ==
+        roi.regions[0].rect.right - roi.regions[0].rect.left);
+  CHECK(venc_apply_roi(0, &roi) == 0);
+  CHECK(set_roi_calls == 1);
+
+  set_roi_ret = -1;
+  results.count = 0;
+  add(100, 100, 200, 300, 0.9f);
+  add(500, 300, 600, 400, 0.8f);
+  CHECK(venc_roi_update(&roi, &results) == 1);
+  CHECK(venc_apply_roi(0, &roi) == -1);
+  CHECK(set_roi_calls == 2);
+  CHECK(roi.qp == 0);
+  for (int i = 0; i < VENC_ROI_MAX; i++) {
+    CHECK(!roi.dirty[i]);
+  }
+  // the frame loop only updates and applies while qp is set
+  for (int f = 0; f < 10; f++) {
+    if (roi.qp != 0 && venc_roi_update(&roi, &results) > 0) {
+      venc_apply_roi(0, &roi);
+    }
+  }
+  CHECK(set_roi_calls == 2);
+  set_roi_ret = RK_SUCCESS;
+}
+
+int main() {
+  test_region_fit();
+  test_sticky();
+  test_more_objects_than_regions();
+  test_apply();
+
+  printf("OK\n");
+  return 0;
+}